@@ -21,9 +21,9 @@
 #include "ejudge/dyntrie.h"
 #include "ejudge/prepare.h"
 #include "ejudge/fileutl.h"
-#include "ejudge/base64.h"
-#include "ejudge/ej_lzma.h"
 #include "ejudge/random.h"
+#include "ejudge/agent_proto.h"
+#include "ejudge/sha256utils.h"
 
 #include <stdlib.h>
 #include "ejudge/cJSON.h"
@@ -46,7 +46,6 @@
 #include <sys/inotify.h>
 #include <ctype.h>
 #include <sys/mman.h>
-#include <zlib.h>
 #include <dirent.h>
 
 static const unsigned char *program_name;
@@ -124,6 +123,16 @@ struct QueryCallback
         cJSON *reply);
 };
 
+struct DigestCacheEntry
+{
+    unsigned char *path;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    char digest[64];
+};
+
 struct ContestInfo
 {
     unsigned char *server;
@@ -192,6 +201,19 @@ struct AppState
     unsigned char *heartbeat_in_dir;
 
     int verbose_mode;
+
+    // binary framing, see agent_proto.h
+    int binary_mode;
+    int switch_to_binary;
+    struct AgentBlob reply_blob;
+    const unsigned char *query_blob;
+    size_t query_blob_size;
+
+    // digests of the mirrored files
+    struct DigestCacheEntry *digests;
+    int digesta;
+    int digestu;
+    struct dyntrie_node *digesti;
 };
 
 static void
@@ -218,6 +240,12 @@ app_state_destroy(struct AppState *as)
     }
     free(as->querys);
     dyntrie_free(&as->queryi, NULL, NULL);
+    for (int i = 0; i < as->digestu; ++i) {
+        free(as->digests[i].path);
+    }
+    free(as->digests);
+    dyntrie_free(&as->digesti, NULL, NULL);
+    agent_blob_free(&as->reply_blob);
 }
 
 static struct FDInfo *
@@ -593,6 +621,63 @@ separator_2nl_ready_func(struct AppState *as, struct FDInfo *fdi)
     return 1;
 }
 
+static int
+frame_ready_func(struct AppState *as, struct FDInfo *fdi)
+{
+    int s = 0;
+    while (1) {
+        long long size = agent_proto_frame_size(fdi->rd_data + s, fdi->rd_size - s);
+        if (size < 0) {
+            err("%s: invalid frame on stdin", as->inst_id);
+            as->term_flag = 1;
+            fdi->rd_size = 0;
+            return 0;
+        }
+        if (!size) break;
+        fdinfo_add_rchunk(fdi, &fdi->rd_data[s + AGENT_FRAME_HEADER_SIZE],
+                          size - AGENT_FRAME_HEADER_SIZE);
+        s += size;
+    }
+    if (!s) return 0;
+    fdi->rd_size -= s;
+    memmove(fdi->rd_data, fdi->rd_data + s, fdi->rd_size);
+    return 1;
+}
+
+static int
+stdin_ready_func(struct AppState *as, struct FDInfo *fdi)
+{
+    if (as->binary_mode) {
+        return frame_ready_func(as, fdi);
+    }
+    return separator_2nl_ready_func(as, fdi);
+}
+
+/* send the reply and the attachment, collected in as->reply_blob */
+static void
+send_reply(struct AppState *as, cJSON *reply)
+{
+    char *jstr = cJSON_PrintUnformatted(reply);
+    size_t jlen = strlen(jstr);
+    if (as->verbose_mode) {
+        info("%s: json: %s", as->inst_id, jstr);
+    }
+    if (as->binary_mode) {
+        size_t size = 0;
+        unsigned char *frame = agent_proto_make_frame(jstr, jlen, &as->reply_blob, &size);
+        free(jstr);
+        fdinfo_add_write_data_2(as->stdout_fdi, frame, size);
+        as->reply_blob.size = 0;
+    } else {
+        jstr = realloc(jstr, jlen + 3);
+        jstr[jlen++] = '\n';
+        jstr[jlen++] = '\n';
+        jstr[jlen] = 0;
+        fdinfo_add_write_data_2(as->stdout_fdi, jstr, jlen);
+    }
+    app_state_arm_for_write(as, as->stdout_fdi);
+}
+
 static void
 handle_stdin_rchunk(
         struct AppState *as,
@@ -600,8 +685,6 @@ handle_stdin_rchunk(
         const unsigned char *data,
         int size)
 {
-    char *jstr = NULL;
-    int jlen;
     cJSON *root = NULL;
     cJSON *reply = cJSON_CreateObject();
     int ok = 0;
@@ -613,7 +696,8 @@ handle_stdin_rchunk(
     cJSON_AddNumberToObject(reply, "tt", (double) as->current_time_ms);
     cJSON_AddNumberToObject(reply, "ss", (double) ++as->serial);
 
-    if (strlen(data) != size) {
+    if (agent_proto_get_blob(data, size, &as->query_blob, &as->query_blob_size)
+        && !as->binary_mode) {
         cJSON_AddStringToObject(reply, "message", "binary data");
         err("%s: binary data on stdin", as->inst_id);
         goto done;
@@ -654,22 +738,17 @@ handle_stdin_rchunk(
 
 done:
     cJSON_AddBoolToObject(reply, "ok", ok);
-    jstr = cJSON_PrintUnformatted(reply);
-    jlen = strlen(jstr);
-    if (as->verbose_mode) {
-        info("%s: json: %s", as->inst_id, jstr);
+    send_reply(as, reply);
+    as->query_blob = NULL;
+    as->query_blob_size = 0;
+    if (as->switch_to_binary) {
+        // the reply to the ping is still in the text mode
+        as->switch_to_binary = 0;
+        as->binary_mode = 1;
     }
-    jstr = realloc(jstr, jlen + 3);
-    jstr[jlen++] = '\n';
-    jstr[jlen++] = '\n';
-    jstr[jlen] = 0;
-    fdinfo_add_write_data_2(as->stdout_fdi, jstr, jlen);
-    jstr = NULL;
-    app_state_arm_for_write(as, as->stdout_fdi);
 
     if (root) cJSON_Delete(root);
     if (reply) cJSON_Delete(reply);
-    free(jstr);
 }
 
 static void
@@ -681,7 +760,7 @@ handle_stdin_read_func(struct AppState *as, struct FDInfo *fdi)
     }
 
     for (int i = 0; i < fdi->rchunku; ++i) {
-        {
+        if (!as->binary_mode) {
             unsigned char *data = fdi->rchunks[i].data;
             int size = fdi->rchunks[i].size;
             while (size > 0 && isspace(data[size - 1])) {
@@ -701,7 +780,7 @@ handle_stdin_read_func(struct AppState *as, struct FDInfo *fdi)
 static const struct FDInfoOps stdin_ops =
 {
     .op_read = pipe_read_func,
-    .is_in_ready = separator_2nl_ready_func,
+    .is_in_ready = stdin_ready_func,
     .handle_read = handle_stdin_read_func,
 };
 
@@ -917,9 +996,12 @@ safe_read_packet(
         size_t *p_size);
 static void
 add_file_to_object(
+        struct AppState *as,
         cJSON *j,
         const char *data,
         size_t size);
+static void
+send_reply(struct AppState *as, cJSON *reply);
 
 static void
 check_spool_state(struct AppState *as)
@@ -949,25 +1031,14 @@ check_spool_state(struct AppState *as)
     if (data != NULL) {
         cJSON_AddStringToObject(reply, "q", "file-result");
         cJSON_AddTrueToObject(reply, "found");
-        add_file_to_object(reply, data, size);
+        add_file_to_object(as, reply, data, size);
         free(data); data = NULL;
     } else {
         cJSON_AddStringToObject(reply, "q", "poll-result");
     }
     cJSON_AddStringToObject(reply, "pkt-name", pkt_name);
     cJSON_AddTrueToObject(reply, "ok");
-    char *jstr = cJSON_PrintUnformatted(reply);
-    size_t jlen = strlen(jstr);
-    if (as->verbose_mode) {
-        info("%s: json: %s", as->inst_id, jstr);
-    }
-    jstr = realloc(jstr, jlen + 3);
-    jstr[jlen++] = '\n';
-    jstr[jlen++] = '\n';
-    jstr[jlen] = 0;
-    fdinfo_add_write_data_2(as->stdout_fdi, jstr, jlen);
-    jstr = NULL;
-    app_state_arm_for_write(as, as->stdout_fdi);
+    send_reply(as, reply);
 
     info("%s: wake-up on directory: %d, %d, %s", as->inst_id, as->serial, as->wait_serial, pkt_name);
 
@@ -1051,6 +1122,12 @@ ping_query_func(
         cJSON *reply)
 {
     cJSON_AddStringToObject(reply, "q", "pong");
+    cJSON *jf = cJSON_GetObjectItem(query, "framing");
+    if (jf && jf->type == cJSON_String && !strcmp(jf->valuestring, "binary")
+        && !as->binary_mode) {
+        cJSON_AddStringToObject(reply, "framing", "binary");
+        as->switch_to_binary = 1;
+    }
     return 1;
 }
 
@@ -1090,83 +1167,13 @@ set_query_func(
 }
 
 static void
-add_file_to_object(cJSON *j, const char *data, size_t size)
+add_file_to_object(
+        struct AppState *as,
+        cJSON *j,
+        const char *data,
+        size_t size)
 {
-    cJSON_AddNumberToObject(j, "size", (double) size);
-    if (!size) {
-        return;
-    }
-    // gzip mode
-    if (size < 32) {
-        cJSON_AddTrueToObject(j, "b64");
-        char *ptr = malloc(size * 2 + 16);
-        int n = base64u_encode(data, size, ptr);
-        ptr[n] = 0;
-        cJSON_AddStringToObject(j, "data", ptr);
-        free(ptr);
-    } else {
-        z_stream zs = {};
-        zs.next_in = (Bytef *) data;
-        zs.avail_in = size;
-        zs.total_in = size;
-
-        if (deflateInit(&zs, 9) != Z_OK) {
-            abort();
-        }
-        size_t bound = deflateBound(&zs, size);
-        char *gz_buf = malloc(bound);
-        zs.next_out = (Bytef*) gz_buf;
-        zs.avail_out = bound;
-        zs.total_out = 0;
-        int r = deflate(&zs, Z_FINISH);
-        if (r != Z_STREAM_END) {
-            abort();
-        }
-        size_t gz_size = zs.total_out;
-        if (deflateEnd(&zs) != Z_OK) {
-            abort();
-        }
-        cJSON_AddTrueToObject(j, "gz");
-        cJSON_AddNumberToObject(j, "gz_size", gz_size);
-        char *b64_buf = malloc(gz_size * 2 + 16);
-        int b64_size = base64u_encode(gz_buf, gz_size, b64_buf);
-        b64_buf[b64_size] = 0;
-        cJSON_AddTrueToObject(j, "b64");
-        cJSON_AddStringToObject(j, "data", b64_buf);
-        free(b64_buf);
-        free(gz_buf);
-    }
-    // lzma mode (unused)
-    if (size < 160) {
-        cJSON_AddTrueToObject(j, "b64");
-        char *ptr = malloc(size * 2 + 16);
-        int n = base64u_encode(data, size, ptr);
-        ptr[n] = 0;
-        cJSON_AddStringToObject(j, "data", ptr);
-        free(ptr);
-    } else {
-        unsigned char *lzma_buf = NULL;
-        size_t lzma_size = 0;
-        if (ej_lzma_encode_buf(data, size, &lzma_buf, &lzma_size) < 0) {
-            // fallback to uncompressed
-            cJSON_AddTrueToObject(j, "b64");
-            char *ptr = malloc(size * 2 + 16);
-            int n = base64u_encode(data, size, ptr);
-            ptr[n] = 0;
-            cJSON_AddStringToObject(j, "data", ptr);
-            free(ptr);
-        } else {
-            cJSON_AddTrueToObject(j, "lzma");
-            cJSON_AddNumberToObject(j, "lzma_size", (double) lzma_size);
-            char *b64_buf = malloc(lzma_size * 2 + 16);
-            int b64_size = base64u_encode(lzma_buf, lzma_size, b64_buf);
-            b64_buf[b64_size] = 0;
-            cJSON_AddTrueToObject(j, "b64");
-            cJSON_AddStringToObject(j, "data", b64_buf);
-            free(b64_buf);
-            free(lzma_buf);
-        }
-    }
+    agent_proto_add_file(j, data, size, as->binary_mode?&as->reply_blob:NULL);
 }
 
 static int
@@ -1303,7 +1310,7 @@ poll_func(
             cJSON_AddStringToObject(reply, "pkt-name", pkt_name);
             cJSON_AddStringToObject(reply, "q", "file-result");
             cJSON_AddTrueToObject(reply, "found");
-            add_file_to_object(reply, data, size);
+            add_file_to_object(as, reply, data, size);
             free(data);
             return 1;
         }
@@ -1339,7 +1346,7 @@ get_packet_func(
     }
     cJSON_AddStringToObject(reply, "q", "file-result");
     cJSON_AddTrueToObject(reply, "found");
-    add_file_to_object(reply, pkt_ptr, pkt_len);
+    add_file_to_object(as, reply, pkt_ptr, pkt_len);
     free(pkt_ptr);
     return 1;
 }
@@ -1378,7 +1385,7 @@ get_data_func(
     }
     cJSON_AddStringToObject(reply, "q", "file-result");
     cJSON_AddTrueToObject(reply, "found");
-    add_file_to_object(reply, pkt_ptr, pkt_len);
+    add_file_to_object(as, reply, pkt_ptr, pkt_len);
     free(pkt_ptr);
     return 1;
 }
@@ -1390,120 +1397,11 @@ extract_file(
         char **p_pkt_ptr,
         size_t *p_pkt_len)
 {
-    cJSON *jz = cJSON_GetObjectItem(j, "size");
-    if (!jz || jz->type != cJSON_Number) {
-        err("%s: invalid json: no size", as->inst_id);
-        return -1;
-    }
-    size_t size = (int) jz->valuedouble;
-    if (size < 0 || size > 1000000000) {
-        err("%s: invalid json: invalid size", as->inst_id);
-        return -1;
-    }
-    if (!size) {
-        char *ptr = malloc(1);
-        *ptr = 0;
-        *p_pkt_ptr = ptr;
-        *p_pkt_len = 0;
-        return 1;
-    }
-    cJSON *jb64 = cJSON_GetObjectItem(j, "b64");
-    if (!jb64 || jb64->type != cJSON_True) {
-        err("%s: invalid json: no encoding", as->inst_id);
-        return -1;
-    }
-    cJSON *jd = cJSON_GetObjectItem(j, "data");
-    if (!jd || jd->type != cJSON_String) {
-        err("%s: invalid json: no data", as->inst_id);
+    if (agent_proto_extract_file(j, as->query_blob, as->query_blob_size,
+                                 p_pkt_ptr, p_pkt_len) < 0) {
+        err("%s: failed to extract file", as->inst_id);
         return -1;
     }
-    int len = strlen(jd->valuestring);
-    cJSON *jgz = cJSON_GetObjectItem(j, "gz");
-    cJSON *jlzma = cJSON_GetObjectItem(j, "lzma");
-    if (jgz && jgz->type == cJSON_True) {
-        cJSON *jgzz = cJSON_GetObjectItem(j, "gz_size");
-        if (!jgzz || jgzz->type != cJSON_Number) {
-            err("invalid json: no gz_size");
-            return -1;
-        }
-        size_t gz_size = (size_t) jgzz->valuedouble;
-        char *gz_buf = malloc(len + 1);
-        int b64err = 0;
-        int n = base64u_decode(jd->valuestring, len, gz_buf, &b64err);
-        if (n != gz_size) {
-            err("invalid json: size mismatch");
-            free(gz_buf);
-            return -1;
-        }
-
-        z_stream zs = {};
-        if (inflateInit(&zs) != Z_OK) {
-            err("invalid json: libz failed");
-            free(gz_buf);
-            return -1;
-        }
-        zs.next_in = (Bytef *) gz_buf;
-        zs.avail_in = gz_size;
-        zs.total_in = gz_size;
-        unsigned char *ptr = malloc(size + 1);
-        zs.next_out = (Bytef *) ptr;
-        zs.avail_out = size;
-        zs.total_out = 0;
-        if (inflate(&zs, Z_FINISH) != Z_STREAM_END) {
-            err("invalid json: libz inflate failed");
-            free(gz_buf);
-            free(ptr);
-            inflateEnd(&zs);
-            return -1;
-        }
-        if (inflateEnd(&zs) != Z_OK) {
-            err("invalid json: libz inflate failed");
-            free(gz_buf);
-            free(ptr);
-            return -1;
-        }
-        ptr[size] = 0;
-        free(gz_buf);
-        *p_pkt_ptr = ptr;
-        *p_pkt_len = size;
-    } else if (jlzma && jlzma->type == cJSON_True) {
-        cJSON *jlzmaz = cJSON_GetObjectItem(j, "lzma_size");
-        if (!jlzmaz || jlzmaz->type != cJSON_Number) {
-            err("%s: invalid json: no lzma_size", as->inst_id);
-            return -1;
-        }
-        size_t lzma_size = (size_t) jlzmaz->valuedouble;
-        char *lzma_buf = malloc(len + 1);
-        int b64err = 0;
-        int n = base64u_decode(jd->valuestring, len, lzma_buf, &b64err);
-        if (n != lzma_size) {
-            err("%s: invalid json: size mismatch", as->inst_id);
-            free(lzma_buf);
-            return -1;
-        }
-        unsigned char *ptr = NULL;
-        size_t ptr_size = 0;
-        if (ej_lzma_decode_buf(lzma_buf, lzma_size, size, &ptr, &ptr_size) < 0) {
-            err("%s: invalid json: lzma decode error", as->inst_id);
-            free(lzma_buf);
-            return -1;
-        }
-        free(lzma_buf);
-        *p_pkt_ptr = ptr;
-        *p_pkt_len = ptr_size;
-    } else {
-        char *ptr = malloc(len + 1);
-        int b64err = 0;
-        int n = base64u_decode(jd->valuestring, len, ptr, &b64err);
-        if (n != size) {
-            err("%s: invalid json: size mismatch", as->inst_id);
-            free(ptr);
-            return -1;
-        }
-        ptr[size] = 0;
-        *p_pkt_ptr = ptr;
-        *p_pkt_len = size;
-    }
     return 1;
 }
 
@@ -1755,7 +1653,7 @@ wait_func(
             cJSON_AddStringToObject(reply, "q", "file-result");
             cJSON_AddStringToObject(reply, "pkt-name", pkt_name);
             cJSON_AddTrueToObject(reply, "found");
-            add_file_to_object(reply, data, size);
+            add_file_to_object(as, reply, data, size);
             free(data);
             return 1;
         }
@@ -2026,6 +1924,55 @@ done:
     return result;
 }
 
+/* the sha256 digest of the file, cached while the file is not changed */
+static const char *
+get_file_digest(
+        struct AppState *as,
+        const unsigned char *path,
+        int fd,
+        const struct stat *stb)
+{
+    struct DigestCacheEntry *e = NULL;
+    void *vp = dyntrie_get(&as->digesti, path);
+    if (vp) {
+        e = &as->digests[((int)(intptr_t) vp) - 1];
+        if (e->dev == stb->st_dev && e->ino == stb->st_ino
+            && e->size == stb->st_size
+            && e->mtime.tv_sec == stb->st_mtim.tv_sec
+            && e->mtime.tv_nsec == stb->st_mtim.tv_nsec) {
+            return e->digest;
+        }
+    } else {
+        if (as->digestu == as->digesta) {
+            if (!(as->digesta *= 2)) as->digesta = 64;
+            XREALLOC(as->digests, as->digesta);
+        }
+        e = &as->digests[as->digestu++];
+        memset(e, 0, sizeof(*e));
+        e->path = xstrdup(path);
+        dyntrie_insert(&as->digesti, path, (void*) (intptr_t) as->digestu, 1, NULL);
+    }
+
+    e->digest[0] = 0;
+    if (stb->st_size > 0) {
+        unsigned char *ptr = mmap(NULL, stb->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED) {
+            err("%s: mirror: mmap '%s' failed: %s ", as->inst_id, path,
+                strerror(errno));
+            return NULL;
+        }
+        sha256b64ubuf(e->digest, sizeof(e->digest), ptr, stb->st_size);
+        munmap(ptr, stb->st_size);
+    } else {
+        sha256b64ubuf(e->digest, sizeof(e->digest), (const unsigned char *) "", 0);
+    }
+    e->dev = stb->st_dev;
+    e->ino = stb->st_ino;
+    e->size = stb->st_size;
+    e->mtime = stb->st_mtim;
+    return e->digest;
+}
+
 static int
 mirror_func(
         struct AppState *as,
@@ -2040,7 +1987,13 @@ mirror_func(
     unsigned char perm_buf[64];
 
     /*
-      query: { "path" : PATH, "size" : SIZE, "mtime" : MTIME, "mode" : MODE }
+      query: { "path" : PATH, "size" : SIZE, "mtime" : MTIME, "mode" : MODE,
+               "digest" : BOOL, "sha256" : DIGEST }
+
+      "digest" means that the client can compare the content by the digest,
+      then a file of the same size with different attributes is replied
+      with "file-digest", and the client repeats the query with "sha256"
+      of its copy, if it has different content
      */
 
     cJSON *jpath = cJSON_GetObjectItem(query, "path");
@@ -2125,8 +2078,30 @@ mirror_func(
     cJSON_AddNumberToObject(reply, "mtime", stb.st_mtime);
     cJSON_AddNumberToObject(reply, "uid", stb.st_uid);
     cJSON_AddNumberToObject(reply, "gid", stb.st_gid);
+
+    cJSON *jsha = cJSON_GetObjectItem(query, "sha256");
+    if (jsha && jsha->type != cJSON_String) jsha = NULL;
+    cJSON *jdigest = cJSON_GetObjectItem(query, "digest");
+    if (jdigest && jdigest->type != cJSON_True) jdigest = NULL;
+    if (jsha || (jdigest && size == stb.st_size)) {
+        const char *digest = get_file_digest(as, path, fd, &stb);
+        if (digest && jsha && !strcmp(digest, jsha->valuestring)) {
+            // the client has the same content, only the attributes differ
+            cJSON_AddStringToObject(reply, "q", "file-unchanged");
+            cJSON_AddTrueToObject(reply, "found");
+            result = 1;
+            goto done;
+        }
+        if (digest && !jsha) {
+            cJSON_AddStringToObject(reply, "q", "file-digest");
+            cJSON_AddStringToObject(reply, "sha256", digest);
+            cJSON_AddTrueToObject(reply, "found");
+            result = 1;
+            goto done;
+        }
+    }
     if (stb.st_size <= 0) {
-        add_file_to_object(reply, NULL, 0);
+        add_file_to_object(as, reply, NULL, 0);
         cJSON_AddStringToObject(reply, "q", "file-result");
         cJSON_AddTrueToObject(reply, "found");
         result = 1;
@@ -2143,7 +2118,7 @@ mirror_func(
     close(fd); fd = -1;
     cJSON_AddStringToObject(reply, "q", "file-result");
     cJSON_AddTrueToObject(reply, "found");
-    add_file_to_object(reply, pkt_ptr, pkt_size);
+    add_file_to_object(as, reply, pkt_ptr, pkt_size);
     result = 1;
 
 done:;
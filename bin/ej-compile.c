@@ -50,6 +50,9 @@
 #include "ejudge/logger.h"
 #include "ejudge/osdeps.h"
 #include "ejudge/exec.h"
+#include "ejudge/spool_queue.h"
+#include "ejudge/compile_cache.h"
+#include "ejudge/sha256.h"
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wmisleading-indentation"
@@ -70,7 +73,6 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <dirent.h>
-#include <sys/inotify.h>
 #include <sys/epoll.h>
 #include <sys/mman.h>
 
@@ -110,6 +112,10 @@ static unsigned char pending_reboot_flag; // bool
 static unsigned char *heartbeat_instance_id;
 static unsigned char *local_cache = NULL;
 static int compile_user_serial = 0;
+static unsigned char *compile_cache_dir = NULL;
+static long long compile_cache_size = 1024LL * 1024 * 1024;
+static struct compile_cache *compile_cache = NULL;
+static int compile_timed_out = 0; // the last compilation timed out
 
 struct testinfo_subst_handler_compile
 {
@@ -587,6 +593,7 @@ invoke_compiler(
 
   if (task_IsTimeout(tsk)) {
     err("Compilation process timed out");
+    compile_timed_out = 1;
     task_Delete(tsk);
     if (req->not_ok_is_cf > 0) {
       fprintf(log_f, "\nCompilation process timed out\n");
@@ -713,6 +720,12 @@ save_heartbeat(void)
     ej_compile_Heartbeat_ip_address_create_str(&builder, ip_address);
   }
   ej_compile_Heartbeat_pid_add(&builder, getpid());
+  if (compile_cache) {
+    long long cache_hits = 0, cache_misses = 0;
+    compile_cache_get_stats(compile_cache, &cache_hits, &cache_misses);
+    ej_compile_Heartbeat_cache_hits_add(&builder, cache_hits);
+    ej_compile_Heartbeat_cache_misses_add(&builder, cache_misses);
+  }
   ej_compile_Heartbeat_end_as_root(&builder);
 
   buffer = flatcc_builder_get_direct_buffer(&builder, &size);
@@ -749,6 +762,111 @@ delete_heartbeat(void)
   }
 }
 
+static void
+digest_add_int(SHA256_CTX *ctx, long long value)
+{
+  unsigned char buf[64];
+  int len = snprintf(buf, sizeof(buf), "%lld;", value);
+  sha256_update(ctx, buf, len);
+}
+
+static void
+digest_add_str(SHA256_CTX *ctx, const unsigned char *str)
+{
+  if (!str) {
+    digest_add_int(ctx, -1);
+    return;
+  }
+  size_t len = strlen(str);
+  digest_add_int(ctx, len);
+  sha256_update(ctx, str, len);
+}
+
+/*
+ * the compile cache key covers everything the result of compilation
+ * depends on: the language and its compilation script (whose
+ * modification time stands for the compiler version), the options
+ * of the request, the style checker settings, and the source text
+ */
+static void
+make_compile_cache_key(
+        unsigned char *key,
+        const struct section_language_data *lang,
+        const struct compile_request_packet *req,
+        const unsigned char *src_buf,
+        size_t src_len)
+{
+  const struct section_global_data *global = serve_state.global;
+  SHA256_CTX ctx;
+  unsigned char digest[32];
+  struct stat stb;
+
+  sha256_init(&ctx);
+  digest_add_str(&ctx, "ejudge compile cache 1");
+  digest_add_int(&ctx, lang->id);
+  digest_add_str(&ctx, lang->short_name);
+  digest_add_str(&ctx, lang->long_name);
+  digest_add_str(&ctx, lang->arch);
+  digest_add_str(&ctx, lang->src_sfx);
+  digest_add_str(&ctx, lang->exe_sfx);
+  digest_add_str(&ctx, lang->cmd);
+  if (lang->cmd && stat(lang->cmd, &stb) >= 0) {
+    digest_add_int(&ctx, stb.st_size);
+    digest_add_int(&ctx, stb.st_mtime);
+  }
+  digest_add_int(&ctx, lang->enable_custom);
+  digest_add_int(&ctx, lang->compile_real_time_limit);
+  digest_add_int(&ctx, lang->max_vm_size);
+  digest_add_int(&ctx, lang->max_stack_size);
+  digest_add_int(&ctx, lang->max_file_size);
+  digest_add_int(&ctx, lang->max_rss_size);
+  digest_add_int(&ctx, global->compile_max_vm_size);
+  digest_add_int(&ctx, global->compile_max_stack_size);
+  digest_add_int(&ctx, global->compile_max_file_size);
+  digest_add_int(&ctx, global->compile_max_rss_size);
+  digest_add_int(&ctx, ejudge_config->enable_compile_container);
+
+  digest_add_int(&ctx, req->style_check_only);
+  digest_add_int(&ctx, req->use_container);
+  digest_add_int(&ctx, req->vcs_mode);
+  digest_add_int(&ctx, req->not_ok_is_cf);
+  digest_add_int(&ctx, req->preserve_numbers);
+  digest_add_int(&ctx, req->max_vm_size);
+  digest_add_int(&ctx, req->max_stack_size);
+  digest_add_int(&ctx, req->max_file_size);
+  digest_add_int(&ctx, req->max_rss_size);
+  digest_add_str(&ctx, req->src_sfx);
+  digest_add_str(&ctx, req->container_options);
+  digest_add_str(&ctx, req->vcs_compile_cmd);
+  digest_add_str(&ctx, req->compile_cmd);
+  if (req->compile_cmd && stat(req->compile_cmd, &stb) >= 0) {
+    digest_add_int(&ctx, stb.st_size);
+    digest_add_int(&ctx, stb.st_mtime);
+  }
+  digest_add_int(&ctx, req->env_num);
+  for (int i = 0; i < req->env_num; ++i) {
+    digest_add_str(&ctx, req->env_vars[i]);
+  }
+
+  digest_add_str(&ctx, req->style_checker);
+  if (req->style_checker && stat(req->style_checker, &stb) >= 0) {
+    digest_add_int(&ctx, stb.st_size);
+    digest_add_int(&ctx, stb.st_mtime);
+  }
+  digest_add_int(&ctx, req->sc_env_num);
+  for (int i = 0; i < req->sc_env_num; ++i) {
+    digest_add_str(&ctx, req->sc_env_vars[i]);
+  }
+
+  digest_add_int(&ctx, src_len);
+  sha256_update(&ctx, src_buf, src_len);
+  sha256_final(&ctx, digest);
+
+  for (int i = 0; i < 32; ++i) {
+    sprintf(key + i * 2, "%02x", digest[i]);
+  }
+}
+
 static void
 handle_packet(
         FILE *log_f,
@@ -895,6 +1013,31 @@ handle_packet(
     unsigned char exe_work_path[PATH_MAX];
     snprintf(exe_work_path, sizeof(exe_work_path), "%s/%s", working_dir, exe_work_name);
 
+    // the contents of extra_src_dir are not covered by the cache key
+    unsigned char cache_key[COMPILE_CACHE_KEY_SIZE];
+    cache_key[0] = 0;
+    if (compile_cache && (!req->extra_src_dir || !req->extra_src_dir[0])) {
+      char *key_src_s = NULL;
+      size_t key_src_z = 0;
+      if (src_buf) {
+        make_compile_cache_key(cache_key, lang, req, src_buf, src_len);
+      } else if (generic_read_file(&key_src_s, 0, &key_src_z, 0, NULL, src_work_path, "") >= 0) {
+        make_compile_cache_key(cache_key, lang, req, key_src_s, key_src_z);
+        xfree(key_src_s);
+      }
+    }
+    if (cache_key[0]) {
+      struct compile_cache_result ccr;
+      if (compile_cache_get(compile_cache, cache_key, &ccr, exe_work_path, log_f) > 0) {
+        info("compilation result is found in the cache: %s", cache_key);
+        rpl->status = ccr.status;
+        rpl->prepended_size = ccr.prepended_size;
+        if (ccr.override_exe > 0) *p_override_exe = 1;
+        goto cleanup;
+      }
+    }
+    compile_timed_out = 0;
+
     /*
     if (req->style_checker && req->style_checker[0]) {
       int r = invoke_style_checker(log_f, cs, lang, req, src_work_name, working_dir, log_work_path, NULL);
@@ -923,6 +1066,21 @@ handle_packet(
       if (r == RUN_OK && req->style_check_only > 0) *p_override_exe = 1;
     }
 
+    // check failures and timeouts may be transient, they are not cached
+    if (cache_key[0] && !compile_timed_out
+        && (rpl->status == RUN_OK || rpl->status == RUN_COMPILE_ERR
+            || rpl->status == RUN_STYLE_ERR)) {
+      struct compile_cache_result ccr =
+      {
+        .status = rpl->status,
+        .prepended_size = rpl->prepended_size,
+        .override_exe = *p_override_exe,
+        .has_exe = (rpl->status == RUN_OK && !*p_override_exe && access(exe_work_path, F_OK) >= 0),
+      };
+      fflush(log_f);
+      compile_cache_put(compile_cache, cache_key, &ccr, exe_work_path, log_work_path);
+    }
+
     goto cleanup;
   }
 
@@ -1480,7 +1638,7 @@ new_loop(int parallel_mode, const unsigned char *global_log_path)
   path_t full_working_dir = { 0 };
   struct Future *future = NULL;
   int ifd = -1;
-  int ifd_wd = -1;
+  struct spool_queue *sq = NULL;
   sigset_t emptymask;
   int efd = -1;
 
@@ -1515,12 +1673,6 @@ new_loop(int parallel_mode, const unsigned char *global_log_path)
       err("invalid agent");
       return -1;
     }
-  } else {
-    ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
-    if (ifd < 0) {
-      err("inotify_init1 failed: %s", os_ErrorMsg());
-      return -1;
-    }
   }
 
 #if defined EJUDGE_COMPILE_SPOOL_DIR
@@ -1539,12 +1691,11 @@ new_loop(int parallel_mode, const unsigned char *global_log_path)
   snprintf(compile_server_queue_dir_dir, sizeof(compile_server_queue_dir_dir),
            "%s/dir", compile_server_queue_dir);
 
-  if (ifd >= 0) {
-    ifd_wd = inotify_add_watch(ifd, compile_server_queue_dir_dir, IN_CREATE | IN_MOVED_TO);
-    if (ifd_wd < 0) {
-      err("inotify_add_watch failed: %s", os_ErrorMsg());
+  if (!agent) {
+    if (!(sq = spool_queue_open(compile_server_queue_dir))) {
       return -1;
     }
+    ifd = spool_queue_get_fd(sq);
 
     efd = epoll_create1(EPOLL_CLOEXEC);
     if (efd < 0) {
@@ -1627,7 +1778,7 @@ new_loop(int parallel_mode, const unsigned char *global_log_path)
         }
       }
     } else {
-      r = scan_dir(compile_server_queue_dir, pkt_name, sizeof(pkt_name), 0);
+      r = spool_queue_next(sq, pkt_name, sizeof(pkt_name), 0);
       if (r < 0) {
         switch (-r) {
         case ENOMEM:
@@ -1654,13 +1805,8 @@ new_loop(int parallel_mode, const unsigned char *global_log_path)
         struct epoll_event events[1];
         int r = epoll_pwait(efd, events, 1, HEARTBEAT_UPDATE_MS, &emptymask);
         if (r == 1) {
+          // the events are read by spool_queue_next
           if (events[0].data.fd != ifd) abort();
-          // just read all the data in the ifd without any processing
-          unsigned char ibuf[4096];
-          while (1) {
-            int r = read(ifd, ibuf, sizeof(ibuf));
-            if (r <= 0) break;
-          }
         }
       }
       continue;
@@ -2006,6 +2152,7 @@ new_loop(int parallel_mode, const unsigned char *global_log_path)
   if (agent) {
     agent->ops->close(agent);
   }
+  spool_queue_free(sq);
 
   return retval;
 }
@@ -2325,6 +2472,19 @@ main(int argc, char *argv[])
       local_cache = xstrdup(argv[i++]);
       argv_restart[j++] = argv[i];
       argv_restart[j++] = argv[i - 1];
+    } else if (!strcmp(argv[i], "--compile-cache")) {
+      if (++i >= argc) goto print_usage;
+      xfree(compile_cache_dir);
+      compile_cache_dir = xstrdup(argv[i++]);
+      argv_restart[j++] = "--compile-cache";
+      argv_restart[j++] = argv[i - 1];
+    } else if (!strcmp(argv[i], "--compile-cache-size")) {
+      if (++i >= argc) goto print_usage;
+      long long size = 0;
+      if (size_str_to_size64_t(argv[i++], &size) < 0 || size < 0) goto print_usage;
+      compile_cache_size = size;
+      argv_restart[j++] = "--compile-cache-size";
+      argv_restart[j++] = argv[i - 1];
     } else if (!strcmp(argv[i], "-p")) {
       parallel_mode = 1;
       ++i;
@@ -2655,6 +2815,9 @@ main(int argc, char *argv[])
   if (local_cache && *local_cache) {
     if (make_dir(local_cache, 0770) < 0) return 1;
   }
+  if (compile_cache_dir && *compile_cache_dir) {
+    if (!(compile_cache = compile_cache_open(compile_cache_dir, compile_cache_size))) return 1;
+  }
 
   if (initialize_mode) return 0;
 
@@ -2731,5 +2894,7 @@ main(int argc, char *argv[])
   printf("  -a A   - use agent A to access to compile queue\n");
   printf("  -s I   - set instance Id to I\n");
   printf("  -y S   - set instance serial number to S\n");
+  printf("  --compile-cache D - cache compilation results in directory D\n");
+  printf("  --compile-cache-size S - limit the compilation cache size to S\n");
   return code;
 }
@@ -51,6 +51,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <signal.h>
 #include <pwd.h>
 
@@ -85,6 +86,7 @@ static struct server_framework_params params =
   .ws_handle_packet = handle_ws_request,
   .ws_check_session = ns_ws_check_session,
   .ws_create_session = ns_ws_create_session,
+  .ws_cleanup = ns_ws_push_cleanup,
 };
 
 static struct server_framework_state *state = 0;
@@ -232,11 +234,32 @@ ns_new_autoclose_2(int client_id, void *write_buf, size_t write_len)
 extern const unsigned char * const ns_symbolic_action_table[NEW_SRV_ACTION_LAST];
 
 static void
-cmd_http_request(
+write_worker_reply(int fd, const unsigned char *buf, size_t size)
+{
+  if (fd < 0) return;
+
+  // the worker has nothing else to do, so write in the blocking mode
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+  while (size > 0) {
+    ssize_t w = write(fd, buf, size);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) {
+      err("write_worker_reply: write failed: %s", os_ErrorMsg());
+      break;
+    }
+    buf += w;
+    size -= w;
+  }
+  close(fd);
+}
+
+static void
+do_http_request(
         struct server_framework_state *state,
         struct client_state *p,
         size_t pkt_size,
-        const struct new_server_prot_packet *pkt_gen)
+        const struct new_server_prot_packet *pkt_gen,
+        const struct http_ul_async_results *ul_async)
 {
   enum
   {
@@ -266,6 +289,9 @@ cmd_http_request(
   hr.current_time = hr.timestamp1.tv_sec;
   hr.current_time_us = hr.timestamp1.tv_sec * 1000000LL + hr.timestamp1.tv_usec;
   hr.locale_id = -1;
+  hr.pkt = pkt_gen;
+  hr.pkt_size = pkt_size;
+  if (ul_async) hr.ul_async = *ul_async;
 
   if (pkt_size < sizeof(*pkt))
     return nsf_err_packet_too_small(state, p, pkt_size, sizeof(*pkt));
@@ -400,13 +426,23 @@ cmd_http_request(
   // no reply now
   if (hr.no_reply) goto cleanup;
 
+  if (hr.worker_mode == 1) {
+    // the worker process replies to the client
+    if (!hr.disable_log) {
+      info("%d:%s -> worker", p->id, info_buf);
+    }
+    nsf_close_client_fds(p);
+    nsf_send_reply(state, p, NEW_SRV_RPL_OK);
+    goto cleanup;
+  }
+
   if (hr.protocol_reply) {
     xfree(hr.out_t); hr.out_t = NULL;
     if (!hr.disable_log) {
       info("%d:%s -> %d", p->id, info_buf, hr.protocol_reply);
     }
     nsf_close_client_fds(p);
-    nsf_send_reply(state, p, hr.protocol_reply);
+    if (hr.worker_mode != 2) nsf_send_reply(state, p, hr.protocol_reply);
     goto cleanup;
   }
 
@@ -468,7 +504,7 @@ cmd_http_request(
         info("%d:%s -> OK", p->id, info_buf);
       }
       nsf_close_client_fds(p);
-      nsf_send_reply(state, p, NEW_SRV_RPL_OK);
+      if (hr.worker_mode != 2) nsf_send_reply(state, p, NEW_SRV_RPL_OK);
       goto cleanup;
     }
     hr.out_f = open_memstream(&hr.out_t, &hr.out_z);
@@ -477,6 +513,15 @@ cmd_http_request(
     close_memstream(hr.out_f); hr.out_f = NULL;
   }
 
+  if (hr.worker_mode == 2) {
+    // this is the worker process, the main process has already replied
+    if (!hr.disable_log) {
+      info("%d:%s -> OK, %zu (worker)", p->id, info_buf, hr.out_z);
+    }
+    write_worker_reply(((struct ht_client_state *) p)->client_fds[0], hr.out_t, hr.out_z);
+    _exit(0);
+  }
+
   nsf_new_autoclose(state, p, hr.out_t, hr.out_z);
   if (!hr.disable_log) {
     info("%d:%s -> OK, %zu", p->id, info_buf, hr.out_z);
@@ -497,6 +542,35 @@ cmd_http_request(
   if (hr.user_info) {
     userlist_free(&hr.user_info->b);
   }
+  // the worker process never returns to the main loop
+  if (hr.worker_mode == 2) _exit(0);
+}
+
+static void
+cmd_http_request(
+        struct server_framework_state *state,
+        struct client_state *p,
+        size_t pkt_size,
+        const struct new_server_prot_packet *pkt_gen)
+{
+  do_http_request(state, p, pkt_size, pkt_gen, NULL);
+}
+
+/* execute the suspended request once more, when the asynchronous
+   userlist requests it waited for are completed */
+void
+ns_replay_http_request(
+        int client_id,
+        const void *pkt,
+        size_t pkt_size,
+        const struct http_ul_async_results *ul_async)
+{
+  struct client_state *p = nsf_get_client_by_id(state, client_id);
+  if (!p) {
+    // the client has gone away
+    return;
+  }
+  do_http_request(state, p, pkt_size, pkt, ul_async);
 }
 
 void
@@ -548,6 +622,10 @@ handle_ws_request(
     cJSON_Delete(root);
     return;
   }
+  if (ns_ws_push_request(state, p, root)) {
+    cJSON_Delete(root);
+    return;
+  }
 
   memset(&hr, 0, sizeof(hr));
   hr.id = p->b.id;
@@ -1057,6 +1135,7 @@ main(int argc, char *argv[])
   if (ejudge_config->contests_ws_port > 0) {
     params.ws_port = ejudge_config->contests_ws_port;
   }
+  params.fcgi_socket_path = ejudge_config->contests_fcgi_socket;
   params.config = ejudge_config;
 
   if (load_plugins() < 0) return 1;
@@ -1085,6 +1164,8 @@ main(int argc, char *argv[])
   }
 
   idc_init(&main_id_cache);
+  serve_run_update_hook = ns_ws_push_run_update;
+  serve_clar_update_hook = ns_ws_push_clar_update;
   if (!(state = nsf_init(&params, 0, server_start_time))) return 1;
   setup_spool_dirs(ejudge_config, state);
   if (nsf_prepare(state) < 0) return 1;
@@ -50,6 +50,8 @@
 #include <netinet/ip.h>
 #include <net/if.h>
 #include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <linux/nsfs.h>
 
 #include "config.h"
 
@@ -155,8 +157,22 @@ static char *working_dir = NULL;
 static char *working_dir_parent = NULL;
 static char *working_dir_name = NULL;
 
+// files in the working directory shared with the host (hardlinks),
+// they are neither chowned nor writable inside the container
+enum { MAX_READONLY_FILES = 16 };
+static char *readonly_names[MAX_READONLY_FILES];
+static dev_t readonly_devs[MAX_READONLY_FILES];
+static ino_t readonly_inos[MAX_READONLY_FILES];
+static int readonly_count = 0;
+
 static int bash_mode = 0;
 
+// the socket to send the template mount namespace to (template mode)
+static int template_sock_fd = -1;
+// the prepared template mount namespace to start from
+static int template_ns_fd = -1;
+static int enable_template = 1;
+
 static int exec_user_serial = 0;
 static int exec_uid = -1;
 static int exec_gid = -1;
@@ -368,6 +384,39 @@ get_user_ids(void)
     if (primary_gid == 0) ffatal("group %s cannot be root", PRIMARY_GROUP);
 }
 
+static int
+is_readonly_file(const struct stat *stb)
+{
+    for (int i = 0; i < readonly_count; ++i) {
+        if (stb->st_dev == readonly_devs[i] && stb->st_ino == readonly_inos[i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void
+stat_readonly_files(void)
+{
+    const char *dir = working_dir;
+    if (!dir) dir = ".";
+    for (int i = 0; i < readonly_count; ++i) {
+        char path[PATH_MAX];
+        struct stat stb;
+        if (snprintf(path, sizeof(path), "%s/%s", dir, readonly_names[i]) >= (int) sizeof(path)) {
+            ffatal("path %s/%s is too long", dir, readonly_names[i]);
+        }
+        if (lstat(path, &stb) < 0) {
+            ffatal("read-only file '%s' does not exist", path);
+        }
+        if (!S_ISREG(stb.st_mode)) {
+            ffatal("read-only file '%s' is not a regular file", path);
+        }
+        readonly_devs[i] = stb.st_dev;
+        readonly_inos[i] = stb.st_ino;
+    }
+}
+
 static void
 safe_chown(const char *full, int to_user_id, int to_group_id, int from_user_id)
 {
@@ -383,6 +432,8 @@ safe_chown(const char *full, int to_user_id, int to_group_id, int from_user_id)
         if (stb.st_uid == from_user_id) {
             _ = fchown(fd, to_user_id, to_group_id);
         }
+    } else if (is_readonly_file(&stb)) {
+        // ownership change would affect the original file
     } else {
         if (stb.st_uid == from_user_id) {
             _ = fchown(fd, to_user_id, to_group_id);
@@ -473,102 +524,120 @@ sort_func_1(const void *p1, const void *p2)
     return ((struct MountInfo *) p2)->dst_len - ((struct MountInfo *) p1)->dst_len;
 }
 
+/*
+ * the template part does not depend on the particular invocation and
+ * may be prepared once and shared (see make_template), the instance
+ * part is done in a private copy of the template for each invocation
+ */
+enum
+{
+    RECONFIGURE_TEMPLATE = 1,
+    RECONFIGURE_INSTANCE = 2,
+};
+
 static void
-reconfigure_fs(void)
+reconfigure_fs(int parts)
 {
     int r;
-    char *mnt_s = NULL;
-    size_t mnt_z = 0;
-    FILE *mnt_f = open_memstream(&mnt_s, &mnt_z);
-    int fd = open("/proc/self/mounts", O_RDONLY);
-    if (fd < 0) ffatal("failed to open /proc/self/mounts: %s", strerror(errno));
-    char buf[4096];
-    ssize_t z;
-    while ((z = read(fd, buf, sizeof(buf))) > 0) {
-        fwrite(buf, 1, z, mnt_f);
-    }
-    if (z < 0) ffatal("read error from /proc/self/mounts");
-    close(fd); fd = -1;
-    fclose(mnt_f); mnt_f = NULL;
-
-    if (!mnt_z) ffatal("empty file /proc/self/mounts");
-    if (mnt_s[mnt_z - 1] != '\n') ffatal("invalid /proc/self/mounts (1)");
-
-    // count lines
-    int lcount = 0;
-    for (int i = 0; mnt_s[i]; ++i) {
-        lcount += (mnt_s[i] == '\n');
-    }
-
-    struct MountInfo *mi = calloc(lcount, sizeof(mi[0]));
-    int ind = -1;
-    char *p = mnt_s;
-    while (*p) {
-        ++ind;
-        struct MountInfo *pmi = &mi[ind];
-        char *q = strchr(p, ' ');
-        if (!q) ffatal("invalid /proc/self/mounts (2)");
-        *q = 0;
-        pmi->src_path = p;
-        p = q + 1;
-
-        if (!(q = strchr(p, ' '))) ffatal("invalid /proc/self/mounts (3)");
-        *q = 0;
-        pmi->dst_path = p;
-        pmi->dst_len = strlen(p);
-        p = q + 1;
-
-        if (!(q = strchr(p, ' '))) ffatal("invalid /proc/self/mounts (4)");
-        *q = 0;
-        pmi->type = p;
-        p = q + 1;
-
-        if (!(q = strchr(p, ' '))) ffatal("invalid /proc/self/mounts (5)");
-        *q = 0;
-        pmi->options = p;
-        p = q + 1;
-
-        if (!(q = strchr(p, ' '))) ffatal("invalid /proc/self/mounts (6)");
-        *q = 0;
-        pmi->n1 = p;
-        p = q + 1;
-
-        if (!(q = strchr(p, '\n'))) ffatal("invalid /proc/self/mounts (7)");
-        *q = 0;
-        pmi->n2 = p;
-        p = q + 1;
-    }
-
-    qsort(mi, lcount, sizeof(mi[0]), sort_func_1);
-
-    // make everything private
-    for (int i = 0; i < lcount; ++i) {
-        if ((r = mount(NULL, mi[i].dst_path, NULL, MS_PRIVATE, NULL)) < 0) {
-            ffatal("failed to make '%s' private: %s", mi[i].dst_path, strerror(errno));
-        }
-    }
-
-    // unmount what we don't need
-    for (int i = 0; i < lcount; ++i) {
-        struct MountInfo *pmi = &mi[i];
+    struct stat stb;
+    char bind_path[PATH_MAX];
+    if ((parts & RECONFIGURE_TEMPLATE)) {
+        char *mnt_s = NULL;
+        size_t mnt_z = 0;
+        FILE *mnt_f = open_memstream(&mnt_s, &mnt_z);
+        int fd = open("/proc/self/mounts", O_RDONLY);
+        if (fd < 0) ffatal("failed to open /proc/self/mounts: %s", strerror(errno));
+        char buf[4096];
+        ssize_t z;
+        while ((z = read(fd, buf, sizeof(buf))) > 0) {
+            fwrite(buf, 1, z, mnt_f);
+        }
+        if (z < 0) ffatal("read error from /proc/self/mounts");
+        close(fd); fd = -1;
+        fclose(mnt_f); mnt_f = NULL;
+
+        if (!mnt_z) ffatal("empty file /proc/self/mounts");
+        if (mnt_s[mnt_z - 1] != '\n') ffatal("invalid /proc/self/mounts (1)");
+
+        // count lines
+        int lcount = 0;
+        for (int i = 0; mnt_s[i]; ++i) {
+            lcount += (mnt_s[i] == '\n');
+        }
+
+        struct MountInfo *mi = calloc(lcount, sizeof(mi[0]));
+        int ind = -1;
+        char *p = mnt_s;
+        while (*p) {
+            ++ind;
+            struct MountInfo *pmi = &mi[ind];
+            char *q = strchr(p, ' ');
+            if (!q) ffatal("invalid /proc/self/mounts (2)");
+            *q = 0;
+            pmi->src_path = p;
+            p = q + 1;
+
+            if (!(q = strchr(p, ' '))) ffatal("invalid /proc/self/mounts (3)");
+            *q = 0;
+            pmi->dst_path = p;
+            pmi->dst_len = strlen(p);
+            p = q + 1;
+
+            if (!(q = strchr(p, ' '))) ffatal("invalid /proc/self/mounts (4)");
+            *q = 0;
+            pmi->type = p;
+            p = q + 1;
+
+            if (!(q = strchr(p, ' '))) ffatal("invalid /proc/self/mounts (5)");
+            *q = 0;
+            pmi->options = p;
+            p = q + 1;
+
+            if (!(q = strchr(p, ' '))) ffatal("invalid /proc/self/mounts (6)");
+            *q = 0;
+            pmi->n1 = p;
+            p = q + 1;
+
+            if (!(q = strchr(p, '\n'))) ffatal("invalid /proc/self/mounts (7)");
+            *q = 0;
+            pmi->n2 = p;
+            p = q + 1;
+        }
+
+        qsort(mi, lcount, sizeof(mi[0]), sort_func_1);
+
+        // make everything private
+        for (int i = 0; i < lcount; ++i) {
+            if ((r = mount(NULL, mi[i].dst_path, NULL, MS_PRIVATE, NULL)) < 0) {
+                ffatal("failed to make '%s' private: %s", mi[i].dst_path, strerror(errno));
+            }
+        }
+
+        // unmount what we don't need
+        for (int i = 0; i < lcount; ++i) {
+            struct MountInfo *pmi = &mi[i];
         
-        if (!strcmp(pmi->type, "fusectl")
-            || !strcmp(pmi->type, "rpc_pipefs")
-            || !strcmp(pmi->type, "securityfs")
-            || !strcmp(pmi->type, "tracefs")
-            || !strcmp(pmi->type, "configfs")
-            || !strcmp(pmi->type, "fuse.portal")
-            || !strcmp(pmi->type, "debugfs")
-            || !strcmp(pmi->type, "pstore")
-            || !strcmp(pmi->type, "bpf")
-            || !strcmp(pmi->type, "hugetlbfs")) {
-            if ((r = umount(pmi->dst_path)) < 0) {
-                ffatal("failed to unmount '%s': %s", mi[i].dst_path, strerror(errno));
+            if (!strcmp(pmi->type, "fusectl")
+                || !strcmp(pmi->type, "rpc_pipefs")
+                || !strcmp(pmi->type, "securityfs")
+                || !strcmp(pmi->type, "tracefs")
+                || !strcmp(pmi->type, "configfs")
+                || !strcmp(pmi->type, "fuse.portal")
+                || !strcmp(pmi->type, "debugfs")
+                || !strcmp(pmi->type, "pstore")
+                || !strcmp(pmi->type, "bpf")
+                || !strcmp(pmi->type, "hugetlbfs")) {
+                if ((r = umount(pmi->dst_path)) < 0) {
+                    ffatal("failed to unmount '%s': %s", mi[i].dst_path, strerror(errno));
+                }
             }
         }
+
+        free(mi);
+        free(mnt_s);
     }
 
-    if (enable_sandbox_dir) {
+    if ((parts & RECONFIGURE_INSTANCE) && enable_sandbox_dir) {
         if (mkdir(sandbox_dir, 0755) < 0 && errno != EEXIST) {
             ffatal("failed to create '%s': %s", sandbox_dir, strerror(errno));
         }
@@ -592,23 +661,48 @@ reconfigure_fs(void)
         }
     }
 
+    if ((parts & RECONFIGURE_INSTANCE)) {
+        for (int i = 0; i < readonly_count; ++i) {
+            char path[PATH_MAX];
+            int len;
+            if (enable_sandbox_dir && working_dir_name && *working_dir_name) {
+                len = snprintf(path, sizeof(path), "%s/%s/%s", sandbox_dir, working_dir_name, readonly_names[i]);
+            } else if (enable_sandbox_dir) {
+                len = snprintf(path, sizeof(path), "%s/%s", sandbox_dir, readonly_names[i]);
+            } else if (working_dir && *working_dir) {
+                len = snprintf(path, sizeof(path), "%s/%s", working_dir, readonly_names[i]);
+            } else {
+                len = snprintf(path, sizeof(path), "%s", readonly_names[i]);
+            }
+            if (len >= (int) sizeof(path)) ffatal("read-only file path is too long");
+            if ((r = mount(path, path, NULL, MS_BIND, NULL)) < 0) {
+                ffatal("failed to mount '%s': %s", path, strerror(errno));
+            }
+            if ((r = mount(NULL, path, NULL, MS_REMOUNT | MS_BIND | MS_RDONLY, NULL)) < 0) {
+                ffatal("failed to remount '%s' read-only: %s", path, strerror(errno));
+            }
+        }
+    }
+
     char empty_bind_path[PATH_MAX];
     if (snprintf(empty_bind_path, sizeof(empty_bind_path), "%s/empty", safe_dir_path) >= sizeof(empty_bind_path)) abort();
 
     if (enable_proc) {
-        if (enable_pid_ns) {
+        if ((parts & RECONFIGURE_INSTANCE) && enable_pid_ns) {
             // remout /proc to show restricted pids
             if ((r = mount("proc", "/proc", "proc", 0, NULL)) < 0) {
                 ffatal("failed to mount /proc: %s", strerror(errno));
             }
         }
-    } else {
+    } else if ((parts & RECONFIGURE_TEMPLATE)) {
         // remout /proc to empty directory, this might break things
         if ((r = mount(empty_bind_path, "/proc", NULL, MS_BIND, NULL)) < 0) {
             ffatal("failed to mount %s as /proc: %s", empty_bind_path, strerror(errno));
         }
     }
 
+    if (!(parts & RECONFIGURE_TEMPLATE)) goto instance_part;
+
     if (!enable_sys) {
         // remout /sys to empty directory
         if ((r = mount(empty_bind_path, "/sys", NULL, MS_BIND, NULL)) < 0) {
@@ -622,14 +716,12 @@ reconfigure_fs(void)
     if ((r = mount(empty_bind_path, "/srv", NULL, MS_BIND, NULL)) < 0) {
         ffatal("failed to mount /srv: %s", strerror(errno));
     }
-    struct stat stb;
     if (lstat("/data", &stb) >= 0 && S_ISDIR(stb.st_mode)) {
         if ((r = mount(empty_bind_path, "/data", NULL, MS_BIND, NULL)) < 0) {
             ffatal("failed to mount /data: %s", strerror(errno));
         }
     }
 
-    char bind_path[PATH_MAX];
     if (snprintf(bind_path, sizeof(bind_path), "%s/root", safe_dir_path) >= sizeof(bind_path)) abort();
     if (lstat(bind_path, &stb) >= 0 && S_ISDIR(stb.st_mode)) {
         if ((r = mount(bind_path, "/root", NULL, MS_BIND, NULL)) < 0) {
@@ -696,22 +788,6 @@ reconfigure_fs(void)
         }
     }
 
-    // mount pristine /tmp, /dev/shm, /run
-    if ((r = mount("tmpfs", "/tmp", "tmpfs", MS_NOSUID | MS_NODEV, "size=1024m,nr_inodes=1024")) < 0) {
-        ffatal("failed to mount /tmp: %s", strerror(errno));
-    }
-    if ((r = mount("mqueue", "/dev/mqueue", "mqueue", MS_NOSUID | MS_NODEV | MS_NOEXEC | MS_RELATIME, NULL)) < 0) {
-        ffatal("failed to mount /dev/mqueue: %s", strerror(errno));
-    }
-    if (!enable_run) {
-        if ((r = mount("/tmp", "/run", NULL, MS_BIND, NULL)) < 0){
-            ffatal("failed to mount /run: %s", strerror(errno));
-        }
-    }
-    if ((r = mount("/tmp", "/dev/shm", NULL, MS_BIND, NULL)) < 0){
-        ffatal("failed to mount /dev/shm: %s", strerror(errno));
-    }
-
     if (!enable_home) {
         if (snprintf(bind_path, sizeof(bind_path), "%s/home", safe_dir_path) >= sizeof(bind_path)) abort();
         if (lstat(bind_path, &stb) >= 0 && S_ISDIR(stb.st_mode)) {
@@ -767,6 +843,25 @@ reconfigure_fs(void)
         }
     }
 
+instance_part:
+    if (!(parts & RECONFIGURE_INSTANCE)) return;
+
+    // mount pristine /tmp, /dev/shm, /run
+    if ((r = mount("tmpfs", "/tmp", "tmpfs", MS_NOSUID | MS_NODEV, "size=1024m,nr_inodes=1024")) < 0) {
+        ffatal("failed to mount /tmp: %s", strerror(errno));
+    }
+    if ((r = mount("mqueue", "/dev/mqueue", "mqueue", MS_NOSUID | MS_NODEV | MS_NOEXEC | MS_RELATIME, NULL)) < 0) {
+        ffatal("failed to mount /dev/mqueue: %s", strerror(errno));
+    }
+    if (!enable_run) {
+        if ((r = mount("/tmp", "/run", NULL, MS_BIND, NULL)) < 0){
+            ffatal("failed to mount /run: %s", strerror(errno));
+        }
+    }
+    if ((r = mount("/tmp", "/dev/shm", NULL, MS_BIND, NULL)) < 0){
+        ffatal("failed to mount /dev/shm: %s", strerror(errno));
+    }
+
     if (!enable_proc || (!enable_sys && enable_cgroup)) {
         if (mkdir("/run/0", 0700) < 0) {
             ffatal("failed to mkdir /run/0: %s", strerror(errno));
@@ -804,8 +899,202 @@ reconfigure_fs(void)
         }
     }
 
-    free(mi);
-    free(mnt_s);
+}
+
+/*
+ * the template is marked with a tmpfs mount over the empty directory
+ * (it is not used after the template part), only root can create
+ * such mount in a namespace of the initial user namespace, the mount
+ * source also records the options the template was prepared with
+ */
+static void
+make_template_marker(char *buf, size_t size)
+{
+    unsigned mask = 0;
+    if (enable_proc) mask |= 1;
+    if (enable_sys) mask |= 2;
+    if (enable_etc) mask |= 4;
+    if (enable_var) mask |= 8;
+    if (enable_dev) mask |= 16;
+    if (enable_home) mask |= 32;
+    if (snprintf(buf, size, "ejudge-template-%u", mask) >= size) abort();
+}
+
+/*
+ * prepare the template part of the mount namespace and pass
+ * the namespace descriptor to the caller, the namespace lives
+ * as long as the caller keeps the descriptor
+ */
+static void __attribute__((noreturn))
+make_template(void)
+{
+    if (!enable_template) {
+        ffatal("template mode is disabled");
+    }
+    if (enable_compile_mode) {
+        ffatal("template mode is not supported for compilation");
+    }
+#if !defined NS_GET_NSTYPE || !defined NS_GET_USERNS
+    ffatal("template mount namespaces are not supported");
+#endif
+    if (!enable_mount_ns) {
+        ffatal("template mode requires mount namespace");
+    }
+    if (unshare(CLONE_NEWNS) < 0) {
+        ffatal("unshare failed: %s", strerror(errno));
+    }
+    reconfigure_fs(RECONFIGURE_TEMPLATE);
+
+    char marker[64];
+    char empty_bind_path[PATH_MAX];
+    make_template_marker(marker, sizeof(marker));
+    if (snprintf(empty_bind_path, sizeof(empty_bind_path), "%s/empty", safe_dir_path) >= sizeof(empty_bind_path)) abort();
+    if (mount(marker, empty_bind_path, "tmpfs", MS_RDONLY | MS_NOSUID | MS_NODEV | MS_NOEXEC, "size=4k,nr_inodes=1") < 0) {
+        ffatal("failed to mount the template marker: %s", strerror(errno));
+    }
+
+    int ns_fd = open("/proc/self/ns/mnt", O_RDONLY | O_CLOEXEC);
+    if (ns_fd < 0) {
+        ffatal("failed to open /proc/self/ns/mnt: %s", strerror(errno));
+    }
+#if defined NS_GET_NSTYPE
+    // the kernel must support the checks in check_template_ns
+    if (ioctl(ns_fd, NS_GET_NSTYPE) < 0) {
+        ffatal("namespace ioctls are not supported: %s", strerror(errno));
+    }
+#endif
+
+    struct msghdr msg = {};
+    union
+    {
+        struct cmsghdr hdr;
+        unsigned char buf[CMSG_SPACE(sizeof(int))];
+    } cmsgbuf = {};
+    int val = 0;
+    struct iovec vec = { .iov_base = &val, .iov_len = sizeof(val) };
+    msg.msg_iov = &vec;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsgbuf.buf;
+    msg.msg_controllen = sizeof(cmsgbuf.buf);
+    struct cmsghdr *pmsg = CMSG_FIRSTHDR(&msg);
+    pmsg->cmsg_level = SOL_SOCKET;
+    pmsg->cmsg_type = SCM_RIGHTS;
+    pmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(pmsg), &ns_fd, sizeof(int));
+    if (sendmsg(template_sock_fd, &msg, 0) != sizeof(val)) {
+        ffatal("failed to send the namespace descriptor: %s", strerror(errno));
+    }
+    _exit(0);
+}
+
+static int
+is_same_ns(int fd, const char *path)
+{
+    struct stat stb1, stb2;
+    return fstat(fd, &stb1) >= 0 && stat(path, &stb2) >= 0
+        && stb1.st_dev == stb2.st_dev && stb1.st_ino == stb2.st_ino;
+}
+
+/*
+ * the descriptor comes from the unprivileged caller, so accept
+ * only mount namespaces owned by our own user namespace, i.e.
+ * the namespaces which could only be created by a privileged process,
+ * and not the namespace of the caller or the initial namespace;
+ * the namespace is checked to be our template after entering it
+ */
+static void
+check_template_ns(void)
+{
+#if defined NS_GET_NSTYPE && defined NS_GET_USERNS
+    struct stat stb1, stb2;
+    int nstype = ioctl(template_ns_fd, NS_GET_NSTYPE);
+    if (nstype < 0 || nstype != CLONE_NEWNS) {
+        ffatal("invalid template mount namespace descriptor");
+    }
+    int user_fd = ioctl(template_ns_fd, NS_GET_USERNS);
+    if (user_fd < 0) {
+        ffatal("cannot get the owner of the template mount namespace: %s", strerror(errno));
+    }
+    if (fstat(user_fd, &stb1) < 0 || stat("/proc/self/ns/user", &stb2) < 0
+        || stb1.st_dev != stb2.st_dev || stb1.st_ino != stb2.st_ino) {
+        ffatal("template mount namespace is not owned by the initial user namespace");
+    }
+    close(user_fd);
+    if (is_same_ns(template_ns_fd, "/proc/self/ns/mnt")
+        || is_same_ns(template_ns_fd, "/proc/1/ns/mnt")) {
+        ffatal("template mount namespace is not a template");
+    }
+    int flags = fcntl(template_ns_fd, F_GETFD);
+    if (flags < 0 || fcntl(template_ns_fd, F_SETFD, flags | FD_CLOEXEC) < 0) {
+        ffatal("invalid template mount namespace descriptor");
+    }
+#else
+    ffatal("template mount namespaces are not supported");
+#endif
+}
+
+/*
+ * the template has no shared mounts and has the marker mount
+ * with the options of this invocation
+ */
+static void
+check_template_mounts(void)
+{
+    char marker[64];
+    char empty_bind_path[PATH_MAX];
+    make_template_marker(marker, sizeof(marker));
+    if (snprintf(empty_bind_path, sizeof(empty_bind_path), "%s/empty", safe_dir_path) >= sizeof(empty_bind_path)) abort();
+
+    FILE *f = fopen("/proc/self/mountinfo", "r");
+    if (!f) ffatal("failed to open /proc/self/mountinfo: %s", strerror(errno));
+    char *line = NULL;
+    size_t linez = 0;
+    int marker_found = 0;
+    // ID PARENT-ID MAJ:MIN ROOT MOUNT-POINT OPTIONS [OPTIONAL...] - TYPE SOURCE SUPER-OPTIONS
+    while (getline(&line, &linez, f) > 0) {
+        char *fields[16];
+        int count = 0;
+        char *sp = NULL;
+        for (char *t = strtok_r(line, " \n", &sp); t && count < 16; t = strtok_r(NULL, " \n", &sp)) {
+            fields[count++] = t;
+        }
+        int sep = 6;
+        while (sep < count && strcmp(fields[sep], "-") != 0) {
+            if (!strncmp(fields[sep], "shared:", 7) || !strncmp(fields[sep], "master:", 7)) {
+                ffatal("template mount namespace has shared mounts");
+            }
+            ++sep;
+        }
+        if (sep + 2 >= count) ffatal("invalid /proc/self/mountinfo");
+        if (!strcmp(fields[4], empty_bind_path) && !strcmp(fields[sep + 1], "tmpfs")
+            && !strcmp(fields[sep + 2], marker)) {
+            marker_found = 1;
+        }
+    }
+    free(line);
+    fclose(f);
+    if (!marker_found) {
+        ffatal("template mount namespace is not a template");
+    }
+}
+
+/* enter a private copy of the template mount namespace */
+static void
+enter_template(void)
+{
+    if (setns(template_ns_fd, CLONE_NEWNS) < 0) {
+        ffatal("failed to enter the template mount namespace: %s", strerror(errno));
+    }
+    close(template_ns_fd); template_ns_fd = -1;
+    check_template_mounts();
+    if (unshare(CLONE_NEWNS) < 0) {
+        ffatal("unshare failed: %s", strerror(errno));
+    }
+    // the template is private already, but never let the instance mounts propagate
+    if (mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) < 0) {
+        ffatal("failed to make / private: %s", strerror(errno));
+    }
+    reconfigure_fs(RECONFIGURE_INSTANCE);
 }
 
 static void
@@ -2270,6 +2559,23 @@ main(int argc, char *argv[])
             } else if (*opt == 'm' && opt[1] == 'C') {
                 enable_compile_mode = 1;
                 opt += 2;
+            } else if (*opt == 'm' && opt[1] == 'k') {
+                enable_template = 0;
+                opt += 2;
+            } else if (*opt == 'm' && (opt[1] == 'K' || opt[1] == 'T')) {
+                char *eptr = NULL;
+                errno = 0;
+                long v = strtol(opt + 2, &eptr, 10);
+                struct stat stb;
+                if (errno || eptr == opt + 2 || v < 0 || (int) v != v || fstat(v, &stb) < 0) {
+                    ffatal("invalid file descriptor");
+                }
+                if (opt[1] == 'K') {
+                    template_sock_fd = v;
+                } else {
+                    template_ns_fd = v;
+                }
+                opt = eptr;
             } else if (*opt == 'm' && opt[1] == 'r') {
                 enable_run = 1;
                 opt += 2;
@@ -2309,6 +2615,15 @@ main(int argc, char *argv[])
                 stderr_mode = O_WRONLY | O_CREAT | O_APPEND;
             } else if (*opt == 'r' && opt[1] == 'p') {
                 start_program_name = extract_string(&opt, 2, "rp");
+            } else if (*opt == 'r' && opt[1] == 'I') {
+                char *name = extract_string(&opt, 2, "rI");
+                if (!*name || strchr(name, '/') || !strcmp(name, ".") || !strcmp(name, "..")) {
+                    ffatal("invalid read-only file name '%s'", name);
+                }
+                if (readonly_count >= MAX_READONLY_FILES) {
+                    ffatal("too many read-only files");
+                }
+                readonly_names[readonly_count++] = name;
             } else if (*opt == 'r' && opt[1] == 'a') {
                 char *eptr = NULL;
                 errno = 0;
@@ -2487,6 +2802,17 @@ main(int argc, char *argv[])
         if (!len) ffatal("invalid working directory '%s'", working_dir);
     }
 
+    if (template_sock_fd >= 0) {
+        make_template();
+    }
+    if (template_ns_fd >= 0 && (!enable_mount_ns || !enable_template)) {
+        close(template_ns_fd);
+        template_ns_fd = -1;
+    }
+    if (template_ns_fd >= 0) {
+        check_template_ns();
+    }
+
     start_args = argv + argi;
     if (start_program_name) {
         start_program = start_program_name;
@@ -2522,6 +2848,8 @@ main(int argc, char *argv[])
         }
     }
 
+    stat_readonly_files();
+
     if (enable_chown) {
         change_ownership(slave_uid, slave_gid, primary_uid);
     }
@@ -2540,7 +2868,8 @@ main(int argc, char *argv[])
     unsigned clone_flags = CLONE_CHILD_CLEARTID | CLONE_CHILD_SETTID | SIGCHLD;
     if (enable_ipc_ns) clone_flags |= CLONE_NEWIPC;
     if (enable_net_ns) clone_flags |= CLONE_NEWNET;
-    if (enable_mount_ns) clone_flags |= CLONE_NEWNS;
+    // the template namespace is entered by the child
+    if (enable_mount_ns && template_ns_fd < 0) clone_flags |= CLONE_NEWNS;
     if (enable_pid_ns) clone_flags |= CLONE_NEWPID;
 
     pid_t tidptr = 0;
@@ -2554,8 +2883,10 @@ main(int argc, char *argv[])
     }
 
     if (!pid) {
-        if (enable_mount_ns) {
-            reconfigure_fs();
+        if (template_ns_fd >= 0) {
+            enter_template();
+        } else if (enable_mount_ns) {
+            reconfigure_fs(RECONFIGURE_TEMPLATE | RECONFIGURE_INSTANCE);
         }
 
         sigset_t bs;
@@ -32,6 +32,7 @@
 #include "ejudge/ej_uuid.h"
 #include "ejudge/super_run_status.h"
 #include "ejudge/agent_client.h"
+#include "ejudge/spool_queue.h"
 
 #include "ejudge/xalloc.h"
 #include "ejudge/osdeps.h"
@@ -48,7 +49,6 @@
 #include <signal.h>
 #include <errno.h>
 #include <sys/time.h>
-#include <sys/inotify.h>
 #include <sys/epoll.h>
 #include <sys/mman.h>
 #include <fcntl.h>
@@ -817,7 +817,7 @@ do_loop(
   size_t pkt_size = 0;
   int ifd = -1;
   int efd = -1;
-  int ifd_wd = -1;
+  struct spool_queue *sq = NULL;
   sigset_t emptymask;
 
   sigemptyset(&emptymask);
@@ -843,19 +843,10 @@ do_loop(
       return -1;
     }
   } else {
-    ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
-    if (ifd < 0) {
-      err("inotify_init1 failed: %s", os_ErrorMsg());
-      return -1;
-    }
-
-    unsigned char srspd[PATH_MAX];
-    snprintf(srspd, sizeof(srspd), "%s/dir", super_run_spool_path);
-    ifd_wd = inotify_add_watch(ifd, srspd, IN_CREATE | IN_MOVED_TO);
-    if (ifd_wd < 0) {
-      err("inotify_add_watch failed: %s", os_ErrorMsg());
+    if (!(sq = spool_queue_open(super_run_spool_path))) {
       return -1;
     }
+    ifd = spool_queue_get_fd(sq);
 
     efd = epoll_create1(EPOLL_CLOEXEC);
     if (efd < 0) {
@@ -960,9 +951,9 @@ do_loop(
       }
       */
     } else {
-      r = scan_dir(super_run_spool_path, pkt_name, sizeof(pkt_name), 1);
+      r = spool_queue_next(sq, pkt_name, sizeof(pkt_name), 1);
       if (r < 0) {
-        err("scan_dir failed for %s, waiting...", super_run_spool_path);
+        err("spool_queue_next failed for %s, waiting...", super_run_spool_path);
       }
     }
     if (r < 0) {
@@ -991,13 +982,8 @@ do_loop(
         struct epoll_event events[1];
         int r = epoll_pwait(efd, events, 1, 30000, &emptymask);
         if (r == 1) {
+          // the events are read by spool_queue_next
           if (events[0].data.fd != ifd) abort();
-          // just read all the data in the ifd without any processing
-          unsigned char ibuf[4096];
-          while (1) {
-            int r = read(ifd, ibuf, sizeof(ibuf));
-            if (r <= 0) break;
-          }
         }
       } else {
         interrupt_enable();
@@ -1014,7 +1000,7 @@ do_loop(
       if (agent) {
         //agent->ops->add_ignored(agent, pkt_name);
       } else {
-        scan_dir_add_ignored(super_run_spool_path, pkt_name);
+        spool_queue_add_ignored(sq, pkt_name);
       }
     }
 
@@ -1028,6 +1014,7 @@ do_loop(
   if (agent) {
     agent->ops->close(agent);
   }
+  spool_queue_free(sq);
 
   return 0;
 }
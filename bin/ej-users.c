@@ -43,6 +43,7 @@
 #include "ejudge/bitset.h"
 #include "ejudge/sha256utils.h"
 #include "ejudge/userlist_bin.h"
+#include "ejudge/userlist_shm.h"
 #include "ejudge/ej_uuid.h"
 
 #include "ejudge/xalloc.h"
@@ -65,6 +66,7 @@
 #include <fcntl.h>
 #include <stdarg.h>
 #include <string.h>
+#include <limits.h>
 #include <zlib.h>
 #include <pwd.h>
 
@@ -125,11 +127,22 @@ struct contest_extra
   struct userlist_table *tbl;
 };
 
+enum { CONTEST_CHANGE_LOG_SIZE = 1024 };
+
 /* new extra information about contest */
 struct new_contest_extra
 {
   int id;
   struct observer_info *o_first, *o_last; /* list of observers */
+
+  /* journal of changed users for the delta user list requests */
+  int change_vintage;           /* the vintage of the last change, never 0 */
+  int change_count;             /* the number of valid journal entries */
+  int *change_users;            /* user_id's by vintage, 0 - unknown */
+
+  /* the standings user list published in the shared memory */
+  struct userlist_shm *shm;
+  int shm_dirty;
 };
 
 struct client_state
@@ -193,6 +206,9 @@ static int contest_extras_size;
 static struct new_contest_extra **new_contest_extras;
 static size_t new_contest_extras_size;
 
+/* the recent cookie check replies published in the shared memory */
+static struct userlist_shm *cookie_shm;
+
 static time_t cur_time;
 static time_t last_cookie_check;
 static time_t last_user_check;
@@ -380,6 +396,12 @@ new_contest_extra_get(int contest_id)
   if (!(p = new_contest_extras[contest_id])) {
     XCALLOC(p, 1);
     p->id = contest_id;
+    // start from a random vintage, so the vintages of the clients
+    // from the previous run of the server are not accepted
+    random_bytes((unsigned char *) &p->change_vintage,
+                 sizeof(p->change_vintage));
+    p->change_vintage &= 0x3fffffff;
+    if (!p->change_vintage) p->change_vintage = 1;
     new_contest_extras[contest_id] = p;
   }
   return new_contest_extras[contest_id];
@@ -491,12 +513,80 @@ old_update_userlist_table(int cnts_id)
 }
 
 static void
-new_update_userlist_table(int cnts_id)
+record_user_change(struct new_contest_extra *ne, int user_id)
+{
+  if (!ne->change_users) {
+    XCALLOC(ne->change_users, CONTEST_CHANGE_LOG_SIZE);
+  }
+  // the vintage runs through the whole 32-bit range, so the vintages
+  // before the wrap around are never mistaken for the current ones
+  ne->change_vintage = (int) ((unsigned) ne->change_vintage + 1);
+  if (!ne->change_vintage) {
+    // the journal does not cover the wrap around, so the clients
+    // get the full list
+    ne->change_vintage = 1;
+    ne->change_count = 0;
+  }
+  if (user_id < 0) user_id = 0;
+  ne->change_users[(unsigned) ne->change_vintage % CONTEST_CHANGE_LOG_SIZE] = user_id;
+  if (ne->change_count < CONTEST_CHANGE_LOG_SIZE) ++ne->change_count;
+}
+
+static int
+sort_func_int(const void *p1, const void *p2)
+{
+  int v1 = *(const int *) p1;
+  int v2 = *(const int *) p2;
+  if (v1 < v2) return -1;
+  return v1 > v2;
+}
+
+/* collect the users changed since the given vintage,
+   returns -1, if the journal does not cover the vintage */
+static int
+get_user_changes(
+        const struct new_contest_extra *ne,
+        int vintage,
+        int **p_ids,
+        int *p_count)
+{
+  unsigned diff = (unsigned) ne->change_vintage - (unsigned) vintage;
+  int *ids = NULL;
+  int count = 0;
+
+  *p_ids = NULL;
+  *p_count = 0;
+  if (!vintage || diff > (unsigned) ne->change_count) return -1;
+  if (!diff) return 0;
+
+  XCALLOC(ids, diff);
+  for (unsigned i = 1; i <= diff; ++i) {
+    int user_id = ne->change_users[((unsigned) vintage + i) % CONTEST_CHANGE_LOG_SIZE];
+    if (user_id <= 0) {
+      xfree(ids);
+      return -1;
+    }
+    ids[count++] = user_id;
+  }
+  qsort(ids, count, sizeof(ids[0]), sort_func_int);
+  int j = 0;
+  for (int i = 0; i < count; ++i) {
+    if (!j || ids[j - 1] != ids[i]) ids[j++] = ids[i];
+  }
+  *p_ids = ids;
+  *p_count = j;
+  return 0;
+}
+
+static void
+new_update_userlist_table(int cnts_id, int user_id)
 {
   struct new_contest_extra *ne;
   struct observer_info *p;
 
   if (!(ne = new_contest_extra_try(cnts_id))) return;
+  record_user_change(ne, user_id);
+  if (ne->shm) ne->shm_dirty = 1;
   for (p = ne->o_first; p; p = p->cnts_next) {
     if (!p->changed) {
       p->changed = 1;
@@ -505,16 +595,31 @@ new_update_userlist_table(int cnts_id)
   }
 }
 
+/* the cached cookie check replies for the user become stale */
+static void
+forget_shm_user(int user_id)
+{
+  if (cookie_shm) userlist_shm_forget_user(cookie_shm, user_id);
+}
+
+static void
+forget_shm_cookie(const struct userlist_cookie *c)
+{
+  if (cookie_shm && c) userlist_shm_forget_cookie(cookie_shm, c->cookie);
+}
+
+/* user_id is 0, if the change is not specific to one user */
 static void
-update_userlist_table(int cnts_id)
+update_userlist_table(int cnts_id, int user_id)
 {
   int i;
   const struct contest_desc *cnts;
 
   if (cnts_id <= 0) return;
 
+  forget_shm_user(user_id);
   old_update_userlist_table(cnts_id);
-  new_update_userlist_table(cnts_id);
+  new_update_userlist_table(cnts_id, user_id);
 
   for (i = 1; i < new_contest_extras_size; ++i) {
     if (cnts_id == i || !new_contest_extras[i]) continue;
@@ -522,7 +627,7 @@ update_userlist_table(int cnts_id)
     if (contests_get(i, &cnts) < 0 || !cnts) continue;
     if (cnts->user_contest_num == cnts_id) {
       old_update_userlist_table(i);
-      new_update_userlist_table(i);
+      new_update_userlist_table(i, user_id);
     }
   }
 }
@@ -560,47 +665,47 @@ link_client_state(struct client_state *p)
 #define default_forced_sync() dflt_iface->forced_sync(uldb_default->data)
 #define default_get_login(a) dflt_iface->get_login(uldb_default->data, a)
 #define default_new_user(a,b,c,d,e,f,g,h,i,j,k,l,m) dflt_iface->new_user(uldb_default->data, a, b, c, d, e, f, g, h, i, j, k, l, m)
-#define default_remove_user(a) dflt_iface->remove_user(uldb_default->data, a)
+#define default_remove_user(a) (forget_shm_user(a), dflt_iface->remove_user(uldb_default->data, a))
 #define default_get_cookie(a, b, c) dflt_iface->get_cookie(uldb_default->data, a, b, c)
 #define default_new_cookie(a, b, c, d, e, f, g, h, i, j, k, l) dflt_iface->new_cookie(uldb_default->data, a, b, c, d, e, f, g, h, i, j, k, l)
-#define default_remove_cookie(a) dflt_iface->remove_cookie(uldb_default->data, a)
-#define default_remove_user_cookies(a) dflt_iface->remove_user_cookies(uldb_default->data, a)
+#define default_remove_cookie(a) (forget_shm_cookie(a), dflt_iface->remove_cookie(uldb_default->data, a))
+#define default_remove_user_cookies(a) (forget_shm_user(a), dflt_iface->remove_user_cookies(uldb_default->data, a))
 #define default_remove_expired_cookies(a) dflt_iface->remove_expired_cookies(uldb_default->data, a)
 #define default_get_user_contest_iterator(a) dflt_iface->get_user_contest_iterator(uldb_default->data, a)
-#define default_remove_expired_users(a) dflt_iface->remove_expired_users(uldb_default->data, a)
+#define default_remove_expired_users(a) (forget_shm_user(0), dflt_iface->remove_expired_users(uldb_default->data, a))
 #define default_get_user_info_1(a, b) dflt_iface->get_user_info_1(uldb_default->data, a, b)
 #define default_get_user_info_2(a, b, c, d) dflt_iface->get_user_info_2(uldb_default->data, a, b, c, d)
 #define default_touch_login_time(a, b, c) dflt_iface->touch_login_time(uldb_default->data, a, b, c)
 #define default_get_user_info_3(a, b, c, d, e) dflt_iface->get_user_info_3(uldb_default->data, a, b, c, d, e)
-#define default_set_cookie_contest(a, b) dflt_iface->set_cookie_contest(uldb_default->data, a, b)
-#define default_set_cookie_locale(a, b) dflt_iface->set_cookie_locale(uldb_default->data, a, b)
-#define default_set_cookie_priv_level(a, b) dflt_iface->set_cookie_priv_level(uldb_default->data, a, b)
-#define default_set_cookie_team_login(a, b) dflt_iface->set_cookie_team_login(uldb_default->data, a, b)
+#define default_set_cookie_contest(a, b) (forget_shm_cookie(a), dflt_iface->set_cookie_contest(uldb_default->data, a, b))
+#define default_set_cookie_locale(a, b) (forget_shm_cookie(a), dflt_iface->set_cookie_locale(uldb_default->data, a, b))
+#define default_set_cookie_priv_level(a, b) (forget_shm_cookie(a), dflt_iface->set_cookie_priv_level(uldb_default->data, a, b))
+#define default_set_cookie_team_login(a, b) (forget_shm_cookie(a), dflt_iface->set_cookie_team_login(uldb_default->data, a, b))
 #define default_get_user_info_4(a, b, c) dflt_iface->get_user_info_4(uldb_default->data, a, b, c)
 #define default_get_user_info_5(a, b, c) dflt_iface->get_user_info_5(uldb_default->data, a, b, c)
 #define default_get_brief_list_iterator(a) dflt_iface->get_brief_list_iterator(uldb_default->data, a)
 #define default_get_standings_list_iterator(a) dflt_iface->get_standings_list_iterator(uldb_default->data, a)
 #define default_check_user(a) dflt_iface->check_user(uldb_default->data, a)
-#define default_set_reg_passwd(a, b, c, d) dflt_iface->set_reg_passwd(uldb_default->data, a, b, c, d)
-#define default_set_team_passwd(a, b, c, d, e, f) dflt_iface->set_team_passwd(uldb_default->data, a, b, c, d, e, f)
-#define default_register_contest(a, b, c, d, e, f) dflt_iface->register_contest(uldb_default->data, a, b, c, d, e, f)
+#define default_set_reg_passwd(a, b, c, d) (forget_shm_user(a), dflt_iface->set_reg_passwd(uldb_default->data, a, b, c, d))
+#define default_set_team_passwd(a, b, c, d, e, f) (forget_shm_user(a), dflt_iface->set_team_passwd(uldb_default->data, a, b, c, d, e, f))
+#define default_register_contest(a, b, c, d, e, f) (forget_shm_user(a), dflt_iface->register_contest(uldb_default->data, a, b, c, d, e, f))
 #define default_remove_member(a, b, c, d, e) dflt_iface->remove_member(uldb_default->data, a, b, c, d, e)
 #define default_is_read_only(a, b) dflt_iface->is_read_only(uldb_default->data, a, b)
 #define default_get_info_list_iterator(a, b) dflt_iface->get_info_list_iterator(uldb_default->data, a, b)
-#define default_clear_team_passwd(a, b, c) dflt_iface->clear_team_passwd(uldb_default->data, a, b, c)
-#define default_remove_registration(a, b) dflt_iface->remove_registration(uldb_default->data, a, b)
-#define default_set_reg_status(a, b, c) dflt_iface->set_reg_status(uldb_default->data, a, b, c)
-#define default_set_reg_flags(a, b, c, d) dflt_iface->set_reg_flags(uldb_default->data, a, b, c, d)
-#define default_remove_user_contest_info(a, b) dflt_iface->remove_user_contest_info(uldb_default->data, a, b)
-#define default_clear_user_field(a, b, c) dflt_iface->clear_user_field(uldb_default->data, a, b, c)
-#define default_clear_user_info_field(a, b, c, d, e) dflt_iface->clear_user_info_field(uldb_default->data, a, b, c, d, e)
+#define default_clear_team_passwd(a, b, c) (forget_shm_user(a), dflt_iface->clear_team_passwd(uldb_default->data, a, b, c))
+#define default_remove_registration(a, b) (forget_shm_user(a), dflt_iface->remove_registration(uldb_default->data, a, b))
+#define default_set_reg_status(a, b, c) (forget_shm_user(a), dflt_iface->set_reg_status(uldb_default->data, a, b, c))
+#define default_set_reg_flags(a, b, c, d) (forget_shm_user(a), dflt_iface->set_reg_flags(uldb_default->data, a, b, c, d))
+#define default_remove_user_contest_info(a, b) (forget_shm_user(a), dflt_iface->remove_user_contest_info(uldb_default->data, a, b))
+#define default_clear_user_field(a, b, c) (forget_shm_user(a), dflt_iface->clear_user_field(uldb_default->data, a, b, c))
+#define default_clear_user_info_field(a, b, c, d, e) (forget_shm_user(a), dflt_iface->clear_user_info_field(uldb_default->data, a, b, c, d, e))
 #define default_clear_member_field(a, b, c, d, e, f) dflt_iface->clear_user_member_field(uldb_default->data, a, b, c, d, e, f)
-#define default_set_user_field(a, b, c, d) dflt_iface->set_user_field(uldb_default->data, a, b, c, d)
-#define default_set_user_info_field(a, b, c, d, e, f) dflt_iface->set_user_info_field(uldb_default->data, a, b, c, d, e, f)
+#define default_set_user_field(a, b, c, d) (forget_shm_user(a), dflt_iface->set_user_field(uldb_default->data, a, b, c, d))
+#define default_set_user_info_field(a, b, c, d, e, f) (forget_shm_user(a), dflt_iface->set_user_info_field(uldb_default->data, a, b, c, d, e, f))
 #define default_set_user_member_field(a, b, c, d, e, f, g) dflt_iface->set_user_member_field(uldb_default->data, a, b, c, d, e, f, g)
 #define default_new_member(a, b, c, d, e) dflt_iface->new_member(uldb_default->data, a, b, c, d, e)
-#define default_set_user_xml(a, b, c, d, e) dflt_iface->set_user_xml(uldb_default->data, a, b, c, d, e)
-#define default_copy_user_info(a, b, c, d, e, f) dflt_iface->copy_user_info(uldb_default->data, a, b, c, d, e, f)
+#define default_set_user_xml(a, b, c, d, e) (forget_shm_user(a), dflt_iface->set_user_xml(uldb_default->data, a, b, c, d, e))
+#define default_copy_user_info(a, b, c, d, e, f) (forget_shm_user(a), dflt_iface->copy_user_info(uldb_default->data, a, b, c, d, e, f))
 #define default_check_user_reg_data(a, b) dflt_iface->check_user_reg_data(uldb_default->data, a, b)
 #define default_move_member(a, b, c, d, e, f) dflt_iface->move_member(uldb_default->data, a, b, c, d, e, f)
 #define default_get_user_info_6(a, b, c, d, e, f) dflt_iface->get_user_info_6(uldb_default->data, a, b, c, d, e, f)
@@ -608,7 +713,7 @@ link_client_state(struct client_state *p)
 #define default_unlock_user(a) dflt_iface->unlock_user(uldb_default->data, a)
 #define default_get_contest_reg(a, b) dflt_iface->get_contest_reg(uldb_default->data, a, b)
 #define default_try_new_login(a, b, c, d, e) dflt_iface->try_new_login(uldb_default->data, a, b, c, d, e)
-#define default_set_simple_reg(a, b, c) dflt_iface->set_simple_reg(uldb_default->data, a, b, c)
+#define default_set_simple_reg(a, b, c) (forget_shm_user(a), dflt_iface->set_simple_reg(uldb_default->data, a, b, c))
 #define default_get_brief_list_iterator_2(a, b, c, d, e, f, g, h, i, j) dflt_iface->get_brief_list_iterator_2(uldb_default->data, a, b, c, d, e, f, g, h, i, j)
 #define default_get_user_count(a, b, c, d, e, f, g) dflt_iface->get_user_count(uldb_default->data, a, b, c, d, e, f, g)
 #define default_get_group_iterator_2(a, b, c) dflt_iface->get_group_iterator_2(uldb_default->data, a, b, c)
@@ -625,7 +730,7 @@ update_all_user_contests(int user_id)
        iter->has_next(iter);
        iter->next(iter)) {
     c = (const struct userlist_contest *) iter->get(iter);
-    update_userlist_table(c->id);
+    update_userlist_table(c->id, user_id);
   }
 }
 
@@ -843,6 +948,7 @@ enqueue_reply_to_client_2(
 
 static void report_uptime(time_t t1, time_t t2);
 static void cleanup_clients(void);
+static void close_shm(void);
 static void
 graceful_exit(void)
 {
@@ -850,6 +956,7 @@ graceful_exit(void)
     unlink(config->socket_path);
   }
   if (listen_socket >= 0) close(listen_socket);
+  close_shm();
   cleanup_clients();
   random_cleanup();
   dflt_iface->close(uldb_default->data);
@@ -1151,6 +1258,19 @@ check_pk_map_contest(
   return 0;
 }
 
+static int
+check_pk_list_users_delta(
+        struct client_state *p,
+        int pkt_len,
+        struct userlist_pk_list_users_delta *data)
+{
+  if (pkt_len != sizeof(*data)) {
+    CONN_BAD("packet length mismatch");
+    return -1;
+  }
+  return 0;
+}
+
 static int
 check_pk_edit_field(
         struct client_state *p,
@@ -2711,7 +2831,7 @@ do_remove_user(const struct userlist_user *u)
        iter->next(iter)) {
     reg = (struct userlist_contest*) iter->get(iter);
     if (reg->status == USERLIST_REG_OK)
-      update_userlist_table(reg->id);
+      update_userlist_table(reg->id, u->id);
   }
 
   //remove_from_system_uid_map(u->id);
@@ -5177,6 +5297,157 @@ cmd_list_standings_users_2(
   info("%s -> OK, size = %u, time = %llu", logbuf, (unsigned) header->pkt_size, (ms2 - ms1));
 }
 
+static void
+marshall_standings_users(UserlistBinaryContext *cntx, int contest_id)
+{
+  ptr_iterator_t iter;
+  const struct userlist_user *u;
+
+  for (iter = default_get_standings_list_iterator(contest_id);
+       iter->has_next(iter);
+       iter->next(iter)) {
+    u = (const struct userlist_user*) iter->get(iter);
+    userlist_bin_marshall_user(cntx, u, contest_id);
+    default_unlock_user(u);
+  }
+  iter->destroy(iter);
+}
+
+/* the standings user list is (re)published in the shared memory */
+static void
+publish_users_shm(struct new_contest_extra *ne)
+{
+  UserlistBinaryContext cntx;
+
+  ne->shm_dirty = 0;
+  userlist_bin_init_context(&cntx);
+  userlist_bin_marshall_user_list(&cntx, NULL, ne->id);
+  marshall_standings_users(&cntx, ne->id);
+  userlist_bin_finish_context(&cntx);
+
+  if (!ne->shm
+      || userlist_shm_publish_users(ne->shm, &cntx, ne->change_vintage) < 0) {
+    // the readers note, that the old segment is dead
+    ne->shm = userlist_shm_close(ne->shm);
+    ne->shm = userlist_shm_create(config->socket_path, ne->id,
+                                  cntx.total_size * 2 + 65536);
+    if (ne->shm) {
+      userlist_shm_touch(ne->shm, cur_time, config->enable_cookie_ip_check > 0);
+      userlist_shm_publish_users(ne->shm, &cntx, ne->change_vintage);
+    }
+  }
+  userlist_bin_destroy_context(&cntx);
+}
+
+static void
+update_shm(void)
+{
+  static time_t last_touch_time;
+  int ip_check = config->enable_cookie_ip_check > 0;
+
+  if (!cookie_shm) return;
+
+  for (size_t i = 1; i < new_contest_extras_size; ++i) {
+    struct new_contest_extra *ne = new_contest_extras[i];
+    if (!ne || !ne->shm) continue;
+    if (ne->shm_dirty) publish_users_shm(ne);
+    if (ne->shm && cur_time != last_touch_time)
+      userlist_shm_touch(ne->shm, cur_time, ip_check);
+  }
+  if (cur_time != last_touch_time) {
+    userlist_shm_touch(cookie_shm, cur_time, ip_check);
+    last_touch_time = cur_time;
+  }
+}
+
+static void
+close_shm(void)
+{
+  for (size_t i = 1; i < new_contest_extras_size; ++i) {
+    struct new_contest_extra *ne = new_contest_extras[i];
+    if (ne) ne->shm = userlist_shm_close(ne->shm);
+  }
+  cookie_shm = userlist_shm_close(cookie_shm);
+}
+
+/* like LIST_STANDINGS_USERS_2, but only the users changed since
+   the vintage of the client are sent, if the change journal allows,
+   the changed users, which are not in the standings list (see
+   standings_list_do_skip in uldb_plugin_xml.c), are removed */
+static void
+cmd_list_standings_users_3(
+        struct client_state *p,
+        int pkt_len,
+        struct userlist_pk_list_users_delta *data)
+{
+  const struct contest_desc *cnts = 0;
+  unsigned char logbuf[1024];
+  const struct userlist_user *u;
+  UserlistBinaryContext cntx;
+  struct timeval ts1, ts2;
+  struct new_contest_extra *ne;
+  int *ids = NULL;
+  int count = 0, delta_mode = 0;
+
+  snprintf(logbuf, sizeof(logbuf), "PRIV_STANDINGS_USERS_3: %d, %d, %d",
+           p->user_id, data->contest_id, data->vintage);
+
+  gettimeofday(&ts1, NULL);
+
+  if (is_admin(p, logbuf) < 0) return;
+  if (full_get_contest(p, logbuf, &data->contest_id, &cnts) < 0) return;
+  if (is_cnts_capable(p, cnts, OPCAP_MAP_CONTEST, logbuf) < 0) return;
+
+  ne = new_contest_extra_get(data->contest_id);
+  if (get_user_changes(ne, data->vintage, &ids, &count) >= 0) {
+    delta_mode = 1;
+  }
+
+  userlist_bin_init_context(&cntx);
+  userlist_bin_marshall_user_list(&cntx, NULL, data->contest_id);
+  if (delta_mode) {
+    for (int i = 0; i < count; ++i) {
+      const struct userlist_contest *c = default_get_contest_reg(ids[i], data->contest_id);
+      if (!c || c->status != USERLIST_REG_OK) continue;
+      u = NULL;
+      if (default_get_user_info_5(ids[i], data->contest_id, &u) >= 0 && u) {
+        userlist_bin_marshall_user(&cntx, u, data->contest_id);
+        default_unlock_user(u);
+      }
+    }
+    userlist_bin_marshall_delta(&cntx, ids, count);
+  } else {
+    marshall_standings_users(&cntx, data->contest_id);
+  }
+  userlist_bin_finish_context(&cntx);
+
+  unsigned char *msg = xmalloc(cntx.total_size + 4);
+  UserlistBinaryHeader *header = userlist_bin_marshall(msg + 4, &cntx, data->contest_id);
+  header->reply_id = ULS_BIN_DATA;
+  header->vintage = ne->change_vintage;
+  userlist_bin_destroy_context(&cntx);
+  xfree(ids);
+
+  gettimeofday(&ts2, NULL);
+
+  unsigned long long ms1 = ts1.tv_sec * 1000000ULL;
+  ms1 += ts1.tv_usec;
+  unsigned long long ms2 = ts2.tv_sec * 1000000ULL;
+  ms2 += ts2.tv_usec;
+
+  enqueue_reply_to_client_2(p, header->pkt_size, msg);
+  if (delta_mode) {
+    info("%s -> OK, delta of %d users, size = %u, time = %llu", logbuf,
+         count, (unsigned) header->pkt_size, (ms2 - ms1));
+  } else {
+    info("%s -> OK, size = %u, time = %llu", logbuf,
+         (unsigned) header->pkt_size, (ms2 - ms1));
+  }
+
+  // the next requests of the contest are served from the shared memory
+  if (cookie_shm && !ne->shm) publish_users_shm(ne);
+}
+
 static void
 cmd_get_user_contests(struct client_state *p,
                       int pkt_len,
@@ -5558,7 +5829,7 @@ cmd_register_contest(
 
   default_check_user_reg_data(data->user_id, data->contest_id);
   if (r->status == USERLIST_REG_OK) {
-    update_userlist_table(data->contest_id);
+    update_userlist_table(data->contest_id, data->user_id);
   }
   info("%s -> OK", logbuf);
   send_reply(p, ULS_OK);
@@ -5632,7 +5903,7 @@ cmd_register_contest_2(
 
   default_check_user_reg_data(data->user_id, data->contest_id);
   r = default_get_contest_reg(data->user_id, data->contest_id);
-  update_userlist_table(data->contest_id);
+  update_userlist_table(data->contest_id, data->user_id);
   info("%s -> OK", logbuf);
   send_reply(p, ULS_OK);
   return;
@@ -5681,7 +5952,7 @@ cmd_priv_register_contest(
   }
 
   if (r && r->status == USERLIST_REG_OK) {
-    update_userlist_table(data->contest_id);
+    update_userlist_table(data->contest_id, data->user_id);
   }
   info("%s -> OK", logbuf);
   send_reply(p, ULS_OK);
@@ -5736,7 +6007,7 @@ cmd_delete_member(struct client_state *p, int pkt_len,
     return send_reply(p, -ULS_ERR_UNSPECIFIED_ERROR);
   }
 
-  update_userlist_table(data->contest_id);
+  update_userlist_table(data->contest_id, data->user_id);
   if (cloned_flag) reply_code = ULS_CLONED;
   info("%s -> OK", logbuf);
   send_reply(p, reply_code);
@@ -6693,7 +6964,7 @@ cmd_map_contest(
   out->sem_key = 0;
   out->shm_key = ex->shm_key;
   enqueue_reply_to_client(p, out_size, out);
-  update_userlist_table(data->contest_id);
+  update_userlist_table(data->contest_id, 0);
   info("%s -> OK, %d", logbuf, (int) ex->shm_key);
 }
 
@@ -6933,7 +7204,7 @@ cmd_generate_register_passwords_2(
     generate_random_password(8, buf);
     default_set_reg_passwd(u->id, USERLIST_PWD_PLAIN, buf, cur_time);
   }
-  update_userlist_table(data->contest_id);
+  update_userlist_table(data->contest_id, 0);
   info("%s -> OK", logbuf);
   send_reply(p, ULS_OK);
 }
@@ -6995,7 +7266,7 @@ cmd_generate_team_passwords_2(
     default_set_team_passwd(u->id, data->contest_id, USERLIST_PWD_PLAIN,
                             buf, cur_time, NULL);
   }
-  update_userlist_table(data->contest_id);
+  update_userlist_table(data->contest_id, 0);
   info("%s -> OK", logbuf);
   send_reply(p, ULS_OK);
 }
@@ -7263,7 +7534,7 @@ cmd_edit_registration(struct client_state *p, int pkt_len,
     if (!(data->new_flags & USERLIST_UC_PRIVILEGED) && !(data->new_flags & USERLIST_UC_INCOMPLETE))
       default_check_user_reg_data(data->user_id, data->contest_id);
   }
-  update_userlist_table(data->contest_id);
+  update_userlist_table(data->contest_id, data->user_id);
   info("%s -> OK", logbuf);
   send_reply(p, ULS_OK);
 }
@@ -7358,7 +7629,7 @@ cmd_priv_delete_member(struct client_state *p, int pkt_len,
   }
   default_check_user_reg_data(data->user_id, data->contest_id);
   if (r == 1) {
-    update_userlist_table(data->contest_id);
+    update_userlist_table(data->contest_id, data->user_id);
   }
   if (cloned_flag) reply_code = ULS_CLONED;
   send_reply(p, reply_code);
@@ -7455,7 +7726,7 @@ cmd_delete_user_info(struct client_state *p, int pkt_len,
   if (is_dbcnts_capable(p, cnts, capbit, logbuf) < 0) return;
 
   if ((r=default_remove_user_contest_info(data->user_id, data->contest_id))== 1)
-    update_userlist_table(data->contest_id);
+    update_userlist_table(data->contest_id, data->user_id);
   default_check_user_reg_data(data->user_id, data->contest_id);
   send_reply(p, ULS_OK);
   info("%s -> OK, %d", logbuf, r);
@@ -7540,7 +7811,7 @@ cmd_delete_field(
       send_reply(p, -ULS_ERR_CANNOT_DELETE);
       return;
     }
-    update_userlist_table(data->contest_id);
+    update_userlist_table(data->contest_id, data->user_id);
     goto done;
   }
 
@@ -7632,7 +7903,7 @@ cmd_edit_field(
                                          &cloned_flag))<0)
       goto cannot_change;
     if (r > 0 && data->contest_id > 0)
-      update_userlist_table(data->contest_id);
+      update_userlist_table(data->contest_id, data->user_id);
     goto done;
   }
 
@@ -7643,7 +7914,7 @@ cmd_edit_field(
                                            &cloned_flag)) < 0)
       goto cannot_change;
     if (r > 0 && data->contest_id > 0)
-      update_userlist_table(data->contest_id);
+      update_userlist_table(data->contest_id, data->user_id);
     goto done;
   }
 
@@ -8187,7 +8458,7 @@ cmd_copy_all(
   default_check_user_reg_data(user_id, to_contest_id);
 
   if (to_uc && to_uc->status == USERLIST_REG_OK) {
-    update_userlist_table(to_contest_id);
+    update_userlist_table(to_contest_id, user_id);
   }
 
   info("%s -> OK", logbuf);
@@ -8365,6 +8636,9 @@ cmd_get_cookie(
   int cookie_is_ws = 0;
   int cookie_is_job = 0;
   time_t cookie_expire = 0;
+  ej_cookie_t cookie_client_key;
+  ej_ip_t cookie_ip;
+  int cookie_ssl;
 
   if (pkt_len != sizeof(*data)) {
     CONN_BAD("bad packet length: %d", pkt_len);
@@ -8409,6 +8683,9 @@ cmd_get_cookie(
   cookie_is_ws = cookie->is_ws;
   cookie_is_job = cookie->is_job;
   cookie_expire = cookie->expire;
+  cookie_client_key = cookie->client_key;
+  cookie_ip = cookie->ip;
+  cookie_ssl = cookie->ssl;
 
   if (default_get_user_info_3(cookie->user_id, new_contest_id, &u, &ui, &c) < 0
       || !u)
@@ -8504,6 +8781,13 @@ cmd_get_cookie(
 
   enqueue_reply_to_client(p, out_size, out);
 
+  // the repeated checks have no side effects, so they are served
+  // by ej-contests until the cookie or the user is changed
+  if (cookie_shm && data->client_key && data->client_key == cookie_client_key) {
+    userlist_shm_put_cookie(cookie_shm, data->request_id, &cookie_ip,
+                            cookie_ssl, out, out_size);
+  }
+
   /*
   if (!daemon_mode) {
     CONN_INFO("%s -> OK, %d, %s, %d, %llu us", logbuf, user_id, user_login,
@@ -9432,7 +9716,7 @@ cmd_move_member(struct client_state *p, int pkt_len,
   }
   default_check_user_reg_data(data->user_id, data->contest_id);
   if (r == 1) {
-    update_userlist_table(data->contest_id);
+    update_userlist_table(data->contest_id, data->user_id);
   }
   if (cloned_flag) reply_code = ULS_CLONED;
   send_reply(p, reply_code);
@@ -11466,6 +11750,7 @@ static void (*cmd_table[])() =
   [ULS_DELETE_API_KEY] =        cmd_delete_api_key,
   [ULS_PRIV_CREATE_COOKIE] =    cmd_priv_create_cookie,
   [ULS_COPY_ALL] =              cmd_copy_all,
+  [ULS_LIST_STANDINGS_USERS_3] =cmd_list_standings_users_3,
 
   [ULS_LAST_CMD] = 0
 };
@@ -11579,6 +11864,7 @@ static int (*check_table[])() =
   [ULS_DELETE_API_KEY] =        check_pk_api_key_data,
   [ULS_PRIV_CREATE_COOKIE] =    NULL,
   [ULS_COPY_ALL] =              check_pk_edit_field,
+  [ULS_LIST_STANDINGS_USERS_3] =check_pk_list_users_delta,
 
   [ULS_LAST_CMD] = 0
 };
@@ -11699,6 +11985,8 @@ do_work(void)
   last_cookie_check = 0;
   cookie_check_interval = 0;
 
+  cookie_shm = userlist_shm_create(config->socket_path, 0, 0);
+
   info("initialization is ok, now serving requests");
 
   while (1) {
@@ -11765,6 +12053,9 @@ do_work(void)
       disconnect_client(p);
     }
     */
+    /* the observers reread the published user lists */
+    update_shm();
+
     /* check, that there exist outstanding observer events */
     check_observers();
 
@@ -12388,6 +12679,7 @@ main(int argc, char *argv[])
 
   if (socket_name) unlink(socket_name);
   if (listen_socket >= 0) close(listen_socket);
+  close_shm();
   cleanup_clients();
   random_cleanup();
   ejudge_cfg_free(config);
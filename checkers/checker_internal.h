@@ -117,6 +117,13 @@ extern char *dir_out_path;
 
 void checker_do_init(int, char **, int, int, int);
 
+/* glibc maps regular files into memory when opened in "m" mode */
+#if defined __GLIBC__
+#define CHECKER_READ_MODE "rm"
+#else
+#define CHECKER_READ_MODE "r"
+#endif
+
 #ifdef __GNUC__
 #define LIBCHECKER_ATTRIB(x) __attribute__(x)
 #else
@@ -166,6 +173,9 @@ int  checker_read_buf(int, const char *, int,
         LIBCHECKER_ATTRIB((deprecated));
 char *checker_read_buf_2(int ind, const char *name, int eof_error_flag,
                          char *sbuf, size_t ssz, char **pdbuf, size_t *pdsz);
+const char *checker_read_token(int ind, int eof_error_flag, size_t *p_len);
+int checker_parse_dec(const char *s, size_t len, int *p_neg,
+                      libchecker_u64_t *p_val);
 
 void checker_in_open(const char *path);
 void checker_out_open(const char *path);
@@ -30,7 +30,7 @@ checker_corr_open(const char *path)
   if (f_arr[2]) fclose(f_arr[2]);
   f_arr[2] = 0;
 
-  if (!(f_corr = fopen(path, "r"))) {
+  if (!(f_corr = fopen(path, CHECKER_READ_MODE))) {
     fatal_CF(_("%s: cannot open %s for reading"), gettext(f_arr_names[2]), path);
   }
   f_arr[2] = f_corr;
@@ -47,17 +47,17 @@ checker_do_init(int argc, char **argv, int corr_flag, int info_flag,
   if (argc < need_arg)
     fatal_CF(_("Invalid number of arguments: %d instead of %d"), argc, need_arg);
 
-  if (!(f_in = fopen(argv[1], "r")))
+  if (!(f_in = fopen(argv[1], CHECKER_READ_MODE)))
     fatal_CF(_("Cannot open input file '%s'"), argv[1]);
   f_arr[0] = f_in;
-  if (!(f_out = fopen(argv[2], "r")))
+  if (!(f_out = fopen(argv[2], CHECKER_READ_MODE)))
     fatal_PE(_("Cannot open output file '%s'"), argv[2]);
   f_arr[1] = f_out;
   // backward compatibility
   f_team = f_out;
 
   if (corr_flag) {
-    if (!(f_corr = fopen(argv[arg_ind], "r")))
+    if (!(f_corr = fopen(argv[arg_ind], CHECKER_READ_MODE)))
       fatal_CF(_("Cannot open correct output file '%s'"), argv[arg_ind]);
     f_arr[2] = f_corr;
     arg_ind++;
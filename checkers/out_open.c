@@ -30,7 +30,7 @@ checker_out_open(const char *path)
   if (f_arr[1]) fclose(f_arr[1]);
   f_arr[1] = 0;
 
-  if (!(f_out = fopen(path, "r")))
+  if (!(f_out = fopen(path, CHECKER_READ_MODE)))
     fatal_PE(_("%s: cannot open %s for reading"), gettext(f_arr_names[1]), path);
   f_arr[1] = f_out;
 }
@@ -39,38 +39,17 @@ checker_read_buf_2(
         char **pdbuf,
         size_t *pdsz)
 {
-  int c, i = 0;
+  const char *tb;
+  size_t tl = 0;
   char *dbuf = 0;
   size_t dsz = 0;
 
-  c = getc(f_arr[ind]);
-  while (isspace(c)) c = getc(f_arr[ind]);
-  if (ferror(f_arr[ind])) {
-    fatal_CF(_("%s: input error"), gettext(f_arr_names[ind]));
-  }
-  if (feof(f_arr[ind])) {
-    if (eof_error_flag) fatal_read(ind, _("Unexpected EOF"));
-    else return 0;
-  }
-
-  if (c < ' ') fatal_read(ind, _("Invalid control character %d"), c);
+  if (!(tb = checker_read_token(ind, eof_error_flag, &tl))) return 0;
 
   if (sbuf && ssz > 1) {
-    while (c != EOF && !isspace(c) && i + 1 < ssz) {
-      if (c < ' ') fatal_read(ind, _("Invalid control character %d"), c);
-      sbuf[i++] = c;
-      c = getc(f_arr[ind]);
-    }
-    if (c == EOF) {
-      if (ferror(f_arr[ind])) {
-        fatal_CF(_("%s: input error"), gettext(f_arr_names[ind]));
-      }
-      sbuf[i] = 0;
-      return sbuf;
-    }
-    if (isspace(c)) {
-      ungetc(c, f_arr[ind]);
-      sbuf[i] = 0;
+    if (tl < ssz) {
+      memcpy(sbuf, tb, tl);
+      sbuf[tl] = 0;
       return sbuf;
     }
     if (!pdbuf || !pdsz) fatal_read(ind, _("Input element is too long"));
@@ -82,31 +61,14 @@ checker_read_buf_2(
   dsz = *pdsz;
   if (!dbuf || !dsz) {
     dsz = 32;
-    while (i >= dsz) dsz *= 2;
+    while (tl >= dsz) dsz *= 2;
     dbuf = (char *) xmalloc(dsz);
-  } else {
-    while (i >= dsz) dsz *= 2;
+  } else if (tl >= dsz) {
+    while (tl >= dsz) dsz *= 2;
     dbuf = (char*) xrealloc(dbuf, dsz);
   }
-  if (i > 0) memcpy(dbuf, sbuf, i + 1);
-
-  while (c != EOF && !isspace(c)) {
-    if (c < ' ') fatal_read(ind, _("Invalid control character %d"), c);
-    if (i + 1 >= dsz) {
-      dsz *= 2;
-      dbuf = (char*) xrealloc(dbuf, dsz);
-    }
-    dbuf[i++] = c;
-    c = getc(f_arr[ind]);
-  }
-  if (c == EOF) {
-    if (ferror(f_arr[ind])) {
-      fatal_CF(_("%s: input error"), gettext(f_arr_names[ind]));
-    }
-  } else {
-    ungetc(c, f_arr[ind]);
-  }
-  dbuf[i] = 0;
+  memcpy(dbuf, tb, tl);
+  dbuf[tl] = 0;
   *pdbuf = dbuf;
   *pdsz = dsz;
   return dbuf;
@@ -16,8 +16,6 @@
 
 #include "checker_internal.h"
 
-#include <errno.h>
-
 #include "l10n_impl.h"
 
 int
@@ -27,24 +25,20 @@ checker_read_int(
         int eof_error_flag,
         int *p_val)
 {
-  long x;
-  char sb[128], *db = 0, *vb = 0, *ep = 0;
-  size_t ds = 0;
+  const char *tb;
+  size_t tl = 0;
+  libchecker_u64_t x = 0;
+  int neg = 0, r;
 
   if (!name) name = "";
-  vb = checker_read_buf_2(ind, name, eof_error_flag, sb, sizeof(sb), &db, &ds);
-  if (!vb) return -1;
-  if (!*vb) {
-    fatal_read(ind, _("%s: no int32 value"), name);
-  }
-  errno = 0;
-  x = strtol(vb, &ep, 10);
-  if (*ep) {
+  if (!(tb = checker_read_token(ind, eof_error_flag, &tl))) return -1;
+  r = checker_parse_dec(tb, tl, &neg, &x);
+  if (!r) {
     fatal_read(ind, _("%s: cannot parse int32 value"), name);
   }
-  if (errno || (int) x != x) {
+  if (r < 0 || x > (neg?2147483648ULL:2147483647ULL)) {
     fatal_read(ind, _("%s: int32 value is out of range"), name);
   }
-  *p_val = x;
+  *p_val = neg?(int) -(libchecker_i64_t) x:(int) x;
   return 1;
 }
@@ -17,8 +17,6 @@
 
 #include "checker_internal.h"
 
-#include <errno.h>
-
 #include "l10n_impl.h"
 
 int
@@ -28,20 +26,20 @@ checker_read_long_long(
         int eof_error_flag,
         long long *p_val)
 {
-  long long x;
-  char sb[128], *db = 0, *vb = 0, *ep = 0;
-  size_t ds = 0;
+  const char *tb;
+  size_t tl = 0;
+  libchecker_u64_t x = 0;
+  int neg = 0, r;
 
   if (!name) name = "";
-  vb = checker_read_buf_2(ind, name, eof_error_flag, sb, sizeof(sb), &db, &ds);
-  if (!vb) return -1;
-  if (!*vb) {
-    fatal_read(ind, _("%s: no int64 value"), name);
+  if (!(tb = checker_read_token(ind, eof_error_flag, &tl))) return -1;
+  r = checker_parse_dec(tb, tl, &neg, &x);
+  if (!r) {
+    fatal_read(ind, _("%s: cannot parse int64 value"), name);
+  }
+  if (r < 0 || x > (neg?9223372036854775808ULL:9223372036854775807ULL)) {
+    fatal_read(ind, _("%s: int64 value is out of range"), name);
   }
-  errno = 0;
-  x = strtoll(vb, &ep, 10);
-  if (*ep) fatal_read(ind, _("%s: cannot parse int64 value"), name);
-  if (errno) fatal_read(ind, _("%s: int64 value is out of range"), name);
-  *p_val = x;
+  *p_val = neg?-(libchecker_i64_t) (x - 1) - 1:(libchecker_i64_t) x;
   return 1;
 }
@@ -0,0 +1,230 @@
+/* -*- mode: c -*- */
+
+/* Copyright (C) 2024 Alexander Chernov <cher@ejudge.ru> */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "checker_internal.h"
+
+#include "l10n_impl.h"
+
+#if defined __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * glibc exposes the get area of a stream, so the tokens are scanned
+ * right in the stdio buffer (which is the whole file, when the file
+ * is opened with CHECKER_READ_MODE), the other libcs read char by char
+ */
+#if defined __GLIBC__
+#define HAS_GET_AREA 1
+#endif
+
+/* the tokens crossing the stdio buffer boundary are collected here */
+static char *spill_buf;
+static size_t spill_size;
+
+static void
+spill_append(size_t len, const unsigned char *data, size_t size)
+{
+  if (len + size >= spill_size) {
+    if (!spill_size) spill_size = 128;
+    while (len + size >= spill_size) spill_size *= 2;
+    spill_buf = (char*) xrealloc(spill_buf, spill_size);
+  }
+  memcpy(spill_buf + len, data, size);
+}
+
+#if defined HAS_GET_AREA
+/* skips ' ' and '\n', the other whitespace is handled by the caller */
+static const unsigned char *
+skip_blanks(const unsigned char *p, const unsigned char *e)
+{
+#if defined __SSE2__
+  const __m128i sp = _mm_set1_epi8(' ');
+  const __m128i nl = _mm_set1_epi8('\n');
+
+  while (e - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *) p);
+    unsigned m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, sp),
+                                                _mm_cmpeq_epi8(v, nl)));
+    if (m != 0xffff) return p + __builtin_ctz(~m);
+    p += 16;
+  }
+#endif
+  while (p < e && (*p == ' ' || *p == '\n')) ++p;
+  return p;
+}
+
+/* returns the first char, which is either a whitespace or a control char */
+static const unsigned char *
+find_blank(const unsigned char *p, const unsigned char *e)
+{
+#if defined __SSE2__
+  const __m128i sp = _mm_set1_epi8(' ');
+
+  while (e - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *) p);
+    unsigned m = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, sp), v));
+    if (m) return p + __builtin_ctz(m);
+    p += 16;
+  }
+#endif
+  while (p < e && *p > ' ') ++p;
+  return p;
+}
+#endif
+
+/**
+   read a token (i.e. sequence of chars except whitespace) without copying
+   \param ind input stream index (0 - test in, 1 - program out, 2 - correct)
+   \param eof_error_flag if TRUE, EOF condition is error
+   \param p_len pointer to the token length
+   \return the token (not \0-terminated), valid until the next read
+   from any stream, or NULL on EOF
+ */
+const char *
+checker_read_token(int ind, int eof_error_flag, size_t *p_len)
+{
+  FILE *f = f_arr[ind];
+  int c;
+  size_t len = 0;
+
+#if defined HAS_GET_AREA
+  const unsigned char *p, *e, *q;
+
+  while (1) {
+    p = (const unsigned char *) f->_IO_read_ptr;
+    e = (const unsigned char *) f->_IO_read_end;
+    p = skip_blanks(p, e);
+    while (p < e && *p < ' ' && isspace(*p)) p = skip_blanks(p + 1, e);
+    f->_IO_read_ptr = (char*) p;
+    if (p < e) break;
+
+    // the buffer is exhausted, refill it
+    c = getc(f);
+    if (c == EOF) goto check_eof;
+    if (!isspace(c)) {
+      ungetc(c, f);
+      if (f->_IO_read_ptr >= f->_IO_read_end) goto start_token;
+    }
+  }
+
+  q = find_blank(p, e);
+  if (q < e) {
+    f->_IO_read_ptr = (char*) q;
+    if (!isspace(*q)) fatal_read(ind, _("Invalid control character %d"), *q);
+    *p_len = q - p;
+    return (const char*) p;
+  }
+
+  // the token may continue after the buffer end
+  len = e - p;
+  spill_append(0, p, len);
+  f->_IO_read_ptr = (char*) e;
+  c = getc(f);
+  goto read_rest;
+
+start_token:
+#endif
+  c = getc(f);
+  while (isspace(c)) c = getc(f);
+
+#if defined HAS_GET_AREA
+check_eof:
+#endif
+  if (ferror(f)) {
+    fatal_CF(_("%s: input error"), gettext(f_arr_names[ind]));
+  }
+  if (c == EOF) {
+    if (eof_error_flag) fatal_read(ind, _("Unexpected EOF"));
+    return NULL;
+  }
+
+#if defined HAS_GET_AREA
+read_rest:
+#endif
+  while (c != EOF && !isspace(c)) {
+    unsigned char b = c;
+    if (c < ' ') fatal_read(ind, _("Invalid control character %d"), c);
+    spill_append(len++, &b, 1);
+    c = getc(f);
+  }
+  if (c == EOF) {
+    if (ferror(f)) {
+      fatal_CF(_("%s: input error"), gettext(f_arr_names[ind]));
+    }
+  } else {
+    ungetc(c, f);
+  }
+  *p_len = len;
+  return spill_buf;
+}
+
+/**
+   parse a decimal number the way strtoull with base 10 does
+   \param s the token
+   \param len the token length
+   \param p_neg set, if the token starts with '-'
+   \param p_val the absolute value
+   \return 1 on success, 0 on syntax error, -1 if the value does not
+   fit into 64 bits
+ */
+int
+checker_parse_dec(
+        const char *s,
+        size_t len,
+        int *p_neg,
+        libchecker_u64_t *p_val)
+{
+  const unsigned char *p = (const unsigned char *) s, *e = p + len;
+  libchecker_u64_t v = 0, d;
+  int ovf = 0;
+
+  *p_neg = 0;
+  if (p < e && (*p == '+' || *p == '-')) {
+    *p_neg = (*p == '-');
+    ++p;
+  }
+  if (p == e) return 0;
+  while (p < e && *p == '0') ++p;
+
+#if defined __BYTE_ORDER__ && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  // eight digits at a time
+  while (e - p >= 8) {
+    libchecker_u64_t x;
+    memcpy(&x, p, 8);
+    if ((x & 0xF0F0F0F0F0F0F0F0ULL) != 0x3030303030303030ULL
+        || ((x + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) != 0x3030303030303030ULL)
+      break;
+    x -= 0x3030303030303030ULL;
+    x = x * 10 + (x >> 8);
+    x = (((x & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32)))
+         + (((x >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+    if (v > (~0ULL - x) / 100000000ULL) ovf = 1;
+    else v = v * 100000000ULL + x;
+    p += 8;
+  }
+#endif
+
+  for (; p < e; ++p) {
+    d = *p - '0';
+    if (d > 9) return 0;
+    if (v > (~0ULL - d) / 10) ovf = 1;
+    else v = v * 10 + d;
+  }
+  if (ovf) return -1;
+  *p_val = v;
+  return 1;
+}
@@ -16,8 +16,6 @@
 
 #include "checker_internal.h"
 
-#include <errno.h>
-
 #include "l10n_impl.h"
 
 int
@@ -27,28 +25,23 @@ checker_read_unsigned_int(
         int eof_error_flag,
         unsigned int *p_val)
 {
-  unsigned long x;
-  char sb[128], *db = 0, *vb = 0, *ep = 0;
-  size_t ds = 0;
+  const char *tb;
+  size_t tl = 0;
+  libchecker_u64_t x = 0;
+  int neg = 0, r;
 
   if (!name) name = "";
-  vb = checker_read_buf_2(ind, name, eof_error_flag, sb, sizeof(sb), &db, &ds);
-  if (!vb) return -1;
-  if (!*vb) {
-    fatal_read(ind, _("%s: no uint32 value"), name);
-  }
-
-  if (vb[0] == '-') {
+  if (!(tb = checker_read_token(ind, eof_error_flag, &tl))) return -1;
+  r = checker_parse_dec(tb, tl, &neg, &x);
+  if (neg) {
     fatal_read(ind, _("%s: `-' before uint32 value"), name);
   }
-  errno = 0;
-  x = strtoul(vb, &ep, 10);
-  if (*ep) {
+  if (!r) {
     fatal_read(ind, _("%s: cannot parse uint32 value"), name);
   }
-  if (errno || (unsigned) x != x) {
+  if (r < 0 || x > 4294967295ULL) {
     fatal_read(ind, _("%s: uint32 value is out of range"), name);
   }
-  *p_val = x;
+  *p_val = (unsigned) x;
   return 1;
 }
@@ -32,6 +32,8 @@ checker_read_unsigned_int_2(
   char sb[128], *db = 0, *vb = 0, *ep = 0;
   size_t ds = 0;
 
+  if (base == 10) return checker_read_unsigned_int(ind, name, eof_error_flag, p_val);
+
   if (!name) name = "";
   vb = checker_read_buf_2(ind, name, eof_error_flag, sb, sizeof(sb), &db, &ds);
   if (!vb) return -1;
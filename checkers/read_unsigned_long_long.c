@@ -17,8 +17,6 @@
 
 #include "checker_internal.h"
 
-#include <errno.h>
-
 #include "l10n_impl.h"
 
 int
@@ -28,25 +26,21 @@ checker_read_unsigned_long_long(
         int eof_error_flag,
         unsigned long long *p_val)
 {
-  unsigned long long x;
-  char sb[128], *db = 0, *vb = 0, *ep = 0;
-  size_t ds = 0;
+  const char *tb;
+  size_t tl = 0;
+  libchecker_u64_t x = 0;
+  int neg = 0, r;
 
   if (!name) name = "";
-  vb = checker_read_buf_2(ind, name, eof_error_flag, sb, sizeof(sb), &db, &ds);
-  if (!vb) return -1;
-  if (!*vb) {
-    fatal_read(ind, _("%s: no uint64 value"), name);
-  }
-  if (vb[0] == '-') {
+  if (!(tb = checker_read_token(ind, eof_error_flag, &tl))) return -1;
+  r = checker_parse_dec(tb, tl, &neg, &x);
+  if (neg) {
     fatal_read(ind, _("%s: `-' before uint64 value"), name);
   }
-  errno = 0;
-  x = strtoull(vb, &ep, 10);
-  if (*ep) {
+  if (!r) {
     fatal_read(ind, _("%s: cannot parse uint64 value"), name);
   }
-  if (errno) {
+  if (r < 0) {
     fatal_read(ind, _("%s: uint64 value is out of range"), name);
   }
   *p_val = x;
@@ -1047,6 +1047,599 @@ sort_moscow(
     xfree(pen_st);
 }
 
+/*
+ * returns 1, if the run is not accounted because it is made after
+ * the standings time moment, 0 otherwise
+ */
+static int
+process_standings_run(
+        StandingsPage *pg,
+        StandingsExtraInfo *sii,
+        struct serve_state *cs,
+        struct filter_env *env,
+        int run_id,
+        int need_eff_time)
+{
+    const struct section_global_data *global = cs->global;
+    // the full entry is accessed only for the runs which pass the checks
+    const struct run_entry_hot *pe = &pg->hot_runs[run_id];
+
+    if (pe->status == RUN_VIRTUAL_START || pe->status == RUN_VIRTUAL_STOP || pe->status == RUN_EMPTY) return 0;
+    if (pe->user_id <= 0 || pe->user_id >= pg->t_max) return 0;
+    if (pe->prob_id <= 0 || pe->prob_id > cs->max_prob) return 0;
+    if (pe->is_hidden) return 0;
+    if (sii->user_filter && sii->user_filter->stand_run_tree) {
+        env->rid = run_id;
+        if (filter_tree_bool_eval(env, sii->user_filter->stand_run_tree) <= 0)
+            return 0;
+    }
+
+    int tind = pg->t_rev[pe->user_id];
+    if (tind < 0) return 0;
+    int pind = pg->p_rev[pe->prob_id];
+    if (pind < 0) return 0;
+    const struct section_problem_data *prob = cs->probs[pe->prob_id];
+    if (!prob || prob->hidden) return 0;
+    StandingsUserRow *row = &pg->rows[tind];
+    int up_ind = (tind << pg->row_sh) + pind;
+    StandingsCell *cell = &pg->cells[up_ind];
+
+    if (row->start_time <= 0) return 0;
+    time_t run_time = pe->time;
+    if (row->stop_time > 0 && run_time > row->stop_time && cs->upsolving_freeze_standings > 0) return 0;
+    time_t run_duration = run_time - row->start_time;
+    if (run_duration < 0) run_duration = 0;
+
+    /*
+    if (sii->user_id > 0) {
+        // run from the (virtual) future
+        if (run_duration > pg->cur_duration) continue;
+    }
+    */
+    if (run_duration > pg->cur_duration) return 1;
+
+    if (pg->duration_before_fog >= 0) {
+        if (!pg->unfog_flag && run_duration >= pg->duration_before_fog) {
+            // this is fogged run
+            if (run_time > cell->last_fogged_time) {
+                cell->last_fogged_time = run_time;
+            }
+            ++cell->fogged_num;
+            if (!cell->fogged_num) --cell->fogged_num; // overflow, keep the value at USHRT_MAX
+            return 0;
+        }
+    }
+
+    if (global->score_system == SCORE_ACM) {
+        process_acm_run(pg, sii, cs, run_id, &pg->runs[run_id], need_eff_time);
+    } else if (global->score_system == SCORE_MOSCOW) {
+        process_moscow_run(pg, sii, cs, run_id, &pg->runs[run_id], need_eff_time);
+    } else {
+        process_kirov_run(pg, sii, cs, run_id, &pg->runs[run_id], need_eff_time);
+    }
+    return 0;
+}
+
+/*
+ * The standings cache keeps the cells and the columns of the standings
+ * table computed for the particular set of standings parameters.
+ * Each column depends only on the runs of its problems, so after
+ * a runlog change only the columns of the changed runs are recomputed.
+ * The totals are recomputed only for the rows whose cells changed,
+ * and the table is sorted again only if some totals changed.
+ * The cells do not depend on the user viewing the standings, so
+ * all the participants share the same slot. The standings time is
+ * not a part of the key: each column remembers the range of the
+ * standings durations it is valid for.
+ * The cache is dropped on config reload together with serve_state.
+ */
+
+/* contribution of a column to the page-wide counters */
+typedef struct StandingsColumnTotals
+{
+    int last_submit_run;
+    int last_success_run;
+    int total_prs;
+    int total_summoned;
+    int total_disqualified;
+    int total_rejected;
+    int total_pending;
+    int total_accepted;
+    int total_trans;
+    int total_check_failed;
+    // the column is valid for the durations in [acc_duration, future_duration)
+    time_t acc_duration;
+    time_t future_duration;
+    int has_future;
+} StandingsColumnTotals;
+
+/* the cached totals of a row */
+typedef struct StandingsRowTotals
+{
+    int tot_score;
+    int tot_full;
+    int tot_penalty;
+    int total_rejected;
+} StandingsRowTotals;
+
+#define STANDINGS_CACHE_SLOTS 4
+
+struct standings_cache_slot
+{
+    int is_valid;
+
+    // the parameters the standings are computed for
+    int user_mode;
+    int accepting_mode;
+    int need_eff_time;
+    int unfog_flag;
+    int upsolving_freeze_standings;
+    time_t duration_before_fog;
+    time_t start_time;
+    time_t stop_time;
+    int t_max;
+    int t_tot;
+    int p_max;
+    int p_tot;
+    int row_sh;
+    int *t_rev;
+    int *p_rev;
+
+    long long change_serial; // the last runlog change accounted
+    long long last_use;
+
+    StandingsCell *cells;
+    StandingsProblemColumn *columns;
+    StandingsColumnTotals *totals;
+    StandingsRowTotals *rows;
+    int *t_sort;        // NULL, if the sort order is not computed yet
+    StandingsPlace *places;
+};
+
+struct standings_cache
+{
+    long long use_counter;
+    struct standings_cache_slot slots[STANDINGS_CACHE_SLOTS];
+};
+
+static void
+standings_cache_slot_clear(struct standings_cache_slot *slot)
+{
+    xfree(slot->t_rev);
+    xfree(slot->p_rev);
+    xfree(slot->cells);
+    xfree(slot->columns);
+    xfree(slot->totals);
+    xfree(slot->rows);
+    xfree(slot->t_sort);
+    xfree(slot->places);
+    memset(slot, 0, sizeof(*slot));
+}
+
+static void
+standings_cache_free(struct standings_cache *sc)
+{
+    if (!sc) return;
+    for (int i = 0; i < STANDINGS_CACHE_SLOTS; ++i) {
+        standings_cache_slot_clear(&sc->slots[i]);
+    }
+    xfree(sc);
+}
+
+/* the contest-wide conditions for the standings cache */
+static int
+standings_cache_is_supported(const struct serve_state *cs)
+{
+    // per-user start times
+    if (cs->global->is_virtual > 0) return 0;
+    // provide_ok updates other columns
+    for (int i = 1; i <= cs->max_prob; ++i) {
+        if (cs->probs[i] && cs->probs[i]->provide_ok && cs->probs[i]->provide_ok[0]) return 0;
+    }
+    return 1;
+}
+
+static int
+standings_cache_is_applicable(
+        const StandingsPage *pg,
+        const StandingsExtraInfo *sii,
+        const struct serve_state *cs)
+{
+    if (pg->t_tot <= 0 || pg->p_tot <= 0) return 0;
+    // no run filters
+    if (sii->user_filter && (sii->user_filter->stand_run_tree || sii->user_filter->stand_time_expr_mode > 0)) return 0;
+    // per-user scores, token flags matter only in this case as well
+    if (pg->separate_user_score > 0 && sii->user_mode) return 0;
+    return 1;
+}
+
+static int
+standings_cache_slot_matches(
+        const struct standings_cache_slot *slot,
+        const StandingsPage *pg,
+        const StandingsExtraInfo *sii,
+        const struct serve_state *cs,
+        int need_eff_time)
+{
+    return slot->is_valid
+        && slot->user_mode == sii->user_mode
+        && slot->accepting_mode == sii->accepting_mode
+        && slot->need_eff_time == need_eff_time
+        && slot->unfog_flag == pg->unfog_flag
+        && slot->upsolving_freeze_standings == cs->upsolving_freeze_standings
+        && slot->duration_before_fog == pg->duration_before_fog
+        && slot->start_time == pg->start_time
+        && slot->stop_time == pg->stop_time
+        && slot->t_max == pg->t_max
+        && slot->t_tot == pg->t_tot
+        && slot->p_max == pg->p_max
+        && slot->p_tot == pg->p_tot
+        && slot->row_sh == pg->row_sh
+        && !memcmp(slot->t_rev, pg->t_rev, pg->t_max * sizeof(pg->t_rev[0]))
+        && !memcmp(slot->p_rev, pg->p_rev, pg->p_max * sizeof(pg->p_rev[0]));
+}
+
+static int
+sort_run_id_func(const void *p1, const void *p2)
+{
+    int r1 = *(const int *) p1;
+    int r2 = *(const int *) p2;
+    return (r1 > r2) - (r1 < r2);
+}
+
+/*
+ * recompute the column pind of the cached standings from scratch,
+ * the rows whose cells are changed are marked in row_dirty
+ */
+static void
+replay_standings_column(
+        StandingsPage *pg,
+        StandingsExtraInfo *sii,
+        struct serve_state *cs,
+        struct standings_cache_slot *slot,
+        int pind,
+        int need_eff_time,
+        unsigned char *row_dirty)
+{
+    StandingsCell *old_cells = NULL;
+    XCALLOC(old_cells, slot->t_tot);
+    for (int i = 0; i < slot->t_tot; ++i) {
+        StandingsCell *cell = &slot->cells[(i << slot->row_sh) + pind];
+        old_cells[i] = *cell;
+        memset(cell, 0, sizeof(*cell));
+    }
+    memset(&slot->columns[pind], 0, sizeof(slot->columns[0]));
+
+    // the runs of all problems of the column (see stand_column) in run_id order
+    int *run_ids = NULL;
+    int run_u = 0, run_a = 0;
+    int prob_count = 0;
+    for (int prob_id = 1; prob_id < pg->p_max; ++prob_id) {
+        if (pg->p_rev[prob_id] != pind) continue;
+        ++prob_count;
+        for (int run_id = run_get_prob_first_run_id(cs->runlog_state, prob_id);
+             run_id >= pg->r_beg && run_id < pg->r_tot;
+             run_id = run_get_prob_next_run_id(cs->runlog_state, run_id)) {
+            if (run_u == run_a) {
+                if (!(run_a *= 2)) run_a = 64;
+                XREALLOC(run_ids, run_a);
+            }
+            run_ids[run_u++] = run_id;
+        }
+    }
+    if (prob_count > 1 && run_u > 1) {
+        qsort(run_ids, run_u, sizeof(run_ids[0]), sort_run_id_func);
+    }
+
+    StandingsPage tmp = *pg;
+    tmp.cells = slot->cells;
+    tmp.columns = slot->columns;
+    tmp.last_submit_run = -1;
+    tmp.last_success_run = -1;
+    tmp.total_prs = 0;
+    tmp.total_summoned = 0;
+    tmp.total_disqualified = 0;
+    tmp.total_rejected = 0;
+    tmp.total_pending = 0;
+    tmp.total_accepted = 0;
+    tmp.total_trans = 0;
+    tmp.total_check_failed = 0;
+
+    // the durations of the accounted and the skipped runs nearest
+    // to the standings time
+    time_t acc_duration = 0;
+    time_t future_duration = 0;
+    int has_future = 0;
+    for (int i = 0; i < run_u; ++i) {
+        process_standings_run(&tmp, sii, cs, NULL, run_ids[i], need_eff_time);
+        time_t run_duration = pg->hot_runs[run_ids[i]].time - pg->start_time;
+        if (run_duration < 0) run_duration = 0;
+        if (run_duration <= pg->cur_duration) {
+            if (run_duration > acc_duration) acc_duration = run_duration;
+        } else if (!has_future || run_duration < future_duration) {
+            future_duration = run_duration;
+            has_future = 1;
+        }
+    }
+    xfree(run_ids);
+
+    for (int i = 0; i < slot->t_tot; ++i) {
+        if (memcmp(&old_cells[i], &slot->cells[(i << slot->row_sh) + pind], sizeof(old_cells[0]))) {
+            row_dirty[i] = 1;
+        }
+    }
+    xfree(old_cells);
+
+    StandingsColumnTotals *ct = &slot->totals[pind];
+    ct->last_submit_run = tmp.last_submit_run;
+    ct->last_success_run = tmp.last_success_run;
+    ct->total_prs = tmp.total_prs;
+    ct->total_summoned = tmp.total_summoned;
+    ct->total_disqualified = tmp.total_disqualified;
+    ct->total_rejected = tmp.total_rejected;
+    ct->total_pending = tmp.total_pending;
+    ct->total_accepted = tmp.total_accepted;
+    ct->total_trans = tmp.total_trans;
+    ct->total_check_failed = tmp.total_check_failed;
+    ct->acc_duration = acc_duration;
+    ct->future_duration = future_duration;
+    ct->has_future = has_future;
+}
+
+/* compute the totals of the row i from its cells */
+static void
+compute_standings_row_totals(
+        StandingsPage *pg,
+        struct serve_state *cs,
+        int i)
+{
+    const struct section_global_data *global = cs->global;
+    StandingsUserRow *row = &pg->rows[i];
+
+    row->tot_score = 0;
+    row->tot_full = 0;
+    row->tot_penalty = 0;
+    if (global->score_n_best_problems > 0 && pg->p_tot > 0) {
+        unsigned char *used_flag = alloca(pg->p_tot);
+        memset(used_flag, 0, pg->p_tot);
+        for (int k = 0; k < global->score_n_best_problems; ++k) {
+            int max_ind = -1;
+            int max_score = -1;
+            for (int j = 0; j < pg->p_tot; ++j) {
+                int up_ind = (i << pg->row_sh) + j;
+                StandingsCell *cell = &pg->cells[up_ind];
+                if (!used_flag[j] && cell->score > 0 && (max_ind < 0 || cell->score > max_score)) {
+                    max_ind = j;
+                    max_score = cell->score;
+                }
+            }
+            if (max_ind < 0) break;
+            {
+                int up_ind = (i << pg->row_sh) + max_ind;
+                StandingsCell *cell = &pg->cells[up_ind];
+                row->tot_score += cell->score;
+                row->tot_full += cell->full_sol;
+                row->tot_penalty += cell->penalty;
+                used_flag[max_ind] = 1;
+            }
+        }
+    } else {
+        for (int j = 0; j < pg->p_tot; ++j) {
+            int up_ind = (i << pg->row_sh) + j;
+            StandingsCell *cell = &pg->cells[up_ind];
+            if (cs->probs[pg->p_ind[j]]->stand_ignore_score <= 0) {
+                row->tot_score += cell->score;
+                row->tot_full += cell->full_sol;
+                row->tot_penalty += cell->penalty;
+            }
+        }
+    }
+}
+
+/* the number of the rejected cells of the row i */
+static int
+count_standings_row_rejected(
+        const StandingsPage *pg,
+        int i)
+{
+    int count = 0;
+    for (int j = 0; j < pg->p_tot; ++j) {
+        int up_ind = (i << pg->row_sh) + j;
+        const StandingsCell *cell = &pg->cells[up_ind];
+        int rj_flag = cell->rj_flag;
+        if (cell->full_sol) rj_flag = 0;
+        if (cell->sm_flag) rj_flag = 0;
+        if (cell->pr_flag) rj_flag = 0;
+        if (cell->trans_num) rj_flag = 0;
+        if (cell->disq_num > 0) rj_flag = 0;
+        if (cell->cf_num > 0) rj_flag = 0;
+        count += rj_flag;
+    }
+    return count;
+}
+
+static void
+sort_standings(
+        StandingsPage *pg,
+        StandingsExtraInfo *sii,
+        struct serve_state *cs)
+{
+    const struct section_global_data *global = cs->global;
+
+    if (global->score_system == SCORE_ACM) {
+        sort_acm(pg, sii, cs);
+    } else if (global->score_system == SCORE_MOSCOW) {
+        sort_moscow(pg, sii, cs);
+    } else {
+        sort_kirov(pg, sii, cs);
+    }
+}
+
+/*
+ * fill in pg->cells, pg->columns, the row totals, the sort order and
+ * the page-wide counters from the standings cache, updating the cache
+ * as necessary
+ * returns -1, if the cache cannot be used for these standings
+ */
+static int
+update_from_standings_cache(
+        StandingsPage *pg,
+        StandingsExtraInfo *sii,
+        struct serve_state *cs,
+        int need_eff_time)
+{
+    // the main process keeps the standings requests of such contests,
+    // see fork_readonly_worker
+    cs->standings_cache_unsupported = !standings_cache_is_supported(cs);
+    if (cs->standings_cache_unsupported) return -1;
+    if (!standings_cache_is_applicable(pg, sii, cs)) return -1;
+
+    if (!cs->standings_cache) {
+        XCALLOC(cs->standings_cache, 1);
+        cs->standings_cache_free = standings_cache_free;
+    }
+    struct standings_cache *sc = cs->standings_cache;
+    long long change_serial = run_get_change_serial(cs->runlog_state);
+
+    struct standings_cache_slot *slot = NULL;
+    for (int i = 0; i < STANDINGS_CACHE_SLOTS; ++i) {
+        if (standings_cache_slot_matches(&sc->slots[i], pg, sii, cs, need_eff_time)) {
+            slot = &sc->slots[i];
+            break;
+        }
+    }
+
+    unsigned char *dirty = NULL;
+    XALLOCAZ(dirty, pg->p_tot);
+    unsigned char *row_dirty = NULL;
+    XCALLOC(row_dirty, pg->t_tot);
+    int full_flag = 0;
+
+    if (!slot) {
+        // replace the least recently used slot
+        slot = &sc->slots[0];
+        for (int i = 1; i < STANDINGS_CACHE_SLOTS; ++i) {
+            if (sc->slots[i].last_use < slot->last_use) {
+                slot = &sc->slots[i];
+            }
+        }
+        standings_cache_slot_clear(slot);
+        slot->user_mode = sii->user_mode;
+        slot->accepting_mode = sii->accepting_mode;
+        slot->need_eff_time = need_eff_time;
+        slot->unfog_flag = pg->unfog_flag;
+        slot->upsolving_freeze_standings = cs->upsolving_freeze_standings;
+        slot->duration_before_fog = pg->duration_before_fog;
+        slot->start_time = pg->start_time;
+        slot->stop_time = pg->stop_time;
+        slot->t_max = pg->t_max;
+        slot->t_tot = pg->t_tot;
+        slot->p_max = pg->p_max;
+        slot->p_tot = pg->p_tot;
+        slot->row_sh = pg->row_sh;
+        XCALLOC(slot->t_rev, pg->t_max);
+        memcpy(slot->t_rev, pg->t_rev, pg->t_max * sizeof(pg->t_rev[0]));
+        XCALLOC(slot->p_rev, pg->p_max);
+        memcpy(slot->p_rev, pg->p_rev, pg->p_max * sizeof(pg->p_rev[0]));
+        XCALLOC(slot->cells, pg->t_tot << pg->row_sh);
+        XCALLOC(slot->columns, pg->p_tot);
+        XCALLOC(slot->totals, pg->p_tot);
+        XCALLOC(slot->rows, pg->t_tot);
+        slot->is_valid = 1;
+        full_flag = 1;
+    } else {
+        // changes outside of the journal window are reported as -1
+        for (long long serial = slot->change_serial + 1; serial <= change_serial; ++serial) {
+            int run_id = run_get_changed_run_id(cs->runlog_state, serial);
+            if (run_id < 0) {
+                full_flag = 1;
+                break;
+            }
+            if (run_id < pg->r_beg || run_id >= pg->r_tot) continue;
+            int prob_id = pg->hot_runs[run_id].prob_id;
+            if (prob_id <= 0 || prob_id >= pg->p_max) continue;
+            int pind = pg->p_rev[prob_id];
+            if (pind >= 0) dirty[pind] = 1;
+        }
+        // the columns which have runs between the old and the new standings time
+        for (int pind = 0; pind < pg->p_tot; ++pind) {
+            const StandingsColumnTotals *ct = &slot->totals[pind];
+            if (pg->cur_duration < ct->acc_duration
+                || (ct->has_future && pg->cur_duration >= ct->future_duration)) {
+                dirty[pind] = 1;
+            }
+        }
+    }
+
+    for (int pind = 0; pind < pg->p_tot; ++pind) {
+        if (full_flag || dirty[pind]) {
+            replay_standings_column(pg, sii, cs, slot, pind, need_eff_time, row_dirty);
+        }
+    }
+    slot->change_serial = change_serial;
+    slot->last_use = ++sc->use_counter;
+
+    memcpy(pg->cells, slot->cells, (pg->t_tot << pg->row_sh) * sizeof(pg->cells[0]));
+    memcpy(pg->columns, slot->columns, pg->p_tot * sizeof(pg->columns[0]));
+    for (int pind = 0; pind < pg->p_tot; ++pind) {
+        const StandingsColumnTotals *ct = &slot->totals[pind];
+        if (ct->last_submit_run > pg->last_submit_run) pg->last_submit_run = ct->last_submit_run;
+        if (ct->last_success_run > pg->last_success_run) pg->last_success_run = ct->last_success_run;
+        pg->total_prs += ct->total_prs;
+        pg->total_summoned += ct->total_summoned;
+        pg->total_disqualified += ct->total_disqualified;
+        pg->total_rejected += ct->total_rejected;
+        pg->total_pending += ct->total_pending;
+        pg->total_accepted += ct->total_accepted;
+        pg->total_trans += ct->total_trans;
+        pg->total_check_failed += ct->total_check_failed;
+    }
+
+    int sort_flag = !slot->t_sort;
+    int total_rejected = 0;
+    for (int i = 0; i < pg->t_tot; ++i) {
+        StandingsUserRow *row = &pg->rows[i];
+        StandingsRowTotals *rt = &slot->rows[i];
+        if (full_flag || row_dirty[i]) {
+            compute_standings_row_totals(pg, cs, i);
+            if (rt->tot_score != row->tot_score
+                || rt->tot_full != row->tot_full
+                || rt->tot_penalty != row->tot_penalty) {
+                sort_flag = 1;
+            }
+            rt->tot_score = row->tot_score;
+            rt->tot_full = row->tot_full;
+            rt->tot_penalty = row->tot_penalty;
+            rt->total_rejected = count_standings_row_rejected(pg, i);
+        } else {
+            row->tot_score = rt->tot_score;
+            row->tot_full = rt->tot_full;
+            row->tot_penalty = rt->tot_penalty;
+        }
+        total_rejected += rt->total_rejected;
+    }
+    xfree(row_dirty);
+    if (pg->total_rejected > 0) {
+        pg->total_rejected = total_rejected;
+    }
+
+    if (sort_flag) {
+        sort_standings(pg, sii, cs);
+        if (!slot->t_sort) {
+            XCALLOC(slot->t_sort, pg->t_tot);
+            XCALLOC(slot->places, pg->t_tot);
+        }
+        memcpy(slot->t_sort, pg->t_sort, pg->t_tot * sizeof(pg->t_sort[0]));
+        memcpy(slot->places, pg->places, pg->t_tot * sizeof(pg->places[0]));
+    } else {
+        XCALLOC(pg->t_sort, pg->t_tot);
+        memcpy(pg->t_sort, slot->t_sort, pg->t_tot * sizeof(pg->t_sort[0]));
+        memcpy(pg->places, slot->places, pg->t_tot * sizeof(pg->places[0]));
+    }
+
+    return 0;
+}
+
 static int
 csp_execute_int_standings(
         PageInterface *ps,
@@ -1161,6 +1754,7 @@ csp_execute_int_standings(
     pg->r_beg = run_get_first(cs->runlog_state);
     pg->r_tot = run_get_total(cs->runlog_state);
     pg->runs = run_get_entries_ptr(cs->runlog_state);
+    pg->hot_runs = run_get_hot_entries_ptr(cs->runlog_state);
 
     if (global->disable_user_database > 0) {
         pg->t_max = run_get_max_user_id(cs->runlog_state) + 1;
@@ -1172,10 +1766,10 @@ csp_execute_int_standings(
     if (global->prune_empty_users > 0 || global->disable_user_database > 0) {
         memset(t_runs, 0, pg->t_max);
         for (int k = pg->r_beg; k < pg->r_tot; k++) {
-            if (pg->runs[k].status == RUN_EMPTY) continue;
-            if (pg->runs[k].is_hidden) continue;
-            if(pg->runs[k].user_id <= 0 && pg->runs[k].user_id >= pg->t_max) continue;
-            t_runs[pg->runs[k].user_id] = 1;
+            if (pg->hot_runs[k].status == RUN_EMPTY) continue;
+            if (pg->hot_runs[k].is_hidden) continue;
+            if(pg->hot_runs[k].user_id <= 0 && pg->hot_runs[k].user_id >= pg->t_max) continue;
+            t_runs[pg->hot_runs[k].user_id] = 1;
         }
     } else {
         memset(t_runs, 1, pg->t_max);
@@ -1313,133 +1907,27 @@ csp_execute_int_standings(
         env.rtotal = pg->r_tot;
         env.cur_time = pg->cur_time;
         env.rentries = pg->runs;
+        env.rhot = pg->hot_runs;
         env.rid = 0;
     }
 
-    for (int k = pg->r_beg; k < pg->r_tot; ++k) {
-        const struct run_entry *pe = &pg->runs[k];
-
-        if (pe->status == RUN_VIRTUAL_START || pe->status == RUN_VIRTUAL_STOP || pe->status == RUN_EMPTY) continue;
-        if (pe->user_id <= 0 || pe->user_id >= pg->t_max) continue;
-        if (pe->prob_id <= 0 || pe->prob_id > cs->max_prob) continue;
-        if (pe->is_hidden) continue;
-        if (sii->user_filter && sii->user_filter->stand_run_tree) {
-            env.rid = k;
-            if (filter_tree_bool_eval(&env, sii->user_filter->stand_run_tree) <= 0)
-                continue;
-        }
-    
-        int tind = pg->t_rev[pe->user_id];
-        if (tind < 0) continue;
-        int pind = pg->p_rev[pe->prob_id];
-        if (pind < 0) continue;
-        const struct section_problem_data *prob = cs->probs[pe->prob_id];
-        if (!prob || prob->hidden) continue;
-        StandingsUserRow *row = &pg->rows[tind];
-        int up_ind = (tind << pg->row_sh) + pind;
-        StandingsCell *cell = &pg->cells[up_ind];
-
-        if (row->start_time <= 0) continue;
-        time_t run_time = pe->time;
-        if (row->stop_time > 0 && run_time > row->stop_time && cs->upsolving_freeze_standings > 0) continue;
-        time_t run_duration = run_time - row->start_time;
-        if (run_duration < 0) run_duration = 0;
-
-        /*
-        if (sii->user_id > 0) {
-            // run from the (virtual) future
-            if (run_duration > pg->cur_duration) continue;
-        }
-        */
-        if (run_duration > pg->cur_duration) continue;
-
-        if (pg->duration_before_fog >= 0) {
-            if (!pg->unfog_flag && run_duration >= pg->duration_before_fog) {
-                // this is fogged run
-                if (run_time > cell->last_fogged_time) {
-                    cell->last_fogged_time = run_time;
-                }
-                ++cell->fogged_num;
-                if (!cell->fogged_num) --cell->fogged_num; // overflow, keep the value at USHRT_MAX
-                continue;
-            }
+    if (update_from_standings_cache(pg, sii, cs, need_eff_time) < 0) {
+        for (int k = pg->r_beg; k < pg->r_tot; ++k) {
+            process_standings_run(pg, sii, cs, &env, k, need_eff_time);
         }
 
-        if (global->score_system == SCORE_ACM) {
-            process_acm_run(pg, sii, cs, k, pe, need_eff_time);
-        } else if (global->score_system == SCORE_MOSCOW) {
-            process_moscow_run(pg, sii, cs, k, pe, need_eff_time);
-        } else {
-            process_kirov_run(pg, sii, cs, k, pe, need_eff_time);
-        }
-    }
-
-    /* compute the total for each team */
-    if (global->score_n_best_problems > 0 && pg->p_tot > 0) {
-        unsigned char *used_flag = alloca(pg->p_tot);
-        for (int i = 0; i < pg->t_tot; ++i) {
-            StandingsUserRow *row = &pg->rows[i];
-            memset(used_flag, 0, pg->p_tot);
-            for (int k = 0; k < global->score_n_best_problems; ++k) {
-                int max_ind = -1;
-                int max_score = -1;
-                for (int j = 0; j < pg->p_tot; ++j) {
-                    int up_ind = (i << pg->row_sh) + j;
-                    StandingsCell *cell = &pg->cells[up_ind];
-                    if (!used_flag[j] && cell->score > 0 && (max_ind < 0 || cell->score > max_score)) {
-                        max_ind = j;
-                        max_score = cell->score;
-                    }
-                }
-                if (max_ind < 0) break;
-                {
-                    int up_ind = (i << pg->row_sh) + max_ind;
-                    StandingsCell *cell = &pg->cells[up_ind];
-                    row->tot_score += cell->score;
-                    row->tot_full += cell->full_sol;
-                    row->tot_penalty += cell->penalty;
-                    used_flag[max_ind] = 1;
-                }
-            }
-        }
-    } else {
+        /* compute the total for each team */
         for (int i = 0; i < pg->t_tot; ++i) {
-            StandingsUserRow *row = &pg->rows[i];
-            for (int j = 0; j < pg->p_tot; ++j) {
-                int up_ind = (i << pg->row_sh) + j;
-                StandingsCell *cell = &pg->cells[up_ind];
-                if (cs->probs[pg->p_ind[j]]->stand_ignore_score <= 0) {
-                    row->tot_score += cell->score;
-                    row->tot_full += cell->full_sol;
-                    row->tot_penalty += cell->penalty;
-                }
-            }
+            compute_standings_row_totals(pg, cs, i);
         }
-    }
 
-    if (global->score_system == SCORE_ACM) {
-        sort_acm(pg, sii, cs);
-    } else if (global->score_system == SCORE_MOSCOW) {
-        sort_moscow(pg, sii, cs);
-    } else {
-        sort_kirov(pg, sii, cs);
-    }
+        sort_standings(pg, sii, cs);
 
-    /* recompute the total number of rejected runs */
-    if (pg->total_rejected > 0) {
-        pg->total_rejected = 0;
-        for (int i = 0; i < pg->t_tot; ++i) {
-            for (int j = 0; j < pg->p_tot; ++j) {
-                int up_ind = (i << pg->row_sh) + j;
-                StandingsCell *cell = &pg->cells[up_ind];
-                int rj_flag = cell->rj_flag;
-                if (cell->full_sol) rj_flag = 0;
-                if (cell->sm_flag) rj_flag = 0;
-                if (cell->pr_flag) rj_flag = 0;
-                if (cell->trans_num) rj_flag = 0;
-                if (cell->disq_num > 0) rj_flag = 0;
-                if (cell->cf_num > 0) rj_flag = 0;
-                pg->total_rejected += rj_flag;
+        /* recompute the total number of rejected runs */
+        if (pg->total_rejected > 0) {
+            pg->total_rejected = 0;
+            for (int i = 0; i < pg->t_tot; ++i) {
+                pg->total_rejected += count_standings_row_rejected(pg, i);
             }
         }
     }
@@ -234,6 +234,7 @@ static struct meta_info_item meta_info_section_global_data_data[] =
   [CNTSGLOB_plog_header_txt] = { CNTSGLOB_plog_header_txt, 's', XSIZE(struct section_global_data, plog_header_txt), NULL, XOFFSET(struct section_global_data, plog_header_txt) },
   [CNTSGLOB_plog_footer_txt] = { CNTSGLOB_plog_footer_txt, 's', XSIZE(struct section_global_data, plog_footer_txt), NULL, XOFFSET(struct section_global_data, plog_footer_txt) },
   [CNTSGLOB_plog_update_time] = { CNTSGLOB_plog_update_time, 'i', XSIZE(struct section_global_data, plog_update_time), "plog_update_time", XOFFSET(struct section_global_data, plog_update_time) },
+  [CNTSGLOB_standings_update_time] = { CNTSGLOB_standings_update_time, 'i', XSIZE(struct section_global_data, standings_update_time), "standings_update_time", XOFFSET(struct section_global_data, standings_update_time) },
   [CNTSGLOB_plog_symlink_dir] = { CNTSGLOB_plog_symlink_dir, 's', XSIZE(struct section_global_data, plog_symlink_dir), "plog_symlink_dir", XOFFSET(struct section_global_data, plog_symlink_dir) },
   [CNTSGLOB_internal_xml_update_time] = { CNTSGLOB_internal_xml_update_time, 'i', XSIZE(struct section_global_data, internal_xml_update_time), "internal_xml_update_time", XOFFSET(struct section_global_data, internal_xml_update_time) },
   [CNTSGLOB_external_xml_update_time] = { CNTSGLOB_external_xml_update_time, 'i', XSIZE(struct section_global_data, external_xml_update_time), "external_xml_update_time", XOFFSET(struct section_global_data, external_xml_update_time) },
@@ -815,6 +816,7 @@ void cntsglob_copy(struct section_global_data *dst, const struct section_global_
   // private plog_header_txt
   // private plog_footer_txt
   dst->plog_update_time = src->plog_update_time;
+  dst->standings_update_time = src->standings_update_time;
   if (src->plog_symlink_dir) {
     dst->plog_symlink_dir = strdup(src->plog_symlink_dir);
   }
@@ -1210,6 +1212,7 @@ static struct meta_info_item meta_info_section_problem_data_data[] =
   [CNTSPROB_disable_stderr] = { CNTSPROB_disable_stderr, 'f', XSIZE(struct section_problem_data, disable_stderr), "disable_stderr", XOFFSET(struct section_problem_data, disable_stderr) },
   [CNTSPROB_enable_process_group] = { CNTSPROB_enable_process_group, 'f', XSIZE(struct section_problem_data, enable_process_group), "enable_process_group", XOFFSET(struct section_problem_data, enable_process_group) },
   [CNTSPROB_enable_kill_all] = { CNTSPROB_enable_kill_all, 'f', XSIZE(struct section_problem_data, enable_kill_all), "enable_kill_all", XOFFSET(struct section_problem_data, enable_kill_all) },
+  [CNTSPROB_readonly_input] = { CNTSPROB_readonly_input, 'f', XSIZE(struct section_problem_data, readonly_input), "readonly_input", XOFFSET(struct section_problem_data, readonly_input) },
   [CNTSPROB_hide_variant] = { CNTSPROB_hide_variant, 'f', XSIZE(struct section_problem_data, hide_variant), "hide_variant", XOFFSET(struct section_problem_data, hide_variant) },
   [CNTSPROB_enable_testlib_mode] = { CNTSPROB_enable_testlib_mode, 'f', XSIZE(struct section_problem_data, enable_testlib_mode), "enable_testlib_mode", XOFFSET(struct section_problem_data, enable_testlib_mode) },
   [CNTSPROB_autoassign_variants] = { CNTSPROB_autoassign_variants, 'f', XSIZE(struct section_problem_data, autoassign_variants), "autoassign_variants", XOFFSET(struct section_problem_data, autoassign_variants) },
@@ -1374,6 +1377,7 @@ static struct meta_info_item meta_info_section_problem_data_data[] =
   [CNTSPROB_checker_max_rss_size] = { CNTSPROB_checker_max_rss_size, 'E', XSIZE(struct section_problem_data, checker_max_rss_size), "checker_max_rss_size", XOFFSET(struct section_problem_data, checker_max_rss_size) },
   [CNTSPROB_max_open_file_count] = { CNTSPROB_max_open_file_count, 'i', XSIZE(struct section_problem_data, max_open_file_count), "max_open_file_count", XOFFSET(struct section_problem_data, max_open_file_count) },
   [CNTSPROB_max_process_count] = { CNTSPROB_max_process_count, 'i', XSIZE(struct section_problem_data, max_process_count), "max_process_count", XOFFSET(struct section_problem_data, max_process_count) },
+  [CNTSPROB_parallel_tests] = { CNTSPROB_parallel_tests, 'i', XSIZE(struct section_problem_data, parallel_tests), "parallel_tests", XOFFSET(struct section_problem_data, parallel_tests) },
   [CNTSPROB_extid] = { CNTSPROB_extid, 's', XSIZE(struct section_problem_data, extid), "extid", XOFFSET(struct section_problem_data, extid) },
   [CNTSPROB_unhandled_vars] = { CNTSPROB_unhandled_vars, 's', XSIZE(struct section_problem_data, unhandled_vars), "unhandled_vars", XOFFSET(struct section_problem_data, unhandled_vars) },
   [CNTSPROB_score_view] = { CNTSPROB_score_view, 'x', XSIZE(struct section_problem_data, score_view), "score_view", XOFFSET(struct section_problem_data, score_view) },
@@ -1500,6 +1504,7 @@ void cntsprob_copy(struct section_problem_data *dst, const struct section_proble
   dst->disable_stderr = src->disable_stderr;
   dst->enable_process_group = src->enable_process_group;
   dst->enable_kill_all = src->enable_kill_all;
+  dst->readonly_input = src->readonly_input;
   dst->hide_variant = src->hide_variant;
   dst->enable_testlib_mode = src->enable_testlib_mode;
   dst->autoassign_variants = src->autoassign_variants;
@@ -1792,6 +1797,7 @@ void cntsprob_copy(struct section_problem_data *dst, const struct section_proble
   dst->checker_max_rss_size = src->checker_max_rss_size;
   dst->max_open_file_count = src->max_open_file_count;
   dst->max_process_count = src->max_process_count;
+  dst->parallel_tests = src->parallel_tests;
   if (src->extid) {
     dst->extid = strdup(src->extid);
   }
@@ -364,11 +364,13 @@ static struct meta_info_item meta_info_super_run_in_problem_packet_data[] =
   [META_SUPER_RUN_IN_PROBLEM_PACKET_max_file_size] = { META_SUPER_RUN_IN_PROBLEM_PACKET_max_file_size, 'E', XSIZE(struct super_run_in_problem_packet, max_file_size), "max_file_size", XOFFSET(struct super_run_in_problem_packet, max_file_size) },
   [META_SUPER_RUN_IN_PROBLEM_PACKET_max_open_file_count] = { META_SUPER_RUN_IN_PROBLEM_PACKET_max_open_file_count, 'i', XSIZE(struct super_run_in_problem_packet, max_open_file_count), "max_open_file_count", XOFFSET(struct super_run_in_problem_packet, max_open_file_count) },
   [META_SUPER_RUN_IN_PROBLEM_PACKET_max_process_count] = { META_SUPER_RUN_IN_PROBLEM_PACKET_max_process_count, 'i', XSIZE(struct super_run_in_problem_packet, max_process_count), "max_process_count", XOFFSET(struct super_run_in_problem_packet, max_process_count) },
+  [META_SUPER_RUN_IN_PROBLEM_PACKET_parallel_tests] = { META_SUPER_RUN_IN_PROBLEM_PACKET_parallel_tests, 'i', XSIZE(struct super_run_in_problem_packet, parallel_tests), "parallel_tests", XOFFSET(struct super_run_in_problem_packet, parallel_tests) },
   [META_SUPER_RUN_IN_PROBLEM_PACKET_spelling] = { META_SUPER_RUN_IN_PROBLEM_PACKET_spelling, 's', XSIZE(struct super_run_in_problem_packet, spelling), "spelling", XOFFSET(struct super_run_in_problem_packet, spelling) },
   [META_SUPER_RUN_IN_PROBLEM_PACKET_open_tests] = { META_SUPER_RUN_IN_PROBLEM_PACKET_open_tests, 's', XSIZE(struct super_run_in_problem_packet, open_tests), "open_tests", XOFFSET(struct super_run_in_problem_packet, open_tests) },
   [META_SUPER_RUN_IN_PROBLEM_PACKET_enable_process_group] = { META_SUPER_RUN_IN_PROBLEM_PACKET_enable_process_group, 'B', XSIZE(struct super_run_in_problem_packet, enable_process_group), "enable_process_group", XOFFSET(struct super_run_in_problem_packet, enable_process_group) },
   [META_SUPER_RUN_IN_PROBLEM_PACKET_umask] = { META_SUPER_RUN_IN_PROBLEM_PACKET_umask, 's', XSIZE(struct super_run_in_problem_packet, umask), "umask", XOFFSET(struct super_run_in_problem_packet, umask) },
   [META_SUPER_RUN_IN_PROBLEM_PACKET_enable_kill_all] = { META_SUPER_RUN_IN_PROBLEM_PACKET_enable_kill_all, 'B', XSIZE(struct super_run_in_problem_packet, enable_kill_all), "enable_kill_all", XOFFSET(struct super_run_in_problem_packet, enable_kill_all) },
+  [META_SUPER_RUN_IN_PROBLEM_PACKET_readonly_input] = { META_SUPER_RUN_IN_PROBLEM_PACKET_readonly_input, 'B', XSIZE(struct super_run_in_problem_packet, readonly_input), "readonly_input", XOFFSET(struct super_run_in_problem_packet, readonly_input) },
   [META_SUPER_RUN_IN_PROBLEM_PACKET_uuid] = { META_SUPER_RUN_IN_PROBLEM_PACKET_uuid, 's', XSIZE(struct super_run_in_problem_packet, uuid), "uuid", XOFFSET(struct super_run_in_problem_packet, uuid) },
   [META_SUPER_RUN_IN_PROBLEM_PACKET_enable_extended_info] = { META_SUPER_RUN_IN_PROBLEM_PACKET_enable_extended_info, 'B', XSIZE(struct super_run_in_problem_packet, enable_extended_info), "enable_extended_info", XOFFSET(struct super_run_in_problem_packet, enable_extended_info) },
   [META_SUPER_RUN_IN_PROBLEM_PACKET_stop_on_first_fail] = { META_SUPER_RUN_IN_PROBLEM_PACKET_stop_on_first_fail, 'B', XSIZE(struct super_run_in_problem_packet, stop_on_first_fail), "stop_on_first_fail", XOFFSET(struct super_run_in_problem_packet, stop_on_first_fail) },
@@ -561,6 +563,7 @@ void meta_super_run_in_problem_packet_copy(struct super_run_in_problem_packet *d
   dst->max_file_size = src->max_file_size;
   dst->max_open_file_count = src->max_open_file_count;
   dst->max_process_count = src->max_process_count;
+  dst->parallel_tests = src->parallel_tests;
   if (src->spelling) {
     dst->spelling = strdup(src->spelling);
   }
@@ -572,6 +575,7 @@ void meta_super_run_in_problem_packet_copy(struct super_run_in_problem_packet *d
     dst->umask = strdup(src->umask);
   }
   dst->enable_kill_all = src->enable_kill_all;
+  dst->readonly_input = src->readonly_input;
   if (src->uuid) {
     dst->uuid = strdup(src->uuid);
   }
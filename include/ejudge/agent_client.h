@@ -149,6 +149,7 @@ struct AgentClientOps
         time_t current_mtime,
         long long current_size,
         int current_mode,
+        const unsigned char *local_path, // to compare by digest, may be NULL
         char **p_pkt_ptr,
         size_t *p_pkt_len,
         time_t *p_new_mtime,
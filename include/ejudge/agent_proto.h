@@ -0,0 +1,92 @@
+/* -*- mode: c; c-basic-offset: 4 -*- */
+#ifndef __AGENT_PROTO_H__
+#define __AGENT_PROTO_H__
+
+/* Copyright (C) 2024 Alexander Chernov <cher@ejudge.ru> */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+
+/*
+ * The agent protocol starts in the text mode, where each message is
+ * a JSON object terminated with an empty line, and the files are
+ * compressed and base64-encoded. If the "ping" request contains
+ * "framing":"binary" and the agent supports it, the reply contains
+ * the same field, and both sides switch to the binary frames:
+ *
+ *   "EJF1" | u32le json_size | u32le blob_size | JSON \0 | blob
+ *
+ * where json_size includes the terminating \0, and the files are
+ * stored in the blob as is or deflated.
+ */
+
+enum { AGENT_FRAME_HEADER_SIZE = 12 };
+
+/* the binary attachment of a frame */
+struct AgentBlob
+{
+    unsigned char *data;
+    size_t size;
+    size_t reserved;
+};
+
+struct cJSON;
+
+void
+agent_blob_free(struct AgentBlob *blob);
+
+/* add the file to the JSON object, blob == NULL means the text mode */
+void
+agent_proto_add_file(
+        struct cJSON *j,
+        const char *data,
+        size_t size,
+        struct AgentBlob *blob);
+
+/* extract the file described by the JSON object, the blob is
+   the attachment of the frame (NULL in the text mode),
+   returns 1 on success, -1 on error */
+int
+agent_proto_extract_file(
+        struct cJSON *j,
+        const unsigned char *blob,
+        size_t blob_size,
+        char **p_data,
+        size_t *p_size);
+
+/* make a frame, the returned buffer is malloc'ed */
+unsigned char *
+agent_proto_make_frame(
+        const char *json,
+        size_t json_len,
+        const struct AgentBlob *blob,
+        size_t *p_size);
+
+/* check for a complete frame in the buffer, returns the size of the frame,
+   0 if the frame is incomplete, -1 if the frame header is invalid,
+   the frame payload (JSON \0 blob) starts at AGENT_FRAME_HEADER_SIZE */
+long long
+agent_proto_frame_size(const unsigned char *data, size_t size);
+
+/* split the payload of a received message into the JSON and the blob,
+   returns 1, if the JSON is followed by \0 and the blob (possibly empty),
+   0, if there is no \0 in the payload, i.e. the message is plain JSON */
+int
+agent_proto_get_blob(
+        const unsigned char *payload,
+        size_t payload_size,
+        const unsigned char **p_blob,
+        size_t *p_blob_size);
+
+#endif /* __AGENT_PROTO_H__ */
@@ -20,6 +20,9 @@
 #include <stdlib.h>
 
 int   cgi_read(char const *charset);
+int   cgi_parse_request(char const *content_type,
+                        char *query_buf, size_t query_size,
+                        char *body_buf, size_t body_size);
 char *cgi_param(char const *);
 char *cgi_nparam(char const *, int);
 char *cgi_nname(char const *, int);
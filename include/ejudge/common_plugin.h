@@ -42,6 +42,10 @@ struct common_plugin_iface
   // parse the plugin configuration
   int (*prepare)(struct common_plugin_data *, const struct ejudge_cfg *,
                  struct xml_tree *);
+  // called in a forked child process, which does not exec: release
+  // the connections shared with the parent process without closing
+  // the server sessions, may be NULL
+  void (*fork_child)(struct common_plugin_data *);
 };
 
 struct common_loaded_plugin
@@ -66,5 +70,7 @@ const struct common_loaded_plugin *
 plugin_get(
         const unsigned char *type,
         const unsigned char *name);
+void
+plugin_fork_child(void);
 
 #endif /* __COMMON_PLUGIN_H__ */
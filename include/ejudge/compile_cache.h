@@ -0,0 +1,73 @@
+/* -*- mode: c; c-basic-offset: 4 -*- */
+
+#ifndef __COMPILE_CACHE_H__
+#define __COMPILE_CACHE_H__
+
+/* Copyright (C) 2024 Alexander Chernov <cher@ejudge.ru> */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+enum { COMPILE_CACHE_KEY_SIZE = 65 }; // hex sha256 + \0
+
+/*
+ * on-disk cache of compilation results, the entries are addressed
+ * by the digest of everything that affects the compilation, several
+ * compilers may share the same cache directory, the least recently
+ * used entries are removed when the cache grows over its size limit
+ */
+struct compile_cache;
+
+struct compile_cache_result
+{
+    int status;
+    int prepended_size;
+    int override_exe;
+    int has_exe;
+};
+
+struct compile_cache *
+compile_cache_open(const unsigned char *dir, long long max_size);
+struct compile_cache *
+compile_cache_free(struct compile_cache *cc);
+
+/*
+ * on hit 1 is returned, the cached executable (if any) is copied
+ * to exe_path, and the cached compilation log is appended to log_f,
+ * 0 is returned on miss
+ */
+int
+compile_cache_get(
+        struct compile_cache *cc,
+        const unsigned char *key,
+        struct compile_cache_result *res,
+        const unsigned char *exe_path,
+        FILE *log_f);
+
+int
+compile_cache_put(
+        struct compile_cache *cc,
+        const unsigned char *key,
+        const struct compile_cache_result *res,
+        const unsigned char *exe_path,
+        const unsigned char *log_path);
+
+void
+compile_cache_get_stats(
+        const struct compile_cache *cc,
+        long long *p_hits,
+        long long *p_misses);
+
+#endif /* __COMPILE_CACHE_H__ */
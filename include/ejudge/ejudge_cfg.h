@@ -86,6 +86,9 @@ struct ejudge_cfg
   // max loaded contests count for ej-contests
   int max_loaded_contests;
 
+  // max number of worker processes for read-only requests in ej-contests
+  int contests_workers;
+
   // these strings actually point into other strings in XML tree
   unsigned char *socket_path;
   unsigned char *db_path;
@@ -130,6 +133,8 @@ struct ejudge_cfg
   unsigned char *default_status_plugin;
   unsigned char *default_variant_plugin;
   unsigned char *caps_file;
+  // FastCGI socket of ej-contests, the web server connects to it directly
+  unsigned char *contests_fcgi_socket;
   unsigned char *contest_server_id;
   struct xml_tree *user_map;
   struct xml_tree *oauth_user_map;
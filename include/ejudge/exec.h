@@ -98,6 +98,8 @@ int      task_EnableMemoryLimitError(tpTask);
 int      task_EnableSecureExec(tpTask);
 int      task_EnableSuidExec(tpTask);
 int      task_EnableContainer(tpTask);
+int      task_EnableContainerTemplate(tpTask);
+void     task_CloseContainerTemplate(void);
 int      task_EnableAllSignals(tpTask);
 int      task_EnableSecurityViolationError(tpTask);
 int      task_EnableProcessGroup(tpTask);
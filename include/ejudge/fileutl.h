@@ -64,6 +64,8 @@ int   remove_directory_recursively(const unsigned char *path, int preserve_root)
 
 int make_symlink(unsigned char const *dest, unsigned char const *path);
 int make_hardlink(const unsigned char *src, const unsigned char *dst);
+/* returns 1, if the file is linked, 0, if it is copied */
+int link_or_copy_file(const unsigned char *src, const unsigned char *dst);
 
 int generic_truncate(const char *path, ssize_t size);
 
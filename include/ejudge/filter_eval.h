@@ -36,6 +36,7 @@ struct filter_env
   int rtotal;
   struct run_header rhead;
   const struct run_entry *rentries;
+  const struct run_entry_hot *rhot; /* optional, indexed as rentries */
   int rid;
   const struct run_entry *cur;
   time_t cur_time;
@@ -44,4 +45,60 @@ struct filter_env
 
 int filter_tree_bool_eval(struct filter_env *env, struct filter_tree *t);
 
+/* compiled filter expression */
+struct filter_program;
+
+struct filter_program *
+filter_program_compile(struct filter_env *env, struct filter_tree *t);
+struct filter_program *
+filter_program_free(struct filter_program *prog);
+
+/* evaluate the program for the runs rids[0..count-1], count <= 128,
+   results[i] is 1 (match), 0 (no match), or a negative error code */
+void
+filter_program_eval_batch(
+        struct filter_env *env,
+        struct filter_program *prog,
+        const int *rids,
+        int count,
+        int *results);
+
+/* store the run_id's of the matching runs in the ascending order to
+   match_idx and return their number, prog == NULL matches all runs;
+   if limit > 0, the runs are scanned from the last one, and the scan stops
+   when limit matches are found */
+int
+filter_program_select(
+        struct filter_env *env,
+        struct filter_program *prog,
+        int limit,
+        int *match_idx,
+        void (*errfunc)(void *, unsigned char const *, ...),
+        void *errdata);
+
+/* a page of the matching runs counted from the end of the run list */
+struct filter_page
+{
+  int before;                   /* in: scan the runs below, -1 - from the end */
+  int limit;                    /* in: the maximal number of runs on the page */
+  int next;                     /* out: 'before' for the next page, or -1 */
+  int scanned;                  /* out: the number of the evaluated runs */
+  int estimate;                 /* out: the number of matching runs below 'before' */
+  int exact;                    /* out: 1, if 'estimate' is the exact count */
+};
+
+/* store up to page->limit matching run_id's below page->before in the
+   ascending order to match_idx, scanning the runs from the last one,
+   return the number of stored run_id's; the total number of matching
+   runs is extrapolated from the evaluated runs unless the scan reaches
+   the beginning of the run list */
+int
+filter_program_select_page(
+        struct filter_env *env,
+        struct filter_program *prog,
+        struct filter_page *page,
+        int *match_idx,
+        void (*errfunc)(void *, unsigned char const *, ...),
+        void *errdata);
+
 #endif /* __FILTER_EVAL_H__ */
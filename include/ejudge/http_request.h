@@ -34,6 +34,17 @@ struct cJSON;
 struct new_session_info;
 struct userlist_user;
 
+enum { HTTP_UL_ASYNC_MAX = 4 };
+
+/* the results of the asynchronous userlist requests of a suspended
+   request, the request is replayed with them when they complete */
+struct http_ul_async_results
+{
+  int count;
+  int cmd[HTTP_UL_ASYNC_MAX];
+  int status[HTTP_UL_ASYNC_MAX];
+};
+
 struct http_request_info
 {
   int id;
@@ -112,6 +123,13 @@ struct http_request_info
   int protocol_reply;
   int allow_empty_output;
   int no_reply;
+  // 1 - the request is passed to a worker process, 2 - this is the worker process
+  int worker_mode;
+  // the request packet, the request may be suspended and replayed later
+  const void *pkt;
+  size_t pkt_size;
+  struct http_ul_async_results ul_async;
+  unsigned ul_async_used;       // the mask of the consumed results
   int error_code;
   unsigned char *redirect;
 
@@ -90,6 +90,7 @@ typedef struct StandingsPage
     int r_beg; // first loaded run
     int r_tot; // total number of runs
     const struct run_entry *runs;
+    const struct run_entry_hot *hot_runs; // hot copy of runs for the scans
 
     int t_max; // size of user_id indices (i.e. max user_id + 1)
     int t_tot; // total number of indexed participants
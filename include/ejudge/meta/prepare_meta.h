@@ -227,6 +227,7 @@ enum
   CNTSGLOB_plog_header_txt,
   CNTSGLOB_plog_footer_txt,
   CNTSGLOB_plog_update_time,
+  CNTSGLOB_standings_update_time,
   CNTSGLOB_plog_symlink_dir,
   CNTSGLOB_internal_xml_update_time,
   CNTSGLOB_external_xml_update_time,
@@ -404,6 +405,7 @@ enum
   CNTSPROB_disable_stderr,
   CNTSPROB_enable_process_group,
   CNTSPROB_enable_kill_all,
+  CNTSPROB_readonly_input,
   CNTSPROB_hide_variant,
   CNTSPROB_enable_testlib_mode,
   CNTSPROB_autoassign_variants,
@@ -568,6 +570,7 @@ enum
   CNTSPROB_checker_max_rss_size,
   CNTSPROB_max_open_file_count,
   CNTSPROB_max_process_count,
+  CNTSPROB_parallel_tests,
   CNTSPROB_extid,
   CNTSPROB_unhandled_vars,
   CNTSPROB_score_view,
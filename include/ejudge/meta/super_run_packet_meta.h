@@ -177,11 +177,13 @@ enum
   META_SUPER_RUN_IN_PROBLEM_PACKET_max_file_size,
   META_SUPER_RUN_IN_PROBLEM_PACKET_max_open_file_count,
   META_SUPER_RUN_IN_PROBLEM_PACKET_max_process_count,
+  META_SUPER_RUN_IN_PROBLEM_PACKET_parallel_tests,
   META_SUPER_RUN_IN_PROBLEM_PACKET_spelling,
   META_SUPER_RUN_IN_PROBLEM_PACKET_open_tests,
   META_SUPER_RUN_IN_PROBLEM_PACKET_enable_process_group,
   META_SUPER_RUN_IN_PROBLEM_PACKET_umask,
   META_SUPER_RUN_IN_PROBLEM_PACKET_enable_kill_all,
+  META_SUPER_RUN_IN_PROBLEM_PACKET_readonly_input,
   META_SUPER_RUN_IN_PROBLEM_PACKET_uuid,
   META_SUPER_RUN_IN_PROBLEM_PACKET_enable_extended_info,
   META_SUPER_RUN_IN_PROBLEM_PACKET_stop_on_first_fail,
@@ -42,6 +42,8 @@ struct metrics_contest_data
     long long key_cache_size;
     long long append_run_us;
     long long append_run_count;
+    long long standings_updates;
+    long long standings_coalesced;
 };
 
 struct metrics_desc
@@ -497,6 +497,12 @@ ns_list_all_users_callback(
         int contest_id,
         unsigned char **p_xml,
         struct UserlistBinaryHeader **p_header);
+int
+ns_list_users_delta_callback(
+        void *user_data,
+        int contest_id,
+        int vintage,
+        struct UserlistBinaryHeader **p_header);
 void
 ns_check_contest_events(
         struct contest_extra *extra,
@@ -511,6 +517,19 @@ void ns_client_state_clear_contest_id(int client_id);
 void ns_close_client_fds(int client_id);
 void ns_send_reply_2(int client_id, int answer);
 void ns_new_autoclose_2(int client_id, void *write_buf, size_t write_len);
+struct http_ul_async_results;
+void ns_replay_http_request(
+        int client_id,
+        const void *pkt,
+        size_t pkt_size,
+        const struct http_ul_async_results *ul_async);
+/* returns 1, if the request is suspended until the userlist-server replies */
+int ns_ul_register_contest(
+        struct http_request_info *phr,
+        int cmd,
+        int user_id,
+        int contest_id,
+        int *p_r);
 
 struct UserProblemInfo;
 void
@@ -953,6 +972,32 @@ int
 ns_ws_create_session(
         struct server_framework_state *state,
         struct ws_client_state *p);
+void
+ns_ws_error(
+        struct ws_client_state *p,
+        int error_code);
+
+/* WebSocket push of the run and clar updates (new_server_push.c) */
+struct cJSON;
+int
+ns_ws_push_request(
+        struct server_framework_state *state,
+        struct ws_client_state *p,
+        const struct cJSON *root);
+void
+ns_ws_push_cleanup(
+        struct server_framework_state *state,
+        struct ws_client_state *p);
+void
+ns_ws_push_run_update(
+        serve_state_t cs,
+        const struct run_entry *re);
+void
+ns_ws_push_clar_update(
+        serve_state_t cs,
+        int clar_id);
+void
+ns_ws_push_flush(void);
 
 int
 ns_load_problem_uuid(
@@ -25,9 +25,13 @@
 
 struct new_server_conn;
 typedef struct new_server_conn *new_server_conn_t;
+struct iovec;
 
 int new_server_clnt_open(const unsigned char *, new_server_conn_t *);
 int new_server_clnt_send_packet(new_server_conn_t, size_t, void const *);
+/* the packet of the total size size is gathered from the iov pieces */
+int new_server_clnt_send_packet_v(new_server_conn_t, size_t size,
+                                  int iovcnt, const struct iovec *iov);
 int new_server_clnt_recv_packet(new_server_conn_t, size_t *, void **);
 int new_server_clnt_pass_fd(new_server_conn_t, int, const int *);
 
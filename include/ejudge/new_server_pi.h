@@ -293,6 +293,11 @@ typedef struct RunDisplayInfos
     RunDisplayInfo *runs;
     int size;
     int reserved;
+    // paging: at most 'limit' runs below 'before' (if > 0) are listed,
+    // 'next' is 'before' for the next page, or -1
+    int limit;
+    int before;
+    int next;
 } RunDisplayInfos;
 
 void run_display_info_free(struct RunDisplayInfo *rdi);
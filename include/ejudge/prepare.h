@@ -636,6 +636,8 @@ struct section_global_data
   unsigned char *plog_footer_txt META_ATTRIB((meta_private));
   /** public submission log update interval */
   int plog_update_time;
+  /** minimal interval between the regenerations of the standings files */
+  int standings_update_time;
   /** directory where to install a symlink to the public log file */
   unsigned char *plog_symlink_dir;
 
@@ -982,6 +984,8 @@ struct section_problem_data
   ejbyteflag_t enable_process_group;
   /** kill all processes belonging to 'ejexec' user */
   ejbyteflag_t enable_kill_all;
+  /** the input file is not modified by the program, so it may be shared */
+  ejbyteflag_t readonly_input;
   /** hide variant number from user */
   ejbyteflag_t hide_variant;
   /** enable testlib-compatibility mode */
@@ -1307,6 +1311,8 @@ struct section_problem_data
   int max_open_file_count;
   /** max number of processes per user */
   int max_process_count;
+  /** number of tests to run concurrently (0, 1 - sequential testing) */
+  int parallel_tests;
 
   /** external id (for external application binding) */
   unsigned char *extid;
@@ -0,0 +1,71 @@
+/* -*- mode: c; c-basic-offset: 4 -*- */
+
+#ifndef __REPORT_SUMMARY_H__
+#define __REPORT_SUMMARY_H__
+
+/* Copyright (C) 2024 Alexander Chernov <cher@ejudge.ru> */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "ejudge/ej_types.h"
+
+#include <stdint.h>
+
+struct run_entry;
+struct testing_report_xml;
+
+enum
+{
+    REPORT_SUMMARY_VALID = 1,
+    REPORT_SUMMARY_NO_REPORT = 2,       // the report cannot be read
+    REPORT_SUMMARY_STATUS_OVERFLOW = 4, // a test status does not fit the mask
+};
+
+/* compact summary of a testing report, the summary is valid as long as
+   the run_uuid, judge_uuid (or judge_id) and status of the run match */
+struct report_summary
+{
+    ej_uuid_t run_uuid;
+    ej_uuid_t judge_uuid;
+    unsigned char status;
+    unsigned char flags;
+    unsigned char pad[2];
+    uint32_t test_status_mask;  // bit (1 << status) for each test status
+    int32_t run_tests;
+    int32_t max_time_ms;
+    int64_t max_memory_used;
+    unsigned char pad2[8];
+};
+
+struct report_summary_cache;
+
+/* the cache is persisted in the file path, NULL is returned on error */
+struct report_summary_cache *
+report_summary_cache_open(const unsigned char *path);
+struct report_summary_cache *
+report_summary_cache_free(struct report_summary_cache *rsc);
+
+/* returns NULL, if there is no valid summary for the run */
+const struct report_summary *
+report_summary_cache_get(
+        const struct report_summary_cache *rsc,
+        const struct run_entry *re);
+
+/* tr == NULL means that the run has no readable report */
+void
+report_summary_cache_put(
+        struct report_summary_cache *rsc,
+        const struct run_entry *re,
+        const struct testing_report_xml *tr);
+
+#endif /* __REPORT_SUMMARY_H__ */
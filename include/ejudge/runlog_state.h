@@ -21,6 +21,7 @@
 #include <stdint.h>
 
 #define RUNLOG_MAX_SIZE    15625000         // 2000000000 bytes
+#define RUNLOG_CHANGE_QUEUE_SIZE 4096       // recent changes remembered for incremental consumers
 
 struct user_flags_info_s
 {
@@ -32,6 +33,24 @@ struct run_entry_extra
 {
   int prev_user_id;            /* previous run with the same user_id, -1, if none*/
   int next_user_id;            /* next run with the same user_id, -1, if none */
+  int prev_user_prob_id;       /* previous run with the same user_id and prob_id, -1, if none */
+  int next_user_prob_id;       /* next run with the same user_id and prob_id, -1, if none */
+  int prev_prob_id;            /* previous run with the same prob_id, -1, if none */
+  int next_prob_id;            /* next run with the same prob_id, -1, if none */
+};
+
+struct user_prob_run_index_entry
+{
+  int user_id;                 /* 0, if the entry is empty */
+  int prob_id;
+  int run_id_first;            /* first run with the user_id and prob_id, -1, if none */
+  int run_id_last;             /* last run with the user_id and prob_id, -1, if none */
+};
+
+struct prob_run_index_entry
+{
+  int run_id_first;            /* first run with the prob_id, -1, if none */
+  int run_id_last;             /* last run with the prob_id, -1, if none */
 };
 
 struct uuid_hash_entry
@@ -66,6 +85,7 @@ struct user_run_header_info
 };
 
 _Static_assert(sizeof(struct user_run_header_info) == 64, "user_run_header_info must have size 64");
+_Static_assert(sizeof(struct run_entry_hot) == 32, "run_entry_hot must have size 32");
 
 struct user_run_header_state
 {
@@ -90,15 +110,38 @@ struct runlog_state
   // timestamp of the last change with microsecond precision
   long long last_update_time_us;
 
+  // journal of the recent changes
+  long long change_serial;   // the serial number of the last change
+  int *change_queue;         // run_id changed with serial s is at s % RUNLOG_CHANGE_QUEUE_SIZE, -1 - unknown
+
   struct user_flags_info_s user_flags; // banned/invisible/locked flags for users
 
   int max_user_id;
   int user_count;
 
+  // hot copy of runs, see run_get_hot_entries_ptr, hot_runs[i] is for runs[i],
+  // synchronized lazily by replaying the change journal from hot_serial
+  struct run_entry_hot *hot_runs;
+  int hot_f, hot_u, hot_a;
+  int hot_valid;
+  long long hot_serial;
+  // the number of runs in the transient statuses among the hot runs
+  int hot_transient;
+
   int run_extra_f;  // first index offset, i.e. run_extras[0] is actually index for run id run_extra_f, see also run_f
   int run_extra_u, run_extra_a;
   struct run_entry_extra *run_extras; /* run indices */
 
+  // (user_id, prob_id) -> runs hash, rebuilt together with the user index
+  int user_prob_hash_size;  // the size of the hash table, power of 2
+  int user_prob_hash_used;  // the number of entries in the table
+  struct user_prob_run_index_entry *user_prob_hash;
+
+  // prob_id -> runs index, rebuilt lazily after non-append changes
+  int prob_index_valid;
+  int prob_index_size;
+  struct prob_run_index_entry *prob_index;
+
   // UUID hash information
   int uuid_hash_state; // -1 - disabled, 0 - not built, 1 - ok
   int uuid_hash_size;  // the size of the hash table
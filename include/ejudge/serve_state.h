@@ -36,6 +36,8 @@ struct clarlog_state;
 struct teamdb_state;
 struct user_state_info;
 struct user_filter_info;
+struct standings_cache;
+struct report_summary_cache;
 struct teamdb_db_callbacks;
 struct userlist_clnt;
 struct ejudge_cfg;
@@ -100,6 +102,7 @@ struct compile_dir_item
 {
   unsigned char *status_dir;
   unsigned char *report_dir;
+  int watch_id;                 // spool watch of status_dir, -1 - scan always
 };
 
 struct compile_queue_item
@@ -117,6 +120,7 @@ struct run_dir_item
   unsigned char *report_dir;
   unsigned char *team_report_dir;
   unsigned char *full_report_dir;
+  int watch_id;                 // spool watch of status_dir, -1 - scan always
 };
 
 struct run_queue_item
@@ -322,6 +326,7 @@ struct serve_state
   time_t stat_report_time;
 
   time_t last_update_public_log;
+  time_t last_update_standings;
   time_t last_update_external_xml_log;
   time_t last_update_internal_xml_log;
   time_t last_update_status_file;
@@ -333,6 +338,11 @@ struct serve_state
   // runlog last update timestamp on the moment of internal XML update
   long long last_update_internal_xml_log_us;
 
+  // standings regeneration is postponed to serve_flush_standings_file
+  int defer_standings_update;
+  int standings_dirty;
+  int standings_phase;
+
   time_t last_periodic_check;
   time_t last_daily_reminder;
 
@@ -379,6 +389,15 @@ struct serve_state
 
   // serial number for the testing user
   int exec_user_serial;
+
+  // incrementally maintained standings state, owned by the standings page
+  struct standings_cache *standings_cache;
+  void (*standings_cache_free)(struct standings_cache *);
+  // the standings cache cannot be used in this contest
+  int standings_cache_unsupported;
+
+  // summaries of the testing reports, used by the run filters
+  struct report_summary_cache *report_summary_cache;
 };
 typedef struct serve_state *serve_state_t;
 
@@ -418,6 +437,11 @@ serve_update_public_log_file(
         struct contest_extra *extra,
         serve_state_t state,
         const struct contest_desc *cnts);
+void
+serve_flush_standings_file(
+        struct contest_extra *extra,
+        serve_state_t state,
+        const struct contest_desc *cnts);
 void serve_update_external_xml_log(serve_state_t state,
                                    const struct contest_desc *cnts);
 void serve_update_internal_xml_log(serve_state_t state,
@@ -1017,5 +1041,14 @@ serve_notify_run_update(
         const struct ejudge_cfg *config,
         serve_state_t cs,
         const struct run_entry *re);
+void
+serve_notify_clar_update(
+        const struct ejudge_cfg *config,
+        serve_state_t cs,
+        int clar_id);
+
+/* set by ej-contests to push the updates to the WebSocket clients */
+extern void (*serve_run_update_hook)(serve_state_t cs, const struct run_entry *re);
+extern void (*serve_clar_update_hook)(serve_state_t cs, int clar_id);
 
 #endif /* __SERVE_STATE_H__ */
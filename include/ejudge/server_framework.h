@@ -29,6 +29,10 @@ enum
   STATE_READ_READY,
   STATE_WRITE,
   STATE_WRITECLOSE,
+  STATE_FCGI_READ,    // FastCGI connection, reading the request records
+  STATE_FCGI_READY,   // FastCGI request is complete, but not started yet
+  STATE_FCGI_BUSY,    // FastCGI request is being served
+  STATE_FCGI_CLOSE,   // FastCGI reply is being flushed before the close
   STATE_DISCONNECT,
 };
 
@@ -54,6 +58,8 @@ struct ws_frame
 };
 
 struct client_state;
+struct server_framework_state;
+struct fcgi_conn;
 
 struct client_auth
 {
@@ -101,6 +107,10 @@ struct client_state
 
   int id;
   int fd;
+
+  // main loop bookkeeping
+  unsigned poll_events; // events registered in the epoll set
+  int poll_dirty;       // the client is queued for the state recheck
 };
 
 struct ht_client_state
@@ -125,6 +135,9 @@ struct ht_client_state
 
   int contest_id;
   void (*destroy_callback)(struct client_state*);
+
+  // not NULL for the connections from the web server
+  struct fcgi_conn *fcgi;
 };
 
 struct ws_client_state
@@ -146,6 +159,9 @@ struct ws_client_state
 
   struct client_auth *auth;
 
+  // the framework state, to requeue the client on output
+  struct server_framework_state *nsf_state;
+
   long long last_read_time_us;
   long long last_write_time_us;
 
@@ -201,6 +217,10 @@ struct server_framework_params
   // WebSocket port, if > 0, then the server listens for websocket incoming connections
   int ws_port;
 
+  // FastCGI socket path, if set, the server answers the HTTP requests
+  // forwarded by the web server without the CGI program
+  unsigned char *fcgi_socket_path;
+
   struct ws_client_state *(*ws_alloc_state)(
         struct server_framework_state *);
 
@@ -245,6 +265,9 @@ void nsf_new_autoclose(struct server_framework_state *state,
                        struct client_state *p, void *write_buf,
                        size_t write_len);
 void nsf_close_client_fds(struct client_state *p);
+int  nsf_is_ws_client(const struct client_state *p);
+void nsf_detach_worker(struct server_framework_state *state,
+                       struct client_state *keep);
 struct client_state * nsf_get_client_by_id(struct server_framework_state *,
                                            int id);
 
@@ -267,6 +290,29 @@ nsf_add_directory_watch(
                 void *user),
         void *user);
 
+/*
+ * readiness watches for spool directories which are scanned by the caller:
+ * a watch is ready when a packet appears in DIR/dir, the watches for
+ * the same directory are shared, -1 is returned if inotify is not available
+ */
+int
+nsf_add_spool_watch(
+        struct server_framework_state *state,
+        const unsigned char *dir);
+void
+nsf_remove_spool_watch(
+        struct server_framework_state *state,
+        int id);
+/* returns the ready flag and clears it */
+int
+nsf_test_spool_watch(
+        struct server_framework_state *state,
+        int id);
+void
+nsf_set_spool_watch_ready(
+        struct server_framework_state *state,
+        int id);
+
 void
 nsf_add_post_select(
         const struct ejudge_cfg *config,
@@ -300,6 +346,7 @@ struct server_framework_watch
 int nsf_add_watch(struct server_framework_state *,
                   struct server_framework_watch*);
 int nsf_remove_watch(struct server_framework_state *, int);
+int nsf_set_watch_mode(struct server_framework_state *, int fd, int mode);
 int nsf_is_restart_requested(struct server_framework_state *);
 
 void nsf_err_bad_packet_length(struct server_framework_state *,
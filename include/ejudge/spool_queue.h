@@ -0,0 +1,51 @@
+/* -*- mode: c; c-basic-offset: 4 -*- */
+
+#ifndef __SPOOL_QUEUE_H__
+#define __SPOOL_QUEUE_H__
+
+/* Copyright (C) 2024 Alexander Chernov <cher@ejudge.ru> */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+
+/*
+ * in-memory index of a spool directory (the 'dir' subdirectory of
+ * the spool), maintained with inotify, the packets are picked
+ * in the same order as scan_dir does
+ */
+struct spool_queue;
+
+/* returns NULL, if inotify cannot be used, scan_dir should be used then */
+struct spool_queue *
+spool_queue_open(const unsigned char *spool_path);
+struct spool_queue *
+spool_queue_free(struct spool_queue *q);
+
+/* the descriptor becomes readable when the spool directory changes */
+int
+spool_queue_get_fd(const struct spool_queue *q);
+
+/* same semantics as scan_dir */
+int
+spool_queue_next(
+        struct spool_queue *q,
+        char *found_item,
+        size_t fi_size,
+        int random_mode);
+
+/* same semantics as scan_dir_add_ignored */
+void
+spool_queue_add_ignored(struct spool_queue *q, const unsigned char *name);
+
+#endif /* __SPOOL_QUEUE_H__ */
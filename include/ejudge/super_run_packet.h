@@ -189,11 +189,13 @@ struct super_run_in_problem_packet
   ej_size64_t max_file_size;
   int max_open_file_count;
   int max_process_count;
+  int parallel_tests;
   unsigned char *spelling;
   unsigned char *open_tests;
   ejintbool_t enable_process_group;
   unsigned char *umask;
   ejintbool_t enable_kill_all;
+  ejintbool_t readonly_input;
   unsigned char *uuid;
   ejintbool_t enable_extended_info;
   ejintbool_t stop_on_first_fail;
@@ -42,6 +42,9 @@ struct teamdb_db_callbacks
 {
   void *user_data;
   int (*list_all_users)(void *, int, unsigned char **, struct UserlistBinaryHeader **p_header);
+  // optional: get the users changed since the vintage, the full list
+  // may be returned, if ej-users cannot make a delta
+  int (*list_users_delta)(void *, int, int, struct UserlistBinaryHeader **p_header);
 };
 struct userlist_user;
 
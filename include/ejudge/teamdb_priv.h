@@ -49,6 +49,13 @@ struct old_db_state
   key_t shm_key;
 };
 
+/* open addressing hash of user_id's by a string key */
+struct teamdb_hash
+{
+  int size;                     /* power of 2, 0 - not built */
+  int *ids;                     /* user_id's, 0 - empty slot */
+};
+
 struct UserlistBinaryHeader;
 struct teamdb_state
 {
@@ -65,10 +72,23 @@ struct teamdb_state
   struct UserlistBinaryHeader *header;
   struct userlist_list *users;
 
+  /* delta updates from ej-users: the deltas own the memory of the changed
+     users, the user_map of the header is replaced by our own copy */
+  int vintage;
+  int delta_disabled;
+  int delta_u, delta_a;
+  struct UserlistBinaryHeader **deltas;
+  int delta_users;
+  struct userlist_user **user_map;
+
   int total_participants;
   struct userlist_user **participants;
   struct userlist_contest **u_contests;
 
+  struct teamdb_hash login_hash;
+  struct teamdb_hash name_hash;
+  struct teamdb_hash cypher_hash;
+
   int extra_out_of_sync;
   int extra_num;
   struct teamdb_extra **extra_info;
@@ -42,7 +42,9 @@ typedef struct UserlistBinaryHeader
     uint32_t max_user_id;          // maximum user_id in the data
     uint32_t root_offset;          // offset from data[] to the root of the tree, currently 16
     int32_t contest_id;
-    unsigned char pad3[12];
+    int32_t vintage;               // change vintage of the user list in ej-users
+    uint32_t delta_count;          // number of user_id's in the delta array
+    uint32_t delta_offset;         // offset from data[] to the array of changed user_id's, 0 - not a delta
     unsigned char data[];
 } UserlistBinaryHeader;
 
@@ -60,6 +62,8 @@ typedef struct UserlistBinaryContext
     size_t  user_offsets_size;
     size_t *user_offsets;
     uint32_t root_offset;
+    uint32_t delta_count;
+    uint32_t delta_offset;
     size_t total_size;
 } UserlistBinaryContext;
 
@@ -75,6 +79,13 @@ userlist_bin_marshall_user(
         const struct userlist_user *u,
         int contest_id);
 
+/* mark the data as a delta containing only the users listed in user_ids */
+void
+userlist_bin_marshall_delta(
+        UserlistBinaryContext *cntx,
+        const int *user_ids,
+        int count);
+
 UserlistBinaryHeader *
 userlist_bin_marshall(
         void *dst,
@@ -95,5 +106,8 @@ const struct userlist_list *
 userlist_bin_unmarshall(UserlistBinaryHeader *header);
 const struct userlist_list *
 userlist_bin_get_root(const UserlistBinaryHeader *header);
+/* returns NULL, if the data is a full user list */
+const int32_t *
+userlist_bin_get_delta(const UserlistBinaryHeader *header, int *p_count);
 
 #endif /* __USERLIST_BIN_H__ */
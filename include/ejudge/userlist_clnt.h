@@ -143,6 +143,12 @@ userlist_clnt_get_cookie_2(
         ej_cookie_t cookie,
         ej_cookie_t client_key,
         struct UserlistGetCookieResult *p_res);
+/* parse the reply to ULS_*_GET_COOKIE, the reply packet is consumed */
+int
+userlist_clnt_parse_cookie_reply(
+        size_t in_size,
+        void *void_in,
+        struct UserlistGetCookieResult *p_res);
 
 int
 userlist_clnt_set_cookie(
@@ -523,6 +529,13 @@ userlist_clnt_bin_data(
         int cmd,
         int contest_id,
         unsigned char **p_data);
+int
+userlist_clnt_bin_data_delta(
+        struct userlist_clnt *clnt,
+        int cmd,
+        int contest_id,
+        int vintage,
+        unsigned char **p_data);
 
 struct userlist_cookie;
 int
@@ -544,4 +557,82 @@ userlist_clnt_api_key_request(
         struct userlist_api_key **p_out_api_keys,
         struct userlist_contest_info *p_cnts_info);
 
+/*
+ * asynchronous client: the requests are sent without waiting for
+ * the replies, several requests may be in flight on one connection,
+ * the server replies to them in order, so the replies are matched
+ * to the requests by the order, each request is identified by
+ * the serial number returned by the send functions
+ */
+struct userlist_async;
+typedef struct userlist_async *userlist_async_t;
+
+enum
+{
+  USERLIST_ASYNC_READ = 1,
+  USERLIST_ASYNC_WRITE = 2,
+};
+
+/* status < 0 - the request failed, the reply is not available,
+   the reply packet is freed after the callback returns */
+typedef void (*userlist_async_reply_func_t)(
+        void *user,
+        long long request_id,
+        int status,
+        size_t size,
+        const void *data);
+/* the ownership of res->data is passed to the callback, if r >= 0 */
+typedef void (*userlist_async_cookie_func_t)(
+        void *user,
+        long long request_id,
+        int r,
+        struct UserlistGetCookieResult *res);
+typedef void (*userlist_async_status_func_t)(
+        void *user,
+        long long request_id,
+        int r);
+
+/* the connection is taken over from clnt, clnt is freed */
+userlist_async_t userlist_async_open(userlist_clnt_t clnt);
+/* the requests in flight are completed with -ULS_ERR_DISCONNECT */
+userlist_async_t userlist_async_close(userlist_async_t ua);
+int userlist_async_get_fd(userlist_async_t ua);
+/* USERLIST_ASYNC_READ | USERLIST_ASYNC_WRITE to wait for */
+int userlist_async_get_events(userlist_async_t ua);
+int userlist_async_get_pending(userlist_async_t ua);
+/* the time the oldest request in flight was sent, 0 - no requests */
+time_t userlist_async_get_oldest_time(userlist_async_t ua);
+/* perform I/O and complete the requests, < 0 - the connection is broken */
+int userlist_async_process(userlist_async_t ua, int events);
+/* the reply to the request will be ignored */
+void userlist_async_cancel(userlist_async_t ua, long long request_id);
+
+long long
+userlist_async_send(
+        userlist_async_t ua,
+        size_t size,
+        const void *data,
+        userlist_async_reply_func_t callback,
+        void *user);
+long long
+userlist_async_get_cookie(
+        userlist_async_t ua,
+        int cmd,
+        const ej_ip_t *origin_ip,
+        int ssl,
+        ej_cookie_t cookie,
+        ej_cookie_t client_key,
+        userlist_async_cookie_func_t callback,
+        void *user);
+long long
+userlist_async_register_contest(
+        userlist_async_t ua,
+        int cmd,
+        int user_id,
+        int contest_id,
+        const ej_ip_t *ip,
+        int ssl_flag,
+        userlist_async_status_func_t callback,
+        void *user);
+
 #endif /* __USERLIST_CLNT_H__ */
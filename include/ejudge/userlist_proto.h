@@ -131,6 +131,7 @@ enum
     ULS_DELETE_API_KEY,
     ULS_PRIV_CREATE_COOKIE,
     ULS_COPY_ALL,
+    ULS_LIST_STANDINGS_USERS_3,
 
     ULS_LAST_CMD
   };
@@ -366,6 +367,14 @@ struct userlist_pk_map_contest
   int   contest_id;
 };
 
+/* request for the users changed since the given vintage */
+struct userlist_pk_list_users_delta
+{
+  short request_id;
+  int   contest_id;
+  int   vintage;
+};
+
 struct userlist_pk_edit_registration
 {
   short          request_id;
@@ -0,0 +1,96 @@
+/* -*- mode: c; c-basic-offset: 4 -*- */
+
+#ifndef __USERLIST_SHM_H__
+#define __USERLIST_SHM_H__
+
+/* Copyright (C) 2024 Alexander Chernov <cher@ejudge.ru> */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "ejudge/ej_types.h"
+#include "ejudge/userlist_bin.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * shared memory segments published by ej-users and mapped read-only
+ * by ej-contests: the segment of a contest holds the standings user list
+ * in the userlist_bin format, the cookie segment (contest_id 0) holds
+ * the recent replies to ULS_*_GET_COOKIE; the data is protected by
+ * sequence counters, the readers never block the writer
+ */
+struct userlist_shm;
+struct userlist_pk_login_ok;
+struct UserlistGetCookieResult;
+
+/* ej-users side */
+struct userlist_shm *
+userlist_shm_create(
+        const unsigned char *socket_path,
+        int contest_id,
+        size_t users_capacity);
+/* the segment is marked dead and removed, if created by this process */
+struct userlist_shm *
+userlist_shm_close(struct userlist_shm *shm);
+/* the readers ignore the segments not touched for several seconds */
+void
+userlist_shm_touch(struct userlist_shm *shm, time_t cur_time, int ip_check);
+/* returns -1, if the user list does not fit into the segment */
+int
+userlist_shm_publish_users(
+        struct userlist_shm *shm,
+        const UserlistBinaryContext *cntx,
+        int vintage);
+/* the cached cookies of the user become stale, user_id 0 - all users */
+void
+userlist_shm_forget_user(struct userlist_shm *shm, int user_id);
+void
+userlist_shm_forget_cookie(struct userlist_shm *shm, ej_cookie_t cookie);
+void
+userlist_shm_put_cookie(
+        struct userlist_shm *shm,
+        int request_id,
+        const ej_ip_t *ip,
+        int ssl,
+        const struct userlist_pk_login_ok *pkt,
+        size_t size);
+
+/* ej-contests side, returns NULL, if the segment is not available */
+struct userlist_shm *
+userlist_shm_get(
+        const unsigned char *socket_path,
+        int contest_id,
+        time_t cur_time);
+/* returns 1 and the copy of the cached reply, 0, if not cached */
+int
+userlist_shm_get_cookie(
+        struct userlist_shm *shm,
+        int request_id,
+        const ej_ip_t *ip,
+        int ssl,
+        ej_cookie_t cookie,
+        ej_cookie_t client_key,
+        time_t cur_time,
+        struct UserlistGetCookieResult *p_res);
+/*
+ * returns the unmarshalled copy of the user list, or an empty delta,
+ * if the list did not change since the vintage, -1, if not published
+ */
+int
+userlist_shm_get_users(
+        struct userlist_shm *shm,
+        int vintage,
+        UserlistBinaryHeader **p_header);
+
+#endif /* __USERLIST_SHM_H__ */
@@ -20,14 +20,16 @@
 static const flatbuffers_voffset_t __ej_compile_Heartbeat_required[] = { 0 };
 typedef flatbuffers_ref_t ej_compile_Heartbeat_ref_t;
 static ej_compile_Heartbeat_ref_t ej_compile_Heartbeat_clone(flatbuffers_builder_t *B, ej_compile_Heartbeat_table_t t);
-__flatbuffers_build_table(flatbuffers_, ej_compile_Heartbeat, 9)
+__flatbuffers_build_table(flatbuffers_, ej_compile_Heartbeat, 11)
 
 #define __ej_compile_Heartbeat_formal_args ,\
   int64_t v0, int64_t v1, int64_t v2, int64_t v3,\
-  int64_t v4, flatbuffers_string_ref_t v5, flatbuffers_string_ref_t v6, flatbuffers_string_ref_t v7, int32_t v8
+  int64_t v4, flatbuffers_string_ref_t v5, flatbuffers_string_ref_t v6, flatbuffers_string_ref_t v7,\
+  int32_t v8, int64_t v9, int64_t v10
 #define __ej_compile_Heartbeat_call_args ,\
   v0, v1, v2, v3,\
-  v4, v5, v6, v7, v8
+  v4, v5, v6, v7,\
+  v8, v9, v10
 static inline ej_compile_Heartbeat_ref_t ej_compile_Heartbeat_create(flatbuffers_builder_t *B __ej_compile_Heartbeat_formal_args);
 __flatbuffers_build_table_prolog(flatbuffers_, ej_compile_Heartbeat, ej_compile_Heartbeat_file_identifier, ej_compile_Heartbeat_type_identifier)
 
@@ -40,6 +42,8 @@ __flatbuffers_build_string_field(5, flatbuffers_, ej_compile_Heartbeat_instance_
 __flatbuffers_build_string_field(6, flatbuffers_, ej_compile_Heartbeat_queue, ej_compile_Heartbeat)
 __flatbuffers_build_string_field(7, flatbuffers_, ej_compile_Heartbeat_ip_address, ej_compile_Heartbeat)
 __flatbuffers_build_scalar_field(8, flatbuffers_, ej_compile_Heartbeat_pid, flatbuffers_int32, int32_t, 4, 4, INT32_C(0), ej_compile_Heartbeat)
+__flatbuffers_build_scalar_field(9, flatbuffers_, ej_compile_Heartbeat_cache_hits, flatbuffers_int64, int64_t, 8, 8, INT64_C(0), ej_compile_Heartbeat)
+__flatbuffers_build_scalar_field(10, flatbuffers_, ej_compile_Heartbeat_cache_misses, flatbuffers_int64, int64_t, 8, 8, INT64_C(0), ej_compile_Heartbeat)
 
 static inline ej_compile_Heartbeat_ref_t ej_compile_Heartbeat_create(flatbuffers_builder_t *B __ej_compile_Heartbeat_formal_args)
 {
@@ -49,6 +53,8 @@ static inline ej_compile_Heartbeat_ref_t ej_compile_Heartbeat_create(flatbuffers
         || ej_compile_Heartbeat_start_time_ms_add(B, v2)
         || ej_compile_Heartbeat_accumulated_ms_add(B, v3)
         || ej_compile_Heartbeat_request_count_add(B, v4)
+        || ej_compile_Heartbeat_cache_hits_add(B, v9)
+        || ej_compile_Heartbeat_cache_misses_add(B, v10)
         || ej_compile_Heartbeat_instance_id_add(B, v5)
         || ej_compile_Heartbeat_queue_add(B, v6)
         || ej_compile_Heartbeat_ip_address_add(B, v7)
@@ -67,6 +73,8 @@ static ej_compile_Heartbeat_ref_t ej_compile_Heartbeat_clone(flatbuffers_builder
         || ej_compile_Heartbeat_start_time_ms_pick(B, t)
         || ej_compile_Heartbeat_accumulated_ms_pick(B, t)
         || ej_compile_Heartbeat_request_count_pick(B, t)
+        || ej_compile_Heartbeat_cache_hits_pick(B, t)
+        || ej_compile_Heartbeat_cache_misses_pick(B, t)
         || ej_compile_Heartbeat_instance_id_pick(B, t)
         || ej_compile_Heartbeat_queue_pick(B, t)
         || ej_compile_Heartbeat_ip_address_pick(B, t)
@@ -55,6 +55,8 @@ __flatbuffers_define_string_field(5, ej_compile_Heartbeat, instance_id, 0)
 __flatbuffers_define_string_field(6, ej_compile_Heartbeat, queue, 0)
 __flatbuffers_define_string_field(7, ej_compile_Heartbeat, ip_address, 0)
 __flatbuffers_define_scalar_field(8, ej_compile_Heartbeat, pid, flatbuffers_int32, int32_t, INT32_C(0))
+__flatbuffers_define_scalar_field(9, ej_compile_Heartbeat, cache_hits, flatbuffers_int64, int64_t, INT64_C(0))
+__flatbuffers_define_scalar_field(10, ej_compile_Heartbeat, cache_misses, flatbuffers_int64, int64_t, INT64_C(0))
 
 
 #include "flatcc/flatcc_epilogue.h"
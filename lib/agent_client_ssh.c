@@ -20,8 +20,8 @@
 #include "ejudge/xalloc.h"
 #include "ejudge/errlog.h"
 #include "ejudge/osdeps.h"
-#include "ejudge/base64.h"
-#include "ejudge/ej_lzma.h"
+#include "ejudge/agent_proto.h"
+#include "ejudge/sha256utils.h"
 
 #include <stdlib.h>
 #include "ejudge/cJSON.h"
@@ -42,7 +42,6 @@
 #include <sys/mman.h>
 #include <sys/timerfd.h>
 #include <ctype.h>
-#include <zlib.h>
 
 struct FDChunk
 {
@@ -63,6 +62,9 @@ struct Future
     pthread_cond_t c;
 
     cJSON *value;
+    unsigned char *payload;     // the received message
+    const unsigned char *blob;  // the attachment in the payload
+    size_t blob_size;
     long long expiration_time_ms;
     int cancel_requested;
 
@@ -132,6 +134,9 @@ struct AgentClientSsh
 
     long long ping_time_ms;
     struct Future *ping_future;
+
+    // binary framing is negotiated on connect
+    _Atomic _Bool binary_mode;
 };
 
 static void future_init(struct Future *f, int serial)
@@ -147,6 +152,7 @@ static void future_fini(struct Future *f)
     pthread_mutex_destroy(&f->m);
     pthread_cond_destroy(&f->c);
     if (f->value) cJSON_Delete(f->value);
+    free(f->payload);
 }
 
 static void future_wait(struct AgentClientSsh *acs, struct Future *f)
@@ -318,7 +324,25 @@ do_pipe_read(struct AgentClientSsh *acs)
         acs->rd_size += r;
         acs->rd_data[acs->rd_size] = 0;
     }
-    if (acs->rd_size >= 2) {
+    if (acs->binary_mode) {
+        int s = 0;
+        while (1) {
+            long long size = agent_proto_frame_size(acs->rd_data + s, acs->rd_size - s);
+            if (size < 0) {
+                err("pipe_read_func: invalid frame");
+                acs->need_cleanup = 1;
+                return;
+            }
+            if (!size) break;
+            add_rchunk(acs, &acs->rd_data[s + AGENT_FRAME_HEADER_SIZE],
+                       size - AGENT_FRAME_HEADER_SIZE);
+            s += size;
+        }
+        if (s > 0) {
+            acs->rd_size -= s;
+            memmove(acs->rd_data, acs->rd_data + s, acs->rd_size);
+        }
+    } else if (acs->rd_size >= 2) {
         int s = 0;
         for (int i = 1; i < acs->rd_size; ++i) {
             if (acs->rd_data[i] == '\n' && acs->rd_data[i - 1] == '\n') {
@@ -434,7 +458,10 @@ handle_rchunks(struct AgentClientSsh *acs)
 
     for (int i = 0; i < acs->rchunku; ++i) {
         struct FDChunk *c = &acs->rchunks[i];
-        if (acs->verbose_mode) {
+        const unsigned char *blob = NULL;
+        size_t blob_size = 0;
+        int framed = agent_proto_get_blob(c->data, c->size, &blob, &blob_size);
+        if (acs->verbose_mode && !framed) {
             while (c->size > 0 && isspace(c->data[c->size - 1])) {
                 --c->size;
             }
@@ -450,8 +477,16 @@ handle_rchunks(struct AgentClientSsh *acs)
                 err("invalid JSON");
             } else {
                 int serial = js->valuedouble;
+                cJSON *jf = cJSON_GetObjectItem(j, "framing");
+                if (jf && jf->type == cJSON_String && !strcmp(jf->valuestring, "binary")) {
+                    // the next message from the agent is a frame
+                    acs->binary_mode = 1;
+                }
                 struct Future *f = get_future(acs, serial);
                 if (f) {
+                    f->payload = c->data; c->data = NULL;
+                    f->blob = blob;
+                    f->blob_size = blob_size;
                     if (f->callback) {
                         f->value = j; j = NULL;
                         f->ready = 1;
@@ -646,6 +681,17 @@ thread_func(void *ptr)
     return NULL;
 }
 
+static cJSON *
+create_request(
+        struct AgentClientSsh *acs,
+        struct Future *f,
+        long long *p_time_ms,
+        const unsigned char *query);
+static void
+add_wchunk_json(
+        struct AgentClientSsh *acs,
+        cJSON *json);
+
 static int
 connect_func(struct AgentClient *ac)
 {
@@ -789,6 +835,17 @@ connect_func(struct AgentClient *ac)
     }
     pthread_attr_destroy(&pa);
 
+    // the older agents ignore the framing request and stay in the text mode
+    {
+        struct Future f;
+        cJSON *jq = create_request(acs, &f, NULL, "ping");
+        cJSON_AddStringToObject(jq, "framing", "binary");
+        add_wchunk_json(acs, jq);
+        cJSON_Delete(jq);
+        future_wait(acs, &f);
+        future_fini(&f);
+    }
+
     return 0;
 
 fail:
@@ -822,15 +879,23 @@ is_closed_func(struct AgentClient *ac)
 }
 
 static void
-add_wchunk_json(
+add_wchunk_json_2(
         struct AgentClientSsh *acs,
-        cJSON *json)
+        cJSON *json,
+        const struct AgentBlob *blob)
 {
     char *str = cJSON_PrintUnformatted(json);
     int len = strlen(str);
     if (acs->verbose_mode) {
         info("to agent: %s", str);
     }
+    if (acs->binary_mode) {
+        size_t size = 0;
+        unsigned char *frame = agent_proto_make_frame(str, len, blob, &size);
+        free(str);
+        add_wchunk_move(acs, frame, size);
+        return;
+    }
     str = realloc(str, len + 3);
     str[len++] = '\n';
     str[len++] = '\n';
@@ -838,6 +903,14 @@ add_wchunk_json(
     add_wchunk_move(acs, str, len);
 }
 
+static void
+add_wchunk_json(
+        struct AgentClientSsh *acs,
+        cJSON *json)
+{
+    add_wchunk_json_2(acs, json, NULL);
+}
+
 static cJSON *
 create_request(
         struct AgentClientSsh *acs,
@@ -868,7 +941,7 @@ create_request(
 static int
 process_file_result(
         struct AgentClientSsh *acs,
-        cJSON *j,
+        struct Future *f,
         char **p_pkt_ptr,
         size_t *p_pkt_len);
 
@@ -924,7 +997,7 @@ poll_queue_func(
                     snprintf(pkt_name, pkt_len, "%s", jn->valuestring);
                     result = 1;
                 }
-                result = process_file_result(acs, f.value, p_data, p_size);
+                result = process_file_result(acs, &f, p_data, p_size);
             }
             cJSON *jt = cJSON_GetObjectItem(f.value, "t");
             if (jt && jt->type == cJSON_Number) {
@@ -942,10 +1015,11 @@ poll_queue_func(
 static int
 process_file_result(
         struct AgentClientSsh *acs,
-        cJSON *j,
+        struct Future *f,
         char **p_pkt_ptr,
         size_t *p_pkt_len)
 {
+    cJSON *j = f->value;
     cJSON *jok = cJSON_GetObjectItem(j, "ok");
     if (!jok || jok->type != cJSON_True) {
         return -1;
@@ -959,122 +1033,7 @@ process_file_result(
     if (!jf || jf->type != cJSON_True) {
         return 0;
     }
-    cJSON *jz = cJSON_GetObjectItem(j, "size");
-    if (!jz || jz->type != cJSON_Number) {
-        err("invalid json: no size");
-        return -1;
-    }
-    int size = (int) jz->valuedouble;
-    if (size < 0 || size > 1000000000) {
-        err("invalid json: invalid size");
-        return -1;
-    }
-    if (!size) {
-        char *ptr = malloc(1);
-        *ptr = 0;
-        *p_pkt_ptr = ptr;
-        *p_pkt_len = 0;
-        return 1;
-    }
-    cJSON *jb64 = cJSON_GetObjectItem(j, "b64");
-    if (!jb64 || jb64->type != cJSON_True) {
-        err("invalid json: no encoding");
-        return -1;
-    }
-    cJSON *jd = cJSON_GetObjectItem(j, "data");
-    if (!jd || jd->type != cJSON_String) {
-        err("invalid json: no data");
-        return -1;
-    }
-    int len = strlen(jd->valuestring);
-    cJSON *jgz = cJSON_GetObjectItem(j, "gz");
-    cJSON *jlzma = cJSON_GetObjectItem(j, "lzma");
-    if (jgz && jgz->type == cJSON_True) {
-        cJSON *jgzz = cJSON_GetObjectItem(j, "gz_size");
-        if (!jgzz || jgzz->type != cJSON_Number) {
-            err("invalid json: no gz_size");
-            return -1;
-        }
-        size_t gz_size = (size_t) jgzz->valuedouble;
-        char *gz_buf = malloc(len + 1);
-        int b64err = 0;
-        int n = base64u_decode(jd->valuestring, len, gz_buf, &b64err);
-        if (n != gz_size) {
-            err("invalid json: size mismatch");
-            free(gz_buf);
-            return -1;
-        }
-
-        z_stream zs = {};
-        if (inflateInit(&zs) != Z_OK) {
-            err("invalid json: libz failed");
-            free(gz_buf);
-            return -1;
-        }
-        zs.next_in = (Bytef *) gz_buf;
-        zs.avail_in = gz_size;
-        zs.total_in = gz_size;
-        unsigned char *ptr = malloc(size + 1);
-        zs.next_out = (Bytef *) ptr;
-        zs.avail_out = size;
-        zs.total_out = 0;
-        if (inflate(&zs, Z_FINISH) != Z_STREAM_END) {
-            err("invalid json: libz inflate failed");
-            free(gz_buf);
-            free(ptr);
-            inflateEnd(&zs);
-            return -1;
-        }
-        if (inflateEnd(&zs) != Z_OK) {
-            err("invalid json: libz inflate failed");
-            free(gz_buf);
-            free(ptr);
-            return -1;
-        }
-        ptr[size] = 0;
-        free(gz_buf);
-        *p_pkt_ptr = ptr;
-        *p_pkt_len = size;
-    } else if (jlzma && jlzma->type == cJSON_True) {
-        cJSON *jlzmaz = cJSON_GetObjectItem(j, "lzma_size");
-        if (!jlzmaz || jlzmaz->type != cJSON_Number) {
-            err("invalid json: no lzma_size");
-            return -1;
-        }
-        size_t lzma_size = (size_t) jlzmaz->valuedouble;
-        char *lzma_buf = malloc(len + 1);
-        int b64err = 0;
-        int n = base64u_decode(jd->valuestring, len, lzma_buf, &b64err);
-        if (n != lzma_size) {
-            err("invalid json: size mismatch");
-            free(lzma_buf);
-            return -1;
-        }
-        unsigned char *ptr = NULL;
-        size_t ptr_size = 0;
-        if (ej_lzma_decode_buf(lzma_buf, lzma_size, size, &ptr, &ptr_size) < 0) {
-            err("invalid json: lzma decode error");
-            free(lzma_buf);
-            return -1;
-        }
-        free(lzma_buf);
-        *p_pkt_ptr = ptr;
-        *p_pkt_len = ptr_size;
-    } else {
-        char *ptr = malloc(len + 1);
-        int b64err = 0;
-        int n = base64u_decode(jd->valuestring, len, ptr, &b64err);
-        if (n != size) {
-            err("invalid json: size mismatch");
-            free(ptr);
-            return -1;
-        }
-        ptr[size] = 0;
-        *p_pkt_ptr = ptr;
-        *p_pkt_len = size;
-    }
-
-    return 1;
+    return agent_proto_extract_file(j, f->blob, f->blob_size, p_pkt_ptr, p_pkt_len);
 }
 
 static int
@@ -1097,7 +1056,7 @@ get_packet_func(
     if (acs->is_stopped) {
         result = -1;
     } else {
-        result = process_file_result(acs, f.value, p_pkt_ptr, p_pkt_len);
+        result = process_file_result(acs, &f, p_pkt_ptr, p_pkt_len);
     }
 
     future_fini(&f);
@@ -1128,7 +1087,7 @@ get_data_func(
     if (acs->is_stopped) {
         result = -1;
     } else {
-        result = process_file_result(acs, f.value, p_pkt_ptr, p_pkt_len);
+        result = process_file_result(acs, &f, p_pkt_ptr, p_pkt_len);
     }
 
     future_fini(&f);
@@ -1136,83 +1095,14 @@ get_data_func(
 }
 
 static void
-add_file_to_object(cJSON *j, const char *data, size_t size)
+add_file_to_object(
+        struct AgentClientSsh *acs,
+        cJSON *j,
+        struct AgentBlob *blob,
+        const char *data,
+        size_t size)
 {
-    cJSON_AddNumberToObject(j, "size", (double) size);
-    if (!size) {
-        return;
-    }
-    // gzip mode
-    if (size < 32) {
-        cJSON_AddTrueToObject(j, "b64");
-        char *ptr = malloc(size * 2 + 16);
-        int n = base64u_encode(data, size, ptr);
-        ptr[n] = 0;
-        cJSON_AddStringToObject(j, "data", ptr);
-        free(ptr);
-    } else {
-        z_stream zs = {};
-        zs.next_in = (Bytef *) data;
-        zs.avail_in = size;
-        zs.total_in = size;
-
-        if (deflateInit(&zs, 9) != Z_OK) {
-            abort();
-        }
-        size_t bound = deflateBound(&zs, size);
-        char *gz_buf = malloc(bound);
-        zs.next_out = (Bytef*) gz_buf;
-        zs.avail_out = bound;
-        zs.total_out = 0;
-        int r = deflate(&zs, Z_FINISH);
-        if (r != Z_STREAM_END) {
-            abort();
-        }
-        size_t gz_size = zs.total_out;
-        if (deflateEnd(&zs) != Z_OK) {
-            abort();
-        }
-        cJSON_AddTrueToObject(j, "gz");
-        cJSON_AddNumberToObject(j, "gz_size", gz_size);
-        char *b64_buf = malloc(gz_size * 2 + 16);
-        int b64_size = base64u_encode(gz_buf, gz_size, b64_buf);
-        b64_buf[b64_size] = 0;
-        cJSON_AddTrueToObject(j, "b64");
-        cJSON_AddStringToObject(j, "data", b64_buf);
-        free(b64_buf);
-        free(gz_buf);
-    }
-    // lzma mode (unused)
-    if (size < 160) {
-        cJSON_AddTrueToObject(j, "b64");
-        char *ptr = malloc(size * 2 + 16);
-        int n = base64u_encode(data, size, ptr);
-        ptr[n] = 0;
-        cJSON_AddStringToObject(j, "data", ptr);
-        free(ptr);
-    } else {
-        unsigned char *lzma_buf = NULL;
-        size_t lzma_size = 0;
-        if (ej_lzma_encode_buf(data, size, &lzma_buf, &lzma_size) < 0) {
-            // fallback to uncompressed
-            cJSON_AddTrueToObject(j, "b64");
-            char *ptr = malloc(size * 2 + 16);
-            int n = base64u_encode(data, size, ptr);
-            ptr[n] = 0;
-            cJSON_AddStringToObject(j, "data", ptr);
-            free(ptr);
-        } else {
-            cJSON_AddTrueToObject(j, "lzma");
-            cJSON_AddNumberToObject(j, "lzma_size", (double) lzma_size);
-            char *b64_buf = malloc(lzma_size * 2 + 16);
-            int b64_size = base64u_encode(lzma_buf, lzma_size, b64_buf);
-            b64_buf[b64_size] = 0;
-            cJSON_AddTrueToObject(j, "b64");
-            cJSON_AddStringToObject(j, "data", b64_buf);
-            free(b64_buf);
-            free(lzma_buf);
-        }
-    }
+    agent_proto_add_file(j, data, size, acs->binary_mode?blob:NULL);
 }
 
 static int
@@ -1232,8 +1122,10 @@ put_reply_func(
     cJSON_AddStringToObject(jq, "server", contest_server_name);
     cJSON_AddNumberToObject(jq, "contest", contest_id);
     cJSON_AddStringToObject(jq, "run_name", run_name);
-    add_file_to_object(jq, pkt_ptr, pkt_len);
-    add_wchunk_json(acs, jq);
+    struct AgentBlob blob = {};
+    add_file_to_object(acs, jq, &blob, pkt_ptr, pkt_len);
+    add_wchunk_json_2(acs, jq, &blob);
+    agent_blob_free(&blob);
     cJSON_Delete(jq); jq = NULL;
 
     future_wait(acs, &f);
@@ -1271,8 +1163,10 @@ put_output_func(
     if (suffix) {
         cJSON_AddStringToObject(jq, "suffix", suffix);
     }
-    add_file_to_object(jq, pkt_ptr, pkt_len);
-    add_wchunk_json(acs, jq);
+    struct AgentBlob blob = {};
+    add_file_to_object(acs, jq, &blob, pkt_ptr, pkt_len);
+    add_wchunk_json_2(acs, jq, &blob);
+    agent_blob_free(&blob);
     cJSON_Delete(jq); jq = NULL;
 
     future_wait(acs, &f);
@@ -1343,8 +1237,10 @@ put_output_2_func(
     if (suffix) {
         cJSON_AddStringToObject(jq, "suffix", suffix);
     }
-    add_file_to_object(jq, pkt_ptr, pkt_len);
-    add_wchunk_json(acs, jq);
+    struct AgentBlob blob = {};
+    add_file_to_object(acs, jq, &blob, pkt_ptr, pkt_len);
+    add_wchunk_json_2(acs, jq, &blob);
+    agent_blob_free(&blob);
     cJSON_Delete(jq); jq = NULL;
     if (pkt_ptr) {
         munmap(pkt_ptr, pkt_len);
@@ -1430,7 +1326,7 @@ async_wait_init_func(
                     snprintf(pkt_name, pkt_len, "%s", jn->valuestring);
                     result = 1;
                 }
-                result = process_file_result(acs, f.value, p_data, p_size);
+                result = process_file_result(acs, &f, p_data, p_size);
             }
             if (jj && jj->type == cJSON_String && !strcmp("channel-result", jj->valuestring)) {
                 // the future to wait on is already create in the IO thread
@@ -1487,7 +1383,7 @@ async_wait_complete_func(
             snprintf(pkt_name, pkt_len, "%s", jn->valuestring);
             result = 1;
         }
-        result = process_file_result(acs, j, p_data, p_size);
+        result = process_file_result(acs, future, p_data, p_size);
     }
 
 done:
@@ -1576,8 +1472,10 @@ put_packet_func(
     long long time_ms;
     cJSON *jq = create_request(acs, &f, &time_ms, "put-packet");
     cJSON_AddStringToObject(jq, "pkt_name", pkt_name);
-    add_file_to_object(jq, pkt_ptr, pkt_len);
-    add_wchunk_json(acs, jq);
+    struct AgentBlob blob = {};
+    add_file_to_object(acs, jq, &blob, pkt_ptr, pkt_len);
+    add_wchunk_json_2(acs, jq, &blob);
+    agent_blob_free(&blob);
     cJSON_Delete(jq); jq = NULL;
 
     future_wait(acs, &f);
@@ -1667,8 +1565,10 @@ put_heartbeat_func(
     long long time_ms;
     cJSON *jq = create_request(acs, &f, &time_ms, "put-heartbeat");
     cJSON_AddStringToObject(jq, "name", file_name);
-    add_file_to_object(jq, data, size);
-    add_wchunk_json(acs, jq);
+    struct AgentBlob blob = {};
+    add_file_to_object(acs, jq, &blob, data, size);
+    add_wchunk_json_2(acs, jq, &blob);
+    agent_blob_free(&blob);
     cJSON_Delete(jq); jq = NULL;
 
     future_wait(acs, &f);
@@ -1790,8 +1690,10 @@ put_archive_2_func(
     if (suffix) {
         cJSON_AddStringToObject(jq, "suffix", suffix);
     }
-    add_file_to_object(jq, pkt_ptr, pkt_len);
-    add_wchunk_json(acs, jq);
+    struct AgentBlob blob = {};
+    add_file_to_object(acs, jq, &blob, pkt_ptr, pkt_len);
+    add_wchunk_json_2(acs, jq, &blob);
+    agent_blob_free(&blob);
     cJSON_Delete(jq); jq = NULL;
     if (pkt_ptr) {
         munmap(pkt_ptr, pkt_len);
@@ -1811,6 +1713,69 @@ put_archive_2_func(
     return result;
 }
 
+static int
+compute_file_digest(const unsigned char *path, char *buf, size_t size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK, 0);
+    if (fd < 0) return -1;
+    struct stat stb;
+    if (fstat(fd, &stb) < 0 || !S_ISREG(stb.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    if (stb.st_size <= 0) {
+        sha256b64ubuf(buf, size, (const unsigned char *) "", 0);
+        close(fd);
+        return 0;
+    }
+    unsigned char *ptr = mmap(NULL, stb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) return -1;
+    sha256b64ubuf(buf, size, ptr, stb.st_size);
+    munmap(ptr, stb.st_size);
+    return 0;
+}
+
+static void
+get_file_attrs(
+        cJSON *j,
+        time_t *p_mtime,
+        int *p_mode,
+        int *p_uid,
+        int *p_gid)
+{
+    time_t mtime = 0;
+    int mode = -1;
+    int uid = -1;
+    int gid = -1;
+
+    cJSON *jj = cJSON_GetObjectItem(j, "mtime");
+    if (jj && jj->type == cJSON_Number) {
+        mtime = jj->valuedouble;
+        if (mtime < 0) mtime = 0;
+    }
+    jj = cJSON_GetObjectItem(j, "mode");
+    if (jj && jj->type == cJSON_String) {
+        mode = strtol(jj->valuestring, NULL, 8);
+        mode &= 07777;
+    }
+    jj = cJSON_GetObjectItem(j, "uid");
+    if (jj && jj->type == cJSON_Number) {
+        uid = jj->valuedouble;
+        if (uid < 0) uid = -1;
+    }
+    jj = cJSON_GetObjectItem(j, "gid");
+    if (jj && jj->type == cJSON_Number) {
+        gid = jj->valuedouble;
+        if (gid < 0) gid = -1;
+    }
+
+    if (p_mtime) *p_mtime = mtime;
+    if (p_mode) *p_mode = mode;
+    if (p_uid) *p_uid = uid;
+    if (p_gid) *p_gid = gid;
+}
+
 static int
 mirror_file_func(
         struct AgentClient *ac,
@@ -1818,6 +1783,7 @@ mirror_file_func(
         time_t current_mtime,
         long long current_size,
         int current_mode,
+        const unsigned char *local_path,
         char **p_pkt_ptr,
         size_t *p_pkt_len,
         time_t *p_new_mtime,
@@ -1831,6 +1797,11 @@ mirror_file_func(
     long long time_ms;
     char *pkt_ptr = NULL;
     size_t pkt_len = 0;
+    // the digest of the local copy, if requested by the agent
+    char local_digest[64] = {};
+    int attempt = 0;
+
+again:;
     cJSON *jq = create_request(acs, &f, &time_ms, "mirror");
     cJSON_AddStringToObject(jq, "path", path);
     if (current_mtime > 0) {
@@ -1844,6 +1815,12 @@ mirror_file_func(
         snprintf(mb, sizeof(mb), "%04o", current_mode);
         cJSON_AddStringToObject(jq, "mode", mb);
     }
+    if (local_path && current_size >= 0) {
+        cJSON_AddTrueToObject(jq, "digest");
+    }
+    if (attempt > 0) {
+        cJSON_AddStringToObject(jq, "sha256", local_digest);
+    }
     add_wchunk_json(acs, jq);
     cJSON_Delete(jq); jq = NULL;
 
@@ -1861,45 +1838,36 @@ mirror_file_func(
             goto done;
         }
         if (!strcmp(jq->valuestring, "file-unchanged")) {
+            // the attributes are present, if the content is matched by digest
+            get_file_attrs(f.value, p_new_mtime, p_new_mode, p_uid, p_gid);
             result = 0;
             goto done;
         }
-        if (process_file_result(acs, f.value, &pkt_ptr, &pkt_len) < 0) {
-            goto done;
-        }
-
-        time_t mtime = 0;
-        int mode = -1;
-        int uid = -1;
-        int gid = -1;
-
-        cJSON *jj = cJSON_GetObjectItem(f.value, "mtime");
-        if (jj && jj->type == cJSON_Number) {
-            mtime = jj->valuedouble;
-            if (mtime < 0) mtime = 0;
-        }
-        jj = cJSON_GetObjectItem(f.value, "mode");
-        if (jj && jj->type == cJSON_String) {
-            mode = strtol(jj->valuestring, NULL, 8);
-            mode &= 07777;
-        }
-        jj = cJSON_GetObjectItem(f.value, "uid");
-        if (jj && jj->type == cJSON_Number) {
-            uid = jj->valuedouble;
-            if (uid < 0) uid = -1;
+        if (!strcmp(jq->valuestring, "file-digest")) {
+            if (attempt > 0 || !local_path) {
+                err("mirror_file: unexpected 'file-digest' reply");
+                goto done;
+            }
+            cJSON *jsha = cJSON_GetObjectItem(f.value, "sha256");
+            if (!jsha || jsha->type != cJSON_String) {
+                err("mirror_file: invalid or missing 'sha256' in reply");
+                goto done;
+            }
+            // an empty digest never matches, so the file is sent
+            if (compute_file_digest(local_path, local_digest, sizeof(local_digest)) < 0) {
+                local_digest[0] = 0;
+            }
+            future_fini(&f);
+            ++attempt;
+            goto again;
         }
-        jj = cJSON_GetObjectItem(f.value, "gid");
-        if (jj && jj->type == cJSON_Number) {
-            gid = jj->valuedouble;
-            if (gid < 0) gid = -1;
+        if (process_file_result(acs, &f, &pkt_ptr, &pkt_len) < 0) {
+            goto done;
         }
 
+        get_file_attrs(f.value, p_new_mtime, p_new_mode, p_uid, p_gid);
         *p_pkt_ptr = pkt_ptr; pkt_ptr = NULL;
         *p_pkt_len = pkt_len; pkt_len = 0;
-        if (p_new_mtime) *p_new_mtime = mtime;
-        if (p_new_mode) *p_new_mode = mode;
-        if (p_uid) *p_uid = uid;
-        if (p_gid) *p_gid = gid;
         result = 1;
     }
 
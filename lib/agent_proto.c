@@ -0,0 +1,385 @@
+/* -*- mode: c; c-basic-offset: 4 -*- */
+
+/* Copyright (C) 2024 Alexander Chernov <cher@ejudge.ru> */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "ejudge/config.h"
+#include "ejudge/agent_proto.h"
+#include "ejudge/base64.h"
+#include "ejudge/ej_lzma.h"
+#include "ejudge/errlog.h"
+
+#include "ejudge/cJSON.h"
+
+#include <string.h>
+#include <stdint.h>
+#include <zlib.h>
+
+#define AGENT_FRAME_MAGIC "EJF1"
+
+/* the files greater than this are not transferred */
+#define AGENT_MAX_FILE_SIZE 1000000000
+
+void
+agent_blob_free(struct AgentBlob *blob)
+{
+    if (blob) {
+        free(blob->data);
+        memset(blob, 0, sizeof(*blob));
+    }
+}
+
+static size_t
+blob_append(struct AgentBlob *blob, const void *data, size_t size)
+{
+    size_t offset = blob->size;
+    if (blob->size + size > blob->reserved) {
+        size_t new_reserved = blob->reserved * 2;
+        if (!new_reserved) new_reserved = 4096;
+        while (new_reserved < blob->size + size) new_reserved *= 2;
+        blob->data = realloc(blob->data, new_reserved);
+        blob->reserved = new_reserved;
+    }
+    memcpy(blob->data + blob->size, data, size);
+    blob->size += size;
+    return offset;
+}
+
+/*
+ * the compression level is chosen by the file size: the small files
+ * are not compressed at all, the large files are compressed with
+ * the fastest level to keep the packet transfer off the CPU
+ */
+static int
+get_compression_level(size_t size)
+{
+    if (size < 256) return 0;
+    if (size < 65536) return Z_DEFAULT_COMPRESSION;
+    return Z_BEST_SPEED;
+}
+
+/* returns the compressed size or 0, if the data is not compressible */
+static size_t
+deflate_buf(const char *data, size_t size, int level, char **p_out)
+{
+    z_stream zs = {};
+    zs.next_in = (Bytef *) data;
+    zs.avail_in = size;
+    zs.total_in = size;
+
+    if (deflateInit(&zs, level) != Z_OK) {
+        abort();
+    }
+    size_t bound = deflateBound(&zs, size);
+    char *gz_buf = malloc(bound);
+    zs.next_out = (Bytef*) gz_buf;
+    zs.avail_out = bound;
+    zs.total_out = 0;
+    int r = deflate(&zs, Z_FINISH);
+    if (r != Z_STREAM_END) {
+        abort();
+    }
+    size_t gz_size = zs.total_out;
+    if (deflateEnd(&zs) != Z_OK) {
+        abort();
+    }
+    if (gz_size >= size) {
+        free(gz_buf);
+        return 0;
+    }
+    *p_out = gz_buf;
+    return gz_size;
+}
+
+static void
+add_b64_data(cJSON *j, const char *data, size_t size)
+{
+    char *ptr = malloc(size * 2 + 16);
+    int n = base64u_encode(data, size, ptr);
+    ptr[n] = 0;
+    cJSON_AddTrueToObject(j, "b64");
+    cJSON_AddStringToObject(j, "data", ptr);
+    free(ptr);
+}
+
+void
+agent_proto_add_file(
+        cJSON *j,
+        const char *data,
+        size_t size,
+        struct AgentBlob *blob)
+{
+    char *gz_buf = NULL;
+    size_t gz_size = 0;
+
+    cJSON_AddNumberToObject(j, "size", (double) size);
+    if (!size) {
+        return;
+    }
+    int level = get_compression_level(size);
+    if (level) {
+        gz_size = deflate_buf(data, size, level, &gz_buf);
+    }
+    if (gz_size > 0) {
+        cJSON_AddTrueToObject(j, "gz");
+        cJSON_AddNumberToObject(j, "gz_size", (double) gz_size);
+    }
+    if (blob) {
+        size_t offset;
+        if (gz_size > 0) {
+            offset = blob_append(blob, gz_buf, gz_size);
+        } else {
+            offset = blob_append(blob, data, size);
+        }
+        cJSON_AddTrueToObject(j, "bin");
+        cJSON_AddNumberToObject(j, "offset", (double) offset);
+    } else if (gz_size > 0) {
+        add_b64_data(j, gz_buf, gz_size);
+    } else {
+        add_b64_data(j, data, size);
+    }
+    free(gz_buf);
+}
+
+static int
+inflate_buf(const char *gz_buf, size_t gz_size, size_t size, char **p_data)
+{
+    z_stream zs = {};
+    if (inflateInit(&zs) != Z_OK) {
+        err("invalid json: libz failed");
+        return -1;
+    }
+    zs.next_in = (Bytef *) gz_buf;
+    zs.avail_in = gz_size;
+    zs.total_in = gz_size;
+    unsigned char *ptr = malloc(size + 1);
+    zs.next_out = (Bytef *) ptr;
+    zs.avail_out = size;
+    zs.total_out = 0;
+    if (inflate(&zs, Z_FINISH) != Z_STREAM_END) {
+        err("invalid json: libz inflate failed");
+        free(ptr);
+        inflateEnd(&zs);
+        return -1;
+    }
+    if (inflateEnd(&zs) != Z_OK) {
+        err("invalid json: libz inflate failed");
+        free(ptr);
+        return -1;
+    }
+    ptr[size] = 0;
+    *p_data = (char *) ptr;
+    return 1;
+}
+
+int
+agent_proto_extract_file(
+        cJSON *j,
+        const unsigned char *blob,
+        size_t blob_size,
+        char **p_data,
+        size_t *p_size)
+{
+    cJSON *jz = cJSON_GetObjectItem(j, "size");
+    if (!jz || jz->type != cJSON_Number) {
+        err("invalid json: no size");
+        return -1;
+    }
+    if (jz->valuedouble < 0 || jz->valuedouble > AGENT_MAX_FILE_SIZE) {
+        err("invalid json: invalid size");
+        return -1;
+    }
+    size_t size = (size_t) jz->valuedouble;
+    if (!size) {
+        char *ptr = malloc(1);
+        *ptr = 0;
+        *p_data = ptr;
+        *p_size = 0;
+        return 1;
+    }
+
+    size_t gz_size = 0;
+    cJSON *jgz = cJSON_GetObjectItem(j, "gz");
+    if (jgz && jgz->type == cJSON_True) {
+        cJSON *jgzz = cJSON_GetObjectItem(j, "gz_size");
+        if (!jgzz || jgzz->type != cJSON_Number
+            || jgzz->valuedouble <= 0 || jgzz->valuedouble > AGENT_MAX_FILE_SIZE) {
+            err("invalid json: no gz_size");
+            return -1;
+        }
+        gz_size = (size_t) jgzz->valuedouble;
+    }
+
+    cJSON *jbin = cJSON_GetObjectItem(j, "bin");
+    if (jbin && jbin->type == cJSON_True) {
+        cJSON *jo = cJSON_GetObjectItem(j, "offset");
+        if (!jo || jo->type != cJSON_Number || jo->valuedouble < 0) {
+            err("invalid json: no offset");
+            return -1;
+        }
+        size_t offset = (size_t) jo->valuedouble;
+        size_t stored_size = gz_size > 0?gz_size:size;
+        if (!blob || offset > blob_size || stored_size > blob_size - offset) {
+            err("invalid frame: file is out of the attachment");
+            return -1;
+        }
+        if (gz_size > 0) {
+            if (inflate_buf((const char *) blob + offset, gz_size, size, p_data) < 0)
+                return -1;
+        } else {
+            char *ptr = malloc(size + 1);
+            memcpy(ptr, blob + offset, size);
+            ptr[size] = 0;
+            *p_data = ptr;
+        }
+        *p_size = size;
+        return 1;
+    }
+
+    cJSON *jb64 = cJSON_GetObjectItem(j, "b64");
+    if (!jb64 || jb64->type != cJSON_True) {
+        err("invalid json: no encoding");
+        return -1;
+    }
+    cJSON *jd = cJSON_GetObjectItem(j, "data");
+    if (!jd || jd->type != cJSON_String) {
+        err("invalid json: no data");
+        return -1;
+    }
+    int len = strlen(jd->valuestring);
+    char *buf = malloc(len + 1);
+    int b64err = 0;
+    int n = base64u_decode(jd->valuestring, len, buf, &b64err);
+
+    cJSON *jlzma = cJSON_GetObjectItem(j, "lzma");
+    if (gz_size > 0) {
+        if (n != gz_size) {
+            err("invalid json: size mismatch");
+            free(buf);
+            return -1;
+        }
+        if (inflate_buf(buf, gz_size, size, p_data) < 0) {
+            free(buf);
+            return -1;
+        }
+        free(buf);
+        *p_size = size;
+    } else if (jlzma && jlzma->type == cJSON_True) {
+        // produced by the older agents
+        cJSON *jlzmaz = cJSON_GetObjectItem(j, "lzma_size");
+        if (!jlzmaz || jlzmaz->type != cJSON_Number) {
+            err("invalid json: no lzma_size");
+            free(buf);
+            return -1;
+        }
+        size_t lzma_size = (size_t) jlzmaz->valuedouble;
+        if (n != lzma_size) {
+            err("invalid json: size mismatch");
+            free(buf);
+            return -1;
+        }
+        unsigned char *ptr = NULL;
+        size_t ptr_size = 0;
+        if (ej_lzma_decode_buf((const unsigned char *) buf, lzma_size, size, &ptr, &ptr_size) < 0) {
+            err("invalid json: lzma decode error");
+            free(buf);
+            return -1;
+        }
+        free(buf);
+        *p_data = (char *) ptr;
+        *p_size = ptr_size;
+    } else {
+        if (n != size) {
+            err("invalid json: size mismatch");
+            free(buf);
+            return -1;
+        }
+        buf[size] = 0;
+        *p_data = buf;
+        *p_size = size;
+    }
+    return 1;
+}
+
+static void
+put_u32le(unsigned char *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint32_t
+get_u32le(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+unsigned char *
+agent_proto_make_frame(
+        const char *json,
+        size_t json_len,
+        const struct AgentBlob *blob,
+        size_t *p_size)
+{
+    size_t blob_size = 0;
+    if (blob) blob_size = blob->size;
+    size_t size = AGENT_FRAME_HEADER_SIZE + json_len + 1 + blob_size;
+    unsigned char *out = malloc(size);
+
+    memcpy(out, AGENT_FRAME_MAGIC, 4);
+    put_u32le(out + 4, json_len + 1);
+    put_u32le(out + 8, blob_size);
+    memcpy(out + AGENT_FRAME_HEADER_SIZE, json, json_len);
+    out[AGENT_FRAME_HEADER_SIZE + json_len] = 0;
+    if (blob_size > 0) {
+        memcpy(out + AGENT_FRAME_HEADER_SIZE + json_len + 1, blob->data, blob_size);
+    }
+    *p_size = size;
+    return out;
+}
+
+long long
+agent_proto_frame_size(const unsigned char *data, size_t size)
+{
+    if (size < AGENT_FRAME_HEADER_SIZE) return 0;
+    if (memcmp(data, AGENT_FRAME_MAGIC, 4) != 0) return -1;
+    uint32_t json_size = get_u32le(data + 4);
+    uint32_t blob_size = get_u32le(data + 8);
+    if (!json_size || json_size > AGENT_MAX_FILE_SIZE || blob_size > AGENT_MAX_FILE_SIZE)
+        return -1;
+    long long total = (long long) AGENT_FRAME_HEADER_SIZE + json_size + blob_size;
+    if (size < total) return 0;
+    const unsigned char *json = data + AGENT_FRAME_HEADER_SIZE;
+    if (json[json_size - 1] != 0 || memchr(json, 0, json_size - 1))
+        return -1;
+    return total;
+}
+
+int
+agent_proto_get_blob(
+        const unsigned char *payload,
+        size_t payload_size,
+        const unsigned char **p_blob,
+        size_t *p_blob_size)
+{
+    size_t json_len = strnlen((const char *) payload, payload_size);
+    *p_blob = NULL;
+    *p_blob_size = 0;
+    if (json_len >= payload_size) return 0;
+    *p_blob = payload + json_len + 1;
+    *p_blob_size = payload_size - json_len - 1;
+    return 1;
+}
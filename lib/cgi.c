@@ -1,6 +1,6 @@
 /* -*- mode: c -*- */
 
-/* Copyright (C) 2000-2023 Alexander Chernov <cher@ejudge.ru> */
+/* Copyright (C) 2000-2024 Alexander Chernov <cher@ejudge.ru> */
 
 /*
  * This program is free software; you can redistribute it and/or modify
@@ -26,6 +26,7 @@
 #include <string.h>
 #include <errno.h>
 #include <limits.h>
+#include <unistd.h>
 
 #define MAX_NAME_SIZE      63
 #define MAX_VALUE_SIZE     EJ_MAX_CGI_VALUE_LEN
@@ -48,91 +49,78 @@ static char *name_buf = 0;
 static int   name_a = 0;
 static int   name_u = 0;
 
-static char *value_buf = 0;
-static int   value_a = 0;
-static int   value_u = 0;
-
 static struct param *params;
 static int param_a;
 static int param_u;
 
+/* the parameter values point into these buffers */
 static char *query;
-static int   query_ind;
-static int   source = 0;
-static int   content_length = 0;
+static char *body;
+static size_t body_size;
+
+/* the request is parsed for a server, the errors must not terminate it */
+static int server_mode;
 
 #define MARK_PLACE fprintf(stderr, "DEBUG: %s, %d\n", __FILE__, __LINE__)
 
-static int
-do_get_char()
+/* the whole request body is read at once, it is never freed */
+static void
+read_body(size_t size)
 {
-  if (!source) {
-    if (!query) return EOF;
-    if (!query[query_ind]) return EOF;
-    return query[query_ind++];
-  } else {
-    if (content_length <= 0) return EOF;
-    --content_length;
-    return getchar();
+  size_t got = 0;
+  ssize_t r;
+
+  body = xmalloc(size + 1);
+  while (got < size) {
+    r = read(0, body + got, size - got);
+    if (r < 0 && errno == EINTR) continue;
+    if (r < 0) {
+      err("cgi: read() failed: %s", strerror(errno));
+      break;
+    }
+    if (!r) break;
+    got += r;
   }
+  body[got] = 0;
+  body_size = got;
 }
 
 static int
-cgi_get_char(void)
-{
-  int  c = do_get_char();
-  char bb[4];
-
-  /* we need to distinguish unescaped '&', '=' from escaped ones */
-  if (c == '&' || c == '=') return -c;
-  if (c != '%' && c != '+') return c;
-  if (c == '+') return ' ';
-
-  c = do_get_char();
-  if (c == EOF) return '?';
-  if (!isxdigit(c)) return '?';
-  bb[0] = c;
-  c = do_get_char();
-  if (c == EOF) return '?';
-  if (!isxdigit(c)) return '?';
-  bb[1] = c;
-  bb[2] = 0;
-  c = strtol(bb, 0, 16);
-  return c;
-}
-
-static void
-cgi_put_char(char **b, int *a, int *u, int c)
+hex_value(int c)
 {
-  if (*u >= *a) {
-    *a += 256;
-    *b = (char*) xrealloc(*b, *a);
-  }
-  (*b)[*u] = c;
-  (*u)++;
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return c - 'A' + 10;
 }
 
-static void
-add_to_param_list(char const *name, char const *value, int size)
+/* decodes '+' and %XX escapes in place, returns the decoded length */
+static size_t
+url_decode(char *s, size_t len)
 {
-  int i;
-
-  for (i = 0; i < param_u; i++) {
-    if (!strcmp(name, params[i].name)) break;
-  }
-  if (i >= param_u) {
-    if (param_u >= param_a) {
-      param_a += 32;
-      params = (struct param*) xrealloc(params, param_a * sizeof(params[0]));
+  char *p = s, *e = s + len, *q;
+
+  // nothing to move until the first escape
+  while (p < e && *p != '%' && *p != '+') p++;
+  q = p;
+  while (p < e) {
+    if (*p == '+') {
+      *q++ = ' ';
+      p++;
+    } else if (*p != '%') {
+      *q++ = *p++;
+    } else if (++p >= e) {
+      *q++ = '?';
+    } else if (!isxdigit((unsigned char) *p++)) {
+      *q++ = '?';
+    } else if (p >= e) {
+      *q++ = '?';
+    } else if (!isxdigit((unsigned char) *p++)) {
+      *q++ = '?';
+    } else {
+      *q++ = hex_value((unsigned char) p[-2]) * 16 + hex_value((unsigned char) p[-1]);
     }
-    param_u++;
   }
-
-  params[i].name  = xstrdup(name);
-  params[i].size  = size;
-  params[i].value = xmalloc(size + 1);
-  memcpy(params[i].value, value, size);
-  params[i].value[size] = 0;
+  return q - s;
 }
 
 static void
@@ -149,6 +137,8 @@ add_to_param_list_2(char const *name, char *value, int size)
       params = (struct param*) xrealloc(params, param_a * sizeof(params[0]));
     }
     param_u++;
+  } else {
+    xfree(params[i].name);
   }
 
   params[i].name  = xstrdup(name);
@@ -156,50 +146,40 @@ add_to_param_list_2(char const *name, char *value, int size)
   params[i].value = value;
 }
 
+/* parses name=value&... in place, the values are not copied */
 static int
-do_cgi_read(void)
+do_cgi_read(char *buf, size_t size)
 {
-  int c;
-
-  c = cgi_get_char();
-  while (c != EOF) {
-    /* read parameter name */
-    name_u = 0;
-    while (c != EOF && c != -'&' && c != -'=' && name_u < MAX_NAME_SIZE) {
-      cgi_put_char(&name_buf, &name_a, &name_u, c);
-      c = cgi_get_char();
-    }
-    cgi_put_char(&name_buf, &name_a, &name_u, 0);
-    if (name_u >= MAX_NAME_SIZE && c != EOF && c != -'&' && c != -'=') {
+  char *p = buf, *e = buf + size, *amp, *eq, *name, *value;
+  size_t name_len, value_len;
+
+  while (p < e) {
+    if (!(amp = memchr(p, '&', e - p))) amp = e;
+    eq = memchr(p, '=', amp - p);
+
+    name = p;
+    name_len = url_decode(name, (eq?eq:amp) - p);
+    if (name_len > MAX_NAME_SIZE) {
       /* name is too long */
-      //printf("NAME TOO LONG\n"); fflush(0);
       return -1;
     }
+    name[name_len] = 0;
 
-    if (c == -'=') {
-      c = cgi_get_char();
-      value_u = 0;
-      while (c != EOF && c != -'&' && value_u < MAX_VALUE_SIZE) {
-        cgi_put_char(&value_buf, &value_a, &value_u, c);
-        c = cgi_get_char();
-      }
-      cgi_put_char(&value_buf, &value_a, &value_u, 0);
-      if (value_u >= MAX_VALUE_SIZE && c != EOF && c != -'&') {
+    if (eq) {
+      value = eq + 1;
+      value_len = url_decode(value, amp - value);
+      if (value_len > MAX_VALUE_SIZE) {
         /* value is too long */
-        //printf("VALUE TOO LONG\n"); fflush(0);
         return -1;
       }
+      value[value_len] = 0;
+    } else {
+      value = name + name_len;
     }
+    add_to_param_list_2(name, value, strlen(value));
 
-    if (!value_buf) {
-      value_a = 16;
-      value_buf = (char*) xcalloc(value_a, 1);
-    }
-    add_to_param_list(name_buf, value_buf, strlen(value_buf));
-
-    if (c == -'&') {
-      c = cgi_get_char();
-    }
+    p = amp;
+    if (p < e) p++;
   }
   return 0;
 }
@@ -232,85 +212,92 @@ request_too_large(char const *charset)
   printf("</p></body></html>\n");
 }
 
+/* in the server mode the error is reported to the caller */
 static int
-parse_multipart(char const *charset)
+reject_request(char const *charset)
+{
+  if (server_mode) return -1;
+  bad_request(charset);
+  exit(0);
+}
+
+/* returns the line length, -1 on EOF, -2 if the line is too long */
+static int
+get_line(char **pp, char *e, char *lbuf, size_t lsize)
+{
+  char *p = *pp, *q;
+  size_t len;
+
+  if (p >= e) return -1;
+  if ((q = memchr(p, '\n', e - p))) q++;
+  else q = e;
+  len = q - p;
+  if (len >= lsize) return -2;
+  memcpy(lbuf, p, len);
+  *pp = q;
+  if (len > 0 && lbuf[len - 1] == '\n') len--;
+  if (len > 0 && lbuf[len - 1] == '\r') len--;
+  lbuf[len] = 0;
+  return len;
+}
+
+static char const mp2[] = "multipart/form-data; boundary=";
+
+/* the multipart data in buf[0..size] is parsed in place */
+static int
+parse_multipart_data(char const *charset, char const *ct, char *buf, size_t size)
 {
-  static char const mp2[] = "multipart/form-data; boundary=";
   static char const s3[] = "content-disposition:";
   static char const s4[] = "form-data;";
   static char const s5[] = "name=\"";
   static char const s6[] = "content-type:";
 
   char const *boundary;
-  char *ct, *cl;
-  int   content_length, n;
   char lbuf[1024];
   int  llen;
   char *p, *q;
-  int  linestart;
   int  boundary_len;
-  int  c;
+  char delim[sizeof(lbuf)];
+  int  delim_len;
+  char *cur = buf, *end = buf + size, *value, *value_end;
 
-  ct = getenv("CONTENT_TYPE");
-  if (!ct) return -1;
-  if (strncmp(ct, mp2, sizeof(mp2) - 1)) {
-    err("parse_multipart: cannot parse CONTENT_TYPE");
-    bad_request(charset);
-    exit(0);
-  }
   boundary = ct + sizeof(mp2) - 1;
   boundary_len = strlen(boundary);
 
-  cl = getenv("CONTENT_LENGTH");
-  if (!cl || sscanf(cl, "%d%n", &content_length, &n) != 1 || cl[n]) {
-    //err("parse_multipart: cannot parse CONTENT_LENGTH");
-    //bad_request(charset);
-    //exit(0);
-    return 0;
-  }
-  if (content_length > MAX_CONTENT_LENGTH) {
-    request_too_large(charset);
-    exit(0);
+  /* the data ends at the line starting with "--" boundary */
+  delim_len = boundary_len + 2;
+  if (delim_len >= sizeof(lbuf)) {
+    err("parse_multipart: boundary string too long");
+    return reject_request(charset);
   }
+  delim[0] = '-';
+  delim[1] = '-';
+  memcpy(delim + 2, boundary, boundary_len + 1);
 
   name_u = 0;
-  value_u = 0;
-  if (!fgets(lbuf, sizeof(lbuf), stdin)) {
+  if ((llen = get_line(&cur, end, lbuf, sizeof(lbuf))) == -1) {
     err("parse_multipart: unexpected EOF");
-    bad_request(charset);
-    exit(0);
+    return reject_request(charset);
   }
-
-  llen = strlen(lbuf);
-  if (llen == sizeof(lbuf) - 1 && lbuf[llen - 1] != '\n') {
+  if (llen == -2) {
     err("parse_multipart: boundary string too long");
-    bad_request(charset);
-    exit(0);
+    return reject_request(charset);
   }
-  lbuf[--llen] = 0;
-  if (lbuf[llen - 1] == '\r') lbuf[--llen] = 0;
-  if (lbuf[0] != '-' || lbuf[1] != '-' || strcmp(boundary, lbuf + 2)) {
+  if (strcmp(delim, lbuf)) {
     err("got: %s(%zu)", lbuf, strlen(lbuf));
-    bad_request(charset);
-    exit(0);
+    return reject_request(charset);
   }
   while (1) {
     /* read and parse header lines */
     while (1) {
-      if (!fgets(lbuf, sizeof(lbuf), stdin)) {
+      if ((llen = get_line(&cur, end, lbuf, sizeof(lbuf))) == -1) {
         err("parse_multipart: unexpected EOF");
-        bad_request(charset);
-        exit(0);
+        return reject_request(charset);
       }
-      //fprintf(stderr, ">>%s<\n", lbuf);
-      llen = strlen(lbuf);
-      if (llen == sizeof(lbuf) - 1 && lbuf[llen - 1] != '\n') {
+      if (llen == -2) {
         err("parse_multipart: header string too long");
-        bad_request(charset);
-        exit(0);
+        return reject_request(charset);
       }
-      lbuf[--llen] = 0;
-      if (lbuf[llen - 1] == '\r') lbuf[--llen] = 0;
       if (!lbuf[0]) break;
       if (!strncasecmp(lbuf, s3, sizeof(s3) - 1)) {
         /* content-disposition header */
@@ -325,8 +312,7 @@ parse_multipart(char const *charset)
             while (*q != '\"' && *q != 0) q++;
             if (!*q) {
               err("unexpected EOLN: %s", lbuf);
-              bad_request(charset);
-              exit(0);
+              return reject_request(charset);
             }
             /* get parameter name */
             if (q - p + 1 > name_a) {
@@ -338,72 +324,47 @@ parse_multipart(char const *charset)
             name_buf[name_u] = 0;
           } else {
             err("name= expected: %s\n", lbuf);
-            bad_request(charset);
-            exit(0);
+            return reject_request(charset);
           }
         } else {
           err("unknown content disposition: %s", lbuf);
-          bad_request(charset);
-          exit(0);
+          return reject_request(charset);
         }
       } else if (!strncasecmp(s6, lbuf, sizeof(s6) - 1)) {
         //err("ignored header: %s", lbuf);
       } else {
         err("unknown header: <%s>", lbuf);
-        bad_request(charset);
-        exit(0);
+        return reject_request(charset);
       }
     }
 
-    /* read and parse data stream */
-    linestart = 0; value_u = 0;
-    if (!value_a) {
-      value_a = 128;
-      value_buf = xmalloc(value_a);
-    }
+    /* find the end of the data, the data is not copied */
+    value = cur;
     while (1) {
-      c = getchar();
-      if (c == EOF) {
+      if (!(p = memmem(cur, end - cur, delim, delim_len))) {
         err("unexpected EOF");
-        bad_request(charset);
-        exit(0);
-      }
-      if (value_u >= value_a) {
-        value_a *= 2;
-        value_buf = xrealloc(value_buf, value_a);
-      }
-      value_buf[value_u++] = c;
-      if (value_u - linestart - 2 == boundary_len
-          && value_buf[linestart] == '-'
-          && value_buf[linestart + 1] == '-'
-          && !strncmp(value_buf + linestart + 2, boundary, boundary_len)) {
-        /* data ended */
-        value_u = linestart;
-        if (value_u > 0 && value_buf[value_u - 1] == '\n') value_u--;
-        if (value_u > 0 && value_buf[value_u - 1] == '\r') value_u--;
-        value_buf[value_u] = 0;
-        break;
-      }
-      if (c == '\n') {
-        linestart = value_u;
+        return reject_request(charset);
       }
+      if (p == value || p[-1] == '\n') break;
+      cur = p + 1;
     }
+    value_end = p;
+    if (value_end > value && value_end[-1] == '\n') value_end--;
+    if (value_end > value && value_end[-1] == '\r') value_end--;
+    cur = p + delim_len;
+    /* the delimiter is already passed, so it may be overwritten */
+    *value_end = 0;
 
     /* add variable to list */
-    add_to_param_list(name_buf, value_buf, value_u);
+    if (!name_buf) name_buf = xstrdup("");
+    add_to_param_list_2(name_buf, value, value_end - value);
     /* skip whitespaces */
-    c = getchar();
-    if (c == '-') {
-      c = getchar();
-      if (c == '-') break;
+    if (cur < end && *cur == '-') {
+      if (++cur < end && *cur == '-') break;
       err("oops: only one '-' after boundary");
-      bad_request(charset);
-      exit(0);
-    } else {
-      ungetc(c, stdin);
+      return reject_request(charset);
     }
-    while ((c = getchar()) == ' ' || c == '\t' || c == '\n' || c == '\r');
-    ungetc(c, stdin);
+    while (cur < end && (*cur == ' ' || *cur == '\t' || *cur == '\n' || *cur == '\r')) cur++;
   }
 
 #if 0
@@ -420,6 +381,36 @@ parse_multipart(char const *charset)
   return 0;
 }
 
+static int
+parse_multipart(char const *charset)
+{
+  char *ct, *cl;
+  int   content_length, n;
+
+  ct = getenv("CONTENT_TYPE");
+  if (!ct) return -1;
+  if (strncmp(ct, mp2, sizeof(mp2) - 1)) {
+    err("parse_multipart: cannot parse CONTENT_TYPE");
+    bad_request(charset);
+    exit(0);
+  }
+
+  cl = getenv("CONTENT_LENGTH");
+  if (!cl || sscanf(cl, "%d%n", &content_length, &n) != 1 || cl[n]) {
+    //err("parse_multipart: cannot parse CONTENT_LENGTH");
+    //bad_request(charset);
+    //exit(0);
+    return 0;
+  }
+  if (content_length > MAX_CONTENT_LENGTH) {
+    request_too_large(charset);
+    exit(0);
+  }
+  if (content_length < 0) content_length = 0;
+  read_body(content_length);
+  return parse_multipart_data(charset, ct, body, body_size);
+}
+
 static char const multipart[] = "multipart/form-data;";
 /**
  * NAME:    cgi_read
@@ -433,10 +424,10 @@ int
 cgi_read(char const *charset)
 {
   char *ct = 0;
-  query = getenv("QUERY_STRING");
-  if (query) {
-    source = 0;
-    if (do_cgi_read() < 0) return -1;
+  char *qs = getenv("QUERY_STRING");
+  if (qs) {
+    query = xstrdup(qs);
+    if (do_cgi_read(query, strlen(query)) < 0) return -1;
   }
   ct = getenv("CONTENT_TYPE");
   if (ct && !strncmp(ct, multipart, sizeof(multipart) - 1)) {
@@ -461,29 +452,14 @@ cgi_read(char const *charset)
       request_too_large(charset);
       exit(0);
     }
-    content_length = v;
-
-    size_t ja = 32;
-    size_t ju = 0;
-    char *jt = xmalloc(ja);
-    for (int i = 0; i < content_length; ++i) {
-      int c = getchar_unlocked();
-      if (c == EOF) break;
-      if (ju == ja) {
-        jt = xrealloc(jt, ja *= 2);
-      }
-      jt[ju++] = c;
-    }
-    if (ju == ja) {
-      jt = xrealloc(jt, ja *= 2);
-      jt[ju] = 0;
-    }
-    add_to_param_list_2("JSON", jt, ju);
+    read_body(v);
+    add_to_param_list_2("JSON", body, body_size);
 
     return 0;
   }
 
   const unsigned char *cl = getenv("CONTENT_LENGTH");
+  int content_length = 0;
   if (cl) {
     errno = 0;
     char *eptr = NULL;
@@ -499,11 +475,60 @@ cgi_read(char const *charset)
     content_length = val;
   }
 
-  source = 1;
-  if (do_cgi_read() < 0) return -1;
+  read_body(content_length);
+  if (do_cgi_read(body, body_size) < 0) return -1;
   return 0;
 }
 
+/**
+ * NAME:    cgi_parse_request
+ * PURPOSE: parse the parameters of a request received by a server
+ * ARGS:    content_type - the request content type, may be NULL
+ *          query_buf    - the query string
+ *          query_size   - the query string length
+ *          body_buf     - the request body
+ *          body_size    - the request body length
+ * RETURN:   0 - OK,
+ *          -1 - malformed request
+ * NOTE:    the previous parameters are dropped, the buffers are decoded
+ *          in place and must have a spare byte after the data,
+ *          the parameter values point into them, nothing is printed
+ */
+int
+cgi_parse_request(
+        char const *content_type,
+        char *query_buf,
+        size_t query_size,
+        char *body_buf,
+        size_t body_size)
+{
+  int i, r = 0;
+
+  for (i = 0; i < param_u; i++) {
+    xfree(params[i].name);
+  }
+  param_u = 0;
+
+  server_mode = 1;
+  if (query_buf && do_cgi_read(query_buf, query_size) < 0) {
+    r = -1;
+  } else if (content_type && !strncmp(content_type, multipart, sizeof(multipart) - 1)) {
+    if (strncmp(content_type, mp2, sizeof(mp2) - 1)) {
+      err("parse_multipart: cannot parse CONTENT_TYPE");
+      r = -1;
+    } else {
+      r = parse_multipart_data(NULL, content_type, body_buf, body_size);
+    }
+  } else if (content_type && !strcmp(content_type, "application/json")) {
+    body_buf[body_size] = 0;
+    add_to_param_list_2("JSON", body_buf, body_size);
+  } else if (body_size > 0) {
+    r = do_cgi_read(body_buf, body_size);
+  }
+  server_mode = 0;
+  return r;
+}
+
 /**
  * NAME:    cgi_param
  * PURPOSE: return the value of the given parameter
@@ -161,3 +161,17 @@ plugin_get(
       return &plugins[i];
   return NULL;
 }
+
+/*
+ * called in a forked child process which keeps running,
+ * e.g. a read-only worker of the contest server
+ */
+void
+plugin_fork_child(void)
+{
+  int i;
+
+  for (i = 0; i < plugins_num; ++i)
+    if (plugins[i].iface->fork_child)
+      plugins[i].iface->fork_child(plugins[i].data);
+}
@@ -0,0 +1,415 @@
+/* -*- mode: c; c-basic-offset: 4 -*- */
+
+/* Copyright (C) 2024 Alexander Chernov <cher@ejudge.ru> */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "ejudge/config.h"
+#include "ejudge/compile_cache.h"
+#include "ejudge/fileutl.h"
+#include "ejudge/errlog.h"
+
+#include "ejudge/xalloc.h"
+#include "ejudge/logger.h"
+#include "ejudge/osdeps.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+/*
+ * each entry consists of three files: KEY.info with the compilation
+ * status, KEY.exe with the executable and KEY.log with the compilation
+ * log, KEY.info is written last and removed first, so an entry is
+ * valid as long as its info file exists, the modification time of
+ * the info file is the time of the last use of the entry
+ */
+
+/* temporary files older than this are considered abandoned */
+enum { STALE_TMP_SECONDS = 3600 };
+
+struct compile_cache
+{
+    unsigned char *dir;
+    long long max_size;
+    long long total_size;       // estimated, recalculated on eviction
+    long long hits;
+    long long misses;
+};
+
+struct cache_item
+{
+    unsigned char key[COMPILE_CACHE_KEY_SIZE];
+    time_t mtime;
+    long long size;
+};
+
+static const char * const entry_suffixes[] = { ".info", ".exe", ".log" };
+
+static int
+is_valid_key(const unsigned char *key)
+{
+    int i;
+    for (i = 0; key[i]; ++i) {
+        if (!((key[i] >= '0' && key[i] <= '9')
+              || (key[i] >= 'a' && key[i] <= 'f'))) {
+            return 0;
+        }
+    }
+    return i == COMPILE_CACHE_KEY_SIZE - 1;
+}
+
+static long long
+get_file_size(const unsigned char *path)
+{
+    struct stat stb;
+    if (stat(path, &stb) < 0 || !S_ISREG(stb.st_mode)) return 0;
+    return stb.st_size;
+}
+
+static int
+copy_file(const unsigned char *dst_path, const unsigned char *src_path)
+{
+    int src_fd = -1;
+    int dst_fd = -1;
+    int need_unlink = 0;
+    int retval = -1;
+    unsigned char buf[65536];
+    struct stat stb;
+
+    src_fd = open(src_path, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK, 0);
+    if (src_fd < 0) {
+        if (errno != ENOENT) {
+            err("%s: open '%s' failed: %s", __FUNCTION__, src_path, os_ErrorMsg());
+        }
+        goto done;
+    }
+    if (fstat(src_fd, &stb) < 0 || !S_ISREG(stb.st_mode)) {
+        err("%s: '%s' is not regular", __FUNCTION__, src_path);
+        goto done;
+    }
+    dst_fd = open(dst_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOCTTY, stb.st_mode & 0777);
+    if (dst_fd < 0) {
+        err("%s: open '%s' failed: %s", __FUNCTION__, dst_path, os_ErrorMsg());
+        goto done;
+    }
+    need_unlink = 1;
+    while (1) {
+        ssize_t r = read(src_fd, buf, sizeof(buf));
+        if (r < 0) {
+            err("%s: read '%s' failed: %s", __FUNCTION__, src_path, os_ErrorMsg());
+            goto done;
+        }
+        if (!r) break;
+        const unsigned char *p = buf;
+        while (r > 0) {
+            ssize_t w = write(dst_fd, p, r);
+            if (w <= 0) {
+                err("%s: write '%s' failed: %s", __FUNCTION__, dst_path, os_ErrorMsg());
+                goto done;
+            }
+            p += w;
+            r -= w;
+        }
+    }
+    // the umask might have dropped the permission bits
+    fchmod(dst_fd, stb.st_mode & 0777);
+    if (close(dst_fd) < 0) {
+        dst_fd = -1;
+        err("%s: close '%s' failed: %s", __FUNCTION__, dst_path, os_ErrorMsg());
+        goto done;
+    }
+    dst_fd = -1;
+    need_unlink = 0;
+    retval = 0;
+
+done:;
+    if (dst_fd >= 0) close(dst_fd);
+    if (need_unlink) unlink(dst_path);
+    if (src_fd >= 0) close(src_fd);
+    return retval;
+}
+
+static void
+make_entry_path(
+        unsigned char *buf,
+        size_t size,
+        const struct compile_cache *cc,
+        const unsigned char *key,
+        const char *suffix)
+{
+    snprintf(buf, size, "%s/%s%s", cc->dir, key, suffix);
+}
+
+static void
+remove_entry(const struct compile_cache *cc, const unsigned char *key)
+{
+    unsigned char path[PATH_MAX];
+    for (int i = 0; i < (int)(sizeof(entry_suffixes) / sizeof(entry_suffixes[0])); ++i) {
+        make_entry_path(path, sizeof(path), cc, key, entry_suffixes[i]);
+        unlink(path);
+    }
+}
+
+static int
+sort_func(const void *p1, const void *p2)
+{
+    const struct cache_item *i1 = (const struct cache_item *) p1;
+    const struct cache_item *i2 = (const struct cache_item *) p2;
+    if (i1->mtime < i2->mtime) return -1;
+    if (i1->mtime > i2->mtime) return 1;
+    return 0;
+}
+
+/* rescans the directory and removes the least recently used entries
+   until the cache size is below 90% of the limit, the directory may
+   be shared, so the in-memory size is only an estimate */
+static void
+evict_entries(struct compile_cache *cc)
+{
+    DIR *d = NULL;
+    struct dirent *dd;
+    struct cache_item *items = NULL;
+    int items_a = 0, items_u = 0;
+    long long total_size = 0;
+    time_t current_time = time(NULL);
+
+    if (!(d = opendir(cc->dir))) {
+        err("%s: cannot open '%s': %s", __FUNCTION__, cc->dir, os_ErrorMsg());
+        return;
+    }
+    while ((dd = readdir(d))) {
+        if (dd->d_name[0] == '.') continue;
+        unsigned char path[PATH_MAX];
+        struct stat stb;
+        snprintf(path, sizeof(path), "%s/%s", cc->dir, dd->d_name);
+        if (lstat(path, &stb) < 0 || !S_ISREG(stb.st_mode)) continue;
+
+        int len = strlen(dd->d_name);
+        if (len > 4 && !strcmp(dd->d_name + len - 4, ".tmp")) {
+            if (stb.st_mtime + STALE_TMP_SECONDS < current_time) {
+                unlink(path);
+            } else {
+                total_size += stb.st_size;
+            }
+            continue;
+        }
+        total_size += stb.st_size;
+        if (len != COMPILE_CACHE_KEY_SIZE - 1 + 5
+            || strcmp(dd->d_name + len - 5, ".info") != 0) {
+            continue;
+        }
+        if (items_u == items_a) {
+            if (!(items_a *= 2)) items_a = 64;
+            XREALLOC(items, items_a);
+        }
+        struct cache_item *item = &items[items_u++];
+        memcpy(item->key, dd->d_name, COMPILE_CACHE_KEY_SIZE - 1);
+        item->key[COMPILE_CACHE_KEY_SIZE - 1] = 0;
+        item->mtime = stb.st_mtime;
+        item->size = stb.st_size;
+    }
+    closedir(d); d = NULL;
+
+    if (cc->max_size > 0 && total_size > cc->max_size) {
+        long long low_size = cc->max_size - cc->max_size / 10;
+        unsigned char path[PATH_MAX];
+
+        qsort(items, items_u, sizeof(items[0]), sort_func);
+        for (int i = 0; i < items_u && total_size > low_size; ++i) {
+            struct cache_item *item = &items[i];
+            make_entry_path(path, sizeof(path), cc, item->key, ".exe");
+            item->size += get_file_size(path);
+            make_entry_path(path, sizeof(path), cc, item->key, ".log");
+            item->size += get_file_size(path);
+            remove_entry(cc, item->key);
+            total_size -= item->size;
+        }
+        if (total_size < 0) total_size = 0;
+    }
+    cc->total_size = total_size;
+    xfree(items);
+}
+
+struct compile_cache *
+compile_cache_open(const unsigned char *dir, long long max_size)
+{
+    struct compile_cache *cc = NULL;
+
+    if (make_all_dir(dir, 0770) < 0) {
+        err("%s: cannot create '%s'", __FUNCTION__, dir);
+        return NULL;
+    }
+
+    XCALLOC(cc, 1);
+    cc->dir = xstrdup(dir);
+    cc->max_size = max_size;
+    evict_entries(cc);
+    return cc;
+}
+
+struct compile_cache *
+compile_cache_free(struct compile_cache *cc)
+{
+    if (cc) {
+        xfree(cc->dir);
+        xfree(cc);
+    }
+    return NULL;
+}
+
+static int
+read_info_file(const unsigned char *path, struct compile_cache_result *res)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    memset(res, 0, sizeof(*res));
+    int r = fscanf(f, "%d%d%d%d", &res->status, &res->prepended_size,
+                   &res->override_exe, &res->has_exe);
+    fclose(f);
+    if (r != 4) return -1;
+    return 0;
+}
+
+int
+compile_cache_get(
+        struct compile_cache *cc,
+        const unsigned char *key,
+        struct compile_cache_result *res,
+        const unsigned char *exe_path,
+        FILE *log_f)
+{
+    unsigned char info_path[PATH_MAX];
+    unsigned char path[PATH_MAX];
+    char *log_s = NULL;
+    size_t log_z = 0;
+
+    if (!cc || !is_valid_key(key)) return 0;
+
+    make_entry_path(info_path, sizeof(info_path), cc, key, ".info");
+    if (read_info_file(info_path, res) < 0) goto miss;
+
+    if (res->has_exe > 0) {
+        make_entry_path(path, sizeof(path), cc, key, ".exe");
+        if (copy_file(exe_path, path) < 0) goto miss;
+    }
+
+    make_entry_path(path, sizeof(path), cc, key, ".log");
+    if (generic_read_file(&log_s, 0, &log_z, 0, NULL, path, "") < 0) {
+        if (res->has_exe > 0) unlink(exe_path);
+        goto miss;
+    }
+    if (log_z > 0) fwrite(log_s, 1, log_z, log_f);
+    xfree(log_s);
+
+    // mark the entry as recently used
+    utimes(info_path, NULL);
+    ++cc->hits;
+    return 1;
+
+miss:
+    ++cc->misses;
+    return 0;
+}
+
+int
+compile_cache_put(
+        struct compile_cache *cc,
+        const unsigned char *key,
+        const struct compile_cache_result *res,
+        const unsigned char *exe_path,
+        const unsigned char *log_path)
+{
+    unsigned char tmp_path[PATH_MAX];
+    unsigned char path[PATH_MAX];
+    unsigned char tmp_sfx[64];
+    long long entry_size = 0;
+    FILE *f = NULL;
+
+    if (!cc || !is_valid_key(key)) return -1;
+
+    snprintf(tmp_sfx, sizeof(tmp_sfx), ".%d.tmp", getpid());
+
+    if (res->has_exe > 0) {
+        make_entry_path(tmp_path, sizeof(tmp_path), cc, key, tmp_sfx);
+        make_entry_path(path, sizeof(path), cc, key, ".exe");
+        if (copy_file(tmp_path, exe_path) < 0) goto fail;
+        if (rename(tmp_path, path) < 0) {
+            err("%s: rename '%s' failed: %s", __FUNCTION__, tmp_path, os_ErrorMsg());
+            goto fail;
+        }
+        entry_size += get_file_size(path);
+    }
+
+    make_entry_path(tmp_path, sizeof(tmp_path), cc, key, tmp_sfx);
+    make_entry_path(path, sizeof(path), cc, key, ".log");
+    if (copy_file(tmp_path, log_path) < 0) goto fail;
+    if (rename(tmp_path, path) < 0) {
+        err("%s: rename '%s' failed: %s", __FUNCTION__, tmp_path, os_ErrorMsg());
+        goto fail;
+    }
+    entry_size += get_file_size(path);
+
+    make_entry_path(tmp_path, sizeof(tmp_path), cc, key, tmp_sfx);
+    make_entry_path(path, sizeof(path), cc, key, ".info");
+    if (!(f = fopen(tmp_path, "w"))) {
+        err("%s: cannot open '%s': %s", __FUNCTION__, tmp_path, os_ErrorMsg());
+        goto fail;
+    }
+    fprintf(f, "%d %d %d %d\n", res->status, res->prepended_size,
+            res->override_exe, res->has_exe);
+    if (ferror(f) || fclose(f) < 0) {
+        f = NULL;
+        err("%s: write to '%s' failed", __FUNCTION__, tmp_path);
+        goto fail;
+    }
+    f = NULL;
+    if (rename(tmp_path, path) < 0) {
+        err("%s: rename '%s' failed: %s", __FUNCTION__, tmp_path, os_ErrorMsg());
+        goto fail;
+    }
+    entry_size += get_file_size(path);
+
+    cc->total_size += entry_size;
+    if (cc->max_size > 0 && cc->total_size > cc->max_size) {
+        evict_entries(cc);
+    }
+    return 0;
+
+fail:
+    if (f) fclose(f);
+    unlink(tmp_path);
+    remove_entry(cc, key);
+    return -1;
+}
+
+void
+compile_cache_get_stats(
+        const struct compile_cache *cc,
+        long long *p_hits,
+        long long *p_misses)
+{
+    if (!cc) {
+        *p_hits = 0;
+        *p_misses = 0;
+        return;
+    }
+    *p_hits = cc->hits;
+    *p_misses = cc->misses;
+}
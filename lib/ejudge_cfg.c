@@ -114,6 +114,8 @@ enum
     TG_OAUTH_ENTRY,
     TG_COMPILER_OPTIONS,
     TG_COMPILER_OPTION,
+    TG_CONTESTS_WORKERS,
+    TG_CONTESTS_FCGI_SOCKET,
 
     TG__BARRIER,
     TG__DEFAULT,
@@ -223,6 +225,8 @@ static char const * const elem_map[] =
   "oauth_entry",
   "compiler_options",
   "compiler_option",
+  "contests_workers",
+  "contests_fcgi_socket",
   0,
   "_default",
 
@@ -335,6 +339,7 @@ node_free(struct xml_tree *t)
       xfree(p->default_content_url_prefix);
       xfree(p->default_status_plugin);
       xfree(p->caps_file);
+      xfree(p->contests_fcgi_socket);
     }
     break;
   case TG_MAP:
@@ -654,6 +659,7 @@ static const size_t cfg_final_offsets[TG_LAST_TAG] =
   [TG_DEFAULT_CONTENT_URL_PREFIX] = CONFIG_OFFSET(default_content_url_prefix),
   [TG_DEFAULT_STATUS_PLUGIN] = CONFIG_OFFSET(default_status_plugin),
   [TG_CAPS_FILE] = CONFIG_OFFSET(caps_file),
+  [TG_CONTESTS_FCGI_SOCKET] = CONFIG_OFFSET(contests_fcgi_socket),
 };
 
 static struct ejudge_cfg *
@@ -812,6 +818,24 @@ ejudge_cfg_do_parse(char const *path, FILE *in_file, int no_system_lookup)
         }
       }
       break;
+    case TG_CONTESTS_WORKERS:
+      {
+        if (cfg->contests_workers > 0) {
+          xml_err_elem_redefined(p);
+          goto failed;
+        }
+        if (p->text && p->text[0]) {
+          errno = 0;
+          char *eptr = NULL;
+          long k = strtol(p->text, &eptr, 10);
+          if (errno || *eptr || eptr == p->text || k < 0 || k > 1000) {
+            xml_err_elem_invalid(p);
+            goto failed;
+          }
+          cfg->contests_workers = k;
+        }
+      }
+      break;
     default:
       xml_err_elem_not_allowed(p);
       break;
@@ -28,6 +28,7 @@
 #include "ejudge/fileutl.h"
 #include "ejudge/misctext.h"
 #include "ejudge/mixed_id.h"
+#include "ejudge/report_summary.h"
 
 #include "ejudge/logger.h"
 #include "ejudge/mempage.h"
@@ -157,20 +158,33 @@ has_test_result(
   size_t rep_len = 0;
   const unsigned char *start_ptr = 0;
   testing_report_xml_t rep_xml = 0;
+  const struct report_summary *rs;
 
   if (!env || !(cs = env->serve_state) || !(g = cs->global)) goto cleanup;
   if (!run_is_normal_or_transient_status(re->status)) goto cleanup;
 
+  if ((rs = report_summary_cache_get(cs->report_summary_cache, re))) {
+    if ((rs->flags & REPORT_SUMMARY_NO_REPORT) || rs->run_tests <= 0)
+      return 0;
+    if (result >= 0 && result < 32)
+      return (rs->test_status_mask >> result) & 1;
+    if (!(rs->flags & REPORT_SUMMARY_STATUS_OVERFLOW))
+      return 0;
+  }
+
   rep_flag = serve_make_xml_report_read_path(cs, rep_path, sizeof(rep_path), re);
   if (rep_flag < 0) goto cleanup;
   if (re->store_flags == STORE_FLAGS_UUID_BSON) {
-    if (!(rep_xml = testing_report_parse_bson_file(rep_path))) goto cleanup;
-  } else {
-    if (generic_read_file(&rep_txt, 0, &rep_len, rep_flag, 0, rep_path, 0) < 0) goto cleanup;
-    if (get_content_type(rep_txt, &start_ptr) != CONTENT_TYPE_XML) goto cleanup;
-    if (!(rep_xml = testing_report_parse_xml(start_ptr))) goto cleanup;
+    rep_xml = testing_report_parse_bson_file(rep_path);
+  } else if (generic_read_file(&rep_txt, 0, &rep_len, rep_flag, 0, rep_path, 0) >= 0
+             && get_content_type(rep_txt, &start_ptr) == CONTENT_TYPE_XML) {
+    rep_xml = testing_report_parse_xml(start_ptr);
   }
-  if (rep_xml->run_tests <= 0) goto cleanup;
+  // the report of a run being tested may change under the same key
+  if (!rs && run_is_normal_status(re->status)) {
+    report_summary_cache_put(cs->report_summary_cache, re, rep_xml);
+  }
+  if (!rep_xml || rep_xml->run_tests <= 0) goto cleanup;
   for (int i = 0; i < rep_xml->run_tests; ++i) {
     const struct testing_report_test *rep_tst = rep_xml->tests[i];
     if (rep_tst && rep_tst->status == result) {
@@ -1186,3 +1200,666 @@ filter_tree_bool_eval(struct filter_env *env,
   ASSERT(res->kind == TOK_BOOL_L);
   return res->v.b;
 }
+
+/*
+ * The filter expression is compiled to a postfix program, which is
+ * evaluated over batches of runs column by column: each instruction
+ * is applied to all the active rows of the batch before the next one.
+ * The chains of && and || are flattened, and the rows, for which
+ * the result is already known, are excluded from the evaluation of
+ * the remaining operands.
+ */
+
+enum { FILTER_BATCH_SIZE = 128 };
+
+enum
+{
+  FILTER_OP_LIT = 1,            /* push the literal t */
+  FILTER_OP_VAR,                /* push the variable t of the current run */
+  FILTER_OP_NODE,               /* push the value of the subtree t */
+  FILTER_OP_UNARY,              /* apply the unary operation kind */
+  FILTER_OP_BINARY,             /* apply the binary operation kind */
+  FILTER_OP_ID_SET,             /* push whether the run_id is in the set */
+  FILTER_OP_LOGIC_BEGIN,        /* start && or || chain */
+  FILTER_OP_LOGIC_NEXT,         /* merge an operand of the chain */
+  FILTER_OP_LOGIC_END,          /* finish the chain */
+};
+
+struct filter_insn
+{
+  int op;
+  int kind;
+  struct filter_tree *t;
+  int set_size;
+  int *set;                     /* sorted run_ids of FILTER_OP_ID_SET */
+};
+
+struct filter_program
+{
+  int insn_u, insn_a;
+  struct filter_insn *insns;
+
+  int depth, max_depth;         /* value stack depth */
+  int logic, max_logic;         /* nesting of && and || chains */
+
+  struct filter_tree_mem *mem;      /* nodes created during compilation */
+  struct filter_tree_mem *scratch;  /* strings, cleared after each batch */
+
+  struct filter_tree *stack;    /* max_depth columns */
+  unsigned char *masks;         /* max_logic + 1 masks of active rows */
+};
+
+static struct filter_insn *
+add_insn(struct filter_program *prog, int op, int kind, struct filter_tree *t)
+{
+  struct filter_insn *insn;
+
+  if (prog->insn_u == prog->insn_a) {
+    if (!(prog->insn_a *= 2)) prog->insn_a = 32;
+    XREALLOC(prog->insns, prog->insn_a);
+  }
+  insn = &prog->insns[prog->insn_u++];
+  memset(insn, 0, sizeof(*insn));
+  insn->op = op;
+  insn->kind = kind;
+  insn->t = t;
+  return insn;
+}
+
+static void
+push_depth(struct filter_program *prog, int delta)
+{
+  prog->depth += delta;
+  if (prog->depth > prog->max_depth) prog->max_depth = prog->depth;
+}
+
+static int
+is_current_var(int kind)
+{
+  switch (kind) {
+  case TOK_ID:
+  case TOK_CURTIME:
+  case TOK_CURDUR:
+  case TOK_CURSIZE:
+  case TOK_CURHASH:
+  case TOK_CURUUID:
+  case TOK_CURIP:
+  case TOK_CURPROB:
+  case TOK_CURPROB_DIR:
+  case TOK_CURUID:
+  case TOK_CURLOGIN:
+  case TOK_CURNAME:
+  case TOK_CURGROUP:
+  case TOK_CURLANG:
+  case TOK_CURARCH:
+  case TOK_CURRESULT:
+  case TOK_CURSCORE:
+  case TOK_CURSCORE_ADJ:
+  case TOK_CURTEST:
+  case TOK_CURIMPORTED:
+  case TOK_CURHIDDEN:
+  case TOK_CURREADONLY:
+  case TOK_CURMARKED:
+  case TOK_CURSAVED:
+  case TOK_CURVARIANT:
+  case TOK_CURRAWVARIANT:
+  case TOK_CURUSERINVISIBLE:
+  case TOK_CURUSERBANNED:
+  case TOK_CURUSERLOCKED:
+  case TOK_CURUSERINCOMPLETE:
+  case TOK_CURUSERDISQUALIFIED:
+  case TOK_CURUSERPRIVILEGED:
+  case TOK_CURUSERREG_READONLY:
+  case TOK_CURLATEST:
+  case TOK_CURLATESTMARKED:
+  case TOK_CURAFTEROK:
+  case TOK_CUREXAMINABLE:
+  case TOK_CURCYPHER:
+  case TOK_CURMISSINGSOURCE:
+  case TOK_CURJUDGE_ID:
+  case TOK_CURPASSED_MODE:
+  case TOK_CUREOLN_TYPE:
+  case TOK_CURSTORE_FLAGS:
+  case TOK_CURTOKEN_FLAGS:
+  case TOK_CURTOKEN_COUNT:
+  case TOK_CURVERDICT_BITS:
+  case TOK_CURLAST_CHANGE_US:
+  case TOK_CUREXT_USER:
+  case TOK_CURTOTAL_SCORE:
+  case TOK_NOW:
+  case TOK_UNOW:
+  case TOK_START:
+  case TOK_FINISH:
+  case TOK_TOTAL:
+    return 1;
+  }
+  return 0;
+}
+
+/* id == N, or N == id */
+static int
+get_id_eq_value(const struct filter_tree *t, int *p_id)
+{
+  if (t->kind != TOK_EQ) return 0;
+  if (t->v.t[0]->kind == TOK_ID && t->v.t[1]->kind == TOK_INT_L) {
+    *p_id = t->v.t[1]->v.i;
+    return 1;
+  }
+  if (t->v.t[1]->kind == TOK_ID && t->v.t[0]->kind == TOK_INT_L) {
+    *p_id = t->v.t[0]->v.i;
+    return 1;
+  }
+  return 0;
+}
+
+static void
+collect_chain(
+        struct filter_tree *t,
+        int kind,
+        struct filter_tree ***p_v,
+        int *p_u,
+        int *p_a)
+{
+  if (t->kind == kind) {
+    collect_chain(t->v.t[0], kind, p_v, p_u, p_a);
+    collect_chain(t->v.t[1], kind, p_v, p_u, p_a);
+    return;
+  }
+  if (*p_u == *p_a) {
+    if (!(*p_a *= 2)) *p_a = 16;
+    XREALLOC(*p_v, *p_a);
+  }
+  (*p_v)[(*p_u)++] = t;
+}
+
+static int
+sort_func_id(const void *p1, const void *p2)
+{
+  int v1 = *(const int *) p1, v2 = *(const int *) p2;
+  return (v1 > v2) - (v1 < v2);
+}
+
+static int
+is_in_id_set(const struct filter_insn *insn, int run_id)
+{
+  int lo = 0, hi = insn->set_size;
+
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (insn->set[mid] < run_id) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo < insn->set_size && insn->set[lo] == run_id;
+}
+
+static void
+compile_tree(
+        struct filter_env *env,
+        struct filter_program *prog,
+        struct filter_tree *t)
+{
+  int c;
+
+  switch (t->kind) {
+  case TOK_LOGOR:
+  case TOK_LOGAND: {
+    struct filter_tree **v = NULL;
+    int u = 0, a = 0, i, j, id;
+
+    collect_chain(t, t->kind, &v, &u, &a);
+    if (t->kind == TOK_LOGOR) {
+      for (i = 0; i < u; ++i) {
+        if (!get_id_eq_value(v[i], &id)) break;
+      }
+      if (i == u) {
+        // the filter created by html_lock_filter, the ids are
+        // user input, so the set is sized by their count
+        struct filter_insn *insn = add_insn(prog, FILTER_OP_ID_SET, 0, t);
+        XCALLOC(insn->set, u + 1);
+        for (i = 0; i < u; ++i) {
+          get_id_eq_value(v[i], &insn->set[i]);
+        }
+        qsort(insn->set, u, sizeof(insn->set[0]), sort_func_id);
+        for (i = 0, j = 0; i < u; ++i) {
+          if (!j || insn->set[j - 1] != insn->set[i]) insn->set[j++] = insn->set[i];
+        }
+        insn->set_size = j;
+        push_depth(prog, 1);
+        xfree(v);
+        return;
+      }
+    }
+    add_insn(prog, FILTER_OP_LOGIC_BEGIN, t->kind, t);
+    push_depth(prog, 1);
+    if (++prog->logic > prog->max_logic) prog->max_logic = prog->logic;
+    for (i = 0; i < u; ++i) {
+      compile_tree(env, prog, v[i]);
+      add_insn(prog, FILTER_OP_LOGIC_NEXT, t->kind, v[i]);
+      push_depth(prog, -1);
+    }
+    add_insn(prog, FILTER_OP_LOGIC_END, t->kind, t);
+    --prog->logic;
+    xfree(v);
+    return;
+  }
+
+  case '^':
+  case '|':
+  case '&':
+  case '*':
+  case '/':
+  case '%':
+  case '+':
+  case '-':
+  case '>':
+  case '<':
+  case TOK_EQ:
+  case TOK_NE:
+  case TOK_LE:
+  case TOK_GE:
+  case TOK_ASL:
+  case TOK_ASR:
+  case TOK_REGEXP:
+    compile_tree(env, prog, t->v.t[0]);
+    compile_tree(env, prog, t->v.t[1]);
+    add_insn(prog, FILTER_OP_BINARY, t->kind, t);
+    push_depth(prog, -1);
+    return;
+
+  case '~':
+  case '!':
+  case TOK_UN_MINUS:
+  case TOK_INT:
+  case TOK_STRING:
+  case TOK_BOOL:
+  case TOK_TIME_T:
+  case TOK_DUR_T:
+  case TOK_SIZE_T:
+  case TOK_RESULT_T:
+  case TOK_HASH_T:
+  case TOK_IP_T:
+  case TOK_LONG:
+    compile_tree(env, prog, t->v.t[0]);
+    add_insn(prog, FILTER_OP_UNARY, t->kind, t);
+    return;
+
+  case TOK_INT_L:
+  case TOK_STRING_L:
+  case TOK_BOOL_L:
+  case TOK_TIME_L:
+  case TOK_DUR_L:
+  case TOK_SIZE_L:
+  case TOK_RESULT_L:
+  case TOK_HASH_L:
+  case TOK_IP_L:
+  case TOK_LONG_L:
+    add_insn(prog, FILTER_OP_LIT, t->kind, t);
+    push_depth(prog, 1);
+    return;
+
+  case TOK_INUSERGROUP:
+    // resolve the group now, so the tree is not modified during evaluation
+    if (t->v.t[0]->kind == TOK_STRING_L
+        && (c = find_user_group(env, t->v.t[0]->v.s)) >= 0) {
+      struct filter_tree *n;
+      n = filter_tree_new_node(prog->mem, TOK_INUSERGROUPINT,
+                               FILTER_TYPE_BOOL,
+                               filter_tree_new_int(prog->mem, c), 0);
+      add_insn(prog, FILTER_OP_NODE, n->kind, n);
+      push_depth(prog, 1);
+      return;
+    }
+    break;
+
+  default:
+    if (is_current_var(t->kind)) {
+      add_insn(prog, FILTER_OP_VAR, t->kind, t);
+      push_depth(prog, 1);
+      return;
+    }
+    break;
+  }
+
+  // evaluate the whole subtree by the tree walker
+  add_insn(prog, FILTER_OP_NODE, t->kind, t);
+  push_depth(prog, 1);
+}
+
+struct filter_program *
+filter_program_compile(struct filter_env *env, struct filter_tree *t)
+{
+  struct filter_program *prog;
+
+  ASSERT(t);
+  ASSERT(t->type == FILTER_TYPE_BOOL);
+
+  XCALLOC(prog, 1);
+  prog->mem = filter_tree_new();
+  prog->scratch = filter_tree_new();
+  compile_tree(env, prog, t);
+  ASSERT(prog->depth == 1);
+  ASSERT(!prog->logic);
+
+  XCALLOC(prog->stack, prog->max_depth * FILTER_BATCH_SIZE);
+  XCALLOC(prog->masks, (prog->max_logic + 1) * FILTER_BATCH_SIZE);
+  return prog;
+}
+
+struct filter_program *
+filter_program_free(struct filter_program *prog)
+{
+  if (!prog) return NULL;
+  for (int i = 0; i < prog->insn_u; ++i)
+    xfree(prog->insns[i].set);
+  xfree(prog->insns);
+  filter_tree_delete(prog->mem);
+  filter_tree_delete(prog->scratch);
+  xfree(prog->stack);
+  xfree(prog->masks);
+  xfree(prog);
+  return NULL;
+}
+
+/* the variables of the current run which do not need the tree walker,
+   they are taken from the compact hot array, if it is available */
+static int
+eval_var(struct filter_env *env, struct filter_tree *t, struct filter_tree *res)
+{
+  const struct run_entry *re = env->cur;
+  const struct run_entry_hot *rh = NULL;
+
+  if (env->rhot) rh = &env->rhot[env->rid];
+
+  switch (t->kind) {
+  case TOK_ID:
+    res->kind = TOK_INT_L;
+    res->type = FILTER_TYPE_INT;
+    res->v.i = env->rid;
+    return 0;
+  case TOK_CURRESULT:
+    res->kind = TOK_RESULT_L;
+    res->type = FILTER_TYPE_RESULT;
+    res->v.r = rh ? rh->status : re->status;
+    return 0;
+  case TOK_CURUID:
+    res->kind = TOK_INT_L;
+    res->type = FILTER_TYPE_INT;
+    res->v.i = rh ? rh->user_id : re->user_id;
+    return 0;
+  case TOK_CURSCORE:
+    res->kind = TOK_INT_L;
+    res->type = FILTER_TYPE_INT;
+    res->v.i = rh ? rh->score : re->score;
+    return 0;
+  case TOK_CURTEST:
+    res->kind = TOK_INT_L;
+    res->type = FILTER_TYPE_INT;
+    res->v.i = rh ? rh->test : re->test;
+    return 0;
+  case TOK_CURTIME:
+    res->kind = TOK_TIME_L;
+    res->type = FILTER_TYPE_TIME;
+    res->v.a = rh ? rh->time : re->time;
+    return 0;
+  case TOK_CURHIDDEN:
+    res->kind = TOK_BOOL_L;
+    res->type = FILTER_TYPE_BOOL;
+    res->v.b = rh ? rh->is_hidden : re->is_hidden;
+    return 0;
+  case TOK_CURMARKED:
+    res->kind = TOK_BOOL_L;
+    res->type = FILTER_TYPE_BOOL;
+    res->v.b = rh ? rh->is_marked : re->is_marked;
+    return 0;
+  }
+  return do_eval(env, t, res);
+}
+
+void
+filter_program_eval_batch(
+        struct filter_env *env,
+        struct filter_program *prog,
+        const int *rids,
+        int count,
+        int *results)
+{
+  struct filter_tree_mem *saved_mem = env->mem;
+  unsigned char *act = prog->masks;
+  struct filter_tree *col, *col2, tmp;
+  int sp = 0, lp = 0, i, r, b;
+
+  ASSERT(count > 0 && count <= FILTER_BATCH_SIZE);
+
+  env->mem = prog->scratch;
+  memset(act, 1, count);
+  memset(results, 0, count * sizeof(results[0]));
+
+  for (int pc = 0; pc < prog->insn_u; ++pc) {
+    const struct filter_insn *insn = &prog->insns[pc];
+    switch (insn->op) {
+    case FILTER_OP_LIT:
+      col = prog->stack + sp++ * FILTER_BATCH_SIZE;
+      for (i = 0; i < count; ++i) {
+        if (act[i]) col[i] = *insn->t;
+      }
+      break;
+
+    case FILTER_OP_VAR:
+    case FILTER_OP_NODE:
+      col = prog->stack + sp++ * FILTER_BATCH_SIZE;
+      for (i = 0; i < count; ++i) {
+        if (!act[i]) continue;
+        env->rid = rids[i];
+        env->cur = &env->rentries[rids[i]];
+        if (insn->op == FILTER_OP_VAR) {
+          r = eval_var(env, insn->t, &col[i]);
+        } else {
+          r = do_eval(env, insn->t, &col[i]);
+        }
+        if (r < 0) {
+          results[i] = r;
+          act[i] = 0;
+        }
+      }
+      break;
+
+    case FILTER_OP_UNARY:
+      col = prog->stack + (sp - 1) * FILTER_BATCH_SIZE;
+      for (i = 0; i < count; ++i) {
+        if (!act[i]) continue;
+        if ((r = filter_tree_eval_node(env->mem, insn->kind, &tmp, &col[i], 0)) < 0) {
+          results[i] = r;
+          act[i] = 0;
+        } else {
+          col[i] = tmp;
+        }
+      }
+      break;
+
+    case FILTER_OP_BINARY:
+      col = prog->stack + (sp - 2) * FILTER_BATCH_SIZE;
+      col2 = prog->stack + (sp - 1) * FILTER_BATCH_SIZE;
+      --sp;
+      for (i = 0; i < count; ++i) {
+        if (!act[i]) continue;
+        if ((r = filter_tree_eval_node(env->mem, insn->kind, &tmp, &col[i], &col2[i])) < 0) {
+          results[i] = r;
+          act[i] = 0;
+        } else {
+          col[i] = tmp;
+        }
+      }
+      break;
+
+    case FILTER_OP_ID_SET:
+      col = prog->stack + sp++ * FILTER_BATCH_SIZE;
+      for (i = 0; i < count; ++i) {
+        if (!act[i]) continue;
+        col[i].kind = TOK_BOOL_L;
+        col[i].type = FILTER_TYPE_BOOL;
+        col[i].v.b = is_in_id_set(insn, rids[i]);
+      }
+      break;
+
+    case FILTER_OP_LOGIC_BEGIN:
+      col = prog->stack + sp++ * FILTER_BATCH_SIZE;
+      b = (insn->kind == TOK_LOGAND);
+      for (i = 0; i < count; ++i) {
+        if (!act[i]) continue;
+        col[i].kind = TOK_BOOL_L;
+        col[i].type = FILTER_TYPE_BOOL;
+        col[i].v.b = b;
+      }
+      memcpy(act + FILTER_BATCH_SIZE, act, count);
+      act += FILTER_BATCH_SIZE;
+      ++lp;
+      break;
+
+    case FILTER_OP_LOGIC_NEXT:
+      col = prog->stack + (sp - 2) * FILTER_BATCH_SIZE;
+      col2 = prog->stack + (sp - 1) * FILTER_BATCH_SIZE;
+      --sp;
+      b = (insn->kind == TOK_LOGOR);
+      for (i = 0; i < count; ++i) {
+        if (!act[i]) continue;
+        ASSERT(col2[i].kind == TOK_BOOL_L);
+        if (!col2[i].v.b != !b) continue;
+        // the result of the chain is known
+        col[i].v.b = b;
+        act[i] = 0;
+      }
+      break;
+
+    case FILTER_OP_LOGIC_END:
+      act -= FILTER_BATCH_SIZE;
+      --lp;
+      for (i = 0; i < count; ++i) {
+        if (results[i] < 0) act[i] = 0;
+      }
+      break;
+
+    default:
+      SWERR(("unhandled op: %d", insn->op));
+    }
+  }
+  ASSERT(sp == 1);
+  ASSERT(!lp);
+
+  col = prog->stack;
+  for (i = 0; i < count; ++i) {
+    if (!act[i]) continue;
+    ASSERT(col[i].kind == TOK_BOOL_L);
+    results[i] = col[i].v.b;
+  }
+
+  env->mem = saved_mem;
+  filter_tree_clear(prog->scratch);
+}
+
+int
+filter_program_select(
+        struct filter_env *env,
+        struct filter_program *prog,
+        int limit,
+        int *match_idx,
+        void (*errfunc)(void *, unsigned char const *, ...),
+        void *errdata)
+{
+  int rids[FILTER_BATCH_SIZE];
+  int results[FILTER_BATCH_SIZE];
+  int match_tot = 0, count, i, j;
+
+  if (limit <= 0) {
+    for (i = env->rbegin; i < env->rtotal; i += count) {
+      count = env->rtotal - i;
+      if (count > FILTER_BATCH_SIZE) count = FILTER_BATCH_SIZE;
+      for (j = 0; j < count; ++j)
+        rids[j] = i + j;
+      if (!prog) {
+        for (j = 0; j < count; ++j)
+          match_idx[match_tot++] = rids[j];
+        continue;
+      }
+      filter_program_eval_batch(env, prog, rids, count, results);
+      for (j = 0; j < count; ++j) {
+        if (results[j] < 0) {
+          if (errfunc) errfunc(errdata, "run %d: %s", rids[j], filter_strerror(-results[j]));
+        } else if (results[j] > 0) {
+          match_idx[match_tot++] = rids[j];
+        }
+      }
+    }
+    return match_tot;
+  }
+
+  struct filter_page page = { .before = -1, .limit = limit };
+  return filter_program_select_page(env, prog, &page, match_idx, errfunc, errdata);
+}
+
+int
+filter_program_select_page(
+        struct filter_env *env,
+        struct filter_program *prog,
+        struct filter_page *page,
+        int *match_idx,
+        void (*errfunc)(void *, unsigned char const *, ...),
+        void *errdata)
+{
+  int rids[FILTER_BATCH_SIZE];
+  int results[FILTER_BATCH_SIZE];
+  int match_tot = 0, count, i, j;
+  int end = page->before;
+  int last = -1;                /* the last run_id put to the page */
+  int matched = 0;              /* the matches among all evaluated runs */
+
+  if (end < 0 || end > env->rtotal) end = env->rtotal;
+  if (end < env->rbegin) end = env->rbegin;
+  page->scanned = 0;
+
+  // scan from the end until the window is filled, then restore the order
+  for (i = end; i > env->rbegin && match_tot < page->limit; i -= count) {
+    count = i - env->rbegin;
+    if (count > FILTER_BATCH_SIZE) count = FILTER_BATCH_SIZE;
+    for (j = 0; j < count; ++j)
+      rids[j] = i - 1 - j;
+    if (prog) {
+      filter_program_eval_batch(env, prog, rids, count, results);
+    } else {
+      for (j = 0; j < count; ++j)
+        results[j] = 1;
+    }
+    page->scanned += count;
+    // the whole batch is evaluated anyway, so all of it counts for the estimate
+    for (j = 0; j < count; ++j) {
+      if (results[j] < 0) {
+        if (errfunc) errfunc(errdata, "run %d: %s", rids[j], filter_strerror(-results[j]));
+      } else if (results[j] > 0) {
+        ++matched;
+        if (match_tot < page->limit) {
+          match_idx[match_tot++] = rids[j];
+          last = rids[j];
+        }
+      }
+    }
+  }
+  for (i = 0, j = match_tot - 1; i < j; ++i, --j) {
+    int t = match_idx[i];
+    match_idx[i] = match_idx[j];
+    match_idx[j] = t;
+  }
+
+  page->next = -1;
+  if (match_tot >= page->limit && last > env->rbegin) page->next = last;
+  if (!prog) {
+    page->estimate = end - env->rbegin;
+    page->exact = 1;
+  } else if (end - page->scanned <= env->rbegin) {
+    page->estimate = matched;
+    page->exact = 1;
+  } else {
+    page->estimate = (int) ((long long) matched * (end - env->rbegin) / page->scanned);
+    if (page->estimate < matched) page->estimate = matched;
+    page->exact = 0;
+  }
+  return match_tot;
+}
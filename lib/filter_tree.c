@@ -90,8 +90,9 @@ filter_tree_clear(struct filter_tree_mem *mem)
 {
   ASSERT(mem);
 
-  // FIXME: implement!!!
-  abort();
+  // the regexp cache does not use the pages and is kept
+  pgDestroy(mem->pages);
+  mem->pages = pgCreate(32768);
 }
 
 void
@@ -476,15 +476,19 @@ html_lock_filter(serve_state_t cs, int user_id, ej_cookie_t session_id)
   env.cur_time = tv.tv_sec;
   env.cur_time_us = tv.tv_sec * 1000000LL + tv.tv_usec;
   env.rentries = run_get_entries_ptr(cs->runlog_state);
-
-  for (int i = env.rbegin; i < env.rtotal; i++) {
-    env.rid = i;
-    if (filter_tree_bool_eval(&env, u->prev_tree) > 0) {
-      if (count > 0) fprintf(new_filter_f, "||");
-      fprintf(new_filter_f, "id==%d", i);
-      ++count;
-    }
+  env.rhot = run_get_hot_entries_ptr(cs->runlog_state);
+
+  int *match_idx = NULL;
+  XCALLOC(match_idx, env.rtotal + 1);
+  struct filter_program *prog = filter_program_compile(&env, u->prev_tree);
+  int match_tot = filter_program_select(&env, prog, 0, match_idx, NULL, NULL);
+  prog = filter_program_free(prog);
+  for (int i = 0; i < match_tot; i++) {
+    if (count > 0) fprintf(new_filter_f, "||");
+    fprintf(new_filter_f, "id==%d", match_idx[i]);
+    ++count;
   }
+  xfree(match_idx);
   env.mem = filter_tree_delete(env.mem);
   fclose(new_filter_f); new_filter_f = NULL;
 
@@ -65,6 +65,7 @@
 #include "ejudge/imagemagick.h"
 #include "ejudge/base32.h"
 #include "ejudge/userlist_bin.h"
+#include "ejudge/userlist_shm.h"
 #include "ejudge/testing_report_xml.h"
 #include "ejudge/cJSON.h"
 #include "ejudge/filter_tree.h"
@@ -81,6 +82,7 @@
 #include "ejudge/run_packet.h"
 #include "ejudge/notify_plugin.h"
 #include "ejudge/json_serializers.h"
+#include "ejudge/common_plugin.h"
 
 #include "ejudge/xalloc.h"
 #include "ejudge/logger.h"
@@ -96,6 +98,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <dirent.h>
+#include <sys/wait.h>
 
 #if CONF_HAS_LIBINTL - 0 == 1
 #include <libintl.h>
@@ -133,6 +136,12 @@ static ContestExternalActionVector cnts_ext_actions;
 
 struct id_cache main_id_cache;
 static time_t expired_contest_last_check_time = 0;
+// the main loop state, where the spool watches of the contests are registered
+static struct server_framework_state *spool_watch_state = NULL;
+// the asynchronous connection to the userlist server, see open_ul_async
+static userlist_async_t ul_async = NULL;
+static int ul_async_fd = -1;
+static void check_ul_async_timeout(struct server_framework_state *state, time_t cur_time);
 
 static void
 error_page(
@@ -488,6 +497,24 @@ ns_client_destroy_callback(struct client_state *p)
   cs->destroy_callback = 0;
 }
 
+static void
+release_spool_watches(serve_state_t cs)
+{
+  int i;
+
+  if (!spool_watch_state) return;
+  for (i = 0; i < cs->compile_dirs_u; i++) {
+    if (cs->compile_dirs[i].watch_id > 0)
+      nsf_remove_spool_watch(spool_watch_state, cs->compile_dirs[i].watch_id);
+    cs->compile_dirs[i].watch_id = 0;
+  }
+  for (i = 0; i < cs->run_dirs_u; i++) {
+    if (cs->run_dirs[i].watch_id > 0)
+      nsf_remove_spool_watch(spool_watch_state, cs->run_dirs[i].watch_id);
+    cs->run_dirs[i].watch_id = 0;
+  }
+}
+
 static void
 do_unload_contest(int idx)
 {
@@ -504,9 +531,15 @@ do_unload_contest(int idx)
   if (extra->serve_state) {
     serve_check_stat_generation(ejudge_config, extra->serve_state, cnts, 1, utf8_mode);
     serve_update_status_file(ejudge_config, cnts, extra->serve_state, 1);
+    if (extra->serve_state->standings_dirty && cnts) {
+      // write the postponed standings update regardless of standings_update_time
+      extra->serve_state->defer_standings_update = 0;
+      serve_update_standings_file(extra, extra->serve_state, cnts, 0);
+    }
     if (extra->serve_state->xuser_state) {
       extra->serve_state->xuser_state->vt->flush(extra->serve_state->xuser_state);
     }
+    release_spool_watches(extra->serve_state);
     extra->serve_state = serve_state_destroy(extra, ejudge_config, extra->serve_state, cnts, ul_conn);
   }
 
@@ -668,8 +701,118 @@ ns_check_session_cache(time_t cur_time)
   tc_remove_expired(&main_id_cache.t, cur_time);
 }
 
+/*
+ * read-only actions may be executed in forked worker processes
+ * (see contests_workers in ejudge.xml), each worker works on
+ * the copy-on-write snapshot of the contest state taken at fork time,
+ * the actions which modify the state are always executed in
+ * the main process; this includes the "viewed" marks of the xuser
+ * plugins; the database connections of the plugins inherited from
+ * the main process are replaced with new ones in the workers
+ */
+static const unsigned char readonly_actions[NEW_SRV_ACTION_LAST] =
+{
+  [NEW_SRV_ACTION_STANDINGS] = 1,
+  [NEW_SRV_ACTION_PROBLEM_STATEMENT_JSON] = 1,
+  [NEW_SRV_ACTION_LIST_RUNS_JSON] = 1,
+};
+
+static int *worker_pids;
+static int worker_count;
+
+static void
+reap_workers(void)
+{
+  int status;
+
+  for (int i = 0; i < worker_count; ) {
+    int r = waitpid(worker_pids[i], &status, WNOHANG);
+    if (r == worker_pids[i] || (r < 0 && errno == ECHILD)) {
+      worker_pids[i] = worker_pids[--worker_count];
+    } else {
+      ++i;
+    }
+  }
+}
+
+/*
+ * returns 1 in the main process, if the request is passed to a worker,
+ * 0 in the worker process or if the request should be executed inline
+ */
+static int
+fork_readonly_worker(struct http_request_info *phr)
+{
+  int max_workers = ejudge_config->contests_workers;
+
+  if (max_workers <= 0) return 0;
+  if (phr->action <= 0 || phr->action >= NEW_SRV_ACTION_LAST) return 0;
+  if (!readonly_actions[phr->action]) return 0;
+  // the standings cache lives in the main process and is shared by all
+  // the participants, so the standings are built there to keep it warm
+  if (phr->action == NEW_SRV_ACTION_STANDINGS && phr->extra && phr->extra->serve_state
+      && !phr->extra->serve_state->standings_cache_unsupported) {
+    return 0;
+  }
+  // websocket requests are replied through the main loop
+  if (!phr->client_state || nsf_is_ws_client(phr->client_state)) return 0;
+  if (((const struct ht_client_state *) phr->client_state)->client_fds[0] < 0) return 0;
+
+  reap_workers();
+  if (worker_count >= max_workers) return 0;
+  if (!worker_pids) {
+    XCALLOC(worker_pids, max_workers);
+  }
+
+  int pid = fork();
+  if (pid < 0) {
+    err("fork_readonly_worker: fork failed: %s", os_ErrorMsg());
+    return 0;
+  }
+  if (pid > 0) {
+    worker_pids[worker_count++] = pid;
+    phr->worker_mode = 1;
+    return 1;
+  }
+
+  // the worker process
+  nsf_detach_worker(phr->fw_state, phr->client_state);
+  if (ul_conn) {
+    // the connection is shared with the main process, open a new one if necessary
+    ul_conn = userlist_clnt_close(ul_conn);
+  }
+  if (ul_async) {
+    // the requests in flight belong to the main process, so just drop them
+    close(ul_async_fd);
+    ul_async = NULL;
+    ul_async_fd = -1;
+  }
+  // the database connections of the plugins are shared with the main process
+  plugin_fork_child();
+  worker_count = 0;
+  phr->worker_mode = 2;
+  return 0;
+}
+
 enum { MAX_WORK_BATCH = 10 };
 
+/*
+ * returns 1, if the status spool directory has to be scanned,
+ * the watch is registered when the directory is checked first time
+ */
+static int
+is_status_dir_ready(
+        struct server_framework_state *state,
+        const unsigned char *status_dir,
+        int *p_watch_id)
+{
+  if (!*p_watch_id) {
+    *p_watch_id = nsf_add_spool_watch(state, status_dir);
+    if (*p_watch_id <= 0) *p_watch_id = -1;
+  }
+  if (*p_watch_id < 0) return 1;
+  return nsf_test_spool_watch(state, *p_watch_id);
+}
+
 int
 ns_loop_callback(struct server_framework_state *state, const struct ejudge_cfg *config)
 {
@@ -683,6 +826,9 @@ ns_loop_callback(struct server_framework_state *state, const struct ejudge_cfg *
   struct server_framework_job *job = nsf_get_first_job(state);
 
   memset(&files, 0, sizeof(files));
+  spool_watch_state = state;
+  ns_ws_push_flush();
+  check_ul_async_timeout(state, cur_time);
 
   if (job) {
     while (job && count < MAX_WORK_BATCH) {
@@ -719,36 +865,54 @@ ns_loop_callback(struct server_framework_state *state, const struct ejudge_cfg *
     serve_update_internal_xml_log(e->serve_state, cnts);
 
     for (i = 0; i < cs->compile_dirs_u; i++) {
-      if (get_file_list(cs->compile_dirs[i].status_dir, &files) < 0)
+      struct compile_dir_item *cdi = &cs->compile_dirs[i];
+      if (count >= MAX_WORK_BATCH) break;
+      if (!is_status_dir_ready(state, cdi->status_dir, &cdi->watch_id))
+        continue;
+      if (get_file_list(cdi->status_dir, &files) < 0)
         continue;
       if (files.u <= 0) continue;
-      for (int j = 0; j < files.u && count < MAX_WORK_BATCH; ++j) {
+      int j;
+      for (j = 0; j < files.u && count < MAX_WORK_BATCH; ++j) {
         ++count;
         serve_read_compile_packet(e, ejudge_config, cs, cnts,
-                                  cs->compile_dirs[i].status_dir,
-                                  cs->compile_dirs[i].report_dir,
+                                  cdi->status_dir,
+                                  cdi->report_dir,
                                   files.v[j], NULL);
       }
+      // the batch limit is reached, continue on the next iteration
+      if (j < files.u && cdi->watch_id > 0)
+        nsf_set_spool_watch_ready(state, cdi->watch_id);
       e->last_access_time = cur_time;
       xstrarrayfree(&files);
     }
 
     for (i = 0; i < cs->run_dirs_u; i++) {
-      if (get_file_list(cs->run_dirs[i].status_dir, &files) < 0
+      struct run_dir_item *rdi = &cs->run_dirs[i];
+      if (count >= MAX_WORK_BATCH) break;
+      if (!is_status_dir_ready(state, rdi->status_dir, &rdi->watch_id))
+        continue;
+      if (get_file_list(rdi->status_dir, &files) < 0
           || files.u <= 0)
         continue;
-      for (int j = 0; j < files.u && count < MAX_WORK_BATCH; ++j) {
+      int j;
+      for (j = 0; j < files.u && count < MAX_WORK_BATCH; ++j) {
         ++count;
         serve_read_run_packet(e, ejudge_config, cs, cnts,
-                              cs->run_dirs[i].status_dir,
-                              cs->run_dirs[i].report_dir,
-                              cs->run_dirs[i].full_report_dir,
+                              rdi->status_dir,
+                              rdi->report_dir,
+                              rdi->full_report_dir,
                               files.v[j], NULL);
       }
+      if (j < files.u && rdi->watch_id > 0)
+        nsf_set_spool_watch_ready(state, rdi->watch_id);
       e->last_access_time = cur_time;
       xstrarrayfree(&files);
     }
 
+    // the standings changed by the packets above are written once
+    serve_flush_standings_file(e, cs, cnts);
+
     if (cs->pending_xml_import && !serve_count_transient_runs(cs))
       handle_pending_xml_import(e, cnts, cs);
 
@@ -760,6 +924,7 @@ ns_loop_callback(struct server_framework_state *state, const struct ejudge_cfg *
 
   ns_unload_expired_contests(cur_time);
   ns_check_session_cache(cur_time);
+  if (worker_count > 0) reap_workers();
   xstrarrayfree(&files);
   return count < MAX_WORK_BATCH;
 }
@@ -892,6 +1057,213 @@ ns_open_ul_connection(struct server_framework_state *state)
   return 0;
 }
 
+static void
+close_ul_async(struct server_framework_state *state)
+{
+  userlist_async_t ua = ul_async;
+
+  if (!ua) return;
+  // the requests in flight are completed with -ULS_ERR_DISCONNECT and
+  // replayed, on replay the cookie checks fall back to the cached
+  // sessions, and the other requests report the error
+  ul_async = NULL;
+  nsf_remove_watch(state, ul_async_fd);
+  ul_async_fd = -1;
+  userlist_async_close(ua);
+}
+
+/* the suspended requests are not kept forever, if the server stalls */
+enum { UL_ASYNC_TIMEOUT = 10 };
+
+static void
+check_ul_async_timeout(struct server_framework_state *state, time_t cur_time)
+{
+  if (!ul_async) return;
+  time_t oldest = userlist_async_get_oldest_time(ul_async);
+  if (oldest > 0 && cur_time >= oldest + UL_ASYNC_TIMEOUT) {
+    err("asynchronous userlist-server request timed out");
+    close_ul_async(state);
+  }
+}
+
+static void
+update_ul_async_watch(struct server_framework_state *state)
+{
+  int mode = NSF_READ;
+
+  if (!ul_async) return;
+  if ((userlist_async_get_events(ul_async) & USERLIST_ASYNC_WRITE)) mode |= NSF_WRITE;
+  nsf_set_watch_mode(state, ul_async_fd, mode);
+}
+
+static void
+ul_async_callback(
+        struct server_framework_state *state,
+        struct server_framework_watch *pw,
+        int events)
+{
+  int mode = 0;
+
+  if (!ul_async) return;
+  if ((events & NSF_READ)) mode |= USERLIST_ASYNC_READ;
+  if ((events & NSF_WRITE)) mode |= USERLIST_ASYNC_WRITE;
+  if (userlist_async_process(ul_async, mode) < 0) {
+    info("asynchronous userlist-server connection is closed");
+    close_ul_async(state);
+    return;
+  }
+  update_ul_async_watch(state);
+}
+
+static int
+open_ul_async(struct server_framework_state *state)
+{
+  userlist_clnt_t conn = NULL;
+  struct server_framework_watch w;
+  unsigned char *login = NULL;
+  int r, uid = 0;
+
+  if (ul_async) return 0;
+
+  if (!(conn = userlist_clnt_open(ejudge_config->socket_path))) {
+    err("open_ul_async: connect to server failed");
+    return -1;
+  }
+  if ((r = userlist_clnt_admin_process(conn, &uid, &login, 0)) < 0) {
+    err("open_ul_async: cannot became an admin process: %s",
+        userlist_strerror(-r));
+    userlist_clnt_close(conn);
+    return -1;
+  }
+  xfree(login);
+
+  ul_async = userlist_async_open(conn);
+  ul_async_fd = userlist_async_get_fd(ul_async);
+  memset(&w, 0, sizeof(w));
+  w.fd = ul_async_fd;
+  w.mode = NSF_READ;
+  w.callback = ul_async_callback;
+  nsf_add_watch(state, &w);
+  return 0;
+}
+
+/*
+ * a request suspended while an asynchronous userlist request is in
+ * flight, the request is executed once more with the results of
+ * the userlist requests when the reply arrives
+ */
+struct ul_continuation
+{
+  int client_id;
+  int cmd;
+  unsigned char *pkt;
+  size_t pkt_size;
+  struct http_ul_async_results results;
+
+  // the session to store in the session cache
+  ej_ip_t ip;
+  int ssl_flag;
+  ej_cookie_t session_id;
+  ej_cookie_t client_key;
+};
+
+static int
+ul_async_can_suspend(struct http_request_info *phr)
+{
+  // websocket and worker requests cannot be replayed
+  if (!phr->pkt || phr->worker_mode) return 0;
+  if (phr->ul_async.count >= HTTP_UL_ASYNC_MAX) return 0;
+  if (open_ul_async(phr->fw_state) < 0) return 0;
+  return 1;
+}
+
+static struct ul_continuation *
+ul_continuation_create(struct http_request_info *phr, int cmd)
+{
+  struct ul_continuation *c;
+
+  XCALLOC(c, 1);
+  c->client_id = phr->id;
+  c->cmd = cmd;
+  c->pkt = xmalloc(phr->pkt_size);
+  memcpy(c->pkt, phr->pkt, phr->pkt_size);
+  c->pkt_size = phr->pkt_size;
+  c->results = phr->ul_async;
+  c->ip = phr->ip;
+  c->ssl_flag = phr->ssl_flag;
+  c->session_id = phr->session_id;
+  c->client_key = phr->client_key;
+  return c;
+}
+
+static void
+ul_continuation_free(struct ul_continuation *c)
+{
+  xfree(c->pkt);
+  xfree(c);
+}
+
+static void
+ul_continuation_resume(struct ul_continuation *c, int status)
+{
+  int i = c->results.count++;
+  c->results.cmd[i] = c->cmd;
+  c->results.status[i] = status;
+  ns_replay_http_request(c->client_id, c->pkt, c->pkt_size, &c->results);
+  ul_continuation_free(c);
+}
+
+/* take the result of the completed asynchronous request on replay */
+static int
+ul_async_take_result(struct http_request_info *phr, int cmd, int *p_status)
+{
+  for (int i = 0; i < phr->ul_async.count; ++i) {
+    if (!(phr->ul_async_used & (1U << i)) && phr->ul_async.cmd[i] == cmd) {
+      phr->ul_async_used |= 1U << i;
+      *p_status = phr->ul_async.status[i];
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void
+ul_async_status_callback(void *user, long long request_id, int r)
+{
+  ul_continuation_resume((struct ul_continuation *) user, r);
+}
+
+int
+ns_ul_register_contest(
+        struct http_request_info *phr,
+        int cmd,
+        int user_id,
+        int contest_id,
+        int *p_r)
+{
+  if (ul_async_take_result(phr, cmd, p_r)) return 0;
+
+  if (ul_async_can_suspend(phr)) {
+    struct ul_continuation *c = ul_continuation_create(phr, cmd);
+    if (userlist_async_register_contest(ul_async, cmd, user_id, contest_id,
+                                        &phr->ip, phr->ssl_flag,
+                                        ul_async_status_callback, c) >= 0) {
+      update_ul_async_watch(phr->fw_state);
+      phr->no_reply = 1;
+      return 1;
+    }
+    ul_continuation_free(c);
+  }
+
+  if (ns_open_ul_connection(phr->fw_state) < 0) {
+    *p_r = -ULS_ERR_NO_CONNECT;
+    return 0;
+  }
+  *p_r = userlist_clnt_register_contest(ul_conn, cmd, user_id, contest_id,
+                                        &phr->ip, phr->ssl_flag);
+  return 0;
+}
+
 void
 ns_load_problem_plugin(
         serve_state_t cs,
@@ -1074,6 +1446,40 @@ fail:
   return -1;
 }
 
+int
+ns_list_users_delta_callback(
+        void *user_data,
+        int contest_id,
+        int vintage,
+        UserlistBinaryHeader **p_header)
+{
+  struct server_framework_state *state = (struct server_framework_state *) user_data;
+  unsigned char *data = NULL;
+  UserlistBinaryHeader *header = NULL;
+  struct userlist_shm *shm;
+
+  // the user list published by ej-users is copied without a request
+  shm = userlist_shm_get(ejudge_config->socket_path, contest_id, time(NULL));
+  if (shm && userlist_shm_get_users(shm, vintage, p_header) >= 0) return 0;
+
+  if (ns_open_ul_connection(state) < 0) return -1;
+
+  int r = userlist_clnt_bin_data_delta(ul_conn, ULS_LIST_STANDINGS_USERS_3,
+                                       contest_id, vintage, &data);
+  if (r < 0) return r;
+  if (r != ULS_BIN_DATA) {
+    xfree(data);
+    return -1;
+  }
+  header = (UserlistBinaryHeader*) data;
+  if (!userlist_bin_unmarshall(header)) {
+    xfree(header);
+    return -1;
+  }
+  *p_header = header;
+  return 0;
+}
+
 static const unsigned char *role_strs[] =
   {
     __("Contestant"),
@@ -4173,6 +4579,7 @@ priv_submit_clar(
     ns_error(log_f, NEW_SRV_ERR_DISK_WRITE_ERROR);
     goto cleanup;
   }
+  serve_notify_clar_update(phr->config, cs, clar_id);
 
   if (global->notify_clar_reply && user_id > 0) {
     unsigned char nsubj[1024];
@@ -4411,6 +4818,7 @@ priv_submit_run_comment(
     ns_error(log_f, NEW_SRV_ERR_DISK_WRITE_ERROR);
     goto cleanup;
   }
+  serve_notify_clar_update(phr->config, cs, clar_id);
 
   if (phr->action == NEW_SRV_ACTION_PRIV_SUBMIT_RUN_COMMENT_AND_IGNORE) {
     run_change_status_4(cs->runlog_state, run_id, RUN_IGNORED, &re);
@@ -4660,6 +5068,7 @@ priv_clar_reply(
     ns_error(log_f, NEW_SRV_ERR_DISK_WRITE_ERROR);
     goto cleanup;
   }
+  serve_notify_clar_update(phr->config, cs, clar_id);
 
   clar_update_flags(cs->clarlog_state, in_reply_to, 2);
 
@@ -9093,13 +9502,23 @@ priv_list_runs_json(
   struct html_armor_buffer ab = HTML_ARMOR_INITIALIZER;
   struct filter_env env;
   const unsigned char *s = NULL;
+  struct filter_program *prog = NULL;
+  int skip_filtered_count = 0;
+  int page_token = -1;
+  struct filter_page page;
+  int use_page = 0;
+  int first_base = 0;
 
   phr->json_reply = 1;
+  memset(&page, 0, sizeof(page));
   memset(&env, 0, sizeof(env));
 
   if (hr_cgi_param(phr, "filter_expr", &filter_expr) < 0) {
     goto err_inv_param;
   }
+  if (hr_cgi_param_bool_opt(phr, "skip_filtered_count", &skip_filtered_count, 0) < 0) {
+    goto err_inv_param;
+  }
   if ((r = hr_cgi_param_int_2(phr, "first_run", &intval)) < 0) {
     goto err_inv_param;
   } else if (r > 0) {
@@ -9112,6 +9531,18 @@ priv_list_runs_json(
     last_run = intval;
     last_run_set = 1;
   }
+  if ((r = hr_cgi_param_int_2(phr, "page_token", &intval)) < 0) {
+    goto err_inv_param;
+  } else if (r > 0) {
+    if (intval < 0) goto err_inv_param;
+    page_token = intval;
+  }
+  // the page token continues the window counted from the last run,
+  // so it cannot be combined with the explicit run positions
+  if (page_token >= 0 && ((first_run_set && first_run >= 0)
+                          || (last_run_set && last_run >= 0))) {
+    goto err_inv_param;
+  }
   if ((r = hr_cgi_param(phr, "field_mask", &s)) < 0) {
     goto err_inv_param;
   } else if (r > 0 && s) {
@@ -9157,32 +9588,14 @@ priv_list_runs_json(
   env.cur_time = tv.tv_sec;
   env.cur_time_us = tv.tv_sec * 1000000LL + tv.tv_usec;
   env.rentries = run_get_entries_ptr(cs->runlog_state);
+  env.rhot = run_get_hot_entries_ptr(cs->runlog_state);
 
   displayed_size = (env.rtotal + BITS_PER_LONG - 1) / BITS_PER_LONG;
   if (!displayed_size) displayed_size = 1;
   XCALLOC(displayed_mask, displayed_size);
 
-  XCALLOC(match_idx, env.rtotal + 1 - env.rbegin);
-  XCALLOC(list_idx, (env.rtotal + 1 - env.rbegin));
   match_tot = 0;
-  transient_tot = 0;
-
-  for (int i = env.rbegin; i < env.rtotal; ++i) {
-    if (env.rentries[i].status >= RUN_TRANSIENT_FIRST && env.rentries[i].status <= RUN_TRANSIENT_LAST) {
-      transient_tot++;
-    }
-    env.rid = i;
-    if (u->prev_tree) {
-      r = filter_tree_bool_eval(&env, u->prev_tree);
-      if (r < 0) {
-        parse_error_func(cs, "run %d: %s", i, filter_strerror(-r));
-        continue;
-      }
-      if (!r) continue;
-    }
-    match_idx[match_tot++] = i;
-  }
-  env.mem = filter_tree_delete(env.mem);
+  transient_tot = run_get_transient_count(cs->runlog_state);
 
   if (!first_run_set && !last_run_set) {
     // last 20 in the reverse order
@@ -9197,6 +9610,35 @@ priv_list_runs_json(
     if (first_run >= 0 && last_run < 0) last_run = 0;
   }
 
+  if (first_run < 0 && last_run < 0
+      && (!u->prev_tree || skip_filtered_count || page_token >= 0)) {
+    // the window is counted from the last run, so the scan may stop
+    // as soon as the window is filled, the number of the filtered runs
+    // is exact without a filter, and is estimated otherwise
+    use_page = 1;
+    page.before = page_token;
+    page.limit = -first_run;
+    if (-last_run > page.limit) page.limit = -last_run;
+    XCALLOC(match_idx, page.limit + 1);
+  } else {
+    XCALLOC(match_idx, env.rtotal + 1 - env.rbegin);
+  }
+  if (u->prev_tree) {
+    prog = filter_program_compile(&env, u->prev_tree);
+  }
+  if (use_page) {
+    match_tot = filter_program_select_page(&env, prog, &page, match_idx,
+                                           parse_error_func, cs);
+    // the positions are reported in the whole filtered list, if it is known
+    if (page.exact && page_token < 0) first_base = page.estimate - match_tot;
+  } else {
+    match_tot = filter_program_select(&env, prog, 0, match_idx,
+                                      parse_error_func, cs);
+  }
+  prog = filter_program_free(prog);
+  env.mem = filter_tree_delete(env.mem);
+  XCALLOC(list_idx, match_tot + 1);
+
   if (first_run >= match_tot) {
     first_run = match_tot - 1;
     if (first_run < 0) first_run = 0;
@@ -9228,14 +9670,23 @@ priv_list_runs_json(
   fprintf(fout, ",\"server_time\":%lld", (long long) cs->current_time);
   fprintf(fout, ",\"result\":{");
   fprintf(fout, "\"total_runs\":%d", env.rtotal);
-  fprintf(fout, ",\"filtered_runs\":%d", match_tot);
+  if (!use_page) {
+    fprintf(fout, ",\"filtered_runs\":%d", match_tot);
+  } else if (page.exact && page_token < 0) {
+    fprintf(fout, ",\"filtered_runs\":%d", page.estimate);
+  } else if (!skip_filtered_count) {
+    fprintf(fout, ",\"filtered_runs_estimate\":%d", page.estimate);
+  }
   fprintf(fout, ",\"listed_runs\":%d", list_tot);
   fprintf(fout, ",\"transient_runs\":%d", transient_tot);
   if (filter_expr && filter_expr[0]) {
     fprintf(fout, ",\"filter_expr\":\"%s\"", JARMOR(filter_expr));
   }
-  fprintf(fout, ",\"first_run\":%d", first_run);
-  fprintf(fout, ",\"last_run\":%d", last_run);
+  fprintf(fout, ",\"first_run\":%d", first_base + first_run);
+  fprintf(fout, ",\"last_run\":%d", first_base + last_run);
+  if (use_page && page.next >= 0) {
+    fprintf(fout, ",\"page_token\":%d", page.next);
+  }
   fprintf(fout, ",\"field_mask\":%llu", (unsigned long long) run_fields);
   fprintf(fout, ",\"runs\":[");
 
@@ -11355,6 +11806,104 @@ priv_check_cached_key(struct http_request_info *phr)
   return 0;
 }
 
+/* store the result of ULS_*_GET_COOKIE to the session cache */
+static struct new_session_info *
+store_cookie_result(
+        int cmd,
+        const ej_ip_t *ip,
+        int ssl_flag,
+        ej_cookie_t session_id,
+        ej_cookie_t client_key,
+        struct UserlistGetCookieResult *result,
+        time_t current_time)
+{
+  struct new_session_info *nsi = nsc_find(&main_id_cache.s, session_id, client_key);
+  if (!nsi) {
+    nsi = nsc_insert(&main_id_cache.s, session_id, client_key);
+  } else {
+    xfree(nsi->login); nsi->login = NULL;
+    xfree(nsi->name); nsi->name = NULL;
+    memset(nsi, 0, sizeof(*nsi));
+    nsi->session_id = session_id;
+    nsi->client_key = client_key;
+  }
+
+  nsi->cmd = cmd;
+  nsi->origin_ip = *ip;
+  nsi->ssl_flag = ssl_flag;
+  nsi->user_id = result->data->user_id;
+  nsi->contest_id = result->data->contest_id;
+  nsi->locale_id = result->data->locale_id;
+  nsi->priv_level = result->data->priv_level;
+  nsi->role = result->data->role;
+  nsi->team_login = result->data->team_login;
+  nsi->reg_status = result->data->reg_status;
+  nsi->reg_flags = result->data->reg_flags;
+  nsi->is_ws = result->data->is_ws;
+  nsi->is_job = result->data->is_job;
+  nsi->passwd_method = result->data->passwd_method;
+  nsi->expire_time = result->data->expire;
+  nsi->refresh_time = current_time + 1200;
+  nsi->access_time = current_time;
+  nsi->login = xstrdup(result->login);
+  nsi->name = xstrdup(result->name);
+
+  xfree(result->data); result->data = NULL;
+  return nsi;
+}
+
+static void
+ul_async_cookie_callback(
+        void *user,
+        long long request_id,
+        int r,
+        struct UserlistGetCookieResult *result)
+{
+  struct ul_continuation *c = (struct ul_continuation *) user;
+
+  // on success the replayed request finds the session in the cache
+  if (r >= 0) {
+    store_cookie_result(c->cmd, &c->ip, c->ssl_flag, c->session_id,
+                        c->client_key, result, time(NULL));
+  }
+  ul_continuation_resume(c, r);
+}
+
+/* returns 1, if ej-users has published the reply to the same check */
+static int
+shm_get_cookie(
+        struct http_request_info *phr,
+        int cmd,
+        time_t current_time,
+        struct UserlistGetCookieResult *p_res)
+{
+  struct userlist_shm *shm;
+
+  shm = userlist_shm_get(ejudge_config->socket_path, 0, current_time);
+  if (!shm) return 0;
+  return userlist_shm_get_cookie(shm, cmd, &phr->ip, phr->ssl_flag,
+                                 phr->session_id, phr->client_key,
+                                 current_time, p_res);
+}
+
+/* returns 1, if the request is suspended until the session is checked */
+static int
+suspend_cookie_check(struct http_request_info *phr, int cmd)
+{
+  if (!ul_async_can_suspend(phr)) return 0;
+
+  struct ul_continuation *c = ul_continuation_create(phr, cmd);
+  if (userlist_async_get_cookie(ul_async, cmd, &phr->ip, phr->ssl_flag,
+                                phr->session_id, phr->client_key,
+                                ul_async_cookie_callback, c) < 0) {
+    ul_continuation_free(c);
+    return 0;
+  }
+  update_ul_async_watch(phr->fw_state);
+  phr->no_reply = 1;
+  return 1;
+}
+
 static int
 priv_check_cached_session(struct http_request_info *phr)
 {
@@ -11396,30 +11945,42 @@ priv_check_cached_session(struct http_request_info *phr)
   }
 
   // cache entry is stale or nonexistant
-  if (ns_open_ul_connection(phr->fw_state) < 0) {
-    if (nsi && nsi->cmd == ULS_PRIV_GET_COOKIE
-        && current_time < nsi->expire_time
-        //&& nsi->ssl_flag == phr->ssl_flag
-        //&& !ej_ip_cmp(&phr->ip, &nsi->origin_ip)
-        ) {
-      // still try to use cached session value
-      copy_nsi_to_phr(phr, nsi, current_time);
-      rdtscll(tsc_end);
-      if (metrics.data) {
-        metrics.data->hit_cookie_tsc += (tsc_end - tsc_start);
-        ++metrics.data->hit_cookie_count;
+  struct UserlistGetCookieResult result;
+  int r = 0;
+  int replayed = ul_async_take_result(phr, ULS_PRIV_GET_COOKIE, &r);
+  if (replayed && r < 0) {
+    // the request is replayed after the asynchronous check failed
+  } else if (!replayed && shm_get_cookie(phr, ULS_PRIV_GET_COOKIE, current_time, &result)) {
+    // no request to ej-users is necessary
+  } else if (!replayed && suspend_cookie_check(phr, ULS_PRIV_GET_COOKIE)) {
+    // the request is replayed when the session is checked
+    return 1;
+  } else {
+    if (ns_open_ul_connection(phr->fw_state) < 0) {
+      if (nsi && nsi->cmd == ULS_PRIV_GET_COOKIE
+          && current_time < nsi->expire_time
+          //&& nsi->ssl_flag == phr->ssl_flag
+          //&& !ej_ip_cmp(&phr->ip, &nsi->origin_ip)
+          ) {
+        // still try to use cached session value
+        copy_nsi_to_phr(phr, nsi, current_time);
+        rdtscll(tsc_end);
+        if (metrics.data) {
+          metrics.data->hit_cookie_tsc += (tsc_end - tsc_start);
+          ++metrics.data->hit_cookie_count;
+        }
+        return 0;
       }
-      return 0;
+      return -NEW_SRV_ERR_USERLIST_SERVER_DOWN;
     }
-    return -NEW_SRV_ERR_USERLIST_SERVER_DOWN;
-  }
 
-  struct UserlistGetCookieResult result;
-  int r = userlist_clnt_get_cookie_2(ul_conn, ULS_PRIV_GET_COOKIE,
-        &phr->ip, phr->ssl_flag,
-        phr->session_id,
-        phr->client_key,
-        &result);
+
+    r = userlist_clnt_get_cookie_2(ul_conn, ULS_PRIV_GET_COOKIE,
+          &phr->ip, phr->ssl_flag,
+          phr->session_id,
+          phr->client_key,
+          &result);
+  }
 
   if (r == -ULS_ERR_DISCONNECT) {
     if (nsi && nsi->cmd == ULS_PRIV_GET_COOKIE
@@ -11457,37 +12018,9 @@ priv_check_cached_session(struct http_request_info *phr)
     return r;
   }
 
-  if (!nsi) {
-    nsi = nsc_insert(&main_id_cache.s, phr->session_id, phr->client_key);
-  } else {
-    xfree(nsi->login); nsi->login = NULL;
-    xfree(nsi->name); nsi->name = NULL;
-    memset(nsi, 0, sizeof(*nsi));
-    nsi->session_id = phr->session_id;
-    nsi->client_key = phr->client_key;
-  }
-
-  nsi->cmd = ULS_PRIV_GET_COOKIE;
-  nsi->origin_ip = phr->ip;
-  nsi->ssl_flag = phr->ssl_flag;
-  nsi->user_id = result.data->user_id;
-  nsi->contest_id = result.data->contest_id;
-  nsi->locale_id = result.data->locale_id;
-  nsi->priv_level = result.data->priv_level;
-  nsi->role = result.data->role;
-  nsi->team_login = result.data->team_login;
-  nsi->reg_status = result.data->reg_status;
-  nsi->reg_flags = result.data->reg_flags;
-  nsi->is_ws = result.data->is_ws;
-  nsi->is_job = result.data->is_job;
-  nsi->passwd_method = result.data->passwd_method;
-  nsi->expire_time = result.data->expire;
-  nsi->refresh_time = current_time + 1200;
-  nsi->access_time = current_time;
-  nsi->login = xstrdup(result.login);
-  nsi->name = xstrdup(result.name);
-
-  xfree(result.data);
+  nsi = store_cookie_result(ULS_PRIV_GET_COOKIE, &phr->ip, phr->ssl_flag,
+                            phr->session_id, phr->client_key,
+                            &result, current_time);
   copy_nsi_to_phr(phr, nsi, current_time);
   rdtscll(tsc_end);
   if (metrics.data) {
@@ -11540,6 +12073,8 @@ privileged_entry_point(
       error_page(fout, phr, 1, r);
       goto cleanup;
     }
+    // suspended until the userlist-server replies
+    if (r > 0) goto cleanup;
   }
 
   if (phr->locale_id < 0) phr->locale_id = 0;
@@ -11656,6 +12191,7 @@ privileged_entry_point(
   memset(&callbacks, 0, sizeof(callbacks));
   callbacks.user_data = (void*) phr->fw_state;
   callbacks.list_all_users = ns_list_all_users_callback;
+  callbacks.list_users_delta = ns_list_users_delta_callback;
 
   // invoke the contest
   if (serve_state_load_contest(extra, ejudge_config, phr->contest_id,
@@ -11687,6 +12223,8 @@ privileged_entry_point(
     phr->action = NEW_SRV_ACTION_MAIN_PAGE;
   }
 
+  if (fork_readonly_worker(phr) > 0) goto cleanup;
+
   if (priv_external_action(fout, phr) > 0) goto cleanup;
 
   if (phr->action > 0 && phr->action < NEW_SRV_ACTION_LAST && actions_table[phr->action]) {
@@ -14710,6 +15248,7 @@ unpriv_submit_clar(FILE *fout,
   if (clar_add_text(cs->clarlog_state, clar_id, &clar_uuid, text3, text3_len) < 0) {
     FAIL2(NEW_SRV_ERR_DISK_WRITE_ERROR);
   }
+  serve_notify_clar_update(phr->config, cs, clar_id);
 
   serve_send_clar_notify_email(ejudge_config, cs, cnts, phr->user_id, phr->name, subj3, text2);
   serve_send_clar_notify_telegram(ejudge_config, cs, cnts, phr->user_id, phr->name, subj3, text2);
@@ -14845,6 +15384,7 @@ unpriv_submit_appeal(FILE *fout,
   if (clar_add_text(cs->clarlog_state, clar_id, &clar_uuid, text3, text3_len) < 0) {
     FAIL2(NEW_SRV_ERR_DISK_WRITE_ERROR);
   }
+  serve_notify_clar_update(phr->config, cs, clar_id);
 
   serve_send_clar_notify_email(ejudge_config, cs, cnts, phr->user_id, phr->name, subj3, text2);
   serve_send_clar_notify_telegram(ejudge_config, cs, cnts, phr->user_id, phr->name, subj3, text2);
@@ -16979,6 +17519,12 @@ unpriv_list_runs_json(
   }
   ns_get_user_problems_summary(cs, phr->user_id, phr->login, accepting_mode, start_time, stop_time, 0, &phr->ip, pinfo);
 
+  if (hr_cgi_param_int_opt(phr, "limit", &rdis.limit, 0) < 0 || rdis.limit < 0
+      || hr_cgi_param_int_opt(phr, "page_token", &rdis.before, 0) < 0 || rdis.before < 0) {
+    error_page(fout, phr, 0, NEW_SRV_ERR_INV_PARAM);
+    goto cleanup;
+  }
+
   filter_user_runs(cs, phr, prob_id, pinfo, start_time, stop_time, 0, &rdis);
 
   fprintf(fout, "{\n");
@@ -17007,6 +17553,9 @@ unpriv_list_runs_json(
     fprintf(fout, "\n      }");
   }
   fprintf(fout, "\n    ]");
+  if (rdis.next > 0) {
+    fprintf(fout, ",\n    \"page_token\": %d", rdis.next);
+  }
   fprintf(fout, "\n  }");
   fprintf(fout, "\n}\n");
 cleanup:
@@ -18509,6 +19058,7 @@ unpriv_gitlab_webhook(
 
   callbacks.user_data = (void*) phr->fw_state;
   callbacks.list_all_users = ns_list_all_users_callback;
+  callbacks.list_users_delta = ns_list_users_delta_callback;
 
   if (serve_state_load_contest(phr->extra, phr->config, phr->contest_id,
                                ul_conn, &callbacks, 0, 0,
@@ -18790,30 +19340,42 @@ unpriv_check_cached_session(struct http_request_info *phr)
   }
 
   // cache entry is stale or nonexistant
-  if (ns_open_ul_connection(phr->fw_state) < 0) {
-    if (nsi && nsi->cmd == ULS_TEAM_GET_COOKIE
-        && current_time < nsi->expire_time
-        //&& nsi->ssl_flag == phr->ssl_flag
-        //&& !ej_ip_cmp(&phr->ip, &nsi->origin_ip)
-        ) {
-      // still try to use cached session value
-      copy_nsi_to_phr(phr, nsi, current_time);
-      rdtscll(tsc_end);
-      if (metrics.data) {
-        metrics.data->hit_cookie_tsc += (tsc_end - tsc_start);
-        ++metrics.data->hit_cookie_count;
+  struct UserlistGetCookieResult result;
+  int r = 0;
+  int replayed = ul_async_take_result(phr, ULS_TEAM_GET_COOKIE, &r);
+  if (replayed && r < 0) {
+    // the request is replayed after the asynchronous check failed
+  } else if (!replayed && shm_get_cookie(phr, ULS_TEAM_GET_COOKIE, current_time, &result)) {
+    // no request to ej-users is necessary
+  } else if (!replayed && suspend_cookie_check(phr, ULS_TEAM_GET_COOKIE)) {
+    // the request is replayed when the session is checked
+    return 1;
+  } else {
+    if (ns_open_ul_connection(phr->fw_state) < 0) {
+      if (nsi && nsi->cmd == ULS_TEAM_GET_COOKIE
+          && current_time < nsi->expire_time
+          //&& nsi->ssl_flag == phr->ssl_flag
+          //&& !ej_ip_cmp(&phr->ip, &nsi->origin_ip)
+          ) {
+        // still try to use cached session value
+        copy_nsi_to_phr(phr, nsi, current_time);
+        rdtscll(tsc_end);
+        if (metrics.data) {
+          metrics.data->hit_cookie_tsc += (tsc_end - tsc_start);
+          ++metrics.data->hit_cookie_count;
+        }
+        return 0;
       }
-      return 0;
+      return -NEW_SRV_ERR_USERLIST_SERVER_DOWN;
     }
-    return -NEW_SRV_ERR_USERLIST_SERVER_DOWN;
-  }
 
-  struct UserlistGetCookieResult result;
-  int r = userlist_clnt_get_cookie_2(ul_conn, ULS_TEAM_GET_COOKIE,
-        &phr->ip, phr->ssl_flag,
-        phr->session_id,
-        phr->client_key,
-        &result);
+
+    r = userlist_clnt_get_cookie_2(ul_conn, ULS_TEAM_GET_COOKIE,
+          &phr->ip, phr->ssl_flag,
+          phr->session_id,
+          phr->client_key,
+          &result);
+  }
 
   if (r == -ULS_ERR_DISCONNECT) {
     if (nsi && nsi->cmd == ULS_TEAM_GET_COOKIE
@@ -18853,37 +19415,9 @@ unpriv_check_cached_session(struct http_request_info *phr)
     return r;
   }
 
-  if (!nsi) {
-    nsi = nsc_insert(&main_id_cache.s, phr->session_id, phr->client_key);
-  } else {
-    xfree(nsi->login); nsi->login = NULL;
-    xfree(nsi->name); nsi->name = NULL;
-    memset(nsi, 0, sizeof(*nsi));
-    nsi->session_id = phr->session_id;
-    nsi->client_key = phr->client_key;
-  }
-
-  nsi->cmd = ULS_TEAM_GET_COOKIE;
-  nsi->origin_ip = phr->ip;
-  nsi->ssl_flag = phr->ssl_flag;
-  nsi->user_id = result.data->user_id;
-  nsi->contest_id = result.data->contest_id;
-  nsi->locale_id = result.data->locale_id;
-  nsi->priv_level = result.data->priv_level;
-  nsi->role = result.data->role;
-  nsi->team_login = result.data->team_login;
-  nsi->reg_status = result.data->reg_status;
-  nsi->reg_flags = result.data->reg_flags;
-  nsi->is_ws = result.data->is_ws;
-  nsi->is_job = result.data->is_job;
-  nsi->passwd_method = result.data->passwd_method;
-  nsi->expire_time = result.data->expire;
-  nsi->refresh_time = current_time + 1200;
-  nsi->access_time = current_time;
-  nsi->login = xstrdup(result.login);
-  nsi->name = xstrdup(result.name);
-
-  xfree(result.data);
+  nsi = store_cookie_result(ULS_TEAM_GET_COOKIE, &phr->ip, phr->ssl_flag,
+                            phr->session_id, phr->client_key,
+                            &result, current_time);
   copy_nsi_to_phr(phr, nsi, current_time);
   rdtscll(tsc_end);
   if (metrics.data) {
@@ -19010,6 +19544,8 @@ unprivileged_entry_point(
       error_page(fout, phr, 0, r);
       goto cleanup;
     }
+    // suspended until the userlist-server replies
+    if (r > 0) goto cleanup;
   }
 
   if (phr->contest_id < 0 || contests_get(phr->contest_id, &cnts) < 0 || !cnts){
@@ -19070,6 +19606,7 @@ unprivileged_entry_point(
   memset(&callbacks, 0, sizeof(callbacks));
   callbacks.user_data = (void*) phr->fw_state;
   callbacks.list_all_users = ns_list_all_users_callback;
+  callbacks.list_users_delta = ns_list_users_delta_callback;
 
   // invoke the contest
   if (serve_state_load_contest(extra, ejudge_config, phr->contest_id,
@@ -19153,6 +19690,7 @@ unprivileged_entry_point(
   if (phr->action <= 0 || phr->action >= NEW_SRV_ACTION_LAST) {
     phr->action = NEW_SRV_ACTION_MAIN_PAGE;
   }
+  if (fork_readonly_worker(phr) > 0) goto cleanup;
   if (external_unpriv_action_aliases[phr->action] > 0 || external_unpriv_action_names[phr->action]) {
     if (unpriv_external_action(fout, phr)) goto cleanup;
   }
@@ -19557,6 +20095,7 @@ do_load_contest(struct http_request_info *phr, const struct contest_desc *cnts)
   memset(&callbacks, 0, sizeof(callbacks));
   callbacks.user_data = (void*) phr->fw_state;
   callbacks.list_all_users = ns_list_all_users_callback;
+  callbacks.list_users_delta = ns_list_users_delta_callback;
 
   // invoke the contest
   if (serve_state_load_contest(extra, ejudge_config, phr->contest_id,
@@ -20716,6 +21255,7 @@ ns_compile_dir_ready(
   struct teamdb_db_callbacks callbacks = {};
   callbacks.user_data = (void*) state;
   callbacks.list_all_users = ns_list_all_users_callback;
+  callbacks.list_users_delta = ns_list_users_delta_callback;
 
   int prev_contest_id = 0;
   const struct contest_desc *cnts = NULL;
@@ -20856,6 +21396,7 @@ ns_run_dir_ready(
   struct teamdb_db_callbacks callbacks = {};
   callbacks.user_data = (void*) state;
   callbacks.list_all_users = ns_list_all_users_callback;
+  callbacks.list_users_delta = ns_list_users_delta_callback;
 
   int prev_contest_id = 0;
   const struct contest_desc *cnts = NULL;
@@ -100,6 +100,23 @@ parse_error_func(void *data, unsigned char const *format, ...)
   filter_expr_nerrs++;
 }
 
+/* the number of the runs in the run window, if the window is counted
+   from the last run, 0 otherwise */
+static int
+get_tail_window_size(
+        int first_run_set,
+        int first_run,
+        int last_run_set,
+        int last_run)
+{
+  if (!first_run_set && !last_run_set) return 20;
+  if (!first_run_set) first_run = -1;
+  if (!last_run_set) last_run = first_run - 20 + 1;
+  if (first_run >= 0 || last_run >= 0) return 0;
+  if (first_run < last_run) return -first_run;
+  return -last_run;
+}
+
 void
 ns_write_priv_all_runs(
         FILE *f,
@@ -114,10 +131,13 @@ ns_write_priv_all_runs(
 {
   struct user_filter_info *u = 0;
   struct filter_env env;
-  int i, r;
+  struct filter_program *prog = 0;
+  int i;
   int *match_idx = 0;
   int match_tot = 0;
+  int filtered_tot = 0;
   int transient_tot = 0;
+  int window_size = 0;
   int *list_idx = 0;
   int list_tot = 0;
   unsigned char *str1 = 0, *str2 = 0;
@@ -219,25 +239,35 @@ ns_write_priv_all_runs(
     env.cur_time = tv.tv_sec;
     env.cur_time_us = tv.tv_sec * 1000000LL + tv.tv_usec;
     env.rentries = run_get_entries_ptr(cs->runlog_state);
+    env.rhot = run_get_hot_entries_ptr(cs->runlog_state);
 
-    XCALLOC(match_idx, env.rtotal + 1 - env.rbegin);
     match_tot = 0;
-    transient_tot = 0;
-
-    for (i = env.rbegin; i < env.rtotal; i++) {
-      if (env.rentries[i].status >= RUN_TRANSIENT_FIRST
-          && env.rentries[i].status <= RUN_TRANSIENT_LAST)
-        transient_tot++;
-      env.rid = i;
+    transient_tot = run_get_transient_count(cs->runlog_state);
+
+    if (!u->prev_tree) {
+      // without a filter the runs of a window counted from the last run
+      // are just the last runs, so the rest of the log is not scanned
+      window_size = get_tail_window_size(
+        first_run_set || u->prev_first_run_set,
+        first_run_set?first_run:u->prev_first_run,
+        last_run_set || u->prev_last_run_set,
+        last_run_set?last_run:u->prev_last_run);
+    }
+    if (window_size > 0) {
+      struct filter_page page = { .before = -1, .limit = window_size };
+      XCALLOC(match_idx, window_size + 1);
+      match_tot = filter_program_select_page(&env, NULL, &page, match_idx,
+                                             parse_error_func, cs);
+      filtered_tot = page.estimate;
+    } else {
+      XCALLOC(match_idx, env.rtotal + 1 - env.rbegin);
       if (u->prev_tree) {
-        r = filter_tree_bool_eval(&env, u->prev_tree);
-        if (r < 0) {
-          parse_error_func(cs, "run %d: %s", i, filter_strerror(-r));
-          continue;
-        }
-        if (!r) continue;
+        prog = filter_program_compile(&env, u->prev_tree);
       }
-      match_idx[match_tot++] = i;
+      match_tot = filter_program_select(&env, prog, 0, match_idx,
+                                        parse_error_func, cs);
+      prog = filter_program_free(prog);
+      filtered_tot = match_tot;
     }
     env.mem = filter_tree_delete(env.mem);
   }
@@ -249,7 +279,7 @@ ns_write_priv_all_runs(
     displayed_mask = (unsigned long*) alloca(displayed_size*sizeof(displayed_mask[0]));
     memset(displayed_mask, 0, displayed_size * sizeof(displayed_mask[0]));
 
-    XCALLOC(list_idx, (env.rtotal + 1 - env.rbegin));
+    XCALLOC(list_idx, match_tot + 1);
     list_tot = 0;
 
     if (!first_run_set) {
@@ -308,7 +338,7 @@ ns_write_priv_all_runs(
   if (!u->error_msgs) {
     fprintf(f, "<p><big>%s: %d, %s: %d, %s: %d</big></p>\n",
             _("Total submissions"), env.rtotal,
-            _("Filtered"), match_tot,
+            _("Filtered"), filtered_tot,
             _("Shown"), list_tot);
     fprintf(f, "<p><big>%s: %d</big></p>\n",
             _("Compiling and running"), transient_tot);
@@ -1647,6 +1677,7 @@ ns_priv_edit_clar_action(
     if (clar_modify_text(cs->clarlog_state, clar_id, new_text, new_size) < 0) {
       FAIL(NEW_SRV_ERR_DATABASE_FAILED);
     }
+    serve_notify_clar_update(phr->config, cs, clar_id);
   }
 
   // **from, **to, **j_from, **flags, **hide_flag, **appeal_flag, **ip, **ssl_flag
@@ -1719,6 +1750,7 @@ ns_priv_edit_clar_action(
   if (clar_modify_record(cs->clarlog_state, clar_id, mask, &new_clar) < 0) {
     FAIL(NEW_SRV_ERR_DATABASE_FAILED);
   }
+  serve_notify_clar_update(phr->config, cs, clar_id);
 
 cleanup:
   xfree(old_text);
@@ -7205,10 +7237,13 @@ filter_user_runs(
   //if (prob_id > 0) runs_to_show = cs->probs[prob_id]->prev_runs_to_show;
   //if (runs_to_show <= 0) runs_to_show = 15;
   runs_to_show = 100000;
+  if (rinfo->limit > 0) runs_to_show = rinfo->limit;
+  rinfo->next = -1;
 
   for (showed = 0, i = run_get_user_last_run_id(cs->runlog_state, phr->user_id);
        i >= 0 && showed < runs_to_show;
        i = run_get_user_prev_run_id(cs->runlog_state, i)) {
+    if (rinfo->before > 0 && i >= rinfo->before) continue;
     if (run_get_entry(cs->runlog_state, i, &re) < 0) continue;
     if (re.status == RUN_VIRTUAL_START || re.status == RUN_VIRTUAL_STOP
         || re.status == RUN_EMPTY)
@@ -7222,6 +7257,7 @@ filter_user_runs(
     if (!cur_prob) continue;
 
     showed++;
+    if (showed == runs_to_show && rinfo->limit > 0) rinfo->next = i;
 
     if (rinfo->size == rinfo->reserved) {
       if (!(rinfo->reserved *= 2)) rinfo->reserved = 16;
@@ -1489,7 +1489,8 @@ do_dump_master_runs(
 {
   struct user_filter_info *u = 0;
   struct filter_env env;
-  int i, r;
+  struct filter_program *prog = NULL;
+  int i;
   int *match_idx = 0;
   int match_tot = 0;
   int transient_tot = 0;
@@ -1567,6 +1568,7 @@ do_dump_master_runs(
   env.cur_time = tv.tv_sec;
   env.cur_time_us = tv.tv_sec * 1000000LL + tv.tv_usec;
   env.rentries = run_get_entries_ptr(cs->runlog_state);
+  env.rhot = run_get_hot_entries_ptr(cs->runlog_state);
 
   XCALLOC(match_idx, (env.rtotal + 1));
   match_tot = 0;
@@ -1576,17 +1578,13 @@ do_dump_master_runs(
     if (env.rentries[i].status >= RUN_TRANSIENT_FIRST
         && env.rentries[i].status <= RUN_TRANSIENT_LAST)
       transient_tot++;
-    env.rid = i;
-    if (u->prev_tree) {
-      r = filter_tree_bool_eval(&env, u->prev_tree);
-      if (r < 0) {
-        parse_error_func(cs, "run %d: %s", i, filter_strerror(-r));
-        continue;
-      }
-      if (!r) continue;
-    }
-    match_idx[match_tot++] = i;
   }
+  if (u->prev_tree) {
+    prog = filter_program_compile(&env, u->prev_tree);
+  }
+  match_tot = filter_program_select(&env, prog, 0, match_idx,
+                                    parse_error_func, cs);
+  prog = filter_program_free(prog);
   env.mem = filter_tree_delete(env.mem);
   if (u->error_msgs) {
     return -NEW_SRV_ERR_INV_FILTER_EXPR;
@@ -2235,6 +2233,7 @@ new_server_cmd_handler(FILE *fout, struct http_request_info *phr)
   memset(&callbacks, 0, sizeof(callbacks));
   callbacks.user_data = (void*) phr->fw_state;
   callbacks.list_all_users = ns_list_all_users_callback;
+  callbacks.list_users_delta = ns_list_users_delta_callback;
 
   // invoke the contest
   if (serve_state_load_contest(extra, ejudge_config, phr->contest_id,
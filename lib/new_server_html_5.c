@@ -2514,13 +2514,17 @@ register_for_contest(
 
   log_f = open_memstream(&log_t, &log_z);
 
-  if (ns_open_ul_connection(phr->fw_state) < 0) {
+  if (ns_ul_register_contest(phr, ULS_REGISTER_CONTEST_2,
+                             phr->user_id, phr->contest_id, &r) > 0) {
+    // the page is generated when the request is replayed
+    close_memstream(log_f);
+    xfree(log_t);
+    return;
+  }
+  if (r == -ULS_ERR_NO_CONNECT) {
     fprintf(log_f, "%s.\n", _("User database server is down"));
     goto done;
   }
-  r = userlist_clnt_register_contest(ul_conn, ULS_REGISTER_CONTEST_2,
-                                     phr->user_id, phr->contest_id,
-                                     &phr->ip, phr->ssl_flag);
   if (r < 0) {
     fprintf(log_f, "%s: %s.\n", _("Registration for contest failed"),
             userlist_strerror(-r));
@@ -0,0 +1,397 @@
+/* -*- mode: c -*- */
+
+/* Copyright (C) 2024 Alexander Chernov <cher@ejudge.ru> */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "ejudge/config.h"
+#include "ejudge/ej_types.h"
+#include "ejudge/new-server.h"
+#include "ejudge/new_server_proto.h"
+#include "ejudge/server_framework.h"
+#include "ejudge/serve_state.h"
+#include "ejudge/contests.h"
+#include "ejudge/opcaps.h"
+#include "ejudge/userlist.h"
+#include "ejudge/runlog.h"
+#include "ejudge/clarlog.h"
+#include "ejudge/json_serializers.h"
+#include "ejudge/cJSON.h"
+#include "ejudge/errlog.h"
+
+#include "ejudge/xalloc.h"
+#include "ejudge/logger.h"
+
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+/*
+ * the WebSocket clients subscribe to the updates of the runs and the clars
+ * of their contest, the participants get only the updates of their own
+ * runs and messages, the judges get the updates of the whole contest;
+ * the push frames are only notifications, the client refetches the
+ * details with the usual requests; the subscription is checked against
+ * the session once, and is dropped when the session expires
+ */
+
+/* the push frames are not queued above this output backlog */
+#define PUSH_HIGH_WATER (256 * 1024)
+/* the resync frame is sent, when the backlog is drained below this */
+#define PUSH_LOW_WATER  (16 * 1024)
+
+struct push_subscriber
+{
+  struct ws_client_state *p;
+  time_t expire_time;
+  int contest_id;
+  int user_id;
+  unsigned char judge_flag;
+  unsigned char runs_flag;
+  unsigned char clars_flag;
+  // some push frames were dropped, the client must refetch everything
+  unsigned char overflow_flag;
+};
+
+static struct push_subscriber *subs;
+static int subs_u, subs_a;
+static int overflow_count;
+static time_t last_expire_check;
+
+static struct push_subscriber *
+find_subscriber(const struct ws_client_state *p)
+{
+  for (int i = 0; i < subs_u; ++i) {
+    if (subs[i].p == p) return &subs[i];
+  }
+  return NULL;
+}
+
+static void
+remove_subscriber(struct push_subscriber *sub)
+{
+  if (sub->overflow_flag) --overflow_count;
+  *sub = subs[--subs_u];
+}
+
+/*
+ * returns 1 for the judge scope, 0 for the user scope, or
+ * a negative error code, if the session may not subscribe
+ */
+static int
+check_subscription_scope(const struct client_auth *auth)
+{
+  if (auth->expire_time > 0 && time(NULL) >= auth->expire_time) {
+    return -NEW_SRV_ERR_PERMISSION_DENIED;
+  }
+
+  if (auth->priv_level <= 0) {
+    if (auth->reg_status != USERLIST_REG_OK) return -NEW_SRV_ERR_PERMISSION_DENIED;
+    if ((auth->reg_flags & (USERLIST_UC_BANNED | USERLIST_UC_LOCKED | USERLIST_UC_DISQUALIFIED)) != 0) {
+      return -NEW_SRV_ERR_PERMISSION_DENIED;
+    }
+    return 0;
+  }
+
+  // the same capabilities as for the privileged login, which gives
+  // the whole run list of the contest
+  const struct contest_desc *cnts = NULL;
+  opcap_t caps = 0;
+  int cap_bit;
+  if (auth->role == USER_ROLE_ADMIN) {
+    cap_bit = OPCAP_MASTER_LOGIN;
+  } else if (auth->role == USER_ROLE_JUDGE) {
+    cap_bit = OPCAP_JUDGE_LOGIN;
+  } else {
+    return -NEW_SRV_ERR_PERMISSION_DENIED;
+  }
+  if (contests_get(auth->contest_id, &cnts) < 0 || !cnts) {
+    return -NEW_SRV_ERR_PERMISSION_DENIED;
+  }
+  if (!auth->login || opcaps_find(&cnts->capabilities, auth->login, &caps) < 0
+      || opcaps_check(caps, cap_bit) < 0) {
+    return -NEW_SRV_ERR_PERMISSION_DENIED;
+  }
+  return 1;
+}
+
+static long long
+get_server_time_us(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static void
+push_frame(struct push_subscriber *sub, const char *str)
+{
+  struct ws_client_state *p = sub->p;
+
+  if (p->state != WS_STATE_ACTIVE || p->out_close_state > 0) return;
+  if (sub->overflow_flag) return;
+  if (p->write_size > PUSH_HIGH_WATER) {
+    // the client does not keep up, stop queueing until it drains
+    sub->overflow_flag = 1;
+    ++overflow_count;
+    return;
+  }
+  nsf_ws_append_reply_frame(p, 0, str, strlen(str));
+}
+
+static void
+push_reply(
+        struct ws_client_state *p,
+        const struct push_subscriber *sub)
+{
+  cJSON *jr = cJSON_CreateObject();
+  cJSON_AddTrueToObject(jr, "ok");
+  cJSON_AddNumberToObject(jr, "server_time_us", (double) get_server_time_us());
+  cJSON_AddNumberToObject(jr, "reply_id", ++p->reply_id);
+  cJSON *jres = cJSON_CreateObject();
+  if (sub) {
+    cJSON_AddNumberToObject(jres, "contest_id", sub->contest_id);
+    cJSON_AddStringToObject(jres, "scope", sub->judge_flag?"contest":"user");
+    cJSON_AddBoolToObject(jres, "runs", sub->runs_flag);
+    cJSON_AddBoolToObject(jres, "clars", sub->clars_flag);
+  }
+  cJSON_AddItemToObject(jr, "result", jres);
+  char *jrstr = cJSON_PrintUnformatted(jr);
+  cJSON_Delete(jr);
+  nsf_ws_append_reply_frame(p, 0, jrstr, strlen(jrstr));
+  free(jrstr);
+}
+
+/*
+ * {"action":"subscribe","events":["runs","clars"]} or
+ * {"action":"unsubscribe"}, returns 0, if the request is not handled here
+ */
+int
+ns_ws_push_request(
+        struct server_framework_state *state,
+        struct ws_client_state *p,
+        const struct cJSON *root)
+{
+  cJSON *ja = cJSON_GetObjectItem((cJSON *) root, "action");
+  if (!ja || ja->type != cJSON_String) return 0;
+
+  struct push_subscriber *sub = find_subscriber(p);
+
+  if (!strcmp(ja->valuestring, "unsubscribe")) {
+    if (sub) remove_subscriber(sub);
+    push_reply(p, NULL);
+    return 1;
+  }
+  if (strcmp(ja->valuestring, "subscribe") != 0) return 0;
+
+  const struct client_auth *auth = p->auth;
+  if (!auth || auth->user_id <= 0 || auth->contest_id <= 0) {
+    ns_ws_error(p, NEW_SRV_ERR_PERMISSION_DENIED);
+    return 1;
+  }
+  int judge_flag = check_subscription_scope(auth);
+  if (judge_flag < 0) {
+    if (sub) remove_subscriber(sub);
+    ns_ws_error(p, -judge_flag);
+    return 1;
+  }
+
+  int runs_flag = 1, clars_flag = 1;
+  cJSON *je = cJSON_GetObjectItem((cJSON *) root, "events");
+  if (je) {
+    if (je->type != cJSON_Array) {
+      ns_ws_error(p, NEW_SRV_ERR_INV_PARAM);
+      return 1;
+    }
+    runs_flag = clars_flag = 0;
+    for (cJSON *jj = je->child; jj; jj = jj->next) {
+      if (jj->type != cJSON_String) {
+        ns_ws_error(p, NEW_SRV_ERR_INV_PARAM);
+        return 1;
+      }
+      if (!strcmp(jj->valuestring, "runs")) {
+        runs_flag = 1;
+      } else if (!strcmp(jj->valuestring, "clars")) {
+        clars_flag = 1;
+      } else {
+        ns_ws_error(p, NEW_SRV_ERR_INV_PARAM);
+        return 1;
+      }
+    }
+  }
+
+  if (!sub) {
+    if (subs_u == subs_a) {
+      if (!(subs_a *= 2)) subs_a = 16;
+      XREALLOC(subs, subs_a);
+    }
+    sub = &subs[subs_u++];
+    memset(sub, 0, sizeof(*sub));
+    sub->p = p;
+  }
+  sub->expire_time = auth->expire_time;
+  sub->contest_id = auth->contest_id;
+  sub->user_id = auth->user_id;
+  sub->judge_flag = judge_flag;
+  sub->runs_flag = runs_flag;
+  sub->clars_flag = clars_flag;
+  push_reply(p, sub);
+  return 1;
+}
+
+/* ws_cleanup callback of the server framework */
+void
+ns_ws_push_cleanup(
+        struct server_framework_state *state,
+        struct ws_client_state *p)
+{
+  struct push_subscriber *sub = find_subscriber(p);
+  if (sub) remove_subscriber(sub);
+}
+
+/* the run_update hook of serve */
+void
+ns_ws_push_run_update(
+        serve_state_t cs,
+        const struct run_entry *re)
+{
+  char *user_str = NULL;
+  char *judge_str = NULL;
+  long long server_time_us = 0;
+
+  for (int i = 0; i < subs_u; ++i) {
+    struct push_subscriber *sub = &subs[i];
+    if (sub->contest_id != cs->contest_id || !sub->runs_flag) continue;
+    if (sub->judge_flag) {
+      if (!judge_str) {
+        if (!server_time_us) server_time_us = get_server_time_us();
+        cJSON *jr = cJSON_CreateObject();
+        cJSON_AddStringToObject(jr, "type", "run");
+        cJSON_AddNumberToObject(jr, "server_time_us", (double) server_time_us);
+        cJSON_AddItemToObject(jr, "run", json_serialize_run(cs, re));
+        judge_str = cJSON_PrintUnformatted(jr);
+        cJSON_Delete(jr);
+      }
+      push_frame(sub, judge_str);
+    } else if (re->user_id == sub->user_id && !re->is_hidden) {
+      // the visible status depends on the contest settings, so
+      // only the run_id is reported
+      if (!user_str) {
+        if (!server_time_us) server_time_us = get_server_time_us();
+        cJSON *jr = cJSON_CreateObject();
+        cJSON_AddStringToObject(jr, "type", "run");
+        cJSON_AddNumberToObject(jr, "server_time_us", (double) server_time_us);
+        cJSON_AddNumberToObject(jr, "contest_id", cs->contest_id);
+        cJSON_AddNumberToObject(jr, "run_id", re->run_id);
+        user_str = cJSON_PrintUnformatted(jr);
+        cJSON_Delete(jr);
+      }
+      push_frame(sub, user_str);
+    }
+  }
+
+  free(user_str);
+  free(judge_str);
+}
+
+/* the clar_update hook of serve */
+void
+ns_ws_push_clar_update(
+        serve_state_t cs,
+        int clar_id)
+{
+  struct clar_entry_v2 clar;
+  char *str = NULL;
+
+  for (int i = 0; i < subs_u; ++i) {
+    struct push_subscriber *sub = &subs[i];
+    if (sub->contest_id != cs->contest_id || !sub->clars_flag) continue;
+    if (!str) {
+      if (clar_get_record(cs->clarlog_state, clar_id, &clar) < 0) return;
+      cJSON *jr = cJSON_CreateObject();
+      cJSON_AddStringToObject(jr, "type", "clar");
+      cJSON_AddNumberToObject(jr, "server_time_us", (double) get_server_time_us());
+      cJSON_AddNumberToObject(jr, "contest_id", cs->contest_id);
+      cJSON_AddNumberToObject(jr, "clar_id", clar_id);
+      str = cJSON_PrintUnformatted(jr);
+      cJSON_Delete(jr);
+    }
+    if (sub->judge_flag
+        || clar.from == sub->user_id || clar.to == sub->user_id
+        || (!clar.from && !clar.to)) {
+      push_frame(sub, str);
+    }
+  }
+
+  free(str);
+}
+
+/*
+ * the subscribers are dropped, when their session expires or
+ * the client is authenticated anew as a different user
+ */
+static void
+drop_expired_subscribers(time_t cur_time)
+{
+  for (int i = 0; i < subs_u; ) {
+    struct push_subscriber *sub = &subs[i];
+    const struct client_auth *auth = sub->p->auth;
+    if (auth && auth->user_id == sub->user_id && auth->contest_id == sub->contest_id
+        && (sub->expire_time <= 0 || cur_time < sub->expire_time)) {
+      ++i;
+      continue;
+    }
+
+    cJSON *jr = cJSON_CreateObject();
+    cJSON_AddStringToObject(jr, "type", "unsubscribed");
+    cJSON_AddNumberToObject(jr, "server_time_us", (double) get_server_time_us());
+    cJSON_AddNumberToObject(jr, "contest_id", sub->contest_id);
+    char *jrstr = cJSON_PrintUnformatted(jr);
+    cJSON_Delete(jr);
+    struct ws_client_state *p = sub->p;
+    if (p->state == WS_STATE_ACTIVE && p->out_close_state <= 0) {
+      nsf_ws_append_reply_frame(p, 0, jrstr, strlen(jrstr));
+    }
+    free(jrstr);
+    remove_subscriber(sub);
+  }
+}
+
+/* called on each iteration of the main loop */
+void
+ns_ws_push_flush(void)
+{
+  time_t cur_time = time(NULL);
+  if (cur_time != last_expire_check) {
+    last_expire_check = cur_time;
+    drop_expired_subscribers(cur_time);
+  }
+
+  if (!overflow_count) return;
+
+  for (int i = 0; i < subs_u; ++i) {
+    struct push_subscriber *sub = &subs[i];
+    if (!sub->overflow_flag || sub->p->write_size > PUSH_LOW_WATER) continue;
+    sub->overflow_flag = 0;
+    --overflow_count;
+
+    cJSON *jr = cJSON_CreateObject();
+    cJSON_AddStringToObject(jr, "type", "resync");
+    cJSON_AddNumberToObject(jr, "server_time_us", (double) get_server_time_us());
+    cJSON_AddNumberToObject(jr, "contest_id", sub->contest_id);
+    char *jrstr = cJSON_PrintUnformatted(jr);
+    cJSON_Delete(jr);
+    push_frame(sub, jrstr);
+    free(jrstr);
+  }
+}
@@ -234,6 +234,7 @@ static const struct config_parse_info section_global_params[] =
   GLOBAL_PARAM(plog_header_file, "S"),
   GLOBAL_PARAM(plog_footer_file, "S"),
   GLOBAL_PARAM(plog_update_time, "d"),
+  GLOBAL_PARAM(standings_update_time, "d"),
   GLOBAL_PARAM(plog_symlink_dir, "S"),
 
   GLOBAL_PARAM(external_xml_update_time, "d"),
@@ -460,6 +461,7 @@ static const struct config_parse_info section_problem_params[] =
   PROBLEM_PARAM(disable_stderr, "L"),
   PROBLEM_PARAM(enable_process_group, "L"),
   PROBLEM_PARAM(enable_kill_all, "L"),
+  PROBLEM_PARAM(readonly_input, "L"),
   PROBLEM_PARAM(enable_testlib_mode, "L"),
   PROBLEM_PARAM(enable_extended_info, "L"),
   PROBLEM_PARAM(stop_on_first_fail, "L"),
@@ -487,6 +489,7 @@ static const struct config_parse_info section_problem_params[] =
   PROBLEM_PARAM(max_file_size, "E"),
   PROBLEM_PARAM(max_open_file_count, "d"),
   PROBLEM_PARAM(max_process_count, "d"),
+  PROBLEM_PARAM(parallel_tests, "d"),
   PROBLEM_PARAM_2(type, do_problem_parse_type),
   PROBLEM_PARAM(interactor_time_limit, "d"),
   PROBLEM_PARAM(interactor_real_time_limit, "d"),
@@ -1214,6 +1217,7 @@ prepare_problem_init_func(struct generic_section_config *gp)
   p->disable_stderr = -1;
   p->enable_process_group = -1;
   p->enable_kill_all = -1;
+  p->readonly_input = -1;
   p->enable_testlib_mode = -1;
   p->enable_extended_info = -1;
   p->stop_on_first_fail = -1;
@@ -1238,6 +1242,7 @@ prepare_problem_init_func(struct generic_section_config *gp)
   p->max_file_size = -1LL;
   p->max_open_file_count = -1;
   p->max_process_count = -1;
+  p->parallel_tests = -1;
   p->interactor_time_limit = -1;
   p->interactor_real_time_limit = -1;
   p->max_user_run_count = -1;
@@ -2566,6 +2571,7 @@ prepare_problem(
   prepare_set_prob_value(CNTSPROB_disable_stderr, prob, aprob, g);
   prepare_set_prob_value(CNTSPROB_enable_process_group, prob, aprob, g);
   prepare_set_prob_value(CNTSPROB_enable_kill_all, prob, aprob, g);
+  prepare_set_prob_value(CNTSPROB_readonly_input, prob, aprob, g);
   prepare_set_prob_value(CNTSPROB_enable_testlib_mode, prob, aprob, g);
   prepare_set_prob_value(CNTSPROB_enable_extended_info, prob, aprob, g);
   prepare_set_prob_value(CNTSPROB_stop_on_first_fail, prob, aprob, g);
@@ -2640,6 +2646,7 @@ prepare_problem(
   prepare_set_prob_value(CNTSPROB_max_file_size, prob, aprob, g);
   prepare_set_prob_value(CNTSPROB_max_open_file_count, prob, aprob, g);
   prepare_set_prob_value(CNTSPROB_max_process_count, prob, aprob, g);
+  prepare_set_prob_value(CNTSPROB_parallel_tests, prob, aprob, g);
   prepare_set_prob_value(CNTSPROB_checker_max_vm_size, prob, aprob, g);
   prepare_set_prob_value(CNTSPROB_checker_max_stack_size, prob, aprob, g);
   prepare_set_prob_value(CNTSPROB_checker_max_rss_size, prob, aprob, g);
@@ -6012,6 +6019,7 @@ prepare_set_prob_value(
   INHERIT_BOOLEAN(disable_stderr);
   INHERIT_BOOLEAN(enable_process_group);
   INHERIT_BOOLEAN(enable_kill_all);
+  INHERIT_BOOLEAN(readonly_input);
   INHERIT_BOOLEAN(enable_testlib_mode);
   INHERIT_BOOLEAN(enable_extended_info);
   INHERIT_BOOLEAN(stop_on_first_fail);
@@ -6070,6 +6078,11 @@ prepare_set_prob_value(
     if (out->max_process_count < 0 && abstr) out->max_process_count = abstr->max_process_count;
     break;
 
+  case CNTSPROB_parallel_tests:
+    if (out->parallel_tests < 0 && abstr) out->parallel_tests = abstr->parallel_tests;
+    if (out->parallel_tests < 0) out->parallel_tests = 0;
+    break;
+
   case CNTSPROB_checker_max_vm_size:
     if (out->checker_max_vm_size < 0 && abstr) out->checker_max_vm_size = abstr->checker_max_vm_size;
     break;
@@ -6641,6 +6654,7 @@ prepare_set_all_prob_values(
     CNTSPROB_disable_stderr,
     CNTSPROB_enable_process_group,
     CNTSPROB_enable_kill_all,
+    CNTSPROB_readonly_input,
     CNTSPROB_enable_testlib_mode,
     CNTSPROB_enable_extended_info,
     CNTSPROB_stop_on_first_fail,
@@ -6710,6 +6724,7 @@ prepare_set_all_prob_values(
     CNTSPROB_max_file_size,
     CNTSPROB_max_open_file_count,
     CNTSPROB_max_process_count,
+    CNTSPROB_parallel_tests,
     CNTSPROB_checker_max_vm_size,
     CNTSPROB_checker_max_stack_size,
     CNTSPROB_checker_max_rss_size,
@@ -398,6 +398,8 @@ prepare_unparse_global(
     if (global->plog_update_time != DFLT_G_PLOG_UPDATE_TIME)
       fprintf(f, "plog_update_time = %d\n", global->plog_update_time);
   }
+  if (global->standings_update_time > 0)
+    fprintf(f, "standings_update_time = %d\n", global->standings_update_time);
   if (global->external_xml_update_time > 0)
     fprintf(f, "external_xml_update_time = %d\n", global->external_xml_update_time);
   if (global->internal_xml_update_time > 0)
@@ -1361,6 +1363,10 @@ prepare_unparse_prob(
   if (prob->max_process_count >= 0) {
     fprintf(f, "max_process_count = %d\n", prob->max_process_count);
   }
+  if ((prob->abstract > 0 && prob->parallel_tests > 0)
+      || (!prob->abstract && prob->parallel_tests >= 0)) {
+    fprintf(f, "parallel_tests = %d\n", prob->parallel_tests);
+  }
   if (prob->umask && prob->umask[0])
     fprintf(f, "umask = \"%s\"\n", CARMOR(prob->umask));
 
@@ -1633,6 +1639,10 @@ prepare_unparse_prob(
       || (!prob->abstract && prob->enable_kill_all >= 0)) {
     unparse_bool(f, "enable_kill_all", prob->enable_kill_all);
   }
+  if ((prob->abstract > 0 && prob->readonly_input > 0)
+      || (!prob->abstract && prob->readonly_input >= 0)) {
+    unparse_bool(f, "readonly_input", prob->readonly_input);
+  }
   if ((prob->abstract > 0 && prob->enable_testlib_mode > 0)
       || (!prob->abstract && prob->enable_testlib_mode >= 0)) {
     unparse_bool(f, "enable_testlib_mode", prob->enable_testlib_mode);
@@ -1885,6 +1895,9 @@ prepare_unparse_actual_prob(
   if (prob->max_process_count > 0) {
     fprintf(f, "max_process_count = %d\n", prob->max_process_count);
   }
+  if (prob->parallel_tests > 0) {
+    fprintf(f, "parallel_tests = %d\n", prob->parallel_tests);
+  }
   if (prob->umask && prob->umask[0])
     fprintf(f, "umask = \"%s\"\n", CARMOR(prob->umask));
 
@@ -2115,6 +2128,8 @@ prepare_unparse_actual_prob(
     unparse_bool(f, "enable_process_group", prob->enable_process_group);
   if (prob->enable_kill_all > 0)
     unparse_bool(f, "enable_kill_all", prob->enable_kill_all);
+  if (prob->readonly_input > 0)
+    unparse_bool(f, "readonly_input", prob->readonly_input);
   if (prob->enable_testlib_mode > 0)
     unparse_bool(f, "enable_testlib_mode", prob->enable_testlib_mode);
   if (prob->enable_extended_info > 0)
@@ -0,0 +1,213 @@
+/* -*- mode: c; c-basic-offset: 4 -*- */
+
+/* Copyright (C) 2024 Alexander Chernov <cher@ejudge.ru> */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "ejudge/config.h"
+#include "ejudge/report_summary.h"
+#include "ejudge/runlog.h"
+#include "ejudge/testing_report_xml.h"
+#include "ejudge/errlog.h"
+
+#include "ejudge/xalloc.h"
+#include "ejudge/logger.h"
+#include "ejudge/osdeps.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define REPORT_SUMMARY_MAGIC "Ejudge report summary cache\n"
+
+/*
+ * the file consists of the header followed by the summaries indexed
+ * by run_id, the summaries are written through as soon as they change
+ */
+struct report_summary_header
+{
+    unsigned char magic[32];
+    int32_t version;
+    int32_t entry_size;
+    unsigned char pad[24];
+};
+
+enum { REPORT_SUMMARY_VERSION = 1 };
+
+struct report_summary_cache
+{
+    int fd;
+    int size;
+    struct report_summary *entries;
+};
+
+static void
+make_header(struct report_summary_header *h)
+{
+    memset(h, 0, sizeof(*h));
+    snprintf((char*) h->magic, sizeof(h->magic), "%s", REPORT_SUMMARY_MAGIC);
+    h->version = REPORT_SUMMARY_VERSION;
+    h->entry_size = sizeof(struct report_summary);
+}
+
+static int
+reset_file(struct report_summary_cache *rsc, const unsigned char *path)
+{
+    struct report_summary_header h;
+
+    make_header(&h);
+    if (ftruncate(rsc->fd, 0) < 0) {
+        err("%s: ftruncate failed: %s", path, os_ErrorMsg());
+        return -1;
+    }
+    if (pwrite(rsc->fd, &h, sizeof(h), 0) != sizeof(h)) {
+        err("%s: write failed: %s", path, os_ErrorMsg());
+        return -1;
+    }
+    return 0;
+}
+
+struct report_summary_cache *
+report_summary_cache_open(const unsigned char *path)
+{
+    struct report_summary_cache *rsc = NULL;
+    struct report_summary_header h, fh;
+    struct stat stb;
+    int count;
+
+    XCALLOC(rsc, 1);
+    rsc->fd = -1;
+    if ((rsc->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) < 0) {
+        err("%s: open failed: %s", path, os_ErrorMsg());
+        goto fail;
+    }
+    if (fstat(rsc->fd, &stb) < 0) {
+        err("%s: fstat failed: %s", path, os_ErrorMsg());
+        goto fail;
+    }
+
+    make_header(&h);
+    if (stb.st_size < (off_t) sizeof(fh)
+        || pread(rsc->fd, &fh, sizeof(fh), 0) != sizeof(fh)
+        || memcmp(&h, &fh, sizeof(h)) != 0
+        || (stb.st_size - sizeof(fh)) % sizeof(struct report_summary) != 0) {
+        if (stb.st_size > 0) {
+            info("%s: invalid report summary cache, resetting", path);
+        }
+        if (reset_file(rsc, path) < 0) goto fail;
+        return rsc;
+    }
+
+    count = (stb.st_size - sizeof(fh)) / sizeof(struct report_summary);
+    if (count > 0) {
+        rsc->size = count;
+        XCALLOC(rsc->entries, rsc->size);
+        ssize_t want = count * sizeof(struct report_summary);
+        if (pread(rsc->fd, rsc->entries, want, sizeof(fh)) != want) {
+            err("%s: read failed, resetting", path);
+            xfree(rsc->entries); rsc->entries = NULL;
+            rsc->size = 0;
+            if (reset_file(rsc, path) < 0) goto fail;
+        }
+    }
+    return rsc;
+
+fail:
+    report_summary_cache_free(rsc);
+    return NULL;
+}
+
+struct report_summary_cache *
+report_summary_cache_free(struct report_summary_cache *rsc)
+{
+    if (rsc) {
+        if (rsc->fd >= 0) close(rsc->fd);
+        xfree(rsc->entries);
+        xfree(rsc);
+    }
+    return NULL;
+}
+
+static int
+is_matching(const struct report_summary *rs, const struct run_entry *re)
+{
+    return (rs->flags & REPORT_SUMMARY_VALID)
+        && rs->status == re->status
+        && !memcmp(&rs->run_uuid, &re->run_uuid, sizeof(rs->run_uuid))
+        && !memcmp(&rs->judge_uuid, &re->j.judge_uuid, sizeof(rs->judge_uuid));
+}
+
+const struct report_summary *
+report_summary_cache_get(
+        const struct report_summary_cache *rsc,
+        const struct run_entry *re)
+{
+    if (!rsc || !re) return NULL;
+    if (re->run_id < 0 || re->run_id >= rsc->size) return NULL;
+    const struct report_summary *rs = &rsc->entries[re->run_id];
+    if (!is_matching(rs, re)) return NULL;
+    return rs;
+}
+
+void
+report_summary_cache_put(
+        struct report_summary_cache *rsc,
+        const struct run_entry *re,
+        const struct testing_report_xml *tr)
+{
+    struct report_summary *rs;
+
+    if (!rsc || !re || re->run_id < 0) return;
+    if (re->run_id >= rsc->size) {
+        int new_size = rsc->size;
+        if (!new_size) new_size = 1024;
+        while (re->run_id >= new_size) new_size *= 2;
+        XREALLOC(rsc->entries, new_size);
+        memset(rsc->entries + rsc->size, 0,
+               (new_size - rsc->size) * sizeof(rsc->entries[0]));
+        rsc->size = new_size;
+    }
+
+    rs = &rsc->entries[re->run_id];
+    memset(rs, 0, sizeof(*rs));
+    rs->run_uuid = re->run_uuid;
+    memcpy(&rs->judge_uuid, &re->j.judge_uuid, sizeof(rs->judge_uuid));
+    rs->status = re->status;
+    rs->flags = REPORT_SUMMARY_VALID;
+    if (!tr) {
+        rs->flags |= REPORT_SUMMARY_NO_REPORT;
+    } else {
+        rs->run_tests = tr->run_tests;
+        for (int i = 0; i < tr->run_tests; ++i) {
+            const struct testing_report_test *t = tr->tests[i];
+            if (!t) continue;
+            if (t->status >= 0 && t->status < 32) {
+                rs->test_status_mask |= 1U << t->status;
+            } else {
+                rs->flags |= REPORT_SUMMARY_STATUS_OVERFLOW;
+            }
+            if (t->time > rs->max_time_ms) rs->max_time_ms = t->time;
+            if ((int64_t) t->max_memory_used > rs->max_memory_used)
+                rs->max_memory_used = t->max_memory_used;
+        }
+    }
+
+    off_t offset = sizeof(struct report_summary_header)
+        + (off_t) re->run_id * sizeof(*rs);
+    if (pwrite(rsc->fd, rs, sizeof(*rs), offset) != sizeof(*rs)) {
+        err("report_summary_cache_put: write failed: %s", os_ErrorMsg());
+    }
+}
@@ -29,6 +29,7 @@
 #include "ejudge/fileutl.h"
 #include "unix/unix_fileutl.h"
 #include "ejudge/xml_utils.h"
+#include "ejudge/expat_iface.h"
 #include "ejudge/random.h"
 #include "ejudge/ej_uuid.h"
 
@@ -40,6 +41,8 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
 #include <errno.h>
 
 enum
@@ -48,9 +51,14 @@ enum
   RUNLOG_CURRENT_VERSION = RUNLOG_VERSION_3,
 };
 
+// the number of modified entries, after which the mapping is synced
+enum { RUNLOG_MSYNC_BATCH = 64 };
+
 struct rldb_file_state
 {
   int nref;
+  // map the run log file into memory instead of reading it
+  int use_mmap;
 };
 
 struct rldb_file_cnts
@@ -59,6 +67,14 @@ struct rldb_file_cnts
   struct runlog_state *rl_state;
   int run_fd;
   unsigned char *runlog_path;
+
+  // mmap mode: rl_state->runs points into this mapping of the file,
+  // the mapping has room for run_a entries, but the file contains
+  // only run_u entries, so the entries above run_u must not be touched
+  unsigned char *map_addr;
+  size_t map_size;
+  // range of the entries modified since the last msync
+  int dirty_first, dirty_last, dirty_count;
 };
 
 static struct common_plugin_data *
@@ -290,6 +306,22 @@ prepare_func(
         const struct ejudge_cfg *config,
         struct xml_tree *plugin_config)
 {
+  struct rldb_file_state *state = (struct rldb_file_state*) data;
+  const struct xml_parse_spec *spec = ejudge_cfg_get_spec();
+
+  if (!plugin_config) return 0;
+
+  for (struct xml_tree *p = plugin_config->first_down; p; p = p->right) {
+    ASSERT(p->tag == spec->default_elem);
+    if (!strcmp(p->name[0], "mmap")) {
+      if (p->first) return xml_err_attrs(p);
+      if (p->first_down) return xml_err_nested_elems(p);
+      if (xml_parse_bool(NULL, "", p->line, p->column, p->text, &state->use_mmap) < 0) return -1;
+    } else {
+      return xml_err_elem_not_allowed(p);
+    }
+  }
+
   return 0;
 }
 
@@ -530,6 +562,104 @@ do_truncate(struct rldb_file_cnts *cs)
   return 0;
 }
 
+static void
+mark_dirty(struct rldb_file_cnts *cs, int first, int last)
+{
+  if (first >= last) return;
+  if (cs->dirty_count <= 0) {
+    cs->dirty_first = first;
+    cs->dirty_last = last;
+  } else {
+    if (first < cs->dirty_first) cs->dirty_first = first;
+    if (last > cs->dirty_last) cs->dirty_last = last;
+  }
+  cs->dirty_count += last - first;
+}
+
+/* schedule writeback of the modified part of the mapping */
+static int
+sync_mapping(struct rldb_file_cnts *cs, int flags)
+{
+  struct runlog_state *rls = cs->rl_state;
+
+  if (!cs->map_addr || cs->dirty_count <= 0) return 0;
+
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t beg = sizeof(rls->head) + sizeof(rls->runs[0]) * cs->dirty_first;
+  size_t end = sizeof(rls->head) + sizeof(rls->runs[0]) * cs->dirty_last;
+  if (cs->dirty_last > rls->run_u) {
+    end = sizeof(rls->head) + sizeof(rls->runs[0]) * rls->run_u;
+  }
+  cs->dirty_count = 0;
+  beg -= beg % page_size;
+  if (beg >= end) return 0;
+  if (msync(cs->map_addr + beg, end - beg, flags) < 0) {
+    err("%s: msync failed: %s", __FUNCTION__, os_ErrorMsg());
+    return -1;
+  }
+  return 0;
+}
+
+/* map the run log file with the room for run_a entries */
+static int
+map_runlog(struct rldb_file_cnts *cs, int run_a)
+{
+  struct runlog_state *rls = cs->rl_state;
+  size_t size = sizeof(rls->head) + sizeof(rls->runs[0]) * run_a;
+  unsigned char *addr;
+
+  if (cs->map_addr) {
+    addr = mremap(cs->map_addr, cs->map_size, size, MREMAP_MAYMOVE);
+  } else {
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, cs->run_fd, 0);
+  }
+  if (addr == MAP_FAILED) {
+    err("%s: mapping of %zu bytes failed: %s", __FUNCTION__, size, os_ErrorMsg());
+    return -1;
+  }
+  cs->map_addr = addr;
+  cs->map_size = size;
+  rls->runs = (struct run_entry *) (addr + sizeof(rls->head));
+  rls->run_a = run_a;
+  return 0;
+}
+
+static void
+free_runs(struct rldb_file_cnts *cs)
+{
+  struct runlog_state *rls = cs->rl_state;
+
+  if (cs->map_addr) {
+    sync_mapping(cs, MS_ASYNC);
+    munmap(cs->map_addr, cs->map_size);
+    cs->map_addr = NULL;
+    cs->map_size = 0;
+    rls->runs = NULL;
+  } else {
+    xfree(rls->runs); rls->runs = NULL;
+  }
+  rls->run_u = rls->run_a = 0;
+}
+
+/* in mmap mode the file must cover an entry before it is stored */
+static int
+extend_mapped_file(struct rldb_file_cnts *cs, int run_u)
+{
+  struct runlog_state *rls = cs->rl_state;
+
+  if (run_u > rls->run_a) {
+    int new_a = rls->run_a;
+    if (!new_a) new_a = 128;
+    while (run_u > new_a) new_a *= 2;
+    if (map_runlog(cs, new_a) < 0) return -1;
+  }
+  if (ftruncate(cs->run_fd, sizeof(rls->head) + sizeof(rls->runs[0]) * run_u) < 0) {
+    err("%s: ftruncate failed: %s", __FILE__, os_ErrorMsg());
+    return -1;
+  }
+  return 0;
+}
+
 static int
 write_full_runlog_current_version(
         struct rldb_file_cnts *cs,
@@ -912,6 +1042,7 @@ run_flush_header(struct rldb_file_cnts *cs)
 static int
 read_runlog(
         struct rldb_file_cnts *cs,
+        int use_mmap,
         time_t init_duration,
         time_t init_sched_time,
         time_t init_finish_time)
@@ -938,6 +1069,7 @@ read_runlog(
     rls->head.finish_time = init_finish_time;
     rls->run_u = 0;
     run_flush_header(cs);
+    if (use_mmap && map_runlog(cs, 128) < 0) goto _cleanup;
     return 0;
   }
 
@@ -958,12 +1090,17 @@ read_runlog(
   rls->run_u = (filesize - sizeof(struct run_header))/sizeof(struct run_entry);
   rls->run_a = 128;
   while (rls->run_u > rls->run_a) rls->run_a *= 2;
-  XCALLOC(rls->runs, rls->run_a);
-  for (i = 0; i < rls->run_a; ++i)
-    rls->runs[i].status = RUN_EMPTY;
-  if (rls->run_u > 0) {
-    if (do_read(cs->run_fd, rls->runs, sizeof(rls->runs[0]) * rls->run_u) < 0)
-      return -1;
+  if (use_mmap) {
+    // the entries are not copied, so the load time does not depend on the size
+    if (map_runlog(cs, rls->run_a) < 0) goto _cleanup;
+  } else {
+    XCALLOC(rls->runs, rls->run_a);
+    for (i = 0; i < rls->run_a; ++i)
+      rls->runs[i].status = RUN_EMPTY;
+    if (rls->run_u > 0) {
+      if (do_read(cs->run_fd, rls->runs, sizeof(rls->runs[0]) * rls->run_u) < 0)
+        return -1;
+    }
   }
 
   if (init_finish_time > 0 && rls->head.finish_time != init_finish_time) {
@@ -977,10 +1114,7 @@ read_runlog(
 
  _cleanup:
   XMEMZERO(&rls->head, 1);
-  if (rls->runs) {
-    xfree(rls->runs); rls->runs = 0;
-    rls->run_u = rls->run_a = 0;
-  }
+  free_runs(cs);
   if (cs->run_fd >= 0) {
     close(cs->run_fd);
     cs->run_fd = -1;
@@ -997,15 +1131,11 @@ do_run_open(
         time_t init_sched_time,
         time_t init_finish_time)
 {
-  struct runlog_state *rls = cs->rl_state;
   int i, oflags;
 
   info("run_open: opening database %s", path);
 
-  if (rls->runs) {
-    xfree(rls->runs); rls->runs = 0;
-    rls->run_u = rls->run_a = 0;
-  }
+  free_runs(cs);
   if (cs->run_fd >= 0) {
     close(cs->run_fd);
     cs->run_fd = -1;
@@ -1050,7 +1180,9 @@ do_run_open(
         return -1;
     }
   } else {
-    if (read_runlog(cs, init_duration, init_sched_time,
+    // a read-only runlog may be truncated by the writer, so it is copied
+    int use_mmap = cs->plugin_state->use_mmap > 0 && flags != RUN_LOG_READONLY;
+    if (read_runlog(cs, use_mmap, init_duration, init_sched_time,
                     init_finish_time) < 0) return -1;
   }
   return 0;
@@ -1114,8 +1246,7 @@ close_func(struct rldb_plugin_cnts *cdata)
   if (!cs) return 0;
   rls = cs->rl_state;
   if (rls) {
-    xfree(rls->runs); rls->runs = 0;
-    rls->run_a = rls->run_u = 0;
+    free_runs(cs);
   }
   if (cs->plugin_state) cs->plugin_state->nref--;
   if (cs->run_fd >= 0) close(cs->run_fd);
@@ -1137,7 +1268,8 @@ reset_func(
 
   rls->run_u = 0;
   rls->run_f = 0;
-  if (rls->run_a > 0) {
+  cs->dirty_count = 0;
+  if (rls->run_a > 0 && !cs->map_addr) {
     memset(rls->runs, 0, sizeof(rls->runs[0]) * rls->run_a);
     for (i = 0; i < rls->run_a; ++i)
       rls->runs[i].status = RUN_EMPTY;
@@ -1171,6 +1303,16 @@ set_runlog_func(
   // not implemented yet
   ASSERT(id_offset == 0);
 
+  if (cs->map_addr) {
+    if (extend_mapped_file(cs, total_entries) < 0) return -1;
+    rls->run_u = total_entries;
+    if (rls->run_u > 0) {
+      memcpy(rls->runs, entries, rls->run_u * sizeof(rls->runs[0]));
+    }
+    mark_dirty(cs, 0, rls->run_u);
+    return sync_mapping(cs, MS_ASYNC);
+  }
+
   if (total_entries > rls->run_a) {
     if (!rls->run_a) rls->run_a = 128;
     xfree(rls->runs);
@@ -1215,6 +1357,10 @@ flush_func(struct rldb_plugin_cnts *cdata)
   struct runlog_state *rls = cs->rl_state;
 
   if (cs->run_fd < 0) ERR_R("invalid descriptor %d", cs->run_fd);
+  if (cs->map_addr) {
+    mark_dirty(cs, 0, rls->run_u);
+    return sync_mapping(cs, MS_SYNC);
+  }
   if (sf_lseek(cs->run_fd, sizeof(rls->head), SEEK_SET, "run") == (off_t) -1)
     return -1;
   if (do_write(cs->run_fd, rls->runs, rls->run_u * sizeof(rls->runs[0])) < 0)
@@ -1236,6 +1382,18 @@ append_to_end(runlog_state_t state, time_t t, int nsec)
   return state->run_u++;
 }
 
+static int
+append_entry(struct rldb_file_cnts *cs, time_t t, int nsec)
+{
+  struct runlog_state *rls = cs->rl_state;
+
+  if (cs->map_addr) {
+    if (extend_mapped_file(cs, rls->run_u + 1) < 0) return -1;
+    mark_dirty(cs, rls->run_u, rls->run_u + 1);
+  }
+  return append_to_end(rls, t, nsec);
+}
+
 static int
 get_insert_run_id(
         struct rldb_plugin_cnts *cdata,
@@ -1250,7 +1408,9 @@ get_insert_run_id(
   struct run_entry *runs = 0;
 
   ASSERT(rls->run_u <= rls->run_a);
-  if (rls->run_u == rls->run_a) {
+  if (cs->map_addr) {
+    // the mapping is extended by append_entry or before the insertion
+  } else if (rls->run_u == rls->run_a) {
     int new_a = rls->run_a * 2;
     struct run_entry *new_r = 0;
 
@@ -1269,20 +1429,20 @@ get_insert_run_id(
   /*
    * RUN_EMPTY compilicates things! :(
    */
-  if (!rls->run_u) return append_to_end(rls, t, nsec);
+  if (!rls->run_u) return append_entry(cs, t, nsec);
 
   j = rls->run_u - 1;
   while (j >= 0 && runs[j].status == RUN_EMPTY) j--;
-  if (j < 0) return append_to_end(rls, t, nsec);
-  if (t > runs[j].time) return append_to_end(rls, t, nsec);
+  if (j < 0) return append_entry(cs, t, nsec);
+  if (t > runs[j].time) return append_entry(cs, t, nsec);
   if (t == runs[j].time) {
     if (nsec < 0 && runs[j].nsec < NSEC_MAX) {
       nsec = runs[j].nsec + 1;
-      return append_to_end(rls, t, nsec);
+      return append_entry(cs, t, nsec);
     }
-    if (nsec > runs[j].nsec) return append_to_end(rls, t, nsec);
+    if (nsec > runs[j].nsec) return append_entry(cs, t, nsec);
     if (nsec == runs[j].nsec && uid >= runs[j].user_id)
-      return append_to_end(rls, t, nsec);
+      return append_entry(cs, t, nsec);
   }
 
   if (nsec < 0) {
@@ -1334,6 +1494,10 @@ get_insert_run_id(
     return -1;
   }
 
+  if (cs->map_addr) {
+    if (extend_mapped_file(cs, rls->run_u + 1) < 0) return -1;
+    runs = rls->runs;
+  }
   memmove(&runs[i + 1], &runs[i], (rls->run_u - i) * sizeof(runs[0]));
   rls->run_u++;
   for (j = i + 1; j < rls->run_u; j++)
@@ -1345,6 +1509,11 @@ get_insert_run_id(
   runs[i].status = RUN_EMPTY;
   runs[i].time = t;
   runs[i].nsec = nsec;
+  if (cs->map_addr) {
+    mark_dirty(cs, i, rls->run_u);
+    if (sync_mapping(cs, MS_ASYNC) < 0) return -1;
+    return i;
+  }
   if (sf_lseek(cs->run_fd, sizeof(rls->head) + i * sizeof(runs[0]),
                SEEK_SET, "run") == (off_t) -1) return -1;
   if (do_write(cs->run_fd, &runs[i], (rls->run_u - i) * sizeof(runs[0])) < 0)
@@ -1371,10 +1540,17 @@ do_flush_entry(
   gettimeofday(&tv, NULL);
   re->last_change_us = tv.tv_sec * 1000000LL + tv.tv_usec;
 
-  if (sf_lseek(cs->run_fd, sizeof(rls->head) + sizeof(*re) * num,
-               SEEK_SET, "run") == (off_t) -1) return -1;
-  if (do_write(cs->run_fd, re, sizeof(*re)) < 0)
-    return -1;
+  if (cs->map_addr) {
+    // the entry is already stored in the mapping
+    mark_dirty(cs, num, num + 1);
+    if (cs->dirty_count >= RUNLOG_MSYNC_BATCH && sync_mapping(cs, MS_ASYNC) < 0)
+      return -1;
+  } else {
+    if (sf_lseek(cs->run_fd, sizeof(rls->head) + sizeof(*re) * num,
+                 SEEK_SET, "run") == (off_t) -1) return -1;
+    if (do_write(cs->run_fd, re, sizeof(*re)) < 0)
+      return -1;
+  }
 
   if (ure) {
     *ure = *re;
@@ -1756,6 +1932,13 @@ squeeze_func(struct rldb_plugin_cnts *cdata)
 
   retval = rls->run_u - j;
   rls->run_u = j;
+  if (cs->map_addr) {
+    // the moved entries are already in the file
+    if (do_truncate(cs) < 0) return -1;
+    if (first_moved >= 0) mark_dirty(cs, first_moved, rls->run_u);
+    if (sync_mapping(cs, MS_ASYNC) < 0) return -1;
+    return retval;
+  }
   if (rls->run_u < rls->run_a) {
     memset(&rls->runs[rls->run_u], 0,
            (rls->run_a - rls->run_u) * sizeof(rls->runs[0]));
@@ -65,6 +65,8 @@
 #include <sys/mman.h>
 #ifndef __MINGW32__
 #include <sys/vfs.h>
+#include <sys/wait.h>
+#include <sched.h>
 #endif
 #ifdef HAVE_TERMIOS_H
 #include <termios.h>
@@ -1566,6 +1568,7 @@ agent_mirror_file(
   int new_uid = -1;
   int new_gid = -1;
   int r = agent->ops->mirror_file(agent, buf, mtime, fsize, mode,
+                                  fsize >= 0?mirror_path:NULL,
                                   &pkt_ptr, &pkt_len, &new_mtime,
                                   &new_mode, &new_uid, &new_gid);
   if (r < 0) {
@@ -1573,6 +1576,20 @@ agent_mirror_file(
     return;
   }
   if (!r) {
+    // the content is the same, but the attributes may be updated
+    if (new_mtime > 0 && new_mtime != mtime) {
+      struct timespec ub[2] = {};
+      ub[0].tv_sec = new_mtime;
+      ub[1].tv_sec = new_mtime;
+      if (utimensat(AT_FDCWD, mirror_path, ub, 0) < 0) {
+        err("failed to change times of '%s': %s", mirror_path, os_ErrorMsg());
+      }
+    }
+    if (new_mode >= 0 && new_mode != mode) {
+      if (chmod(mirror_path, new_mode & 07777) < 0) {
+        err("failed to change perms of '%s': %s", mirror_path, os_ErrorMsg());
+      }
+    }
     info("using mirrored file '%s'", mirror_path);
     snprintf(buf, size, "%s", mirror_path);
     return;
@@ -1690,6 +1707,49 @@ copy_mirrored_file(unsigned char *buf, int size, const unsigned char *mirror_pat
   return 0;
 }
 
+/*
+ * place the test input file to the working directory,
+ * the file is hardlinked, if the program cannot modify it:
+ * the problem declares the input as read-only and the program runs
+ * in the container, which does not chown the shared file and mounts
+ * it read-only; with plain suid_run the working directory is chowned
+ * to the exec user, so the file is always copied,
+ * returns 1, if the file is shared, 0, if it is copied
+ */
+static int
+stage_test_file(
+        const struct super_run_in_global_packet *srgp,
+        const struct super_run_in_problem_packet *srpp,
+        const struct section_tester_data *tst,
+        struct AgentClient *agent,
+        const unsigned char *test_src,
+        int copy_flag,
+        const unsigned char *dst_dir,
+        const unsigned char *dst_name)
+{
+  struct stat stb;
+  unsigned char dst_path[PATH_MAX];
+
+  // with use_tgz the program runs in a subdirectory of dst_dir
+  if (srpp->readonly_input <= 0 || srpp->use_tgz > 0 || copy_flag != 0 || agent || !tst
+      || srgp->enable_container <= 0) {
+    goto copy;
+  }
+  // the output file is chmod-ed after the run
+  if (srpp->output_file && !strcmp(srpp->output_file, dst_name)) goto copy;
+  if (stat(test_src, &stb) < 0 || !S_ISREG(stb.st_mode)) goto copy;
+  if (!(stb.st_mode & S_IROTH)) goto copy;
+
+  snprintf(dst_path, sizeof(dst_path), "%s/%s", dst_dir, dst_name);
+  return link_or_copy_file(test_src, dst_path);
+
+copy:
+  if (generic_copy_file(0, NULL, test_src, "", copy_flag, dst_dir, dst_name, "") < 0) {
+    return -1;
+  }
+  return 0;
+}
+
 static void
 mirror_file(
         struct AgentClient *agent,
@@ -3444,7 +3504,8 @@ run_one_test(
         const unsigned char *test_dir,
         const unsigned char *corr_dir,
         const unsigned char *info_dir,
-        const unsigned char *tgz_dir)
+        const unsigned char *tgz_dir,
+        const unsigned char *slot_check_dir)
 {
   const struct section_global_data *global = state->global;
 
@@ -3489,6 +3550,7 @@ run_one_test(
   int errcode = 0;
   int disable_stderr = -1;
   int copy_flag = 0;
+  int input_shared = 0;
   int error_code_value = 0;
   long long file_size;
   int init_cmd_started = 0;
@@ -3580,7 +3642,10 @@ run_one_test(
     return -1;
   }
 
-  if (tst && tst->check_dir && tst->check_dir[0]) {
+  if (slot_check_dir) {
+    // private working directory of a parallel testing slot
+    snprintf(check_dir, sizeof(check_dir), "%s", slot_check_dir);
+  } else if (tst && tst->check_dir && tst->check_dir[0]) {
     snprintf(check_dir, sizeof(check_dir), "%s", tst->check_dir);
   } else {
     snprintf(check_dir, sizeof(check_dir), "%s", global->run_check_dir);
@@ -3908,7 +3973,8 @@ run_one_test(
   } else {
     /* copy the test */
     mirror_file(agent, test_src, sizeof(test_src), mirror_dir);
-    if (generic_copy_file(0, NULL, test_src, "", copy_flag, check_dir, srpp->input_file, "") < 0) {
+    if ((input_shared = stage_test_file(srgp, srpp, tst, agent, test_src, copy_flag,
+                                        check_dir, srpp->input_file)) < 0) {
       append_msg_to_log(check_out_path, "failed to copy test file %s -> %s/%s",
                         test_src, check_dir, srpp->input_file);
       goto check_failed;
@@ -4235,10 +4301,17 @@ run_one_test(
   if (tst && srgp->enable_container > 0) {
     task_SetSuidHelperDir(tsk, EJUDGE_SERVER_BIN_PATH);
     task_EnableContainer(tsk);
+    // the sandbox is prepared once for all the tests of the run
+    task_EnableContainerTemplate(tsk);
     if (srpp->container_options && srpp->container_options[0])
       task_AppendContainerOptions(tsk, srpp->container_options);
     if (srgp->lang_container_options && srgp->lang_container_options[0])
       task_AppendContainerOptions(tsk, srgp->lang_container_options);
+    if (input_shared > 0) {
+      unsigned char ro_opt[PATH_MAX];
+      snprintf(ro_opt, sizeof(ro_opt), "rI%zu%s", strlen(srpp->input_file), srpp->input_file);
+      task_AppendContainerOptions(tsk, ro_opt);
+    }
     if (srgp->lang_short_name && *srgp->lang_short_name)
       task_SetLanguageName(tsk, srgp->lang_short_name);
     if (tst->secure_exec_type_val == SEXEC_TYPE_JAVA) {
@@ -5260,6 +5333,630 @@ append_skipped_test(
   cur_info->max_score = test_max_score;
 }
 
+#ifndef __WIN32__
+/* parallel testing: each test runs in a forked process pinned to
+   its own CPU core and using its own working directory, the results
+   are passed back through files in the run_work_dir */
+
+struct parallel_test_result
+{
+  int status;
+  int has_real_time;
+  int has_max_memory_used;
+  int has_max_rss;
+  long report_time_limit_ms;
+  long report_real_time_limit_ms;
+  struct run_test_info info;
+};
+
+struct parallel_test_slot
+{
+  pid_t pid;
+  int test_num;
+  int cpu;
+  unsigned char check_dir[PATH_MAX];
+};
+
+enum
+{
+  PARALLEL_TEST_NONE,
+  PARALLEL_TEST_RUNNING,
+  PARALLEL_TEST_DONE,
+};
+
+struct parallel_test_entry
+{
+  int state;
+  struct parallel_test_result res;
+};
+
+static int
+get_parallel_test_cpus(int max_count, int **p_cpus)
+{
+  cpu_set_t cs;
+  int *cpus = NULL;
+  int count = 0;
+
+  CPU_ZERO(&cs);
+  if (sched_getaffinity(0, sizeof(cs), &cs) < 0) {
+    err("%s: sched_getaffinity failed: %s", __FUNCTION__, os_ErrorMsg());
+    return 0;
+  }
+  XCALLOC(cpus, max_count);
+  for (int i = 0; i < CPU_SETSIZE && count < max_count; ++i) {
+    if (CPU_ISSET(i, &cs)) cpus[count++] = i;
+  }
+  *p_cpus = cpus;
+  return count;
+}
+
+static void
+write_parallel_str(FILE *f, const unsigned char *str)
+{
+  int len = -1;
+  if (str) len = strlen(str);
+  fwrite(&len, sizeof(len), 1, f);
+  if (len > 0) fwrite(str, 1, len, f);
+}
+
+static void
+write_parallel_file(FILE *f, const struct run_test_file *rtf)
+{
+  ssize_t len = -1;
+  if (rtf->data) len = rtf->stored_size;
+  fwrite(&len, sizeof(len), 1, f);
+  if (len > 0) fwrite(rtf->data, 1, len, f);
+}
+
+static int
+write_parallel_result(
+        const unsigned char *path,
+        const struct parallel_test_result *res)
+{
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    err("%s: cannot open '%s': %s", __FUNCTION__, path, os_ErrorMsg());
+    return -1;
+  }
+  const struct run_test_info *ti = &res->info;
+  fwrite(res, sizeof(*res), 1, f);
+  write_parallel_str(f, ti->args);
+  write_parallel_str(f, ti->comment);
+  write_parallel_str(f, ti->team_comment);
+  write_parallel_str(f, ti->exit_comment);
+  write_parallel_str(f, ti->program_stats_str);
+  write_parallel_str(f, ti->interactor_stats_str);
+  write_parallel_str(f, ti->checker_stats_str);
+  write_parallel_str(f, ti->checker_token);
+  write_parallel_file(f, &ti->input);
+  write_parallel_file(f, &ti->output);
+  write_parallel_file(f, &ti->correct);
+  write_parallel_file(f, &ti->error);
+  write_parallel_file(f, &ti->chk_out);
+  write_parallel_file(f, &ti->test_checker);
+  if (ferror(f)) {
+    err("%s: write error on '%s'", __FUNCTION__, path);
+    fclose(f);
+    return -1;
+  }
+  if (fclose(f) < 0) {
+    err("%s: write error on '%s': %s", __FUNCTION__, path, os_ErrorMsg());
+    return -1;
+  }
+  return 0;
+}
+
+static int
+read_parallel_str(FILE *f, unsigned char **p_str)
+{
+  int len = -1;
+  *p_str = NULL;
+  if (fread(&len, sizeof(len), 1, f) != 1) return -1;
+  if (len < 0) return 0;
+  unsigned char *str = xmalloc(len + 1);
+  if (len > 0 && fread(str, 1, len, f) != (size_t) len) {
+    xfree(str);
+    return -1;
+  }
+  str[len] = 0;
+  *p_str = str;
+  return 0;
+}
+
+static int
+read_parallel_file(FILE *f, struct run_test_file *rtf)
+{
+  ssize_t len = -1;
+  rtf->data = NULL;
+  if (fread(&len, sizeof(len), 1, f) != 1) return -1;
+  if (len < 0) return 0;
+  unsigned char *data = xmalloc(len + 1);
+  if (len > 0 && fread(data, 1, len, f) != (size_t) len) {
+    xfree(data);
+    return -1;
+  }
+  data[len] = 0;
+  rtf->data = data;
+  return 0;
+}
+
+static void
+free_parallel_result(struct parallel_test_result *res)
+{
+  struct run_test_info *ti = &res->info;
+  xfree(ti->args);
+  xfree(ti->comment);
+  xfree(ti->team_comment);
+  xfree(ti->exit_comment);
+  xfree(ti->program_stats_str);
+  xfree(ti->interactor_stats_str);
+  xfree(ti->checker_stats_str);
+  xfree(ti->checker_token);
+  xfree(ti->input.data);
+  xfree(ti->output.data);
+  xfree(ti->correct.data);
+  xfree(ti->error.data);
+  xfree(ti->chk_out.data);
+  xfree(ti->test_checker.data);
+  memset(res, 0, sizeof(*res));
+}
+
+static int
+read_parallel_result(
+        const unsigned char *path,
+        struct parallel_test_result *res)
+{
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    err("%s: cannot open '%s': %s", __FUNCTION__, path, os_ErrorMsg());
+    return -1;
+  }
+  memset(res, 0, sizeof(*res));
+  if (fread(res, sizeof(*res), 1, f) != 1) {
+    err("%s: unexpected EOF in '%s'", __FUNCTION__, path);
+    memset(res, 0, sizeof(*res));
+    fclose(f);
+    return -1;
+  }
+  // pointers are meaningful only in the child process
+  struct run_test_info *ti = &res->info;
+  ti->args = NULL;
+  ti->comment = NULL;
+  ti->team_comment = NULL;
+  ti->exit_comment = NULL;
+  ti->program_stats_str = NULL;
+  ti->interactor_stats_str = NULL;
+  ti->checker_stats_str = NULL;
+  ti->checker_token = NULL;
+  ti->input.data = NULL;
+  ti->output.data = NULL;
+  ti->correct.data = NULL;
+  ti->error.data = NULL;
+  ti->chk_out.data = NULL;
+  ti->test_checker.data = NULL;
+  if (read_parallel_str(f, &ti->args) < 0
+      || read_parallel_str(f, &ti->comment) < 0
+      || read_parallel_str(f, &ti->team_comment) < 0
+      || read_parallel_str(f, &ti->exit_comment) < 0
+      || read_parallel_str(f, &ti->program_stats_str) < 0
+      || read_parallel_str(f, &ti->interactor_stats_str) < 0
+      || read_parallel_str(f, &ti->checker_stats_str) < 0
+      || read_parallel_str(f, &ti->checker_token) < 0
+      || read_parallel_file(f, &ti->input) < 0
+      || read_parallel_file(f, &ti->output) < 0
+      || read_parallel_file(f, &ti->correct) < 0
+      || read_parallel_file(f, &ti->error) < 0
+      || read_parallel_file(f, &ti->chk_out) < 0
+      || read_parallel_file(f, &ti->test_checker) < 0) {
+    err("%s: unexpected EOF in '%s'", __FUNCTION__, path);
+    free_parallel_result(res);
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+  return 0;
+}
+
+static void
+make_parallel_result_path(
+        unsigned char *buf,
+        size_t size,
+        const struct section_global_data *global,
+        int test_num)
+{
+  snprintf(buf, size, "%s/parallel_%d.bin", global->run_work_dir, test_num);
+}
+
+/* runs a single test in the child process and exits */
+static void
+run_parallel_test_child(
+        const struct ejudge_cfg *config,
+        serve_state_t state,
+        const struct super_run_in_packet *srp,
+        const struct section_tester_data *tst,
+        const struct parallel_test_slot *slot,
+        const unsigned char *exe_name,
+        const unsigned char *report_path,
+        const unsigned char *check_cmd,
+        char **start_env,
+        int open_tests_count,
+        const int *open_tests_val,
+        int test_score_count,
+        const int *test_score_val,
+        long long expected_free_space,
+        int utf8_mode,
+        const unsigned char *mirror_dir,
+        const struct remap_spec *remaps,
+        const unsigned char *src_path,
+        const unsigned char *test_dir,
+        const unsigned char *corr_dir,
+        const unsigned char *info_dir,
+        const unsigned char *tgz_dir)
+{
+  const struct super_run_in_global_packet *srgp = srp->global;
+  struct parallel_test_result res;
+  struct run_test_info_vector tv;
+  unsigned char result_path[PATH_MAX];
+  cpu_set_t cs;
+  int cur_test = slot->test_num;
+
+  CPU_ZERO(&cs);
+  CPU_SET(slot->cpu, &cs);
+  if (sched_setaffinity(0, sizeof(cs), &cs) < 0) {
+    err("%s: sched_setaffinity to CPU %d failed: %s", __FUNCTION__,
+        slot->cpu, os_ErrorMsg());
+  }
+
+  memset(&res, 0, sizeof(res));
+  res.report_time_limit_ms = -1;
+  res.report_real_time_limit_ms = -1;
+
+  // the test info is stored at index cur_test, as in the common vector
+  memset(&tv, 0, sizeof(tv));
+  tv.reserved = cur_test + 1;
+  XCALLOC(tv.data, tv.reserved);
+  tv.size = cur_test;
+
+  int tl_retry = 0;
+  int tl_retry_count = srgp->time_limit_retry_count;
+  if (tl_retry_count <= 0) tl_retry_count = 1;
+
+  while (1) {
+    res.status = run_one_test(config, state, srp, tst,
+                              NULL,
+                              cur_test, &tv,
+                              NULL, exe_name, report_path, check_cmd,
+                              NULL, start_env,
+                              open_tests_count, open_tests_val,
+                              test_score_count, test_score_val,
+                              expected_free_space,
+                              &res.has_real_time, &res.has_max_memory_used,
+                              &res.has_max_rss,
+                              &res.report_time_limit_ms,
+                              &res.report_real_time_limit_ms,
+                              utf8_mode,
+                              mirror_dir, remaps,
+                              0, NULL, 0,
+                              src_path,
+                              test_dir,
+                              corr_dir,
+                              info_dir,
+                              tgz_dir,
+                              slot->check_dir);
+    if (res.status != RUN_TIME_LIMIT_ERR
+        && res.status != RUN_WALL_TIME_LIMIT_ERR)
+      break;
+    if (++tl_retry >= tl_retry_count) break;
+    info("test failed due to TL, do it again");
+    --tv.size;
+  }
+
+  if (tv.size > cur_test) {
+    res.info = tv.data[cur_test];
+  }
+
+  make_parallel_result_path(result_path, sizeof(result_path),
+                            state->global, cur_test);
+  if (write_parallel_result(result_path, &res) < 0) {
+    _exit(1);
+  }
+  _exit(0);
+}
+
+/*
+ * waits for the completion of one of the testing processes of the slots,
+ * the other children of the process belong to the caller and are not
+ * reaped here, returns the pid of the completed process or -1
+ */
+static pid_t
+wait_parallel_slot(
+        const struct parallel_test_slot *slots,
+        int slot_count,
+        int *p_wstat)
+{
+  while (1) {
+    siginfo_t si;
+    memset(&si, 0, sizeof(si));
+    if (waitid(P_ALL, 0, &si, WEXITED | WNOWAIT) < 0) return -1;
+    for (int i = 0; i < slot_count; ++i) {
+      if (slots[i].pid > 0 && slots[i].pid == si.si_pid) {
+        return waitpid(si.si_pid, p_wstat, 0);
+      }
+    }
+    // some other child is completed, it is left as is, so
+    // the testing processes are polled until it is reaped by the caller
+    for (int i = 0; i < slot_count; ++i) {
+      if (slots[i].pid <= 0) continue;
+      pid_t pid = waitpid(slots[i].pid, p_wstat, WNOHANG);
+      if (pid != 0) return pid;
+    }
+    usleep(10000);
+  }
+}
+
+/*
+ * runs tests starting from tests->size concurrently in slot_count slots,
+ * the results are merged into tests in the test order, the same way
+ * as the sequential loop in run_tests does, if the testing stops on
+ * the first failed test, the results of the tests run speculatively
+ * after the failed test are discarded,
+ * returns the status of the last test as the sequential loop does,
+ * or -1, if the parallel testing failed to start
+ */
+static int
+run_tests_parallel(
+        const struct ejudge_cfg *config,
+        serve_state_t state,
+        const struct super_run_in_packet *srp,
+        const struct section_tester_data *tst,
+        int slot_count,
+        const int *cpus,
+        const unsigned char *base_check_dir,
+        struct run_test_info_vector *tests,
+        const unsigned char *exe_name,
+        const unsigned char *report_path,
+        const unsigned char *messages_path,
+        const unsigned char *check_cmd,
+        char **start_env,
+        int open_tests_count,
+        const int *open_tests_val,
+        int test_score_count,
+        const int *test_score_val,
+        long long expected_free_space,
+        int *p_has_real_time,
+        int *p_has_max_memory_used,
+        int *p_has_max_rss,
+        long *p_report_time_limit_ms,
+        long *p_report_real_time_limit_ms,
+        int *p_tests_passed,
+        int utf8_mode,
+        const unsigned char *mirror_dir,
+        const struct remap_spec *remaps,
+        struct run_listener *listener,
+        const unsigned char *src_path,
+        const unsigned char *test_dir,
+        const unsigned char *corr_dir,
+        const unsigned char *info_dir,
+        const unsigned char *tgz_dir)
+{
+  const struct section_global_data *global = state->global;
+  const struct super_run_in_global_packet *srgp = srp->global;
+  const struct super_run_in_problem_packet *srpp = srp->problem;
+
+  struct parallel_test_slot *slots = NULL;
+  struct parallel_test_entry *entries = NULL;
+  int entries_size = 0;
+  int next_test = tests->size;  // the next test to start
+  int merge_test = tests->size; // the next test to merge
+  int end_test = 0;             // the first nonexisting test, if known
+  int running = 0;
+  int stopped = 0;
+  int skip_rest = 0;
+  int status = RUN_OK;
+  int test_limit = 0;
+  struct stat stb;
+  mode_t dir_mode = 0755;
+
+  if (srgp->scoring_system_val == SCORE_OLYMPIAD && srgp->accepting_mode) {
+    test_limit = srpp->tests_to_accept;
+    if (test_limit <= 0) return RUN_OK;
+  }
+
+  if (stat(base_check_dir, &stb) >= 0) {
+    dir_mode = stb.st_mode & 07777;
+  }
+
+  XCALLOC(slots, slot_count);
+  for (int i = 0; i < slot_count; ++i) {
+    struct parallel_test_slot *slot = &slots[i];
+    slot->cpu = cpus[i];
+    snprintf(slot->check_dir, sizeof(slot->check_dir), "%s/slot_%d",
+             base_check_dir, i);
+    if (mkdir(slot->check_dir, dir_mode) < 0 && errno != EEXIST) {
+      append_msg_to_log(messages_path, "mkdir '%s' failed: %s",
+                        slot->check_dir, os_ErrorMsg());
+      goto fail;
+    }
+    chmod(slot->check_dir, dir_mode);
+  }
+
+  while (1) {
+    // merge the completed tests in the test order
+    while (!stopped && merge_test < next_test
+           && entries[merge_test].state == PARALLEL_TEST_DONE) {
+      struct parallel_test_result *res = &entries[merge_test].res;
+      if (res->status < 0) {
+        status = RUN_OK;
+        stopped = 1;
+        break;
+      }
+
+      if (tests->size >= tests->reserved) {
+        tests->reserved *= 2;
+        if (!tests->reserved) tests->reserved = 32;
+        tests->data = (typeof(tests->data)) xrealloc(tests->data, tests->reserved * sizeof(tests->data[0]));
+      }
+      ASSERT(tests->size == merge_test);
+      tests->data[merge_test] = res->info;
+      ++tests->size;
+      status = res->status;
+      if (res->has_real_time) *p_has_real_time = 1;
+      if (res->has_max_memory_used) *p_has_max_memory_used = 1;
+      if (res->has_max_rss) *p_has_max_rss = 1;
+      if (res->report_time_limit_ms >= 0)
+        *p_report_time_limit_ms = res->report_time_limit_ms;
+      if (res->report_real_time_limit_ms >= 0)
+        *p_report_real_time_limit_ms = res->report_real_time_limit_ms;
+      memset(res, 0, sizeof(*res));
+      ++merge_test;
+
+      if (status == RUN_OK) ++*p_tests_passed;
+      if (status > 0) {
+        if (srgp->scoring_system_val == SCORE_ACM
+            || srgp->scoring_system_val == SCORE_MOSCOW
+            || (srgp->scoring_system_val == SCORE_OLYMPIAD
+                && srgp->accepting_mode && !srpp->accept_partial)) {
+          stopped = 1;
+        } else if (srgp->scoring_system_val == SCORE_KIROV
+                   && srpp->stop_on_first_fail > 0) {
+          stopped = 1;
+          skip_rest = 1;
+        }
+      }
+      if (test_limit > 0 && merge_test > test_limit) {
+        stopped = 1;
+      }
+    }
+    if (stopped) break;
+
+    // start new tests in the free slots
+    for (int i = 0; i < slot_count; ++i) {
+      struct parallel_test_slot *slot = &slots[i];
+      if (slot->pid > 0) continue;
+      if (end_test > 0 && next_test >= end_test) break;
+      if (test_limit > 0 && next_test > test_limit) break;
+
+      if (next_test >= entries_size) {
+        int new_size = entries_size * 2;
+        if (!new_size) new_size = 32;
+        while (new_size <= next_test) new_size *= 2;
+        XREALLOC(entries, new_size);
+        memset(&entries[entries_size], 0,
+               (new_size - entries_size) * sizeof(entries[0]));
+        entries_size = new_size;
+      }
+
+      if (listener && listener->ops && listener->ops->before_test) {
+        listener->ops->before_test(listener, next_test);
+      }
+
+      slot->test_num = next_test;
+      pid_t pid = fork();
+      if (pid < 0) {
+        append_msg_to_log(messages_path, "fork() failed: %s", os_ErrorMsg());
+        slot->test_num = 0;
+        goto fail;
+      }
+      if (!pid) {
+        run_parallel_test_child(config, state, srp, tst, slot,
+                                exe_name, report_path, check_cmd,
+                                start_env,
+                                open_tests_count, open_tests_val,
+                                test_score_count, test_score_val,
+                                expected_free_space,
+                                utf8_mode, mirror_dir, remaps,
+                                src_path, test_dir, corr_dir, info_dir,
+                                tgz_dir);
+        _exit(1);
+      }
+      slot->pid = pid;
+      entries[next_test].state = PARALLEL_TEST_RUNNING;
+      ++next_test;
+      ++running;
+    }
+
+    // all the started tests are merged, and nothing more to start
+    if (!running) break;
+
+    int wstat = 0;
+    pid_t pid = wait_parallel_slot(slots, slot_count, &wstat);
+    if (pid < 0) {
+      if (errno == EINTR) continue;
+      append_msg_to_log(messages_path, "waitpid() failed: %s", os_ErrorMsg());
+      goto fail;
+    }
+    int i;
+    for (i = 0; i < slot_count && slots[i].pid != pid; ++i) {}
+    if (i >= slot_count) continue;
+
+    struct parallel_test_slot *slot = &slots[i];
+    struct parallel_test_entry *entry = &entries[slot->test_num];
+    unsigned char result_path[PATH_MAX];
+    make_parallel_result_path(result_path, sizeof(result_path),
+                              global, slot->test_num);
+    if (!WIFEXITED(wstat) || WEXITSTATUS(wstat) != 0
+        || read_parallel_result(result_path, &entry->res) < 0) {
+      append_msg_to_log(messages_path, "test %d: testing process failed",
+                        slot->test_num);
+      memset(&entry->res, 0, sizeof(entry->res));
+      entry->res.status = RUN_CHECK_FAILED;
+      entry->res.info.status = RUN_CHECK_FAILED;
+      entry->res.info.user_status = -1;
+      entry->res.info.user_score = -1;
+      entry->res.info.user_nominal_score = -1;
+      entry->res.report_time_limit_ms = -1;
+      entry->res.report_real_time_limit_ms = -1;
+    }
+    unlink(result_path);
+    if (entry->res.status < 0 && (!end_test || slot->test_num < end_test)) {
+      end_test = slot->test_num;
+    }
+    entry->state = PARALLEL_TEST_DONE;
+    slot->pid = 0;
+    slot->test_num = 0;
+    --running;
+  }
+
+  if (skip_rest) {
+    int cur_test = merge_test;
+    while (does_test_exist(config, state, srp, srpp->test_dir, cur_test)) {
+      append_skipped_test(srpp, cur_test, tests,
+                          open_tests_count, open_tests_val,
+                          test_score_count, test_score_val);
+      ++cur_test;
+    }
+  }
+
+cleanup:
+  // the speculatively started tests are let to complete, their results
+  // are discarded
+  for (int i = 0; i < slot_count; ++i) {
+    struct parallel_test_slot *slot = &slots[i];
+    if (slot->pid > 0) {
+      int wstat = 0;
+      while (waitpid(slot->pid, &wstat, 0) < 0 && errno == EINTR) {}
+      unsigned char result_path[PATH_MAX];
+      make_parallel_result_path(result_path, sizeof(result_path),
+                                global, slot->test_num);
+      unlink(result_path);
+    }
+    if (slot->check_dir[0]) {
+      remove_directory_recursively(slot->check_dir, 0);
+    }
+  }
+  for (int i = 0; i < entries_size; ++i) {
+    free_parallel_result(&entries[i].res);
+  }
+  xfree(entries);
+  xfree(slots);
+  return status;
+
+fail:
+  status = -1;
+  goto cleanup;
+}
+#endif
+
 void
 run_tests(
         const struct ejudge_cfg *config,
@@ -5611,6 +6308,40 @@ run_tests(
   }
 #endif
 
+#ifndef __WIN32__
+  // without containers all the slots run as the same 'ejexec' user,
+  // so enable_kill_all in one slot would kill the others
+  if (srpp->parallel_tests > 1 && !user_input_mode && !valuer_tsk
+      && !agent && !far && !interactor_cmd
+      && !(tst && tst->nwrun_spool_dir && tst->nwrun_spool_dir[0])
+      && !(srgp->enable_container <= 0 && srgp->suid_run > 0
+           && srpp->enable_kill_all > 0)) {
+    int *cpus = NULL;
+    int slot_count = get_parallel_test_cpus(srpp->parallel_tests, &cpus);
+    if (slot_count > 1) {
+      status = run_tests_parallel(config, state, srp, tst,
+                                  slot_count, cpus, check_dir,
+                                  &tests, exe_name, report_path,
+                                  messages_path, check_cmd, start_env,
+                                  open_tests_count, open_tests_val,
+                                  test_score_count, test_score_val,
+                                  expected_free_space,
+                                  &has_real_time, &has_max_memory_used,
+                                  &has_max_rss,
+                                  &report_time_limit_ms,
+                                  &report_real_time_limit_ms,
+                                  &tests_passed,
+                                  utf8_mode, mirror_dir, remaps, listener,
+                                  src_path, test_dir, corr_dir, info_dir,
+                                  tgz_dir);
+      xfree(cpus);
+      if (status < 0) goto check_failed;
+      goto testing_completed;
+    }
+    xfree(cpus);
+  }
+#endif
+
   while (1) {
     ++cur_test;
     if (srgp->scoring_system_val == SCORE_OLYMPIAD
@@ -5646,7 +6377,8 @@ run_tests(
                             test_dir,
                             corr_dir,
                             info_dir,
-                            tgz_dir);
+                            tgz_dir,
+                            NULL);
       if (status != RUN_TIME_LIMIT_ERR && status != RUN_WALL_TIME_LIMIT_ERR)
         break;
       if (++tl_retry >= tl_retry_count) break;
@@ -5774,6 +6506,9 @@ run_tests(
     close(vefds[0]); vefds[0] = -1;
   }
 
+#ifndef __WIN32__
+testing_completed:;
+#endif
   /* TESTING COMPLETED */
   get_current_time(&reply_pkt->ts6, &reply_pkt->ts6_us);
 
@@ -6034,6 +6769,7 @@ done:;
   }
 
   if (far) full_archive_close(far);
+  task_CloseContainerTemplate();
   free_testinfo_vector(&tests);
   xfree(open_tests_val);
   xfree(test_score_val);
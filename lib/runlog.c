@@ -97,6 +97,17 @@ static int update_user_flags(runlog_state_t state);
 static void build_indices(runlog_state_t state, int flags);
 static void extend_run_extras(runlog_state_t state);
 static void run_drop_uuid_hash(runlog_state_t state);
+static void drop_user_prob_hash(runlog_state_t state);
+static void reset_user_prob_entries(runlog_state_t state, int user_id);
+static void append_to_user_prob_index(runlog_state_t state, int run_id);
+static void append_to_prob_index(runlog_state_t state, int run_id);
+static void build_prob_index(runlog_state_t state);
+static struct user_prob_run_index_entry *
+find_user_prob_entry(
+        runlog_state_t state,
+        int user_id,
+        int prob_id,
+        int create_flag);
 static int
 find_free_uuid_hash_index(
     runlog_state_t state,
@@ -117,6 +128,33 @@ run_get_last_update_time_us(runlog_state_t state)
   return state->last_update_time_us;
 }
 
+/* record the change of run_id, run_id < 0 means a change that cannot be tracked per run */
+static void
+note_run_change(runlog_state_t state, int run_id)
+{
+  if (!state->change_queue) {
+    XCALLOC(state->change_queue, RUNLOG_CHANGE_QUEUE_SIZE);
+  }
+  ++state->change_serial;
+  if (run_id < 0) run_id = -1;
+  state->change_queue[state->change_serial % RUNLOG_CHANGE_QUEUE_SIZE] = run_id;
+}
+
+long long
+run_get_change_serial(runlog_state_t state)
+{
+  return state->change_serial;
+}
+
+int
+run_get_changed_run_id(runlog_state_t state, long long serial)
+{
+  if (serial <= 0 || serial > state->change_serial) return -1;
+  if (state->change_serial - serial >= RUNLOG_CHANGE_QUEUE_SIZE) return -1;
+  if (!state->change_queue) return -1;
+  return state->change_queue[serial % RUNLOG_CHANGE_QUEUE_SIZE];
+}
+
 runlog_state_t
 run_init(teamdb_state_t ts)
 {
@@ -142,8 +180,12 @@ run_destroy(runlog_state_t state)
 
   xfree(state->user_flags.flags);
   xfree(state->run_extras);
+  xfree(state->change_queue);
+  xfree(state->hot_runs);
 
   run_drop_uuid_hash(state);
+  drop_user_prob_hash(state);
+  xfree(state->prob_index);
 
   xfree(state->urh.umap);
   xfree(state->urh.infos);
@@ -166,6 +208,7 @@ run_set_runlog(
     return -1;
 
   touch_last_update_time_us(state);
+  note_run_change(state, -1);
 
   if (state->iface->set_runlog(state->cnts, id_offset, total_entries, entries) < 0)
     return -1;
@@ -514,8 +557,14 @@ run_add_record(
       state->run_extras[urh->run_id_last - state->run_extra_f].next_user_id = i;
     }
     urh->run_id_last = i;
+    append_to_user_prob_index(state, i);
+    if (state->prob_index_valid) {
+      append_to_prob_index(state, i);
+    }
+    note_run_change(state, i);
   } else {
     // inserting somewhere in the middle
+    note_run_change(state, -1);
     run_rebuild_user_run_index(state, team);
     for (int j = i + 1; j < state->run_u; ++j) {
       int uu = state->runs[j - state->run_f].user_id;
@@ -546,6 +595,7 @@ int
 run_undo_add_record(runlog_state_t state, int run_id)
 {
   touch_last_update_time_us(state);
+  note_run_change(state, -1);
 
   if (run_id < state->run_f || run_id >= state->run_u) {
     err("run_undo_add_record: invalid run_id");
@@ -566,6 +616,7 @@ run_undo_add_record(runlog_state_t state, int run_id)
     state->uuid_hash_last_added_index = -1;
   }
   int result = state->iface->undo_add_entry(state->cnts, run_id);
+  state->prob_index_valid = 0;
   if (urh) {
     run_rebuild_user_run_index(state, user_id);
   }
@@ -609,6 +660,7 @@ run_change_status(
     ERR_R("this entry is read-only");
 
   touch_last_update_time_us(state);
+  note_run_change(state, runid);
 
   return state->iface->change_status(state->cnts, runid, newstatus, newtest,
                                      newpassedmode, newscore, judge_id,
@@ -653,6 +705,7 @@ run_change_status_3(
     ERR_R("this entry is read-only");
 
   touch_last_update_time_us(state);
+  note_run_change(state, runid);
 
   return state->iface->change_status_3(state->cnts, /* cntx */
                                        runid,       /* run_id */
@@ -694,6 +747,7 @@ run_change_status_4(
     ERR_R("this entry is read-only");
 
   touch_last_update_time_us(state);
+  note_run_change(state, runid);
 
   return state->iface->change_status_4(state->cnts, runid, newstatus, re);
 }
@@ -718,6 +772,7 @@ run_start_contest(runlog_state_t state, time_t start_time)
   if (state->head.start_time) ERR_R("Contest already started");
 
   touch_last_update_time_us(state);
+  note_run_change(state, -1);
 
   return state->iface->start(state->cnts, start_time);
 }
@@ -726,6 +781,7 @@ int
 run_stop_contest(runlog_state_t state, time_t stop_time)
 {
   touch_last_update_time_us(state);
+  note_run_change(state, -1);
 
   return state->iface->stop(state->cnts, stop_time);
 }
@@ -734,6 +790,7 @@ int
 run_set_duration(runlog_state_t state, time_t dur)
 {
   touch_last_update_time_us(state);
+  note_run_change(state, -1);
 
   return state->iface->set_duration(state->cnts, dur);
 }
@@ -742,6 +799,7 @@ int
 run_sched_contest(runlog_state_t state, time_t sched)
 {
   touch_last_update_time_us(state);
+  note_run_change(state, -1);
 
   return state->iface->schedule(state->cnts, sched);
 }
@@ -750,6 +808,7 @@ int
 run_set_finish_time(runlog_state_t state, time_t finish_time)
 {
   touch_last_update_time_us(state);
+  note_run_change(state, -1);
 
   return state->iface->set_finish_time(state->cnts, finish_time);
 }
@@ -895,6 +954,34 @@ run_get_team_usage(
   if (ps) *ps = sz;
 }
 
+/*
+ * iterate over runs of user_id, if prob_id <= 0,
+ * or over runs of (user_id, prob_id) otherwise
+ */
+static int
+user_runs_first(runlog_state_t state, int user_id, int prob_id)
+{
+  if (prob_id > 0) {
+    return run_get_user_prob_first_run_id(state, user_id, prob_id);
+  }
+
+  struct user_run_header_info *urh = run_get_user_run_header(state, user_id, NULL);
+  ASSERT(urh);
+  if (!urh->run_id_valid) {
+    run_rebuild_user_run_index(state, user_id);
+  }
+  return urh->run_id_first;
+}
+
+static inline int
+user_runs_next(runlog_state_t state, int run_id, int prob_id)
+{
+  if (prob_id > 0) {
+    return state->run_extras[run_id - state->run_extra_f].next_user_prob_id;
+  }
+  return state->run_extras[run_id - state->run_extra_f].next_user_id;
+}
+
 int
 run_get_attempts(
         runlog_state_t state,
@@ -913,27 +1000,22 @@ run_get_attempts(
   if (pce_attempts) *pce_attempts = 0;
 
   if (runid < state->run_f || runid >= state->run_u) ERR_R("bad runid: %d", runid);
-  const struct run_entry *sample_re = &state->runs[runid - state->run_f];
+  const struct run_entry_hot *hot = run_get_hot_entries_ptr(state);
+  const struct run_entry_hot *sample_re = &hot[runid];
   if (sample_re->status >= RUN_PSEUDO_FIRST && sample_re->status <= RUN_PSEUDO_LAST) {
     return 0;
   }
 
-  struct user_run_header_info *urh = run_get_user_run_header(state, sample_re->user_id, NULL);
-  ASSERT(urh);
-  if (!urh->run_id_valid){
-    run_rebuild_user_run_index(state, sample_re->user_id);
-  }
-
-  // FIXME: use user_id+prob_id index
+  int first_run_id = run_get_user_prob_first_run_id(state, sample_re->user_id, sample_re->prob_id);
 
-  for (i = urh->run_id_first; i >= state->run_f; i = state->run_extras[i - state->run_extra_f].next_user_id) {
+  for (i = first_run_id; i >= state->run_f; i = state->run_extras[i - state->run_extra_f].next_user_prob_id) {
     ASSERT(i < state->run_u);
-    const struct run_entry *re = &state->runs[i - state->run_f];
+    const struct run_entry_hot *re = &hot[i];
     ASSERT(re->user_id == sample_re->user_id);
+    ASSERT(re->prob_id == sample_re->prob_id);
     if (i >= runid) break;
 
     if (re->status == RUN_VIRTUAL_START || re->status == RUN_VIRTUAL_STOP) continue;
-    if (re->prob_id != sample_re->prob_id) continue;
     if ((re->status == RUN_COMPILE_ERR) && skip_ce_flag) continue;
     if (re->status == RUN_COMPILE_ERR && (ce_penalty > 0 || ce_penalty < -1)) {
       ++cen;
@@ -968,23 +1050,14 @@ int
 run_count_all_attempts(runlog_state_t state, int user_id, int prob_id)
 {
   int i, count = 0;
+  const struct run_entry_hot *hot = run_get_hot_entries_ptr(state);
 
-  struct user_run_header_info *urh = run_get_user_run_header(state, user_id, NULL);
-  ASSERT(urh);
-  if (!urh->run_id_valid) {
-    run_rebuild_user_run_index(state, user_id);
-  }
-
-  // FIXME: use user_id+prob_id index
-
-  for (i = urh->run_id_first; i >= state->run_f; i = state->run_extras[i - state->run_extra_f].next_user_id) {
+  for (i = user_runs_first(state, user_id, prob_id); i >= state->run_f; i = user_runs_next(state, i, prob_id)) {
     ASSERT(i < state->run_u);
-    const struct run_entry *re = &state->runs[i - state->run_f];
+    const struct run_entry_hot *re = &hot[i];
     ASSERT(re->user_id == user_id);
     if (!run_is_normal_or_transient_status(re->status)) continue;
-    if (prob_id <= 0 || re->prob_id == prob_id) {
-      ++count;
-    }
+    ++count;
   }
   ASSERT(i == -1);
 
@@ -995,22 +1068,15 @@ int
 run_count_all_attempts_2(runlog_state_t state, int user_id, int prob_id, int ignored_set)
 {
   int i, count = 0;
+  const struct run_entry_hot *hot = run_get_hot_entries_ptr(state);
 
-  struct user_run_header_info *urh = run_get_user_run_header(state, user_id, NULL);
-  ASSERT(urh);
-  if (!urh->run_id_valid) {
-    run_rebuild_user_run_index(state, user_id);
-  }
-
-  for (i = urh->run_id_first; i >= state->run_f; i = state->run_extras[i - state->run_extra_f].next_user_id) {
+  for (i = user_runs_first(state, user_id, prob_id); i >= state->run_f; i = user_runs_next(state, i, prob_id)) {
     ASSERT(i < state->run_u);
-    const struct run_entry *re = &state->runs[i - state->run_f];
+    const struct run_entry_hot *re = &hot[i];
     ASSERT(re->user_id == user_id);
     if (!run_is_normal_or_transient_status(re->status)) continue;
     if (run_is_normal_status(re->status) && ((1 << re->status) & ignored_set)) continue;
-    if (prob_id <= 0 || re->prob_id == prob_id) {
-      ++count;
-    }
+    ++count;
   }
   ASSERT(i == -1);
 
@@ -1022,18 +1088,14 @@ run_count_all_attempts_3(runlog_state_t state, int user_id, int prob_id)
 {
   int i, count = 0;
 
-  struct user_run_header_info *urh = run_get_user_run_header(state, user_id, NULL);
-  ASSERT(urh);
-  if (!urh->run_id_valid) {
-    run_rebuild_user_run_index(state, user_id);
-  }
+  if (prob_id <= 0) return 0;
+  const struct run_entry_hot *hot = run_get_hot_entries_ptr(state);
 
-  for (i = urh->run_id_first; i >= state->run_f; i = state->run_extras[i - state->run_extra_f].next_user_id) {
+  for (i = user_runs_first(state, user_id, prob_id); i >= state->run_f; i = user_runs_next(state, i, prob_id)) {
     ASSERT(i < state->run_u);
-    const struct run_entry *re = &state->runs[i - state->run_f];
+    const struct run_entry_hot *re = &hot[i];
     ASSERT(re->user_id == user_id);
-    if (re->prob_id == prob_id
-        && re->status >= RUN_TRANSIENT_FIRST && re->status <= RUN_TRANSIENT_LAST)
+    if (re->status >= RUN_TRANSIENT_FIRST && re->status <= RUN_TRANSIENT_LAST)
       ++count;
   }
   ASSERT(i == -1);
@@ -1046,19 +1108,11 @@ run_count_tokens(runlog_state_t state, int user_id, int prob_id)
 {
   int i, count = 0;
 
-  struct user_run_header_info *urh = run_get_user_run_header(state, user_id, NULL);
-  ASSERT(urh);
-  if (!urh->run_id_valid) {
-    run_rebuild_user_run_index(state, user_id);
-  }
-
-  for (i = urh->run_id_first; i >= state->run_f; i = state->run_extras[i - state->run_extra_f].next_user_id) {
+  for (i = user_runs_first(state, user_id, prob_id); i >= state->run_f; i = user_runs_next(state, i, prob_id)) {
     ASSERT(i < state->run_u);
     const struct run_entry *re = &state->runs[i - state->run_f];
     ASSERT(re->user_id == user_id);
-    if (prob_id <= 0 || re->prob_id == prob_id) {
-      count += re->token_count;
-    }
+    count += re->token_count;
   }
   ASSERT(i == -1);
 
@@ -1096,11 +1150,12 @@ run_get_prev_successes(runlog_state_t state, int run_id)
     return RUN_TOO_MANY;
 
   XALLOCAZ(has_success, state->user_flags.nuser);
-  for (i = state->run_f; i < run_id; i++) {
+  int prob_id = state->runs[run_id - state->run_f].prob_id;
+  for (i = run_get_prob_first_run_id(state, prob_id); i >= state->run_f && i < run_id; i = state->run_extras[i - state->run_extra_f].next_prob_id) {
     int i_off = i - state->run_f;
+    ASSERT(state->runs[i_off].prob_id == prob_id);
     if (state->runs[i_off].status != RUN_OK) continue;
     if (state->runs[i_off].is_hidden) continue;
-    if (state->runs[i_off].prob_id != state->runs[run_id - state->run_f].prob_id) continue;
     cur_uid = state->runs[i_off].user_id;
     if (cur_uid <= 0 || cur_uid >= state->user_flags.nuser
         || state->user_flags.flags[cur_uid] < 0
@@ -1166,6 +1221,12 @@ run_reset(
   state->run_extra_a = 0;
   state->run_extra_f = 0;
 
+  drop_user_prob_hash(state);
+  xfree(state->prob_index);
+  state->prob_index = NULL;
+  state->prob_index_size = 0;
+  state->prob_index_valid = 0;
+
   xfree(state->urh.umap);
   xfree(state->urh.infos);
   state->urh.low_user_id = 0;
@@ -1178,6 +1239,7 @@ run_reset(
   run_drop_uuid_hash(state);
 
   touch_last_update_time_us(state);
+  note_run_change(state, -1);
 
   return state->iface->reset(state->cnts, init_duration, init_sched_time,
                              init_finish_time);
@@ -1198,12 +1260,11 @@ run_check_duplicate(runlog_state_t state, int run_id)
     run_rebuild_user_run_index(state, p->user_id);
   }
 
-  // FIXME: use user_id+prob_id index
-
-  for (i = state->run_extras[run_id - state->run_extra_f].prev_user_id; i >= state->run_f; i = state->run_extras[i - state->run_extra_f].prev_user_id) {
+  for (i = state->run_extras[run_id - state->run_extra_f].prev_user_prob_id; i >= state->run_f; i = state->run_extras[i - state->run_extra_f].prev_user_prob_id) {
     ASSERT(i < state->run_u);
     q = &state->runs[i - state->run_f];
     ASSERT(q->user_id == p->user_id);
+    ASSERT(q->prob_id == p->prob_id);
     if (q->status == RUN_VIRTUAL_START || q->status == RUN_VIRTUAL_STOP)
       continue;
     if (p->size == q->size
@@ -1222,6 +1283,8 @@ run_check_duplicate(runlog_state_t state, int run_id)
   ASSERT(i >= -1);
 
   if (i < 0) return 0;
+  touch_last_update_time_us(state);
+  note_run_change(state, run_id);
   if (state->iface->set_status(state->cnts, run_id, RUN_IGNORED) < 0)
     return -1;
   return i + 1;
@@ -1248,15 +1311,17 @@ run_find_duplicate(
     run_rebuild_user_run_index(state, user_id);
   }
 
-  // FIXME: use user_id+prob_id index
+  const struct user_prob_run_index_entry *upe = find_user_prob_entry(state, user_id, prob_id, 0);
+  if (!upe) return -1;
 
-  for (i = urh->run_id_last; i >= state->run_f; i = state->run_extras[i - state->run_extra_f].prev_user_id) {
+  for (i = upe->run_id_last; i >= state->run_f; i = state->run_extras[i - state->run_extra_f].prev_user_prob_id) {
     ASSERT(i < state->run_u);
     q = &state->runs[i - state->run_f];
     ASSERT(q->user_id == user_id);
+    ASSERT(q->prob_id == prob_id);
     if (q->status == RUN_VIRTUAL_START || q->status == RUN_VIRTUAL_STOP)
       continue;
-    if (q->prob_id == prob_id && q->variant == variant) {
+    if (q->variant == variant) {
       if (q->lang_id == lang_id
           && q->size == size
           && q->h.sha1[0] == sha1[0]
@@ -1321,19 +1386,15 @@ run_get_ok_and_reject_count(
   int i;
   const struct run_entry *q;
 
-  struct user_run_header_info *urh = run_get_user_run_header(state, user_id, NULL);
-  ASSERT(urh);
-  if (!urh->run_id_valid) {
-    run_rebuild_user_run_index(state, user_id);
-  }
+  if (prob_id <= 0) return;
 
-  for (i = urh->run_id_first; i >= state->run_f; i = state->run_extras[i - state->run_extra_f].next_user_id) {
+  for (i = run_get_user_prob_first_run_id(state, user_id, prob_id); i >= state->run_f; i = state->run_extras[i - state->run_extra_f].next_user_prob_id) {
     ASSERT(i < state->run_u);
     q = &state->runs[i - state->run_f];
     ASSERT(q->user_id == user_id);
-    if (q->status == RUN_OK && q->prob_id == prob_id) {
+    if (q->status == RUN_OK) {
       ++*p_ok_count;
-    } else if (q->status == RUN_REJECTED && q->prob_id == prob_id) {
+    } else if (q->status == RUN_REJECTED) {
       ++*p_rejected_count;
     }
   }
@@ -1359,6 +1420,106 @@ run_get_entries_ptr(runlog_state_t state)
   //return state->runs;
 }
 
+static inline int
+is_transient_status(int status)
+{
+  return status >= RUN_TRANSIENT_FIRST && status <= RUN_TRANSIENT_LAST;
+}
+
+static void
+copy_hot_entry(struct run_entry_hot *dst, const struct run_entry *src)
+{
+  dst->time = src->time;
+  dst->nsec = src->nsec;
+  dst->user_id = src->user_id;
+  dst->prob_id = src->prob_id;
+  dst->lang_id = src->lang_id;
+  dst->score = src->score;
+  dst->test = src->test;
+  dst->status = src->status;
+  dst->is_hidden = src->is_hidden;
+  dst->is_imported = src->is_imported;
+  dst->is_readonly = src->is_readonly;
+  dst->is_marked = src->is_marked;
+  dst->is_saved = src->is_saved;
+  dst->_pad = 0;
+}
+
+/* copy the runs from hot_u up to run_u */
+static void
+extend_hot_runs(runlog_state_t state)
+{
+  int count = state->run_u - state->run_f;
+
+  if (count > state->hot_a) {
+    int new_a = state->hot_a;
+    if (!new_a) new_a = 128;
+    while (count > new_a) new_a *= 2;
+    XREALLOC(state->hot_runs, new_a);
+    state->hot_a = new_a;
+  }
+  for (int i = state->hot_u; i < count; ++i) {
+    copy_hot_entry(&state->hot_runs[i], &state->runs[i]);
+    if (is_transient_status(state->hot_runs[i].status)) ++state->hot_transient;
+  }
+  state->hot_u = count;
+}
+
+static void
+sync_hot_runs(runlog_state_t state)
+{
+  int rebuild = 0;
+
+  if (!state->hot_valid
+      || state->hot_f != state->run_f
+      || state->hot_u > state->run_u - state->run_f
+      || state->change_serial - state->hot_serial >= RUNLOG_CHANGE_QUEUE_SIZE
+      || (state->change_serial > state->hot_serial && !state->change_queue)) {
+    rebuild = 1;
+  } else {
+    for (long long serial = state->hot_serial + 1; serial <= state->change_serial; ++serial) {
+      int run_id = state->change_queue[serial % RUNLOG_CHANGE_QUEUE_SIZE];
+      if (run_id < 0) {
+        rebuild = 1;
+        break;
+      }
+      int off = run_id - state->hot_f;
+      // the runs above hot_u are copied below
+      if (off >= 0 && off < state->hot_u) {
+        if (is_transient_status(state->hot_runs[off].status)) --state->hot_transient;
+        copy_hot_entry(&state->hot_runs[off], &state->runs[off]);
+        if (is_transient_status(state->hot_runs[off].status)) ++state->hot_transient;
+      }
+    }
+  }
+
+  if (rebuild) {
+    state->hot_f = state->run_f;
+    state->hot_u = 0;
+    state->hot_transient = 0;
+  }
+  extend_hot_runs(state);
+  state->hot_valid = 1;
+  state->hot_serial = state->change_serial;
+}
+
+const struct run_entry_hot *
+run_get_hot_entries_ptr(runlog_state_t state)
+{
+  sync_hot_runs(state);
+  // adjusted pointer, so ptr[i] == state->hot_runs[i - state->run_f]
+  return (const struct run_entry_hot *)((uintptr_t) state->hot_runs - (uintptr_t) state->run_f * sizeof(state->hot_runs[0]));
+}
+
+/* the number of runs being compiled or tested, maintained along
+   with the hot copy, so the run lists need not scan the whole log */
+int
+run_get_transient_count(runlog_state_t state)
+{
+  sync_hot_runs(state);
+  return state->hot_transient;
+}
+
 int
 run_get_entry(runlog_state_t state, int run_id, struct run_entry *out)
 {
@@ -1380,6 +1541,7 @@ run_set_entry(
   int f = 0;
   time_t stop_time;
   int old_user_id = 0;
+  int old_prob_id = 0;
 
   touch_last_update_time_us(state);
 
@@ -1413,6 +1575,7 @@ run_set_entry(
   /* blindly update all fields */
   memcpy(&te, out, sizeof(te));
   old_user_id = out->user_id;
+  old_prob_id = out->prob_id;
   if ((mask & RE_STATUS) && te.status != in->status) {
     te.status = in->status;
     f = 1;
@@ -1648,7 +1811,17 @@ run_set_entry(
   if (!f) return 0;
 
   if (state->iface->set_entry(state->cnts, run_id, &te, mask, ure) < 0) return -1;
+  if (te.user_id != old_user_id || te.prob_id != old_prob_id) {
+    note_run_change(state, -1);
+  } else {
+    note_run_change(state, run_id);
+  }
   int new_user_id = state->runs[run_id - state->run_f].user_id;
+  int new_prob_id = state->runs[run_id - state->run_f].prob_id;
+  if (new_prob_id != old_prob_id) {
+    // the run moves to another per-problem list
+    state->prob_index_valid = 0;
+  }
   if (new_user_id != old_user_id) {
     struct user_run_header_info *urh = NULL;
 
@@ -1658,6 +1831,11 @@ run_set_entry(
     if ((urh = run_try_user_run_header(state, new_user_id))) {
       run_rebuild_user_run_index(state, new_user_id);
     }
+  } else if (new_prob_id != old_prob_id) {
+    // (user_id, prob_id) lists are rebuilt together with the user list
+    if (run_try_user_run_header(state, new_user_id)) {
+      run_rebuild_user_run_index(state, new_user_id);
+    }
   }
   return 0;
 }
@@ -1765,6 +1943,7 @@ run_virtual_start(
   }
 
   touch_last_update_time_us(state);
+  note_run_change(state, -1);
 
   if (state->iface->user_run_header_set_start_time) {
     return state->iface->user_run_header_set_start_time(state->cnts, user_id, t, 1, user_id);
@@ -1833,6 +2012,7 @@ run_virtual_stop(
   }
 
   touch_last_update_time_us(state);
+  note_run_change(state, -1);
 
   if (state->iface->user_run_header_set_stop_time) {
     int duration = urh->duration;
@@ -1909,6 +2089,7 @@ run_clear_entry(runlog_state_t state, int run_id)
   struct user_run_header_info *urh = NULL;
 
   touch_last_update_time_us(state);
+  note_run_change(state, -1);
 
   if (run_id < state->run_f || run_id >= state->run_u) ERR_R("bad runid: %d", run_id);
   if (state->runs[run_id - state->run_f].is_readonly) ERR_R("run %d is readonly", run_id);
@@ -1963,6 +2144,7 @@ run_clear_user_entries(
   if (user_id <= 0) return 0;
 
   touch_last_update_time_us(state);
+  note_run_change(state, -1);
 
   for (run_id = state->run_u - 1; run_id >= state->run_f; --run_id) {
     if (state->runs[run_id - state->run_f].user_id == user_id) {
@@ -1980,6 +2162,7 @@ run_forced_clear_entry(runlog_state_t state, int run_id)
   if (run_id < state->run_f || run_id >= state->run_u) ERR_R("bad runid: %d", run_id);
 
   touch_last_update_time_us(state);
+  note_run_change(state, -1);
 
   struct user_run_header_info *urh = run_try_user_run_header(state, state->runs[run_id - state->run_f].user_id);
   if (urh) {
@@ -1989,6 +2172,7 @@ run_forced_clear_entry(runlog_state_t state, int run_id)
   }
   state->max_user_id = -1;
   state->user_count = -1;
+  state->prob_index_valid = 0;
 
   return state->iface->clear_entry(state->cnts, run_id);
 }
@@ -2001,6 +2185,7 @@ run_set_hidden(
 {
   if (run_id < 0 || run_id >= state->run_u) ERR_R("bad runid: %d", run_id);
   touch_last_update_time_us(state);
+  note_run_change(state, run_id);
   return state->iface->set_hidden(state->cnts, run_id, 1, ure);
 }
 
@@ -2033,6 +2218,8 @@ int
 run_squeeze_log(runlog_state_t state)
 {
   touch_last_update_time_us(state);
+  note_run_change(state, -1);
+  state->prob_index_valid = 0;
   return state->iface->squeeze(state->cnts);
 }
 
@@ -2470,12 +2657,198 @@ build_uuid_hash(
   info("build_uuid_hash: success, size = %d, used = %d, conflicts = %d", hash_size, hash_count, conflicts);
 }
 
+static unsigned
+user_prob_hash_func(int user_id, int prob_id)
+{
+  return (unsigned) user_id * 2654435761U + (unsigned) prob_id * 40503U;
+}
+
+static struct user_prob_run_index_entry *
+find_user_prob_entry(
+        runlog_state_t state,
+        int user_id,
+        int prob_id,
+        int create_flag)
+{
+  if (user_id <= 0) return NULL;
+
+  if (create_flag && 2 * (state->user_prob_hash_used + 1) >= state->user_prob_hash_size) {
+    int new_size = state->user_prob_hash_size * 2;
+    if (!new_size) new_size = 1024;
+    struct user_prob_run_index_entry *new_hash = xcalloc(new_size, sizeof(new_hash[0]));
+    for (int i = 0; i < state->user_prob_hash_size; ++i) {
+      const struct user_prob_run_index_entry *upe = &state->user_prob_hash[i];
+      if (upe->user_id <= 0) continue;
+      int index = user_prob_hash_func(upe->user_id, upe->prob_id) & (new_size - 1);
+      while (new_hash[index].user_id > 0) {
+        index = (index + 1) & (new_size - 1);
+      }
+      new_hash[index] = *upe;
+    }
+    xfree(state->user_prob_hash);
+    state->user_prob_hash = new_hash;
+    state->user_prob_hash_size = new_size;
+  }
+
+  if (state->user_prob_hash_size <= 0) return NULL;
+
+  int index = user_prob_hash_func(user_id, prob_id) & (state->user_prob_hash_size - 1);
+  while (state->user_prob_hash[index].user_id > 0) {
+    struct user_prob_run_index_entry *upe = &state->user_prob_hash[index];
+    if (upe->user_id == user_id && upe->prob_id == prob_id) {
+      return upe;
+    }
+    index = (index + 1) & (state->user_prob_hash_size - 1);
+  }
+  if (!create_flag) return NULL;
+
+  struct user_prob_run_index_entry *upe = &state->user_prob_hash[index];
+  upe->user_id = user_id;
+  upe->prob_id = prob_id;
+  upe->run_id_first = -1;
+  upe->run_id_last = -1;
+  ++state->user_prob_hash_used;
+  return upe;
+}
+
+static void
+reset_user_prob_entries(runlog_state_t state, int user_id)
+{
+  // the entries are never removed from the hash table, only emptied
+  for (int i = 0; i < state->user_prob_hash_size; ++i) {
+    struct user_prob_run_index_entry *upe = &state->user_prob_hash[i];
+    if (upe->user_id == user_id) {
+      upe->run_id_first = -1;
+      upe->run_id_last = -1;
+    }
+  }
+}
+
+static void
+drop_user_prob_hash(runlog_state_t state)
+{
+  state->user_prob_hash_size = 0;
+  state->user_prob_hash_used = 0;
+  xfree(state->user_prob_hash); state->user_prob_hash = NULL;
+}
+
+/* append run_id to the end of its (user_id, prob_id) list */
+static void
+append_to_user_prob_index(runlog_state_t state, int run_id)
+{
+  const struct run_entry *re = &state->runs[run_id - state->run_f];
+  struct run_entry_extra *rex = &state->run_extras[run_id - state->run_extra_f];
+  struct user_prob_run_index_entry *upe = find_user_prob_entry(state, re->user_id, re->prob_id, 1);
+
+  rex->prev_user_prob_id = -1;
+  rex->next_user_prob_id = -1;
+  if (!upe) return;
+
+  rex->prev_user_prob_id = upe->run_id_last;
+  if (upe->run_id_last < 0) {
+    upe->run_id_first = run_id;
+  } else {
+    state->run_extras[upe->run_id_last - state->run_extra_f].next_user_prob_id = run_id;
+  }
+  upe->run_id_last = run_id;
+}
+
+/* append run_id to the end of its prob_id list */
+static void
+append_to_prob_index(runlog_state_t state, int run_id)
+{
+  const struct run_entry *re = &state->runs[run_id - state->run_f];
+  struct run_entry_extra *rex = &state->run_extras[run_id - state->run_extra_f];
+
+  rex->prev_prob_id = -1;
+  rex->next_prob_id = -1;
+  if (re->status == RUN_EMPTY) return;
+  if (re->prob_id <= 0 || re->prob_id > EJ_MAX_PROB_ID) return;
+
+  if (re->prob_id >= state->prob_index_size) {
+    int new_size = state->prob_index_size * 2;
+    if (!new_size) new_size = 32;
+    while (new_size <= re->prob_id) new_size *= 2;
+    XREALLOC(state->prob_index, new_size);
+    for (int i = state->prob_index_size; i < new_size; ++i) {
+      state->prob_index[i].run_id_first = -1;
+      state->prob_index[i].run_id_last = -1;
+    }
+    state->prob_index_size = new_size;
+  }
+
+  struct prob_run_index_entry *pe = &state->prob_index[re->prob_id];
+  rex->prev_prob_id = pe->run_id_last;
+  if (pe->run_id_last < 0) {
+    pe->run_id_first = run_id;
+  } else {
+    state->run_extras[pe->run_id_last - state->run_extra_f].next_prob_id = run_id;
+  }
+  pe->run_id_last = run_id;
+}
+
+static void
+build_prob_index(runlog_state_t state)
+{
+  for (int i = 0; i < state->prob_index_size; ++i) {
+    state->prob_index[i].run_id_first = -1;
+    state->prob_index[i].run_id_last = -1;
+  }
+
+  extend_run_extras(state);
+
+  for (int run_id = state->run_f; run_id < state->run_u; ++run_id) {
+    append_to_prob_index(state, run_id);
+  }
+  state->prob_index_valid = 1;
+}
+
+int
+run_get_prob_first_run_id(runlog_state_t state, int prob_id)
+{
+  if (!state->prob_index_valid) {
+    build_prob_index(state);
+  }
+  if (prob_id <= 0 || prob_id >= state->prob_index_size) return -1;
+  return state->prob_index[prob_id].run_id_first;
+}
+
+int
+run_get_prob_next_run_id(runlog_state_t state, int run_id)
+{
+  if (run_id < state->run_extra_f || run_id >= state->run_extra_u) return -1;
+  return state->run_extras[run_id - state->run_extra_f].next_prob_id;
+}
+
+int
+run_get_user_prob_first_run_id(runlog_state_t state, int user_id, int prob_id)
+{
+  struct user_run_header_info *urh = run_get_user_run_header(state, user_id, NULL);
+  if (!urh) return -1;
+  if (!urh->run_id_valid) {
+    run_rebuild_user_run_index(state, user_id);
+  }
+  const struct user_prob_run_index_entry *upe = find_user_prob_entry(state, user_id, prob_id, 0);
+  if (!upe) return -1;
+  return upe->run_id_first;
+}
+
+int
+run_get_user_prob_next_run_id(runlog_state_t state, int run_id)
+{
+  if (run_id < state->run_extra_f || run_id >= state->run_extra_u) return -1;
+  return state->run_extras[run_id - state->run_extra_f].next_user_prob_id;
+}
+
 static void
 build_indices(runlog_state_t state, int flags)
 {
   int i;
   int max_team_id = -1;
 
+  drop_user_prob_hash(state);
+  state->prob_index_valid = 0;
+
   struct user_run_header_state *urh = &state->urh;
   for (int i = urh->low_user_id; i < urh->high_user_id; ++i) {
     int index = urh->umap[i - urh->low_user_id];
@@ -2497,6 +2870,7 @@ build_indices(runlog_state_t state, int flags)
     if (state->runs[i_off].user_id > max_team_id) max_team_id = state->runs[i_off].user_id;
   }
   if (max_team_id <= 0) {
+    build_prob_index(state);
     if ((flags & RUN_LOG_UUID_INDEX)) {
       build_uuid_hash(state, -1, 0);
     }
@@ -2523,6 +2897,7 @@ build_indices(runlog_state_t state, int flags)
       state->run_extras[urhi->run_id_last - state->run_extra_f].next_user_id = i;
     }
     urhi->run_id_last = i;
+    append_to_user_prob_index(state, i);
 
     if (state->runs[i_off].is_hidden) continue;
     switch (state->runs[i_off].status) {
@@ -2538,6 +2913,8 @@ build_indices(runlog_state_t state, int flags)
     }
   }
 
+  build_prob_index(state);
+
   if ((flags & RUN_LOG_UUID_INDEX)) {
     build_uuid_hash(state, -1, 0);
   }
@@ -2560,6 +2937,7 @@ run_set_pages(
   if (run_id < 0 || run_id >= state->run_u) ERR_R("bad runid: %d", run_id);
   if (pages < 0 || pages > 255) ERR_R("bad pages: %d", pages);
   touch_last_update_time_us(state);
+  note_run_change(state, run_id);
   return state->iface->set_pages(state->cnts, run_id, pages, ure);
 }
 
@@ -2725,6 +3103,7 @@ run_put_entry(
         const struct run_entry *re)
 {
   touch_last_update_time_us(state);
+  note_run_change(state, -1);
   return state->iface->put_entry(state->cnts, re);
 }
 
@@ -2734,6 +3113,7 @@ run_put_header(
         const struct run_header *rh)
 {
   touch_last_update_time_us(state);
+  note_run_change(state, -1);
   return state->iface->put_header(state->cnts, rh);
 }
 
@@ -2872,6 +3252,7 @@ run_clear_index(runlog_state_t state, int run_id)
     urh->run_id_first = -1;
     urh->run_id_last = -1;
   }
+  state->prob_index_valid = 0;
   return 0;
 }
 
@@ -3123,6 +3504,8 @@ run_delete_user_run_header(
   if (user_id >= urh->low_user_id && user_id < urh->high_user_id) {
     urh->umap[user_id - urh->low_user_id] = 0;
   }
+  reset_user_prob_entries(state, user_id);
+  state->prob_index_valid = 0;
 }
 
 int
@@ -3138,6 +3521,7 @@ run_set_user_stop_time(
   }
 
   touch_last_update_time_us(state);
+  note_run_change(state, -1);
 
   return state->iface->user_run_header_set_stop_time(state->cnts, user_id, stop_time, last_change_user_id);
 }
@@ -3150,6 +3534,7 @@ run_set_virtual_is_checked(
         int last_change_user_id)
 {
   touch_last_update_time_us(state);
+  note_run_change(state, -1);
 
   if (state->iface->user_run_header_set_is_checked) {
     return state->iface->user_run_header_set_is_checked(state->cnts, user_id, is_checked, last_change_user_id);
@@ -3180,6 +3565,7 @@ run_set_user_duration(
   }
 
   touch_last_update_time_us(state);
+  note_run_change(state, -1);
 
   return state->iface->user_run_header_set_duration(state->cnts, user_id, duration, last_change_user_id);
 }
@@ -3197,6 +3583,9 @@ run_rebuild_user_run_index(runlog_state_t state, int user_id)
   urhi->run_id_valid = 1;
   urhi->run_id_first = -1;
   urhi->run_id_last = -1;
+  reset_user_prob_entries(state, user_id);
+  // the runs might have been moved or changed, so drop the prob_id index as well
+  state->prob_index_valid = 0;
 
   extend_run_extras(state);
 
@@ -3215,6 +3604,7 @@ run_rebuild_user_run_index(runlog_state_t state, int user_id)
       state->run_extras[urhi->run_id_last - state->run_extra_f].next_user_id = run_id;
     }
     urhi->run_id_last = run_id;
+    append_to_user_prob_index(state, run_id);
   }
 }
 
@@ -3226,6 +3616,7 @@ run_set_run_is_checked(runlog_state_t state, int run_id, int is_checked)
     ERR_R("run_set_is_checked is not implemented");
   } else {
     touch_last_update_time_us(state);
+    note_run_change(state, run_id);
 
     return state->iface->run_set_is_checked(state->cnts, run_id, is_checked);
   }
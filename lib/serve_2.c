@@ -62,6 +62,7 @@
 #include "ejudge/logger.h"
 #include "ejudge/osdeps.h"
 #include "ejudge/exec.h"
+#include "ejudge/report_summary.h"
 
 #include <unistd.h>
 #include <errno.h>
@@ -99,6 +100,18 @@ serve_update_standings_file(
   //run_get_times(state->runlog_state, &start_time, 0, &duration, &stop_time, 0);
 
   if (global->autoupdate_standings <= 0 && force_flag <= 0) return;
+  if (force_flag <= 0 && state->defer_standings_update > 0) {
+    if (state->standings_dirty && metrics.data) {
+      ++metrics.data->standings_coalesced;
+    }
+    state->standings_dirty = 1;
+    return;
+  }
+  state->standings_dirty = 0;
+  state->last_update_standings = state->current_time;
+  if (metrics.data) {
+    ++metrics.data->standings_updates;
+  }
   /*
   while (1) {
     if (global->is_virtual) break;
@@ -181,6 +194,68 @@ serve_update_standings_file(
   */
 }
 
+/* the standings are regenerated immediately when the phase changes */
+static int
+get_standings_phase(serve_state_t state)
+{
+  const struct section_global_data *global = state->global;
+  time_t start_time = 0, duration = 0, stop_time = 0;
+
+  if (global->is_virtual > 0) return 0;
+  run_get_times(state->runlog_state, 0, &start_time, 0, &duration, &stop_time, 0);
+  if (start_time <= 0) return 0;
+  if (stop_time > 0) {
+    if (global->board_fog_time > 0 && duration > 0
+        && state->current_time <= stop_time + global->board_unfog_time)
+      return 2;
+    return 3;
+  }
+  if (global->board_fog_time > 0 && duration > 0
+      && state->current_time >= start_time + duration - global->board_fog_time)
+    return 2;
+  return 1;
+}
+
+/*
+ * regenerate the standings postponed by serve_update_standings_file,
+ * at most once per standings_update_time
+ */
+void
+serve_flush_standings_file(
+        struct contest_extra *extra,
+        serve_state_t state,
+        const struct contest_desc *cnts)
+{
+  const struct section_global_data *global = state->global;
+  int force_flag = 0;
+
+  if (state->defer_standings_update <= 0) {
+    state->defer_standings_update = 1;
+    state->standings_phase = get_standings_phase(state);
+  }
+  if (global->autoupdate_standings <= 0) {
+    state->standings_dirty = 0;
+    return;
+  }
+
+  int phase = get_standings_phase(state);
+  if (phase != state->standings_phase) {
+    state->standings_phase = phase;
+    force_flag = 1;
+  }
+  if (!force_flag) {
+    if (!state->standings_dirty) return;
+    if (global->standings_update_time > 0
+        && state->current_time >= state->last_update_standings
+        && state->current_time < state->last_update_standings + global->standings_update_time)
+      return;
+  }
+
+  state->defer_standings_update = 0;
+  serve_update_standings_file(extra, state, cnts, 0);
+  state->defer_standings_update = 1;
+}
+
 void
 serve_update_public_log_file(
         struct contest_extra *extra,
@@ -620,6 +695,7 @@ do_build_compile_dirs(serve_state_t state,
     XREALLOC(state->compile_dirs, state->compile_dirs_a);
   }
 
+  memset(&state->compile_dirs[state->compile_dirs_u], 0, sizeof(state->compile_dirs[0]));
   state->compile_dirs[state->compile_dirs_u].status_dir = xstrdup(status_dir);
   state->compile_dirs[state->compile_dirs_u].report_dir = xstrdup(report_dir);
   return state->compile_dirs_u++;
@@ -2727,8 +2803,10 @@ serve_run_request(
   srpp->max_file_size = prob->max_file_size;
   srpp->max_open_file_count = prob->max_open_file_count;
   srpp->max_process_count = prob->max_process_count;
+  srpp->parallel_tests = prob->parallel_tests;
   srpp->enable_process_group = prob->enable_process_group;
   srpp->enable_kill_all = prob->enable_kill_all;
+  srpp->readonly_input = prob->readonly_input;
   srgp->testlib_mode = prob->enable_testlib_mode;
   srpp->enable_extended_info = prob->enable_extended_info;
   srpp->stop_on_first_fail = prob->stop_on_first_fail;
@@ -3325,6 +3403,9 @@ notify_submit_update(
   free(jrstr);
 }
 
+void (*serve_run_update_hook)(serve_state_t cs, const struct run_entry *re);
+void (*serve_clar_update_hook)(serve_state_t cs, int clar_id);
+
 void
 serve_notify_run_update(
         const struct ejudge_cfg *config,
@@ -3332,6 +3413,7 @@ serve_notify_run_update(
         const struct run_entry *re)
 {
   if (!re) return;
+  if (serve_run_update_hook) serve_run_update_hook(cs, re);
   if (!re->notify_driver) return;
 
   struct notify_plugin_data *np = notify_plugin_get(config, re->notify_driver);
@@ -3367,6 +3449,16 @@ serve_notify_run_update(
   free(jrstr);
 }
 
+void
+serve_notify_clar_update(
+        const struct ejudge_cfg *config,
+        serve_state_t cs,
+        int clar_id)
+{
+  if (clar_id < 0) return;
+  if (serve_clar_update_hook) serve_clar_update_hook(cs, clar_id);
+}
+
 static void
 read_compile_packet_input(
         struct contest_extra *extra,
@@ -4503,6 +4595,26 @@ done:;
   testing_report_free(tr);
 }
 
+static void
+update_report_summary(
+        serve_state_t state,
+        const struct run_entry *re,
+        const char *rep_text,
+        size_t rep_len)
+{
+  testing_report_xml_t tr = NULL;
+  const unsigned char *start_ptr = NULL;
+
+  if (!state->report_summary_cache) return;
+  if (re->store_flags == STORE_FLAGS_UUID_BSON) {
+    tr = testing_report_parse_bson_data(rep_text, rep_len);
+  } else if (get_content_type(rep_text, &start_ptr) == CONTENT_TYPE_XML) {
+    tr = testing_report_parse_xml(start_ptr);
+  }
+  report_summary_cache_put(state->report_summary_cache, re, tr);
+  testing_report_free(tr);
+}
+
 int
 serve_read_run_packet(
         struct contest_extra *extra,
@@ -4791,6 +4903,7 @@ serve_read_run_packet(
   if (generic_write_file(new_rep_text, new_rep_len, rep_flags, 0, rep_path, 0) < 0) {
     goto failed;
   }
+  update_report_summary(state, &re, new_rep_text, new_rep_len);
 
   if (global->enable_full_archive) {
     full_flags = -1;
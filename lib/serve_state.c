@@ -42,6 +42,7 @@
 #include "ejudge/variant_plugin.h"
 #include "ejudge/submit_plugin.h"
 #include "ejudge/metrics_contest.h"
+#include "ejudge/report_summary.h"
 
 #include "ejudge/xalloc.h"
 #include "ejudge/logger.h"
@@ -124,6 +125,11 @@ serve_state_destroy(
   }
 
   xfree(state->config_path);
+  if (state->standings_cache && state->standings_cache_free) {
+    state->standings_cache_free(state->standings_cache);
+  }
+  state->standings_cache = NULL;
+  state->report_summary_cache = report_summary_cache_free(state->report_summary_cache);
   run_destroy(state->runlog_state);
   if (state->xuser_state) {
     state->xuser_state->vt->close(state->xuser_state);
@@ -920,6 +926,13 @@ serve_state_load_contest(
     state->runlog_state = run_init(state->teamdb_state);
   }
 
+  if (global->var_dir && global->var_dir[0]) {
+    path_t rs_path;
+    snprintf(rs_path, sizeof(rs_path), "%s/report_summary.dat", global->var_dir);
+    // not fatal, the reports are read from the archive then
+    state->report_summary_cache = report_summary_cache_open(rs_path);
+  }
+
   if (clar_open(state->clarlog_state, config, cnts, global, 0, 0) < 0)
     goto failure;
   serve_load_status_file(config, cnts, state);
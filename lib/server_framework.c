@@ -24,6 +24,8 @@
 #include "ejudge/sha.h"
 #include "ejudge/base64.h"
 #include "ejudge/websocket.h"
+#include "ejudge/cgi.h"
+#include "ejudge/ej_limits.h"
 
 #include "ejudge/xalloc.h"
 #include "ejudge/logger.h"
@@ -39,7 +41,7 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <errno.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
 #include <time.h>
 #include <unistd.h>
 #include <netinet/ip.h>
@@ -47,6 +49,7 @@
 #include <arpa/inet.h>
 #include <sys/time.h>
 #include <sys/inotify.h>
+#include <limits.h>
 
 #define MAX_IN_PACKET_SIZE 134217728 /* 128 mb */
 
@@ -107,6 +110,17 @@ struct directory_watch
   int ready;
 };
 
+// readiness flag of a spool directory which is scanned by the caller
+struct spool_watch
+{
+  struct spool_watch *next, *prev;
+  unsigned char *dir;
+  int id;
+  int wd;
+  int refcount;
+  int ready;
+};
+
 struct post_select
 {
   struct post_select *prev, *next;
@@ -125,6 +139,99 @@ struct post_select
   long long update_time_us;
 };
 
+/* what is behind a file descriptor in the epoll set */
+enum
+{
+  POLL_FD_NONE,
+  POLL_FD_SOCKET,     // control socket listener
+  POLL_FD_WS_SOCKET,  // websocket listener
+  POLL_FD_INOTIFY,
+  POLL_FD_WATCH,      // struct watchlist
+  POLL_FD_CLIENT,     // struct ht_client_state
+  POLL_FD_WS_CLIENT,  // struct ws_client_state
+  POLL_FD_FCGI_SOCKET,// FastCGI listener
+  POLL_FD_FCGI_OUT,   // struct ht_client_state, the reply pipe
+};
+
+struct poll_fd
+{
+  int kind;
+  unsigned events;    // events registered in the epoll set, 0 - not registered
+  void *ptr;
+};
+
+/* FastCGI protocol constants, see the FastCGI specification 1.0 */
+enum
+{
+  FCGI_VERSION_1 = 1,
+
+  FCGI_BEGIN_REQUEST = 1,
+  FCGI_ABORT_REQUEST = 2,
+  FCGI_END_REQUEST = 3,
+  FCGI_PARAMS = 4,
+  FCGI_STDIN = 5,
+  FCGI_STDOUT = 6,
+  FCGI_GET_VALUES = 9,
+  FCGI_GET_VALUES_RESULT = 10,
+  FCGI_UNKNOWN_TYPE = 11,
+
+  FCGI_RESPONDER = 1,
+  FCGI_KEEP_CONN = 1,
+
+  FCGI_REQUEST_COMPLETE = 0,
+  FCGI_CANT_MPX_CONN = 1,
+  FCGI_UNKNOWN_ROLE = 3,
+
+  FCGI_HEADER_LEN = 8,
+  FCGI_MAX_CONTENT = 65535,
+};
+
+enum
+{
+  FCGI_MAX_PARAMS_SIZE = 1024 * 1024,
+  FCGI_MAX_ENV_NUM = 10000,
+  // the reply pipe is not read while so much output is pending
+  FCGI_OUT_HIGH_WATER = 1024 * 1024,
+};
+
+struct fcgi_buf
+{
+  unsigned char *data;
+  size_t size;
+  size_t reserved;
+};
+
+/* a connection from the web server, one request at a time */
+struct fcgi_conn
+{
+  int request_id;       // 0 - no request
+  int keep_conn;
+  int params_done;
+  int stdin_done;
+  int too_large;
+  int reply_code;       // the protocol reply of the request handler
+  int out_fd;           // the read end of the reply pipe
+  size_t out_total;
+
+  struct fcgi_buf in;
+  struct fcgi_buf params;
+  struct fcgi_buf body;
+  struct fcgi_buf out;
+  size_t out_pos;
+};
+
+static void
+fcgi_conn_free(struct fcgi_conn *fc)
+{
+  if (!fc) return;
+  if (fc->out_fd >= 0) close(fc->out_fd);
+  xfree(fc->in.data);
+  xfree(fc->params.data);
+  xfree(fc->body.data);
+  xfree(fc->out.data);
+  xfree(fc);
+}
+
 struct server_framework_state
 {
   struct server_framework_params *params;
@@ -137,6 +244,9 @@ struct server_framework_state
   // websocket file descriptor
   int ws_fd;
 
+  // FastCGI file descriptor
+  int fcgi_fd;
+
   // inotify file descriptor
   int ifd;
 
@@ -158,9 +268,120 @@ struct server_framework_state
   struct directory_watch *dw_first;
   struct directory_watch *dw_last;
 
+  struct spool_watch *sw_first;
+  struct spool_watch *sw_last;
+  int sw_serial;
+
   struct post_select *ps_first, *ps_last;
+
+  // epoll file descriptor
+  int efd;
+  // descriptor table, indexed by fd
+  struct poll_fd *poll_fds;
+  int poll_fd_size;
+
+  // clients, which state must be rechecked after the I/O
+  struct client_state **dirty_clients;
+  int dirty_a, dirty_u;
 };
 
+/*
+ * register fd in the epoll set with the given events
+ * kind == POLL_FD_NONE removes fd from the descriptor table,
+ * events == 0 keeps fd in the table, but out of the epoll set
+ */
+static void
+poll_update(
+        struct server_framework_state *state,
+        int fd,
+        int kind,
+        void *ptr,
+        unsigned events)
+{
+  if (fd < 0) return;
+  if (fd >= state->poll_fd_size) {
+    if (kind == POLL_FD_NONE) return;
+    int new_size = state->poll_fd_size;
+    if (!new_size) new_size = 256;
+    while (fd >= new_size) new_size *= 2;
+    XREALLOC(state->poll_fds, new_size);
+    memset(&state->poll_fds[state->poll_fd_size], 0,
+           (new_size - state->poll_fd_size) * sizeof(state->poll_fds[0]));
+    state->poll_fd_size = new_size;
+  }
+
+  struct poll_fd *pf = &state->poll_fds[fd];
+  if (kind == POLL_FD_NONE) events = 0;
+  if (state->efd >= 0 && pf->events != events) {
+    struct epoll_event ev = { .events = events, .data.fd = fd };
+    int op = EPOLL_CTL_MOD;
+    if (!pf->events) op = EPOLL_CTL_ADD;
+    else if (!events) op = EPOLL_CTL_DEL;
+    if (epoll_ctl(state->efd, op, fd, &ev) < 0) {
+      // the descriptor may be already closed by the owner
+      if (op != EPOLL_CTL_DEL) {
+        err("epoll_ctl failed for %d: %s", fd, os_ErrorMsg());
+      }
+      events = 0;
+    }
+  }
+  if (state->efd >= 0) pf->events = events;
+  pf->kind = kind;
+  pf->ptr = ptr;
+  if (kind == POLL_FD_NONE) pf->ptr = NULL;
+}
+
+/* queue the client for the state recheck at the end of the loop iteration */
+static void
+mark_client_dirty(
+        struct server_framework_state *state,
+        struct client_state *p)
+{
+  if (p->poll_dirty) return;
+  if (state->dirty_u == state->dirty_a) {
+    if (!(state->dirty_a *= 2)) state->dirty_a = 64;
+    XREALLOC(state->dirty_clients, state->dirty_a);
+  }
+  state->dirty_clients[state->dirty_u++] = p;
+  p->poll_dirty = 1;
+}
+
+static unsigned
+ht_client_poll_events(const struct ht_client_state *p)
+{
+  if (p->fcgi) {
+    unsigned events = 0;
+    if (p->state == STATE_FCGI_READ) events |= EPOLLIN;
+    if (p->fcgi->out_pos < p->fcgi->out.size) events |= EPOLLOUT;
+    return events;
+  } else if (p->state == STATE_WRITE || p->state == STATE_WRITECLOSE) {
+    return EPOLLOUT;
+  } else if (p->state >= STATE_READ_CREDS && p->state <= STATE_READ_DATA) {
+    return EPOLLIN;
+  }
+  return 0;
+}
+
+static unsigned
+ws_client_poll_events(const struct ws_client_state *p)
+{
+  unsigned events = 0;
+
+  switch (p->state) {
+  case WS_STATE_INITIAL:
+    events = EPOLLIN;
+    break;
+  case WS_STATE_INITIAL_REPLY: case WS_STATE_HTTP_ERROR:
+    if (p->write_size > 0) events = EPOLLOUT;
+    break;
+  case WS_STATE_ACTIVE:
+    if (!p->in_close_state) events |= EPOLLIN;
+    if (p->write_size > 0) events |= EPOLLOUT;
+    break;
+  }
+  return events;
+}
+
 static int
 nsf_get_peer_uid(const struct client_state *p);
 static int
@@ -204,6 +425,7 @@ client_state_new(struct server_framework_state *state, int fd)
   p->b.fd = fd;
   p->client_fds[0] = -1;
   p->client_fds[1] = -1;
+  p->fcgi = NULL;
   p->state = STATE_READ_CREDS;
 
   if (!state->clients_first) {
@@ -213,6 +435,9 @@ client_state_new(struct server_framework_state *state, int fd)
     state->clients_first->b.prev = (struct client_state*) p;
     state->clients_first = p;
   }
+
+  poll_update(state, fd, POLL_FD_CLIENT, p, 0);
+  mark_client_dirty(state, &p->b);
   return p;
 }
 
@@ -282,6 +507,7 @@ ws_client_state_new(
   if (remote_addr) p->remote_addr = xstrdup(remote_addr);
   p->remote_port = remote_port;
   p->ssl_flag = ssl_flag;
+  p->nsf_state = state;
 
   p->b.prev = (struct client_state *) state->ws_last;
   if (p->b.prev) {
@@ -290,6 +516,9 @@ ws_client_state_new(
     state->ws_first = p;
   }
   state->ws_last = p;
+
+  poll_update(state, fd, POLL_FD_WS_CLIENT, p, 0);
+  mark_client_dirty(state, &p->b);
   return p;
 }
 
@@ -323,6 +552,12 @@ nsf_close_client_fds(struct client_state *p)
   pp->client_fds[1] = -1;
 }
 
+int
+nsf_is_ws_client(const struct client_state *p)
+{
+  return p && p->ops == &ws_client_state_operations;
+}
+
 struct client_state *
 nsf_get_client_by_id(struct server_framework_state *state, int id)
 {
@@ -390,12 +625,18 @@ client_state_delete(
     state->clients_first = state->clients_last = 0;
   }
 
+  poll_update(state, p->fd, POLL_FD_NONE, NULL, 0);
   fcntl(p->fd, F_SETFL, fcntl(p->fd, F_GETFL) & ~O_NONBLOCK);
   if (p->fd >= 0) close(p->fd);
   if (pp->client_fds[0] >= 0) close(pp->client_fds[0]);
   if (pp->client_fds[1] >= 0) close(pp->client_fds[1]);
   xfree(pp->read_buf);
   xfree(pp->write_buf);
+  if (pp->fcgi) {
+    poll_update(state, pp->fcgi->out_fd, POLL_FD_NONE, NULL, 0);
+    fcgi_conn_free(pp->fcgi);
+    pp->fcgi = NULL;
+  }
 
   if (state->params->cleanup_client)
     state->params->cleanup_client(state, p);
@@ -467,6 +708,8 @@ ws_client_state_delete(
     } else {
       state->ws_last = (struct ws_client_state *) p->b.prev;
     }
+    poll_update(state, p->b.fd, POLL_FD_NONE, NULL, 0);
+    if (state->params->ws_cleanup) state->params->ws_cleanup(state, p);
     ws_client_state_free(p);
   }
 }
@@ -491,9 +734,33 @@ nsf_add_watch(struct server_framework_state *state,
     state->w_last->next = p;
     state->w_last = p;
   }
+
+  unsigned events = 0;
+  if ((w->mode & NSF_READ)) events |= EPOLLIN;
+  if ((w->mode & NSF_WRITE)) events |= EPOLLOUT;
+  poll_update(state, w->fd, POLL_FD_WATCH, p, events);
   return 0;
 }
 int
+nsf_set_watch_mode(struct server_framework_state *state, int fd, int mode)
+{
+  struct watchlist *p;
+
+  for (p = state->w_first; p; p = p->next) {
+    if (!p->pending_removal && p->w.fd == fd) {
+      if (p->w.mode != mode) {
+        unsigned events = 0;
+        p->w.mode = mode;
+        if ((mode & NSF_READ)) events |= EPOLLIN;
+        if ((mode & NSF_WRITE)) events |= EPOLLOUT;
+        poll_update(state, fd, POLL_FD_WATCH, p, events);
+      }
+      return 0;
+    }
+  }
+  return -1;
+}
+int
 nsf_remove_watch(struct server_framework_state *state, int fd)
 {
   struct watchlist *p;
@@ -501,6 +768,7 @@ nsf_remove_watch(struct server_framework_state *state, int fd)
   for (p = state->w_first; p; p = p->next) {
     if (!p->pending_removal && p->w.fd == fd) {
       p->pending_removal = 1;
+      poll_update(state, fd, POLL_FD_NONE, NULL, 0);
       return 1;
     }
   }
@@ -700,6 +968,545 @@ accept_new_ws_connections(struct server_framework_state *state)
   }
 }
 
+/* one spare byte is always left for \0 */
+static void
+fcgi_buf_append(struct fcgi_buf *b, const void *data, size_t size)
+{
+  if (b->size + size >= b->reserved) {
+    size_t new_reserved = b->reserved;
+    if (!new_reserved) new_reserved = 4096;
+    while (b->size + size >= new_reserved) new_reserved *= 2;
+    b->data = xrealloc(b->data, new_reserved);
+    b->reserved = new_reserved;
+  }
+  if (size > 0) memcpy(b->data + b->size, data, size);
+  b->size += size;
+}
+
+static void
+fcgi_append_record(
+        struct fcgi_conn *fc,
+        int type,
+        int id,
+        const void *data,
+        size_t size)
+{
+  unsigned char hdr[FCGI_HEADER_LEN] =
+  {
+    FCGI_VERSION_1, type, id >> 8, id, size >> 8, size, 0, 0
+  };
+
+  if (fc->out_pos > 0 && fc->out_pos == fc->out.size) {
+    fc->out_pos = fc->out.size = 0;
+  }
+  fcgi_buf_append(&fc->out, hdr, sizeof(hdr));
+  fcgi_buf_append(&fc->out, data, size);
+}
+
+/* the stream data is split into the records of the maximal size */
+static void
+fcgi_append_stream(
+        struct fcgi_conn *fc,
+        int type,
+        const unsigned char *data,
+        size_t size)
+{
+  while (size > FCGI_MAX_CONTENT) {
+    fcgi_append_record(fc, type, fc->request_id, data, FCGI_MAX_CONTENT);
+    data += FCGI_MAX_CONTENT;
+    size -= FCGI_MAX_CONTENT;
+  }
+  fcgi_append_record(fc, type, fc->request_id, data, size);
+}
+
+static void
+fcgi_append_end_request(struct fcgi_conn *fc, int id, int status)
+{
+  unsigned char body[8] = { 0, 0, 0, 0, status, 0, 0, 0 };
+  fcgi_append_record(fc, FCGI_END_REQUEST, id, body, sizeof(body));
+}
+
+static void
+fcgi_append_error(struct fcgi_conn *fc, int http_status, const char *text)
+{
+  unsigned char buf[512];
+  int len = snprintf(buf, sizeof(buf),
+                     "Content-Type: text/plain; charset=UTF-8\n"
+                     "Cache-Control: no-cache\n"
+                     "Status: %d\n"
+                     "Pragma: no-cache\n\n"
+                     "%s\n", http_status, text);
+  fcgi_append_stream(fc, FCGI_STDOUT, buf, len);
+}
+
+/* the length of a name or a value in the name-value pairs, -1 on error */
+static long
+fcgi_get_length(const unsigned char *data, size_t size, size_t *p_pos)
+{
+  size_t pos = *p_pos;
+
+  if (pos >= size) return -1;
+  if (!(data[pos] & 0x80)) {
+    *p_pos = pos + 1;
+    return data[pos];
+  }
+  if (size - pos < 4) return -1;
+  *p_pos = pos + 4;
+  return ((long) (data[pos] & 0x7f) << 24) | (data[pos + 1] << 16)
+    | (data[pos + 2] << 8) | data[pos + 3];
+}
+
+/* only the values asked by the web server are reported */
+static void
+fcgi_get_values(struct fcgi_conn *fc, const unsigned char *data, size_t size)
+{
+  static const char * const values[][2] =
+  {
+    { "FCGI_MAX_CONNS", "1000" },
+    { "FCGI_MAX_REQS", "1000" },
+    { "FCGI_MPXS_CONNS", "0" },
+  };
+  struct fcgi_buf res = {};
+  size_t pos = 0;
+  long nlen, vlen;
+
+  while (pos < size) {
+    if ((nlen = fcgi_get_length(data, size, &pos)) < 0) break;
+    if ((vlen = fcgi_get_length(data, size, &pos)) < 0) break;
+    if (nlen + vlen > size - pos) break;
+    for (int i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+      size_t klen = strlen(values[i][0]);
+      if (klen == nlen && !memcmp(data + pos, values[i][0], klen)) {
+        unsigned char lens[2] = { klen, strlen(values[i][1]) };
+        fcgi_buf_append(&res, lens, 2);
+        fcgi_buf_append(&res, values[i][0], lens[0]);
+        fcgi_buf_append(&res, values[i][1], lens[1]);
+      }
+    }
+    pos += nlen + vlen;
+  }
+  if (res.size <= FCGI_MAX_CONTENT) {
+    fcgi_append_record(fc, FCGI_GET_VALUES_RESULT, 0, res.data, res.size);
+  }
+  xfree(res.data);
+}
+
+/* the connection is closed after the reply, unless the web server keeps it */
+static void
+fcgi_finish_request(struct ht_client_state *p)
+{
+  struct fcgi_conn *fc = p->fcgi;
+
+  fc->request_id = 0;
+  fc->params_done = 0;
+  fc->stdin_done = 0;
+  fc->too_large = 0;
+  fc->reply_code = 0;
+  fc->out_total = 0;
+  fc->params.size = 0;
+  fc->body.size = 0;
+  if (fc->keep_conn) {
+    p->state = STATE_FCGI_READ;
+  } else {
+    p->state = STATE_FCGI_CLOSE;
+  }
+}
+
+static void
+fcgi_complete_request(struct ht_client_state *p)
+{
+  struct fcgi_conn *fc = p->fcgi;
+
+  fcgi_append_record(fc, FCGI_STDOUT, fc->request_id, NULL, 0);
+  fcgi_append_end_request(fc, fc->request_id, FCGI_REQUEST_COMPLETE);
+  fcgi_finish_request(p);
+}
+
+static void
+handle_fcgi_record(
+        struct ht_client_state *p,
+        int type,
+        int id,
+        const unsigned char *data,
+        size_t size)
+{
+  struct fcgi_conn *fc = p->fcgi;
+
+  if (!id) {
+    if (type == FCGI_GET_VALUES) {
+      fcgi_get_values(fc, data, size);
+    } else {
+      unsigned char body[8] = { type };
+      fcgi_append_record(fc, FCGI_UNKNOWN_TYPE, 0, body, sizeof(body));
+    }
+    return;
+  }
+
+  switch (type) {
+  case FCGI_BEGIN_REQUEST:
+    if (size < 8) {
+      err("%d: FastCGI BEGIN_REQUEST is too short", p->b.id);
+      p->state = STATE_DISCONNECT;
+      return;
+    }
+    if (fc->request_id) {
+      fcgi_append_end_request(fc, id, FCGI_CANT_MPX_CONN);
+      return;
+    }
+    if (((data[0] << 8) | data[1]) != FCGI_RESPONDER) {
+      fcgi_append_end_request(fc, id, FCGI_UNKNOWN_ROLE);
+      return;
+    }
+    fc->request_id = id;
+    fc->keep_conn = data[2] & FCGI_KEEP_CONN;
+    break;
+
+  case FCGI_ABORT_REQUEST:
+    if (id != fc->request_id) break;
+    fcgi_append_end_request(fc, id, FCGI_REQUEST_COMPLETE);
+    fcgi_finish_request(p);
+    break;
+
+  case FCGI_PARAMS:
+    if (id != fc->request_id || fc->params_done) break;
+    if (!size) {
+      fc->params_done = 1;
+    } else if (fc->params.size + size > FCGI_MAX_PARAMS_SIZE) {
+      err("%d: FastCGI parameters are too long", p->b.id);
+      p->state = STATE_DISCONNECT;
+      return;
+    } else {
+      fcgi_buf_append(&fc->params, data, size);
+    }
+    break;
+
+  case FCGI_STDIN:
+    if (id != fc->request_id || fc->stdin_done) break;
+    if (!size) {
+      fc->stdin_done = 1;
+    } else if (fc->too_large || fc->body.size + size > EJ_MAX_CGI_VALUE_LEN) {
+      // the rest of the body is skipped, the request is rejected later
+      fc->too_large = 1;
+    } else {
+      fcgi_buf_append(&fc->body, data, size);
+    }
+    break;
+
+  default:
+    // FCGI_DATA is not used by the responders
+    break;
+  }
+
+  if (fc->request_id && fc->params_done && fc->stdin_done) {
+    p->state = STATE_FCGI_READY;
+  }
+}
+
+/* the records of the next request wait, until the current one is served */
+static void
+process_fcgi_records(struct ht_client_state *p)
+{
+  struct fcgi_conn *fc = p->fcgi;
+  size_t pos = 0;
+
+  while (p->state == STATE_FCGI_READ && fc->in.size - pos >= FCGI_HEADER_LEN) {
+    const unsigned char *h = fc->in.data + pos;
+    size_t clen = (h[4] << 8) | h[5];
+    size_t rlen = FCGI_HEADER_LEN + clen + h[6];
+    if (fc->in.size - pos < rlen) break;
+    if (h[0] != FCGI_VERSION_1) {
+      err("%d: unsupported FastCGI version %d", p->b.id, h[0]);
+      p->state = STATE_DISCONNECT;
+      break;
+    }
+    pos += rlen;
+    handle_fcgi_record(p, h[1], (h[2] << 8) | h[3], h + FCGI_HEADER_LEN, clen);
+  }
+  if (pos > 0) {
+    memmove(fc->in.data, fc->in.data + pos, fc->in.size - pos);
+    fc->in.size -= pos;
+  }
+}
+
+static void
+read_fcgi_connection(struct ht_client_state *p)
+{
+  struct fcgi_conn *fc = p->fcgi;
+  unsigned char buf[65536];
+  ssize_t r;
+
+  while (1) {
+    r = read(p->b.fd, buf, sizeof(buf));
+    if (r < 0 && errno == EINTR) continue;
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    if (r < 0) {
+      err("%d: read error: %s", p->b.id, os_ErrorMsg());
+      p->state = STATE_DISCONNECT;
+      return;
+    }
+    if (!r) {
+      p->state = STATE_DISCONNECT;
+      return;
+    }
+    fcgi_buf_append(&fc->in, buf, r);
+    if (r < sizeof(buf)) break;
+  }
+  process_fcgi_records(p);
+}
+
+static void
+write_fcgi_connection(struct ht_client_state *p)
+{
+  struct fcgi_conn *fc = p->fcgi;
+  ssize_t w;
+
+  while (fc->out_pos < fc->out.size) {
+    w = write(p->b.fd, fc->out.data + fc->out_pos, fc->out.size - fc->out_pos);
+    if (w < 0 && errno == EINTR) continue;
+    if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+    if (w <= 0) {
+      err("%d: write error: %s", p->b.id, os_ErrorMsg());
+      p->state = STATE_DISCONNECT;
+      return;
+    }
+    fc->out_pos += w;
+  }
+  fc->out_pos = fc->out.size = 0;
+  if (p->state == STATE_FCGI_CLOSE) p->state = STATE_DISCONNECT;
+}
+
+/* the reply written by the request handler is forwarded as it is */
+static void
+read_fcgi_output(
+        struct server_framework_state *state,
+        struct ht_client_state *p)
+{
+  struct fcgi_conn *fc = p->fcgi;
+  unsigned char buf[FCGI_MAX_CONTENT];
+  unsigned char msg[64];
+  ssize_t r;
+
+  while (fc->out.size - fc->out_pos < FCGI_OUT_HIGH_WATER) {
+    r = read(fc->out_fd, buf, sizeof(buf));
+    if (r < 0 && errno == EINTR) continue;
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+    if (r < 0) {
+      err("%d: read error: %s", p->b.id, os_ErrorMsg());
+    }
+    if (r <= 0) {
+      poll_update(state, fc->out_fd, POLL_FD_NONE, NULL, 0);
+      close(fc->out_fd);
+      fc->out_fd = -1;
+      if (!fc->out_total) {
+        if (fc->reply_code < 0) {
+          snprintf(msg, sizeof(msg), "Error %d", -fc->reply_code);
+        } else {
+          snprintf(msg, sizeof(msg), "Empty reply");
+        }
+        fcgi_append_error(fc, 500, msg);
+      }
+      fcgi_complete_request(p);
+      // the next request might be already received
+      process_fcgi_records(p);
+      return;
+    }
+    fcgi_append_stream(fc, FCGI_STDOUT, buf, r);
+    fc->out_total += r;
+  }
+}
+
+static unsigned
+fcgi_output_events(const struct fcgi_conn *fc)
+{
+  if (fc->out.size - fc->out_pos < FCGI_OUT_HIGH_WATER) return EPOLLIN;
+  return 0;
+}
+
+struct fcgi_env
+{
+  const unsigned char *name;
+  const unsigned char *value;
+  size_t name_len;
+  size_t value_len;
+};
+
+static unsigned char *
+fcgi_find_env(
+        const struct fcgi_env *envs,
+        int env_num,
+        const char *name,
+        size_t *p_len)
+{
+  size_t len = strlen(name);
+  for (int i = 0; i < env_num; ++i) {
+    if (envs[i].name_len == len && !memcmp(envs[i].name, name, len)) {
+      unsigned char *s = xmalloc(envs[i].value_len + 1);
+      memcpy(s, envs[i].value, envs[i].value_len);
+      s[envs[i].value_len] = 0;
+      if (p_len) *p_len = envs[i].value_len;
+      return s;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * the request is passed to the packet handler the same way, as it is
+ * sent by new-client, but the reply is written into a pipe, which is
+ * read by the main loop
+ */
+static void
+dispatch_fcgi_request(
+        struct server_framework_state *state,
+        struct ht_client_state *p)
+{
+  struct fcgi_conn *fc = p->fcgi;
+  struct fcgi_env *envs = NULL;
+  int env_num = 0, env_reserved = 0, param_num = 0, i;
+  size_t pos = 0, out_size, query_len = 0;
+  long nlen, vlen;
+  unsigned char *content_type = NULL, *query = NULL;
+  struct new_server_prot_http_request *pkt = NULL;
+  ej_size_t *sizes;
+  unsigned char *ptr;
+  unsigned char *pname, *pvalue;
+  size_t psize;
+  int pfd[2];
+
+  p->state = STATE_FCGI_BUSY;
+  fc->reply_code = 0;
+
+  while (pos < fc->params.size) {
+    if ((nlen = fcgi_get_length(fc->params.data, fc->params.size, &pos)) < 0
+        || (vlen = fcgi_get_length(fc->params.data, fc->params.size, &pos)) < 0
+        || nlen + vlen > fc->params.size - pos) {
+      err("%d: malformed FastCGI parameters", p->b.id);
+      fcgi_append_error(fc, 400, "Bad request");
+      goto done;
+    }
+    const unsigned char *name = fc->params.data + pos;
+    const unsigned char *value = name + nlen;
+    pos += nlen + vlen;
+    // the environment strings cannot contain \0
+    if (!nlen || memchr(name, 0, nlen + vlen)) continue;
+    if (env_num == FCGI_MAX_ENV_NUM) continue;
+    if (env_num == env_reserved) {
+      if (!(env_reserved *= 2)) env_reserved = 64;
+      XREALLOC(envs, env_reserved);
+    }
+    envs[env_num].name = name;
+    envs[env_num].name_len = nlen;
+    envs[env_num].value = value;
+    envs[env_num].value_len = vlen;
+    ++env_num;
+  }
+
+  if (fc->too_large) {
+    fcgi_append_error(fc, 413, "Request is rejected");
+    goto done;
+  }
+
+  content_type = fcgi_find_env(envs, env_num, "CONTENT_TYPE", NULL);
+  query = fcgi_find_env(envs, env_num, "QUERY_STRING", &query_len);
+  fcgi_buf_append(&fc->body, NULL, 0);
+  if (cgi_parse_request(content_type, query, query_len,
+                        fc->body.data, fc->body.size) < 0
+      || (param_num = cgi_get_param_num()) > FCGI_MAX_ENV_NUM) {
+    fcgi_append_error(fc, 400, "Bad request");
+    goto done;
+  }
+
+  out_size = sizeof(*pkt) + (env_num + 2 * param_num) * sizeof(ej_size_t);
+  for (i = 0; i < env_num; ++i) {
+    out_size += envs[i].name_len + envs[i].value_len + 2;
+  }
+  for (i = 0; i < param_num; ++i) {
+    cgi_get_nth_param_bin(i, &pname, &psize, &pvalue);
+    out_size += strlen(pname) + psize + 2;
+  }
+  if (out_size > MAX_IN_PACKET_SIZE) {
+    fcgi_append_error(fc, 413, "Request is rejected");
+    goto done;
+  }
+
+  pkt = xcalloc(out_size, 1);
+  pkt->b.magic = NEW_SERVER_PROT_PACKET_MAGIC;
+  pkt->b.id = NEW_SRV_CMD_HTTP_REQUEST;
+  pkt->env_num = env_num;
+  pkt->param_num = param_num;
+  sizes = (ej_size_t *) (pkt + 1);
+  ptr = (unsigned char *) (sizes + env_num + 2 * param_num);
+  for (i = 0; i < env_num; ++i) {
+    sizes[i] = envs[i].name_len + envs[i].value_len + 1;
+    memcpy(ptr, envs[i].name, envs[i].name_len);
+    ptr += envs[i].name_len;
+    *ptr++ = '=';
+    memcpy(ptr, envs[i].value, envs[i].value_len);
+    ptr += envs[i].value_len;
+    *ptr++ = 0;
+  }
+  for (i = 0; i < param_num; ++i) {
+    cgi_get_nth_param_bin(i, &pname, &psize, &pvalue);
+    sizes[env_num + i] = strlen(pname);
+    sizes[env_num + param_num + i] = psize;
+    ptr = stpcpy(ptr, pname) + 1;
+    memcpy(ptr, pvalue, psize);
+    ptr += psize;
+    *ptr++ = 0;
+  }
+
+  if (pipe2(pfd, O_CLOEXEC) < 0) {
+    err("%d: pipe2() failed: %s", p->b.id, os_ErrorMsg());
+    fcgi_append_error(fc, 500, "Internal error");
+    goto done;
+  }
+  fcntl(pfd[0], F_SETFL, fcntl(pfd[0], F_GETFL) | O_NONBLOCK);
+  fc->out_fd = pfd[0];
+  poll_update(state, fc->out_fd, POLL_FD_FCGI_OUT, p, 0);
+  p->client_fds[0] = pfd[1];
+  p->client_fds[1] = -1;
+
+  if (state->params->handle_packet) {
+    state->params->handle_packet(state, &p->b, out_size, &pkt->b);
+  } else {
+    nsf_close_client_fds(&p->b);
+  }
+  xfree(pkt);
+  xfree(content_type);
+  xfree(query);
+  xfree(envs);
+  return;
+
+done:
+  xfree(pkt);
+  xfree(content_type);
+  xfree(query);
+  xfree(envs);
+  fcgi_complete_request(p);
+}
+
+static void
+accept_new_fcgi_connections(struct server_framework_state *state)
+{
+  struct ht_client_state *p;
+  int fd;
+
+  while (1) {
+    fd = accept4(state->fcgi_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    if (fd < 0) {
+      err("accept failed: %s", os_ErrorMsg());
+      break;
+    }
+    p = client_state_new(state, fd);
+    XCALLOC(p->fcgi, 1);
+    p->fcgi->out_fd = -1;
+    p->state = STATE_FCGI_READ;
+  }
+}
+
 int
 nsf_ws_append_reply_raw(
         struct ws_client_state *p,
@@ -726,6 +1533,7 @@ nsf_ws_append_reply_raw(
   }
   memcpy(p->write_buf + p->write_size, buf, size);
   p->write_size += size;
+  if (p->nsf_state) mark_client_dirty(p->nsf_state, &p->b);
   return 1;
 }
 
@@ -819,6 +1627,7 @@ nsf_ws_append_reply_frame(
   }
   memcpy(out_ptr, data, size);
   p->write_size += wire_size;
+  if (p->nsf_state) mark_client_dirty(p->nsf_state, &p->b);
   return 1;
 }
 
@@ -1344,8 +2153,15 @@ write_ws_connection(struct ws_client_state *p, long long current_time_us)
   while (p->write_size > 0) {
     int w = write(p->b.fd, p->write_buf, p->write_size);
     if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      // wait for the next EPOLLOUT
+      break;
     } else if (w < 0) {
+      err("%d: write error: %s", p->b.id, os_ErrorMsg());
+      p->state = WS_STATE_DISCONNECT;
+      break;
     } else if (!w) {
+      p->state = WS_STATE_DISCONNECT;
+      break;
     } else {
       if (w < p->write_size) {
         memmove(p->write_buf, p->write_buf + w, p->write_size - w);
@@ -1362,6 +2178,13 @@ nsf_enqueue_reply(struct server_framework_state *state,
 {
   struct ht_client_state *pp = (struct ht_client_state*) p;
 
+  if (pp->fcgi) {
+    // the web page goes into the reply pipe, only the reply code is kept
+    const struct new_server_prot_packet *pkt = msg;
+    if (len >= sizeof(*pkt)) pp->fcgi->reply_code = pkt->id;
+    return;
+  }
+
   ASSERT(!pp->write_len);
 
   pp->write_len = len + sizeof(len);
@@ -1370,6 +2193,7 @@ nsf_enqueue_reply(struct server_framework_state *state,
   memcpy(pp->write_buf + sizeof(len), msg, len);
   pp->written = 0;
   pp->state = STATE_WRITE;
+  mark_client_dirty(state, p);
 }
 
 void
@@ -1409,6 +2233,7 @@ nsf_err_bad_packet_length(
   struct ht_client_state *pp = (struct ht_client_state*) p;
   err("%d: bad packet length: %zu, expected %zu", p->id, len, exp_len);
   pp->state = STATE_DISCONNECT;
+  mark_client_dirty(state, p);
 }
 
 void
@@ -1421,6 +2246,7 @@ nsf_err_packet_too_small(
   struct ht_client_state *pp = (struct ht_client_state*) p;
   err("%d: packet is too small: %zu, minimum %zu", p->id, len, min_len);
   pp->state = STATE_DISCONNECT;
+  mark_client_dirty(state, p);
 }
 
 void
@@ -1432,6 +2258,7 @@ nsf_err_invalid_command(
   struct ht_client_state *pp = (struct ht_client_state *) p;
   err("%d: invalid protocol command: %d", p->id, id);
   pp->state = STATE_DISCONNECT;
+  mark_client_dirty(state, p);
 }
 
 static void
@@ -1540,6 +2367,121 @@ nsf_add_directory_watch(
   return 0;
 }
 
+int
+nsf_add_spool_watch(
+        struct server_framework_state *state,
+        const unsigned char *dir)
+{
+  struct spool_watch *sw;
+
+  if (state->ifd < 0) return -1;
+
+  for (sw = state->sw_first; sw; sw = sw->next) {
+    if (!strcmp(sw->dir, dir)) {
+      ++sw->refcount;
+      return sw->id;
+    }
+  }
+
+  unsigned char dir_dir[PATH_MAX];
+  if (snprintf(dir_dir, sizeof(dir_dir), "%s/dir", dir) >= (int) sizeof(dir_dir)) {
+    err("nsf_add_spool_watch: path %s is too long", dir);
+    return -1;
+  }
+  int wd = inotify_add_watch(state->ifd, dir_dir, IN_CREATE | IN_MOVED_TO);
+  if (wd < 0) {
+    err("nsf_add_spool_watch: inotify_add_watch() for %s failed: %s", dir_dir, os_ErrorMsg());
+    return -1;
+  }
+
+  XCALLOC(sw, 1);
+  sw->dir = xstrdup(dir);
+  sw->id = ++state->sw_serial;
+  sw->wd = wd;
+  sw->refcount = 1;
+  // the directory may already contain packets
+  sw->ready = 1;
+
+  sw->prev = state->sw_last;
+  if (state->sw_last) {
+    state->sw_last->next = sw;
+  } else {
+    state->sw_first = sw;
+  }
+  state->sw_last = sw;
+
+  return sw->id;
+}
+
+static struct spool_watch *
+find_spool_watch(struct server_framework_state *state, int id)
+{
+  for (struct spool_watch *sw = state->sw_first; sw; sw = sw->next) {
+    if (sw->id == id) return sw;
+  }
+  return NULL;
+}
+
+static void
+free_spool_watch(struct server_framework_state *state, struct spool_watch *sw)
+{
+  if (sw->prev) {
+    sw->prev->next = sw->next;
+  } else {
+    state->sw_first = sw->next;
+  }
+  if (sw->next) {
+    sw->next->prev = sw->prev;
+  } else {
+    state->sw_last = sw->prev;
+  }
+  xfree(sw->dir);
+  xfree(sw);
+}
+
+void
+nsf_remove_spool_watch(
+        struct server_framework_state *state,
+        int id)
+{
+  struct spool_watch *sw = find_spool_watch(state, id);
+  if (!sw || --sw->refcount > 0) return;
+
+  // inotify returns the same descriptor for the same directory
+  int shared = 0;
+  for (struct directory_watch *dw = state->dw_first; dw; dw = dw->next) {
+    if (dw->wd == sw->wd) shared = 1;
+  }
+  for (struct spool_watch *p = state->sw_first; p; p = p->next) {
+    if (p != sw && p->wd == sw->wd) shared = 1;
+  }
+  if (!shared && state->ifd >= 0) {
+    inotify_rm_watch(state->ifd, sw->wd);
+  }
+  free_spool_watch(state, sw);
+}
+
+int
+nsf_test_spool_watch(
+        struct server_framework_state *state,
+        int id)
+{
+  struct spool_watch *sw = find_spool_watch(state, id);
+  if (!sw) return 1;
+  int ready = sw->ready;
+  sw->ready = 0;
+  return ready;
+}
+
+void
+nsf_set_spool_watch_ready(
+        struct server_framework_state *state,
+        int id)
+{
+  struct spool_watch *sw = find_spool_watch(state, id);
+  if (sw) sw->ready = 1;
+}
+
 static void
 do_inotify_read(struct server_framework_state *state)
 {
@@ -1563,16 +2505,36 @@ do_inotify_read(struct server_framework_state *state)
     while (p < bend) {
       const struct inotify_event *ev = (const struct inotify_event *) p;
       p += sizeof(*ev) + ev->len;
-      struct directory_watch *dw;
-      for (dw = state->dw_first; dw; dw = dw->next) {
+      if ((ev->mask & IN_Q_OVERFLOW)) {
+        // events are lost, rescan everything
+        for (struct directory_watch *dw = state->dw_first; dw; dw = dw->next) {
+          dw->ready = 1;
+        }
+        for (struct spool_watch *sw = state->sw_first; sw; sw = sw->next) {
+          sw->ready = 1;
+        }
+        continue;
+      }
+      if ((ev->mask & IN_IGNORED)) {
+        // the watch was removed
+        continue;
+      }
+      // the same directory may be watched several times
+      int found = 0;
+      for (struct directory_watch *dw = state->dw_first; dw; dw = dw->next) {
         if (dw->wd == ev->wd) {
-          break;
+          dw->ready = 1;
+          found = 1;
+        }
+      }
+      for (struct spool_watch *sw = state->sw_first; sw; sw = sw->next) {
+        if (sw->wd == ev->wd) {
+          sw->ready = 1;
+          found = 1;
         }
       }
-      if (!dw) {
+      if (!found) {
         err("do_inotify_read: watch descriptor %d not found", ev->wd);
-      } else {
-        dw->ready = 1;
       }
     }
     if (p > bend) {
@@ -1581,15 +2543,129 @@ do_inotify_read(struct server_framework_state *state)
   }
 }
 
+static void
+handle_ws_frames(
+        struct server_framework_state *state,
+        struct ws_client_state *ws_clnt)
+{
+  while (1) {
+    struct ws_frame *wsf = ws_clnt->frame_first;
+    if (!wsf || (signed char) wsf->hdr[0] >= 0) break;
+
+    switch (wsf->hdr[0] & 0x0F) {
+    case WS_FRAME_TEXT:
+    case WS_FRAME_BIN:
+      if (state->params->ws_handle_packet) {
+        state->params->ws_handle_packet(state, ws_clnt, wsf->hdr[0] & 0x0F, wsf->data, wsf->size);
+      }
+
+      //fprintf(stderr, "ws_frame: %d, %d\n", (wsf->hdr[0] & 0x0F), wsf->size);
+      //nsf_ws_append_reply_frame(ws_clnt, WS_FRAME_TEXT, wsf->data, wsf->size);
+
+      break;
+    case WS_FRAME_CLOSE:
+      fprintf(stderr, "ws_close_frame:\n");
+      ws_clnt->in_close_state = 1;
+      if (!ws_clnt->out_close_state) {
+        int close_code = -1;
+        if (wsf->size > 2) {
+          close_code = (wsf->data[0] << 8) | (wsf->data[1]);
+        }
+        nsf_ws_append_close_request(ws_clnt, close_code);
+      }
+      break;
+    case WS_FRAME_PING:
+      fprintf(stderr, "ws_ping_frame:\n");
+      if (wsf->fragments > 1 || wsf->size >= 126) {
+        nsf_ws_append_close_request(ws_clnt, WS_STATUS_PROTOCOL_ERROR);
+      } else {
+        nsf_ws_append_reply_frame(ws_clnt, WS_FRAME_PONG, wsf->data, wsf->size);
+      }
+      break;
+    default:
+      nsf_ws_append_close_request(ws_clnt, WS_STATUS_PROTOCOL_ERROR);
+      break;
+    }
+
+    ws_clnt->frame_first = wsf->next;
+    if (wsf->next) {
+      wsf->next->prev = NULL;
+    } else {
+      ws_clnt->frame_last = NULL;
+    }
+    ws_frame_free(wsf);
+  }
+  if (ws_clnt->in_close_state > 0 && ws_clnt->out_close_state == 2) {
+    ws_clnt->state = WS_STATE_DISCONNECT;
+  }
+}
+
+/*
+ * handle the clients queued by the I/O or by the reply functions:
+ * execute the ready commands, then drop the disconnected clients
+ * and update the epoll interest of the others
+ */
+static void
+process_dirty_clients(struct server_framework_state *state)
+{
+  struct client_state *p;
+
+  // command handlers may queue more clients
+  for (int i = 0; i < state->dirty_u; ++i) {
+    p = state->dirty_clients[i];
+    if (p->ops == &ws_client_state_operations) {
+      struct ws_client_state *ws_clnt = (struct ws_client_state *) p;
+      if (ws_clnt->state == WS_STATE_ACTIVE) {
+        handle_ws_frames(state, ws_clnt);
+      }
+    } else {
+      struct ht_client_state *cur_clnt = (struct ht_client_state *) p;
+      if (cur_clnt->state == STATE_READ_READY) {
+        handle_control_command(state, cur_clnt);
+        ASSERT(cur_clnt->state != STATE_READ_READY);
+      } else if (cur_clnt->state == STATE_FCGI_READY) {
+        dispatch_fcgi_request(state, cur_clnt);
+      }
+    }
+  }
+
+  // destroy callbacks may queue more clients as well
+  for (int i = 0; i < state->dirty_u; ++i) {
+    p = state->dirty_clients[i];
+    p->poll_dirty = 0;
+    if (p->ops == &ws_client_state_operations) {
+      struct ws_client_state *ws_clnt = (struct ws_client_state *) p;
+      if (ws_clnt->state == WS_STATE_DISCONNECT) {
+        ws_client_state_delete(state, ws_clnt);
+      } else {
+        poll_update(state, p->fd, POLL_FD_WS_CLIENT, p, ws_client_poll_events(ws_clnt));
+      }
+    } else {
+      struct ht_client_state *cur_clnt = (struct ht_client_state *) p;
+      if (cur_clnt->state == STATE_DISCONNECT) {
+        client_state_delete(state, p);
+      } else {
+        poll_update(state, p->fd, POLL_FD_CLIENT, p, ht_client_poll_events(cur_clnt));
+        if (cur_clnt->fcgi && cur_clnt->fcgi->out_fd >= 0) {
+          poll_update(state, cur_clnt->fcgi->out_fd, POLL_FD_FCGI_OUT, p,
+                      fcgi_output_events(cur_clnt->fcgi));
+        }
+      }
+    }
+  }
+  state->dirty_u = 0;
+}
+
+enum { MAX_POLL_EVENTS = 256 };
+
 void
 nsf_main_loop(struct server_framework_state *state)
 {
-  struct ht_client_state *cur_clnt;
-  struct timespec timeoutn;
-  int fd_max, n;
-  fd_set rset, wset;
+  struct epoll_event events[MAX_POLL_EVENTS];
+  int timeout_ms, n;
   struct watchlist *pw;
   int mode;
+  struct ht_client_state *cur_clnt;
   struct ws_client_state *ws_clnt;
   long long current_time_us;
 
@@ -1604,88 +2680,23 @@ nsf_main_loop(struct server_framework_state *state)
       }
     }
 
-    fd_max = -1;
-    FD_ZERO(&rset);
-    FD_ZERO(&wset);
-
-    if (state->socket_fd >= 0) {
-      FD_SET(state->socket_fd, &rset);
-      if (state->socket_fd > fd_max) fd_max = state->socket_fd;
-    }
-    if (state->ws_fd >= 0) {
-      FD_SET(state->ws_fd, &rset);
-      if (state->ws_fd > fd_max) fd_max = state->ws_fd;
-    }
-
-    if (state->ifd >= 0) {
-      FD_SET(state->ifd, &rset);
-      if (state->ifd > fd_max) fd_max = state->ifd;
-    }
-
-    for (cur_clnt = state->clients_first; cur_clnt; cur_clnt = (struct ht_client_state *) cur_clnt->b.next) {
-      if (cur_clnt->state==STATE_WRITE || cur_clnt->state==STATE_WRITECLOSE) {
-        FD_SET(cur_clnt->b.fd, &wset);
-        if (cur_clnt->b.fd > fd_max) fd_max = cur_clnt->b.fd;
-      } else if (cur_clnt->state >= STATE_READ_CREDS
-                 && cur_clnt->state <= STATE_READ_DATA) {
-        FD_SET(cur_clnt->b.fd, &rset);
-        if (cur_clnt->b.fd > fd_max) fd_max = cur_clnt->b.fd;
-      }
-    }
-
-    for (ws_clnt = state->ws_first; ws_clnt; ws_clnt = (struct ws_client_state *) ws_clnt->b.next) {
-      switch (ws_clnt->state) {
-      case WS_STATE_INITIAL:
-        FD_SET(ws_clnt->b.fd, &rset);
-        if (ws_clnt->b.fd > fd_max) fd_max = ws_clnt->b.fd;
-        break;
-      case WS_STATE_INITIAL_REPLY: case WS_STATE_HTTP_ERROR:
-        if (ws_clnt->write_size > 0) {
-          FD_SET(ws_clnt->b.fd, &wset);
-          if (ws_clnt->b.fd > fd_max) fd_max = ws_clnt->b.fd;
-        }
-        break;
-      case WS_STATE_ACTIVE:
-        if (!ws_clnt->in_close_state) {
-          FD_SET(ws_clnt->b.fd, &rset);
-          if (ws_clnt->b.fd > fd_max) fd_max = ws_clnt->b.fd;
-        }
-        if (ws_clnt->write_size > 0) {
-          FD_SET(ws_clnt->b.fd, &wset);
-            if (ws_clnt->b.fd > fd_max) fd_max = ws_clnt->b.fd;
-        }
-        break;
-      default:
-        abort();
-      }
-    }
-
+    // replies might be queued by the callbacks above
+    process_dirty_clients(state);
     remove_pending_watches(state);
-    for (pw = state->w_first; pw; pw = pw->next) {
-      if (pw->pending_removal || pw->w.fd < 0) continue;
-      if ((pw->w.mode & NSF_READ)) {
-        FD_SET(pw->w.fd, &rset);
-        if (pw->w.fd > fd_max) fd_max = pw->w.fd;
-      }
-      if ((pw->w.mode & NSF_WRITE)) {
-        FD_SET(pw->w.fd, &wset);
-        if (pw->w.fd > fd_max) fd_max = pw->w.fd;
-      }
-    }
 
     if (work_done) {
-      if ((timeoutn.tv_sec = state->params->select_timeout) <= 0) {
-        timeoutn.tv_sec = 10;
+      if ((timeout_ms = state->params->select_timeout) <= 0) {
+        timeout_ms = 10;
       }
+      timeout_ms *= 1000;
     } else {
-      timeoutn.tv_sec = 0;
+      timeout_ms = 0;
     }
-    timeoutn.tv_nsec = 0;
 
-    n = pselect(fd_max + 1, &rset, &wset, NULL, &timeoutn, &state->work_mask);
+    n = epoll_pwait(state->efd, events, MAX_POLL_EVENTS, timeout_ms, &state->work_mask);
 
     if (n < 0 && errno != EINTR) {
-      err("unexpected select error: %s", os_ErrorMsg());
+      err("unexpected epoll_pwait error: %s", os_ErrorMsg());
       continue;
     }
 
@@ -1718,147 +2729,100 @@ nsf_main_loop(struct server_framework_state *state)
                    &ps->update_time_us, ps->user);
     }
 
-    // process watches
-    for (pw = state->w_first; pw; pw = pw->next) {
-      if (pw->pending_removal || pw->w.fd < 0) continue;
-      mode = 0;
-      if ((pw->w.mode & NSF_READ) && FD_ISSET(pw->w.fd, &rset))
-        mode |= NSF_READ;
-      if ((pw->w.mode & NSF_WRITE) && FD_ISSET(pw->w.fd, &wset))
-        mode |= NSF_WRITE;
-      if (mode) pw->w.callback(state, &pw->w, mode);
-    }
-    remove_pending_watches(state);
-
-    // new WebSocket connections
-    if (state->ws_fd >= 0 && FD_ISSET(state->ws_fd, &rset)) {
-      accept_new_ws_connections(state);
-    }
+    for (int i = 0; i < n; ++i) {
+      int fd = events[i].data.fd;
+      unsigned ev = events[i].events;
+      // errors and hangups are reported as readiness, like select does
+      int rd = (ev & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0;
+      int wr = (ev & (EPOLLOUT | EPOLLERR)) != 0;
 
-    // check for new control connections
-    if (state->socket_fd >= 0 && FD_ISSET(state->socket_fd, &rset)) {
-      accept_new_connection(state);
-    }
+      // the descriptor might be removed by a previous handler
+      if (fd < 0 || fd >= state->poll_fd_size) continue;
+      struct poll_fd *pf = &state->poll_fds[fd];
 
-    // read from/write to control sockets
-    for (cur_clnt = state->clients_first; cur_clnt; cur_clnt = (struct ht_client_state *) cur_clnt->b.next) {
-      switch (cur_clnt->state) {
-      case STATE_READ_CREDS:
-      case STATE_READ_FDS:
-      case STATE_READ_LEN:
-      case STATE_READ_DATA:
-        if (FD_ISSET(cur_clnt->b.fd, &rset))
-          read_from_control_connection(cur_clnt);
+      switch (pf->kind) {
+      case POLL_FD_SOCKET:
+        // check for new control connections
+        if (rd) accept_new_connection(state);
         break;
-      case STATE_WRITE:
-      case STATE_WRITECLOSE:
-        if (FD_ISSET(cur_clnt->b.fd, &wset))
-          write_to_control_connection(cur_clnt);
+
+      case POLL_FD_WS_SOCKET:
+        // new WebSocket connections
+        if (rd) accept_new_ws_connections(state);
         break;
-      }
-    }
 
-    for (ws_clnt = state->ws_first; ws_clnt; ws_clnt = (struct ws_client_state *) ws_clnt->b.next) {
-      if (FD_ISSET(ws_clnt->b.fd, &rset)) {
-        read_ws_connection(state, ws_clnt, current_time_us);
-      }
-      if (FD_ISSET(ws_clnt->b.fd, &wset)) {
-        write_ws_connection(ws_clnt, current_time_us);
-        if (ws_clnt->write_size == 0 && ws_clnt->state == WS_STATE_INITIAL_REPLY) {
-          ws_clnt->state = WS_STATE_ACTIVE;
-        } else if (ws_clnt->write_size == 0 && ws_clnt->state == WS_STATE_HTTP_ERROR) {
-          ws_clnt->state = WS_STATE_DISCONNECT;
-        }
-      }
-    }
+      case POLL_FD_FCGI_SOCKET:
+        // new connections from the web server
+        if (rd) accept_new_fcgi_connections(state);
+        break;
 
-    if (state->ifd >= 0 && FD_ISSET(state->ifd, &rset)) {
-      do_inotify_read(state);
-    }
+      case POLL_FD_INOTIFY:
+        if (rd) do_inotify_read(state);
+        break;
 
-    // execute ready commands from control connections
-    for (cur_clnt = state->clients_first; cur_clnt; cur_clnt = (struct ht_client_state *) cur_clnt->b.next) {
-      if (cur_clnt->state == STATE_READ_READY) {
-        handle_control_command(state, cur_clnt);
-        ASSERT(cur_clnt->state != STATE_READ_READY);
-      }
-    }
+      case POLL_FD_WATCH:
+        pw = (struct watchlist *) pf->ptr;
+        if (pw->pending_removal) break;
+        mode = 0;
+        if ((pw->w.mode & NSF_READ) && rd) mode |= NSF_READ;
+        if ((pw->w.mode & NSF_WRITE) && wr) mode |= NSF_WRITE;
+        if (mode) pw->w.callback(state, &pw->w, mode);
+        break;
 
-    for (ws_clnt = state->ws_first; ws_clnt; ws_clnt = (struct ws_client_state *) ws_clnt->b.next) {
-      if (ws_clnt->state == WS_STATE_ACTIVE) {
-        while (1) {
-          struct ws_frame *wsf = ws_clnt->frame_first;
-          if (!wsf || (signed char) wsf->hdr[0] >= 0) break;
-
-          switch (wsf->hdr[0] & 0x0F) {
-          case WS_FRAME_TEXT:
-          case WS_FRAME_BIN:
-            if (state->params->ws_handle_packet) {
-              state->params->ws_handle_packet(state, ws_clnt, wsf->hdr[0] & 0x0F, wsf->data, wsf->size);
-            }
+      case POLL_FD_CLIENT:
+        // read from/write to control sockets
+        cur_clnt = (struct ht_client_state *) pf->ptr;
+        switch (cur_clnt->state) {
+        case STATE_READ_CREDS:
+        case STATE_READ_FDS:
+        case STATE_READ_LEN:
+        case STATE_READ_DATA:
+          if (rd) read_from_control_connection(cur_clnt);
+          break;
+        case STATE_WRITE:
+        case STATE_WRITECLOSE:
+          if (wr) write_to_control_connection(cur_clnt);
+          break;
+        case STATE_FCGI_READ:
+          if (rd) read_fcgi_connection(cur_clnt);
+          if (wr && cur_clnt->state != STATE_DISCONNECT) write_fcgi_connection(cur_clnt);
+          break;
+        case STATE_FCGI_READY:
+        case STATE_FCGI_BUSY:
+        case STATE_FCGI_CLOSE:
+          if (wr) write_fcgi_connection(cur_clnt);
+          break;
+        }
+        mark_client_dirty(state, &cur_clnt->b);
+        break;
 
-            //fprintf(stderr, "ws_frame: %d, %d\n", (wsf->hdr[0] & 0x0F), wsf->size);
-            //nsf_ws_append_reply_frame(ws_clnt, WS_FRAME_TEXT, wsf->data, wsf->size);
-
-            break;
-          case WS_FRAME_CLOSE:
-            fprintf(stderr, "ws_close_frame:\n");
-            ws_clnt->in_close_state = 1;
-            if (!ws_clnt->out_close_state) {
-              int close_code = -1;
-              if (wsf->size > 2) {
-                close_code = (wsf->data[0] << 8) | (wsf->data[1]);
-              }
-              nsf_ws_append_close_request(ws_clnt, close_code);
-            }
-            break;
-          case WS_FRAME_PING:
-            fprintf(stderr, "ws_ping_frame:\n");
-            if (wsf->fragments > 1 || wsf->size >= 126) {
-              nsf_ws_append_close_request(ws_clnt, WS_STATUS_PROTOCOL_ERROR);
-            } else {
-              nsf_ws_append_reply_frame(ws_clnt, WS_FRAME_PONG, wsf->data, wsf->size);
-            }
-            break;
-          default:
-            nsf_ws_append_close_request(ws_clnt, WS_STATUS_PROTOCOL_ERROR);
-            break;
-          }
+      case POLL_FD_FCGI_OUT:
+        cur_clnt = (struct ht_client_state *) pf->ptr;
+        if (rd) read_fcgi_output(state, cur_clnt);
+        mark_client_dirty(state, &cur_clnt->b);
+        break;
 
-          ws_clnt->frame_first = wsf->next;
-          if (wsf->next) {
-            wsf->next->prev = NULL;
-          } else {
-            ws_clnt->frame_last = NULL;
-          }
-          ws_frame_free(wsf);
+      case POLL_FD_WS_CLIENT:
+        ws_clnt = (struct ws_client_state *) pf->ptr;
+        if (rd && (pf->events & EPOLLIN)) {
+          read_ws_connection(state, ws_clnt, current_time_us);
         }
-        if (ws_clnt->in_close_state > 0 && ws_clnt->out_close_state == 2) {
-          ws_clnt->state = WS_STATE_DISCONNECT;
+        if (wr && (pf->events & EPOLLOUT)) {
+          write_ws_connection(ws_clnt, current_time_us);
+          if (ws_clnt->write_size == 0 && ws_clnt->state == WS_STATE_INITIAL_REPLY) {
+            ws_clnt->state = WS_STATE_ACTIVE;
+          } else if (ws_clnt->write_size == 0 && ws_clnt->state == WS_STATE_HTTP_ERROR) {
+            ws_clnt->state = WS_STATE_DISCONNECT;
+          }
         }
+        mark_client_dirty(state, &ws_clnt->b);
+        break;
       }
     }
+    remove_pending_watches(state);
 
-    // disconnect file descriptors marked for disconnection
-    for (cur_clnt = state->clients_first; cur_clnt; ) {
-      if (cur_clnt->state == STATE_DISCONNECT) {
-        struct client_state *tmp = cur_clnt->b.next;
-        client_state_delete(state, &cur_clnt->b);
-        cur_clnt = (struct ht_client_state *) tmp;
-      } else {
-        cur_clnt = (struct ht_client_state *) cur_clnt->b.next;
-      }
-    }
-
-    for (ws_clnt = state->ws_first; ws_clnt; ) {
-      if (ws_clnt->state == WS_STATE_DISCONNECT) {
-        struct ws_client_state *tmp = (struct ws_client_state *) ws_clnt->b.next;
-        ws_client_state_delete(state, ws_clnt);
-        ws_clnt = tmp;
-      } else {
-        ws_clnt = (struct ws_client_state*) ws_clnt->b.next;
-      }
-    }
+    // execute ready commands, disconnect file descriptors marked for disconnection
+    process_dirty_clients(state);
   }
 }
 
@@ -1878,6 +2842,10 @@ nsf_prepare(struct server_framework_state *state)
     errno = 0;
     if (unlink(state->params->socket_path) < 0 && errno != ENOENT)
       state->params->startup_error("cannot remove stale socket file");
+    errno = 0;
+    if (state->params->fcgi_socket_path
+        && unlink(state->params->fcgi_socket_path) < 0 && errno != ENOENT)
+      state->params->startup_error("cannot remove stale socket file");
   }
 
   // create a websocket socket
@@ -1916,11 +2884,15 @@ nsf_prepare(struct server_framework_state *state)
     }
   }
 
-  if (state->dw_first) {
-    state->ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
-    if (state->ifd < 0) {
+  // spool watches may be added later, so create inotify descriptor in any case
+  state->ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (state->ifd < 0) {
+    if (state->dw_first) {
       state->params->startup_error("inotify_init1() failed: %s", os_ErrorMsg());
     }
+    err("inotify_init1() failed: %s", os_ErrorMsg());
+  }
+  if (state->dw_first) {
 
     for (struct directory_watch *dw = state->dw_first; dw; dw = dw->next) {
       dw->wd = inotify_add_watch(state->ifd, dw->dir_dir, IN_CREATE | IN_MOVED_TO);
@@ -1956,6 +2928,40 @@ nsf_prepare(struct server_framework_state *state)
   if (chmod(state->params->socket_path, 0777) < 0)
     state->params->startup_error("chmod() failed: %s", os_ErrorMsg());
 
+  // create a FastCGI socket for the web server
+  state->fcgi_fd = -1;
+  if (state->params->fcgi_socket_path && state->params->fcgi_socket_path[0]) {
+    if ((state->fcgi_fd = socket(PF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+      state->params->startup_error("socket() failed: %s", os_ErrorMsg());
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(state->params->fcgi_socket_path) >= sizeof(addr.sun_path))
+      state->params->startup_error("socket path is too long");
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s",
+             state->params->fcgi_socket_path);
+    if (bind(state->fcgi_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+      state->params->startup_error("bind() failed: %s", os_ErrorMsg());
+    if (listen(state->fcgi_fd, 128) < 0)
+      state->params->startup_error("listen() failed: %s", os_ErrorMsg());
+    if (chmod(state->params->fcgi_socket_path, 0777) < 0)
+      state->params->startup_error("chmod() failed: %s", os_ErrorMsg());
+  }
+
+  // create the epoll set for the main loop
+  if ((state->efd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    state->params->startup_error("epoll_create1() failed: %s", os_ErrorMsg());
+  poll_update(state, state->socket_fd, POLL_FD_SOCKET, NULL, EPOLLIN);
+  poll_update(state, state->ws_fd, POLL_FD_WS_SOCKET, NULL, EPOLLIN);
+  poll_update(state, state->fcgi_fd, POLL_FD_FCGI_SOCKET, NULL, EPOLLIN);
+  poll_update(state, state->ifd, POLL_FD_INOTIFY, NULL, EPOLLIN);
+  for (struct watchlist *pw = state->w_first; pw; pw = pw->next) {
+    if (pw->pending_removal) continue;
+    unsigned events = 0;
+    if ((pw->w.mode & NSF_READ)) events |= EPOLLIN;
+    if ((pw->w.mode & NSF_WRITE)) events |= EPOLLOUT;
+    poll_update(state, pw->w.fd, POLL_FD_WATCH, pw, events);
+  }
+
   sigprocmask(SIG_SETMASK, 0, &state->orig_mask);
   sigfillset(&state->block_mask);
   sigfillset(&state->work_mask);
@@ -2008,6 +3014,7 @@ nsf_prepare(struct server_framework_state *state)
 
  cleanup:
   unlink(state->params->socket_path);
+  if (state->fcgi_fd >= 0) unlink(state->params->fcgi_socket_path);
   return -1;
 }
 
@@ -2025,6 +3032,11 @@ nsf_cleanup(struct server_framework_state *state)
     p->client_fds[0] = -1;
     p->client_fds[1] = -1;
 
+    if (p->fcgi) {
+      fcgi_conn_free(p->fcgi);
+      p->fcgi = NULL;
+    }
+
     // do not flush pending write buffer, just close the connection
     xfree(p->write_buf); p->write_buf = 0;
     p->write_len = p->written = 0;
@@ -2048,9 +3060,66 @@ nsf_cleanup(struct server_framework_state *state)
     }
   }
 
+  while (state->sw_first) {
+    free_spool_watch(state, state->sw_first);
+  }
+  if (state->ifd >= 0) close(state->ifd);
+  state->ifd = -1;
+
   if (state->socket_fd >= 0) close(state->socket_fd);
   state->socket_fd = -1;
   unlink(state->params->socket_path);
+
+  if (state->fcgi_fd >= 0) {
+    close(state->fcgi_fd);
+    unlink(state->params->fcgi_socket_path);
+  }
+  state->fcgi_fd = -1;
+
+  if (state->efd >= 0) close(state->efd);
+  state->efd = -1;
+  xfree(state->poll_fds); state->poll_fds = NULL;
+  state->poll_fd_size = 0;
+  xfree(state->dirty_clients); state->dirty_clients = NULL;
+  state->dirty_a = state->dirty_u = 0;
+}
+
+/*
+ * called in a forked worker process: release the descriptors of the
+ * main loop, so the worker does not interfere with the parent process
+ * and does not keep the connections of other clients open
+ */
+void
+nsf_detach_worker(
+        struct server_framework_state *state,
+        struct client_state *keep)
+{
+  // the epoll set is shared with the parent, so it must not be modified
+  if (state->efd >= 0) close(state->efd);
+  state->efd = -1;
+  if (state->socket_fd >= 0) close(state->socket_fd);
+  state->socket_fd = -1;
+  if (state->ws_fd >= 0) close(state->ws_fd);
+  state->ws_fd = -1;
+  if (state->fcgi_fd >= 0) close(state->fcgi_fd);
+  state->fcgi_fd = -1;
+  if (state->ifd >= 0) close(state->ifd);
+  state->ifd = -1;
+
+  for (struct ht_client_state *p = state->clients_first; p; p = (struct ht_client_state *) p->b.next) {
+    // the reply pipes are read by the parent process only
+    if (p->fcgi && p->fcgi->out_fd >= 0) close(p->fcgi->out_fd);
+    if (p->fcgi) p->fcgi->out_fd = -1;
+    if (&p->b == keep) continue;
+    if (p->b.fd >= 0) close(p->b.fd);
+    p->b.fd = -1;
+    nsf_close_client_fds(&p->b);
+  }
+  for (struct ws_client_state *p = state->ws_first; p; p = (struct ws_client_state *) p->b.next) {
+    if (&p->b == keep) continue;
+    if (p->b.fd >= 0) close(p->b.fd);
+    p->b.fd = -1;
+  }
 }
 
 int
@@ -2073,6 +3142,8 @@ nsf_init(
   //state->client_id = 1;
   state->server_start_time = server_start_time;
   state->ifd = -1;
+  state->efd = -1;
+  state->fcgi_fd = -1;
 
   return state;
 }
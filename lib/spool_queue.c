@@ -0,0 +1,488 @@
+/* -*- mode: c; c-basic-offset: 4 -*- */
+
+/* Copyright (C) 2024 Alexander Chernov <cher@ejudge.ru> */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "ejudge/config.h"
+#include "ejudge/spool_queue.h"
+#include "ejudge/random.h"
+#include "ejudge/errlog.h"
+
+#include "ejudge/xalloc.h"
+#include "ejudge/logger.h"
+#include "ejudge/osdeps.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/inotify.h>
+
+enum { PRIO_COUNT = 32 };
+
+struct spool_name
+{
+    struct spool_name *next;    // hash chain
+    unsigned hash;
+    int prio;                   // 0 - 31, as in scan_dir
+    unsigned char in_heap;
+    unsigned char removed;      // removed from the directory, but still in heap
+    unsigned char name[];
+};
+
+struct spool_hash
+{
+    struct spool_name **v;
+    size_t size;                // power of 2
+    size_t used;
+};
+
+/* binary min-heap of names of the same priority */
+struct spool_heap
+{
+    struct spool_name **v;
+    size_t a, u;
+};
+
+struct spool_queue
+{
+    unsigned char *spool_path;
+    unsigned char *dir_path;
+    int ifd;
+    int wd;
+    int has_quit;
+
+    struct spool_hash present;
+    struct spool_hash ignored;
+    struct spool_heap heaps[PRIO_COUNT];
+};
+
+static unsigned
+name_hash(const unsigned char *name)
+{
+    // FNV-1a
+    unsigned h = 2166136261U;
+    for (; *name; ++name) {
+        h ^= *name;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+static int
+name_prio(const unsigned char *name)
+{
+    int prio;
+
+    if (name[0] >= '0' && name[0] <= '9') {
+        prio = -16 + (name[0] - '0');
+    } else if (name[0] >= 'A' && name[0] <= 'V') {
+        prio = -6 + (name[0] - 'A');
+    } else {
+        prio = 0;
+    }
+    if (prio < -16) prio = -16;
+    if (prio > 15) prio = 15;
+    return prio + 16;
+}
+
+static struct spool_name *
+spool_name_new(const unsigned char *name, unsigned hash)
+{
+    size_t len = strlen(name);
+    struct spool_name *sn = xcalloc(1, sizeof(*sn) + len + 1);
+    sn->hash = hash;
+    sn->prio = name_prio(name);
+    memcpy(sn->name, name, len + 1);
+    return sn;
+}
+
+static struct spool_name *
+hash_find(struct spool_hash *h, const unsigned char *name, unsigned hash)
+{
+    if (!h->size) return NULL;
+    for (struct spool_name *sn = h->v[hash & (h->size - 1)]; sn; sn = sn->next) {
+        if (sn->hash == hash && !strcmp(sn->name, name)) return sn;
+    }
+    return NULL;
+}
+
+static void
+hash_insert(struct spool_hash *h, struct spool_name *sn)
+{
+    if (h->used >= h->size) {
+        size_t new_size = h->size * 2;
+        if (!new_size) new_size = 256;
+        struct spool_name **new_v = NULL;
+        XCALLOC(new_v, new_size);
+        for (size_t i = 0; i < h->size; ++i) {
+            struct spool_name *p, *q;
+            for (p = h->v[i]; p; p = q) {
+                q = p->next;
+                p->next = new_v[p->hash & (new_size - 1)];
+                new_v[p->hash & (new_size - 1)] = p;
+            }
+        }
+        xfree(h->v);
+        h->v = new_v;
+        h->size = new_size;
+    }
+    size_t idx = sn->hash & (h->size - 1);
+    sn->next = h->v[idx];
+    h->v[idx] = sn;
+    ++h->used;
+}
+
+static struct spool_name *
+hash_remove(struct spool_hash *h, const unsigned char *name, unsigned hash)
+{
+    if (!h->size) return NULL;
+    struct spool_name **pp = &h->v[hash & (h->size - 1)];
+    for (; *pp; pp = &(*pp)->next) {
+        struct spool_name *sn = *pp;
+        if (sn->hash == hash && !strcmp(sn->name, name)) {
+            *pp = sn->next;
+            sn->next = NULL;
+            --h->used;
+            return sn;
+        }
+    }
+    return NULL;
+}
+
+static void
+heap_push(struct spool_heap *hp, struct spool_name *sn)
+{
+    if (hp->u == hp->a) {
+        if (!(hp->a *= 2)) hp->a = 64;
+        XREALLOC(hp->v, hp->a);
+    }
+    size_t i = hp->u++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (strcmp(hp->v[parent]->name, sn->name) <= 0) break;
+        hp->v[i] = hp->v[parent];
+        i = parent;
+    }
+    hp->v[i] = sn;
+    sn->in_heap = 1;
+}
+
+static struct spool_name *
+heap_pop(struct spool_heap *hp)
+{
+    struct spool_name *top = hp->v[0];
+    struct spool_name *last = hp->v[--hp->u];
+    size_t i = 0;
+    while (1) {
+        size_t child = i * 2 + 1;
+        if (child >= hp->u) break;
+        if (child + 1 < hp->u && strcmp(hp->v[child + 1]->name, hp->v[child]->name) < 0) ++child;
+        if (strcmp(last->name, hp->v[child]->name) <= 0) break;
+        hp->v[i] = hp->v[child];
+        i = child;
+    }
+    if (hp->u > 0) hp->v[i] = last;
+    top->in_heap = 0;
+    return top;
+}
+
+static void
+add_name(struct spool_queue *q, const unsigned char *name)
+{
+    if (!strcmp(name, ".") || !strcmp(name, "..")) return;
+    if (!strcmp(name, "QUIT")) {
+        q->has_quit = 1;
+        return;
+    }
+    unsigned hash = name_hash(name);
+    if (hash_find(&q->present, name, hash)) return;
+    struct spool_name *sn = spool_name_new(name, hash);
+    hash_insert(&q->present, sn);
+    heap_push(&q->heaps[sn->prio], sn);
+}
+
+static void
+remove_name(struct spool_queue *q, const unsigned char *name)
+{
+    if (!strcmp(name, "QUIT")) {
+        q->has_quit = 0;
+        return;
+    }
+    unsigned hash = name_hash(name);
+    struct spool_name *sn = hash_remove(&q->present, name, hash);
+    if (sn) {
+        // the heap entry is dropped when it reaches the top
+        if (sn->in_heap) sn->removed = 1;
+        else xfree(sn);
+    }
+    // an ignored item is forgotten when it leaves the directory
+    xfree(hash_remove(&q->ignored, name, hash));
+}
+
+static void
+clear_names(struct spool_queue *q)
+{
+    for (int prio = 0; prio < PRIO_COUNT; ++prio) {
+        struct spool_heap *hp = &q->heaps[prio];
+        for (size_t i = 0; i < hp->u; ++i) {
+            if (hp->v[i]->removed) xfree(hp->v[i]);
+        }
+        hp->u = 0;
+    }
+    for (size_t i = 0; i < q->present.size; ++i) {
+        struct spool_name *p, *r;
+        for (p = q->present.v[i]; p; p = r) {
+            r = p->next;
+            xfree(p);
+        }
+        q->present.v[i] = NULL;
+    }
+    q->present.used = 0;
+    q->has_quit = 0;
+}
+
+/* reread the whole directory */
+static int
+rescan_dir(struct spool_queue *q)
+{
+    DIR *d = NULL;
+    struct dirent *dd;
+
+    clear_names(q);
+    if (!(d = opendir(q->dir_path))) {
+        int saved_errno = errno;
+        err("spool_queue: opendir(\"%s\") failed: %s", q->dir_path, os_ErrorMsg());
+        return -saved_errno;
+    }
+    while ((dd = readdir(d))) {
+        add_name(q, dd->d_name);
+    }
+    closedir(d);
+
+    // drop the ignored items which are not in the directory anymore
+    for (size_t i = 0; i < q->ignored.size; ++i) {
+        struct spool_name **pp = &q->ignored.v[i];
+        while (*pp) {
+            struct spool_name *sn = *pp;
+            if (!hash_find(&q->present, sn->name, sn->hash)) {
+                *pp = sn->next;
+                --q->ignored.used;
+                xfree(sn);
+            } else {
+                pp = &sn->next;
+            }
+        }
+    }
+    return 0;
+}
+
+/* read the pending inotify events */
+static int
+update_queue(struct spool_queue *q)
+{
+    unsigned char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int need_rescan = 0;
+
+    while (1) {
+        ssize_t r = read(q->ifd, buf, sizeof(buf));
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0 && errno == EAGAIN) break;
+        if (r < 0) {
+            err("spool_queue: read failed: %s", os_ErrorMsg());
+            need_rescan = 1;
+            break;
+        }
+        if (!r) break;
+        const unsigned char *p = buf;
+        const unsigned char *bend = buf + r;
+        while (p < bend) {
+            const struct inotify_event *ev = (const struct inotify_event *) p;
+            p += sizeof(*ev) + ev->len;
+            if ((ev->mask & (IN_Q_OVERFLOW | IN_IGNORED))) {
+                need_rescan = 1;
+            } else if (ev->len > 0 && ev->wd == q->wd) {
+                if ((ev->mask & (IN_CREATE | IN_MOVED_TO))) {
+                    add_name(q, ev->name);
+                } else if ((ev->mask & (IN_DELETE | IN_MOVED_FROM))) {
+                    remove_name(q, ev->name);
+                }
+            }
+        }
+    }
+
+    if (need_rescan) {
+        return rescan_dir(q);
+    }
+    return 0;
+}
+
+/* drop the removed and ignored items from the top of the heap */
+static struct spool_name *
+heap_top(struct spool_queue *q, int prio)
+{
+    struct spool_heap *hp = &q->heaps[prio];
+    while (hp->u > 0) {
+        struct spool_name *sn = hp->v[0];
+        if (sn->removed) {
+            heap_pop(hp);
+            xfree(sn);
+        } else if (q->ignored.used > 0 && hash_find(&q->ignored, sn->name, sn->hash)) {
+            // stays in the present set, not picked until it leaves the directory
+            heap_pop(hp);
+        } else {
+            return sn;
+        }
+    }
+    return NULL;
+}
+
+struct spool_queue *
+spool_queue_open(const unsigned char *spool_path)
+{
+    struct spool_queue *q = NULL;
+    unsigned char dir_path[PATH_MAX];
+
+    if (snprintf(dir_path, sizeof(dir_path), "%s/dir", spool_path) >= (int) sizeof(dir_path)) {
+        err("spool_queue_open: path '%s' is too long", spool_path);
+        return NULL;
+    }
+
+    XCALLOC(q, 1);
+    q->spool_path = xstrdup(spool_path);
+    q->dir_path = xstrdup(dir_path);
+    q->wd = -1;
+    q->ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (q->ifd < 0) {
+        err("spool_queue_open: inotify_init1 failed: %s", os_ErrorMsg());
+        goto fail;
+    }
+    q->wd = inotify_add_watch(q->ifd, q->dir_path, IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM);
+    if (q->wd < 0) {
+        err("spool_queue_open: inotify_add_watch failed for '%s': %s", q->dir_path, os_ErrorMsg());
+        goto fail;
+    }
+    // the watch is set up before the scan, so no entry is lost
+    if (rescan_dir(q) < 0) goto fail;
+    return q;
+
+fail:
+    spool_queue_free(q);
+    return NULL;
+}
+
+struct spool_queue *
+spool_queue_free(struct spool_queue *q)
+{
+    if (q) {
+        if (q->ifd >= 0) close(q->ifd);
+        clear_names(q);
+        for (int prio = 0; prio < PRIO_COUNT; ++prio) {
+            xfree(q->heaps[prio].v);
+        }
+        xfree(q->present.v);
+        for (size_t i = 0; i < q->ignored.size; ++i) {
+            struct spool_name *p, *r;
+            for (p = q->ignored.v[i]; p; p = r) {
+                r = p->next;
+                xfree(p);
+            }
+        }
+        xfree(q->ignored.v);
+        xfree(q->dir_path);
+        xfree(q->spool_path);
+        xfree(q);
+    }
+    return NULL;
+}
+
+int
+spool_queue_get_fd(const struct spool_queue *q)
+{
+    return q->ifd;
+}
+
+void
+spool_queue_add_ignored(struct spool_queue *q, const unsigned char *name)
+{
+    if (!name || !*name) return;
+    unsigned hash = name_hash(name);
+    if (hash_find(&q->ignored, name, hash)) return;
+    hash_insert(&q->ignored, spool_name_new(name, hash));
+}
+
+int
+spool_queue_next(
+        struct spool_queue *q,
+        char *found_item,
+        size_t fi_size,
+        int random_mode)
+{
+    int r;
+    struct spool_name *items[PRIO_COUNT];
+    int low_prio = PRIO_COUNT, high_prio = -1;
+
+    if ((r = update_queue(q)) < 0) return r;
+
+    if (q->has_quit) {
+        snprintf(found_item, fi_size, "%s", "QUIT");
+        info("spool_queue: found QUIT packet");
+        return 1;
+    }
+
+    for (int prio = 0; prio < PRIO_COUNT; ++prio) {
+        if ((items[prio] = heap_top(q, prio))) {
+            if (prio < low_prio) low_prio = prio;
+            if (prio > high_prio) high_prio = prio;
+        }
+    }
+    if (high_prio < 0) return 0;
+
+    if (random_mode && low_prio != high_prio) {
+        int range = high_prio - low_prio + 1;
+        unsigned long long mask = (1ULL << range) - 1;
+        unsigned long long value = 0;
+
+        random_init();
+
+        if (range < 16) {
+            value = random_u16() & mask;
+        } else if (range == 16) {
+            value = random_u16();
+        } else if (range < 32) {
+            value = random_u32() & mask;
+        } else if (range == 32) {
+            value = random_u32();
+        } else {
+            value = random_u64() & mask;
+        }
+        for (int i = high_prio; i > low_prio; --i) {
+            if (items[i]) {
+                if (!value) {
+                    low_prio = i;
+                    break;
+                }
+                --value;
+            }
+            value >>= 1;
+        }
+    }
+
+    ASSERT(items[low_prio]);
+    snprintf(found_item, fi_size, "%s", items[low_prio]->name);
+    info("spool_queue: found '%s' (priority %d)", found_item, low_prio - 16);
+    return 1;
+}
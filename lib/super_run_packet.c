@@ -153,8 +153,10 @@ super_run_in_problem_packet_init(struct generic_section_config *gp)
   p->disable_stderr = -1;
   p->max_open_file_count = -1;
   p->max_process_count = -1;
+  p->parallel_tests = -1;
   p->enable_process_group = -1;
   p->enable_kill_all = -1;
+  p->readonly_input = -1;
   p->enable_extended_info = -1;
   p->stop_on_first_fail = -1;
   p->enable_control_socket = -1;
@@ -205,6 +207,7 @@ super_run_in_problem_packet_set_default(struct generic_section_config *gp)
   if (p->disable_stderr < 0) p->disable_stderr = 0;
   if (p->max_open_file_count < 0) p->max_open_file_count = 0;
   if (p->max_process_count < 0) p->max_process_count = 0;
+  if (p->parallel_tests < 0) p->parallel_tests = 0;
 
   if (p->type_val < 0) {
     p->type_val = problem_parse_type(p->type);
@@ -156,18 +156,228 @@ close_connection(struct old_db_state *old_db)
   }
 }
 
+/* the deltas are merged until too many of them are accumulated,
+   then the full user list is requested again */
+enum { TEAMDB_MAX_DELTAS = 64 };
+
+static unsigned
+hash_str(const unsigned char *str)
+{
+  // FNV-1a
+  unsigned h = 2166136261U;
+  for (; *str; ++str) {
+    h ^= *str;
+    h *= 16777619U;
+  }
+  return h;
+}
+
+static const unsigned char *
+get_login_key(const struct userlist_user *u)
+{
+  return u->login;
+}
+
+static const unsigned char *
+get_name_key(const struct userlist_user *u)
+{
+  const unsigned char *v = 0;
+
+  if (u->cnts0) v = u->cnts0->name;
+  if (!v || !*v) v = u->login;
+  return v;
+}
+
+static const unsigned char *
+get_cypher_key(const struct userlist_user *u)
+{
+  if (!u->cnts0) return 0;
+  return u->cnts0->exam_cypher;
+}
+
+static void
+hash_free(struct teamdb_hash *h)
+{
+  xfree(h->ids);
+  h->ids = 0;
+  h->size = 0;
+}
+
+/* for duplicate keys the participant with the least user_id is kept */
+static void
+hash_build(
+        teamdb_state_t state,
+        struct teamdb_hash *h,
+        const unsigned char *(*get_key)(const struct userlist_user *))
+{
+  int i, size = 16;
+  unsigned mask, k;
+  const unsigned char *key, *key2;
+
+  hash_free(h);
+  while (size < 2 * state->total_participants) size *= 2;
+  h->size = size;
+  XCALLOC(h->ids, size);
+  mask = size - 1;
+
+  for (i = 0; i < state->total_participants; i++) {
+    if (!state->participants[i]) continue;
+    if (!(key = get_key(state->participants[i]))) continue;
+    for (k = hash_str(key) & mask; h->ids[k]; k = (k + 1) & mask) {
+      key2 = get_key(state->users->user_map[h->ids[k]]);
+      if (!strcmp(key, key2)) break;
+    }
+    if (!h->ids[k]) h->ids[k] = state->participants[i]->id;
+  }
+}
+
+static int
+hash_find(
+        teamdb_state_t state,
+        const struct teamdb_hash *h,
+        const unsigned char *(*get_key)(const struct userlist_user *),
+        const unsigned char *key)
+{
+  unsigned mask, k;
+
+  if (!h->size || !key) return -1;
+  mask = h->size - 1;
+  for (k = hash_str(key) & mask; h->ids[k]; k = (k + 1) & mask) {
+    if (!strcmp(key, get_key(state->users->user_map[h->ids[k]])))
+      return h->ids[k];
+  }
+  return -1;
+}
+
+static void
+free_users(teamdb_state_t state)
+{
+  int i;
+
+  if (!state->header) {
+    if (state->users) {
+      userlist_free((struct xml_tree*) state->users);
+    }
+  } else {
+    xfree(state->header);
+  }
+  state->header = 0;
+  state->users = 0;
+  for (i = 0; i < state->delta_u; i++)
+    xfree(state->deltas[i]);
+  xfree(state->deltas);
+  state->deltas = 0;
+  state->delta_u = state->delta_a = 0;
+  state->delta_users = 0;
+  xfree(state->user_map);
+  state->user_map = 0;
+}
+
+/* merge the changed users into the current user map */
+static void
+apply_delta(teamdb_state_t state, UserlistBinaryHeader *delta)
+{
+  const struct userlist_list *dl = userlist_bin_get_root(delta);
+  const int32_t *ids;
+  int count = 0, i, user_id, new_size;
+  struct userlist_user *u;
+  struct userlist_user **new_map;
+
+  ids = userlist_bin_get_delta(delta, &count);
+  new_size = state->users->user_map_size;
+  for (i = 0; i < count; i++) {
+    user_id = ids[i];
+    if (user_id > 0 && user_id < dl->user_map_size && dl->user_map[user_id]
+        && user_id >= new_size)
+      new_size = user_id + 1;
+  }
+  if (!state->user_map || new_size > state->users->user_map_size) {
+    XCALLOC(new_map, new_size);
+    if (state->users->user_map_size > 0) {
+      memcpy(new_map, state->users->user_map,
+             state->users->user_map_size * sizeof(new_map[0]));
+    }
+    xfree(state->user_map);
+    state->user_map = new_map;
+    state->users->user_map = new_map;
+    state->users->user_map_size = new_size;
+  }
+  for (i = 0; i < count; i++) {
+    user_id = ids[i];
+    if (user_id <= 0 || user_id >= new_size) continue;
+    u = 0;
+    if (user_id < dl->user_map_size) u = dl->user_map[user_id];
+    state->user_map[user_id] = u;
+  }
+
+  if (state->delta_u == state->delta_a) {
+    if (!(state->delta_a *= 2)) state->delta_a = 8;
+    XREALLOC(state->deltas, state->delta_a);
+  }
+  state->deltas[state->delta_u++] = delta;
+  state->delta_users += count;
+}
+
+static void
+rebuild_participants(teamdb_state_t state, int user_contest_id)
+{
+  int i, j;
+  struct userlist_user *uu;
+  struct userlist_contest *uc;
+
+  xfree(state->participants);
+  state->participants = 0;
+  xfree(state->u_contests);
+  state->u_contests = 0;
+  state->total_participants = 0;
+  hash_free(&state->login_hash);
+  hash_free(&state->name_hash);
+  hash_free(&state->cypher_hash);
+
+  if (state->users->user_map_size <= 0) return;
+
+  for (i = 1; i < state->users->user_map_size; i++)
+    if (state->users->user_map[i]) state->total_participants++;
+  if (!state->total_participants) return;
+
+  XCALLOC(state->participants, state->total_participants);
+  XCALLOC(state->u_contests, state->users->user_map_size);
+
+  for (i = 1, j = 0; i < state->users->user_map_size; i++) {
+    if (!(uu = state->users->user_map[i])) continue;
+    if (!uu->contests) continue;
+
+    for (uc = (struct userlist_contest*) uu->contests->first_down;
+         uc; uc = (struct userlist_contest*) uc->b.right) {
+      if (uc->id == user_contest_id) break;
+    }
+    if (!uc) continue;
+
+    state->participants[j++] = state->users->user_map[i];
+    state->u_contests[i] = uc;
+  }
+  ASSERT(j <= state->total_participants);
+  if (j < state->total_participants) {
+    err("teamdb_refresh: registered %d, passed %d", j,
+        state->total_participants);
+  }
+
+  hash_build(state, &state->login_hash, get_login_key);
+  hash_build(state, &state->name_hash, get_name_key);
+  hash_build(state, &state->cypher_hash, get_cypher_key);
+}
+
 int
 teamdb_refresh(teamdb_state_t state)
 {
-  int i, r, j;
+  int r;
   struct userlist_list *new_users;
   unsigned long prev_vintage;
-  struct userlist_user *uu;
-  struct userlist_contest *uc;
   size_t data_size = 0;
   const struct contest_desc *cnts = 0;
   int user_contest_id = state->contest_id;
   UserlistBinaryHeader *new_header = NULL;
+  int delta_count = -1;
 
   struct timeval tv1, tv2;
 
@@ -182,16 +392,45 @@ teamdb_refresh(teamdb_state_t state)
   if (cnts && cnts->user_contest_num) user_contest_id = cnts->user_contest_num;
 
   if (state->callbacks) {
-    r = state->callbacks->list_all_users(state->callbacks->user_data,
-                                         user_contest_id, NULL, &new_header);
-    if (r < 0) {
-      err("teamdb_refresh: cannot load userlist: %s", userlist_strerror(-r));
-      return -1;
+    if (state->callbacks->list_users_delta && !state->delta_disabled) {
+      int vintage = 0;
+      if (state->header && state->vintage
+          && state->delta_u < TEAMDB_MAX_DELTAS
+          && state->delta_users <= state->total_participants / 2 + 16) {
+        vintage = state->vintage;
+      }
+      r = state->callbacks->list_users_delta(state->callbacks->user_data,
+                                             user_contest_id, vintage,
+                                             &new_header);
+      if (r < 0) {
+        err("teamdb_refresh: delta update is not available: %s",
+            userlist_strerror(-r));
+        state->delta_disabled = 1;
+        new_header = NULL;
+      }
+    }
+    if (!new_header) {
+      r = state->callbacks->list_all_users(state->callbacks->user_data,
+                                           user_contest_id, NULL, &new_header);
+      if (r < 0) {
+        err("teamdb_refresh: cannot load userlist: %s", userlist_strerror(-r));
+        return -1;
+      }
     }
     data_size = new_header->pkt_size;
-    new_users = (struct userlist_list*) userlist_bin_get_root(new_header);
     state->need_update = 0;
     state->pseudo_vintage++;
+
+    if (state->header && userlist_bin_get_delta(new_header, &delta_count)) {
+      state->vintage = new_header->vintage;
+      apply_delta(state, new_header);
+      new_users = state->users;
+      new_header = state->header;
+    } else {
+      delta_count = -1;
+      state->vintage = new_header->vintage;
+      new_users = (struct userlist_list*) userlist_bin_get_root(new_header);
+    }
   } else {
     unsigned char *xml_text = NULL;
     if (open_connection(&state->old, user_contest_id) < 0) return -1;
@@ -234,65 +473,32 @@ teamdb_refresh(teamdb_state_t state)
     }
   }
 
-  if (!state->header) {
-    if (state->users) {
-      userlist_free((struct xml_tree*) state->users);
-    }
-  }
-  if (state->header) {
-    xfree(state->header);
+  if (delta_count < 0) {
+    free_users(state);
+    state->header = new_header;
+    state->users = new_users;
   }
-  state->header = new_header;
-  state->users = new_users;
-  xfree(state->participants);
-  state->participants = 0;
-  xfree(state->u_contests);
-  state->u_contests = 0;
-  state->total_participants = 0;
+  rebuild_participants(state, user_contest_id);
 
-  if (state->users->user_map_size <= 0) {
-    info("teamdb_refresh: no users in updated contest");
-    call_update_hooks(state);
-    return 1;
-  }
-
-  for (i = 1; i < state->users->user_map_size; i++)
-    if (state->users->user_map[i]) state->total_participants++;
   if (!state->total_participants) {
     info("teamdb_refresh: no users in updated contest");
     call_update_hooks(state);
     return 1;
   }
 
-  XCALLOC(state->participants, state->total_participants);
-  XCALLOC(state->u_contests, state->users->user_map_size);
-
-  for (i = 1, j = 0; i < state->users->user_map_size; i++) {
-    if (!(uu = state->users->user_map[i])) continue;
-    if (!uu->contests) continue;
-
-    for (uc = (struct userlist_contest*) uu->contests->first_down;
-         uc; uc = (struct userlist_contest*) uc->b.right) {
-      if (uc->id == user_contest_id) break;
-    }
-    if (!uc) continue;
-
-    state->participants[j++] = state->users->user_map[i];
-    state->u_contests[i] = uc;
-  }
-  ASSERT(j <= state->total_participants);
-  if (j < state->total_participants) {
-    err("teamdb_refresh: registered %d, passed %d", j,
-        state->total_participants);
-  }
-
   gettimeofday(&tv2, NULL);
 
   unsigned long long t1 = (unsigned long long) tv1.tv_sec * 1000000UL + tv1.tv_usec;
   unsigned long long t2 = (unsigned long long) tv2.tv_sec * 1000000UL + tv2.tv_usec;
 
-  info("teamdb_refresh: updated: %d users, %d max user, XML size = %zu, time = %llu",
-       state->total_participants, state->users->user_map_size - 1, data_size, (t2 - t1));
+  if (delta_count >= 0) {
+    info("teamdb_refresh: updated: %d users, %d max user, %d changed, size = %zu, time = %llu",
+         state->total_participants, state->users->user_map_size - 1,
+         delta_count, data_size, (t2 - t1));
+  } else {
+    info("teamdb_refresh: updated: %d users, %d max user, XML size = %zu, time = %llu",
+         state->total_participants, state->users->user_map_size - 1, data_size, (t2 - t1));
+  }
   state->extra_out_of_sync = 1;
   call_update_hooks(state);
   return 1;
@@ -359,63 +565,31 @@ teamdb_lookup(teamdb_state_t state, int teamno)
 int
 teamdb_lookup_login(teamdb_state_t state, char const *login)
 {
-  int i;
-
   if (state->disabled) return -1;
 
   if (teamdb_refresh(state) < 0) return -1;
   if (!state->participants) return -1;
-  for (i = 0; i < state->total_participants; i++) {
-    ASSERT(state->participants[i]);
-    ASSERT(state->participants[i]->login);
-    if (!strcmp(state->participants[i]->login, login))
-      return state->participants[i]->id;
-  }
-  return -1;
+  return hash_find(state, &state->login_hash, get_login_key, login);
 }
 
 int
 teamdb_lookup_name(teamdb_state_t state, char const *name)
 {
-  int i;
-  const unsigned char *v;
-  const struct userlist_user *u = 0;
-
   if (state->disabled) return -1;
 
   if (teamdb_refresh(state) < 0) return -1;
   if (!state->participants) return -1;
-  for (i = 0; i < state->total_participants; i++) {
-    u = state->participants[i];
-    ASSERT(u);
-    v = 0;
-    if (u->cnts0) v = u->cnts0->name;
-    if (!v || !*v) v = state->participants[i]->login;
-    ASSERT(v);
-    if (!strcmp(v, name))
-      return state->participants[i]->id;
-  }
-  return -1;
+  return hash_find(state, &state->name_hash, get_name_key, name);
 }
 
 int
 teamdb_lookup_cypher(teamdb_state_t state, char const *cypher)
 {
-  int i;
-  const struct userlist_user *u;
-  const struct userlist_user_info *ui;
-
   if (state->disabled) return -1;
 
   if (teamdb_refresh(state) < 0) return -1;
   if (!state->participants) return -1;
-  for (i = 0; i < state->total_participants; i++) {
-    if (!(u = state->participants[i])) continue;
-    if (!(ui = u->cnts0)) continue;
-    if (ui->exam_cypher && !strcmp(ui->exam_cypher, cypher))
-      return u->id;
-  }
-  return -1;
+  return hash_find(state, &state->cypher_hash, get_cypher_key, cypher);
 }
 
 char *
@@ -828,15 +1002,12 @@ teamdb_destroy(teamdb_state_t state)
   }
   xfree(state->callbacks);
 
-  if (!state->header) {
-    if (state->users) {
-      userlist_free((struct xml_tree*) state->users);
-    }
-  } else {
-    xfree(state->header);
-  }
+  free_users(state);
   xfree(state->participants);
   xfree(state->u_contests);
+  hash_free(&state->login_hash);
+  hash_free(&state->name_hash);
+  hash_free(&state->cypher_hash);
   for (i = 0; i < state->extra_num; i++)
     xfree(state->extra_info[i]);
   xfree(state->extra_info);
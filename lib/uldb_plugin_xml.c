@@ -30,6 +30,8 @@
 #include "ejudge/xml_utils.h"
 
 #include <string.h>
+#include <stdarg.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -39,6 +41,11 @@
 // default interval to flush changes, in seconds
 #define DEFAULT_FLUSH_INTERVAL 600
 #define DEFAULT_BACKUP_INTERVAL (24*60*60)
+// the journal is compacted into a full snapshot, when it grows larger
+#define JOURNAL_COMPACT_SIZE (16*1024*1024)
+// the buffered journal records are synced once a second, or earlier,
+// when the buffer grows larger
+#define JOURNAL_SYNC_SIZE (64*1024)
 
 static struct common_plugin_data *init_func(void);
 static int finish_func(struct common_plugin_data *);
@@ -379,6 +386,16 @@ struct uldb_xml_state
   time_t last_backup_time;
   int backup_interval;
   struct userlist_list *userlist;
+
+  // the changes since the last snapshot are appended to the journal
+  unsigned char *journal_path;
+  int journal_fd;
+  long long journal_file_size;
+  time_t journal_sync_time;
+  // the records not yet written
+  char *journal_buf;
+  size_t journal_size;
+  size_t journal_reserved;
 };
 
 struct user_id_iterator
@@ -452,6 +469,7 @@ init_func(void)
   struct uldb_xml_state *state;
 
   XCALLOC(state, 1);
+  state->journal_fd = -1;
   return (struct common_plugin_data*) state;
 }
 
@@ -503,6 +521,377 @@ open_func(void *data)
   return 0;
 }
 
+/*
+ * the journal consists of the records "T SIZE CRC32\n" followed by SIZE
+ * bytes of payload, each record sets the state of a single object,
+ * so replaying the records already saved in the snapshot is harmless
+ *   U - "SERIAL\n" and the XML of the user, the user is replaced
+ *   C - the cookie fields, the cookie is created or replaced
+ *   R - "USER_ID COOKIE", the cookie is removed
+ *   X - "USER_ID", all the cookies of the user are removed
+ *   D - "USER_ID", the user is removed
+ * the rare changes (groups, member serial) still mark the whole
+ * database dirty
+ */
+static void
+journal_append(
+        struct uldb_xml_state *state,
+        int type,
+        const char *data,
+        size_t size)
+{
+  char hdr[64];
+  int hlen;
+  size_t new_reserved;
+
+  if (state->journal_fd < 0) {
+    // the next snapshot saves the change
+    state->dirty = 1;
+    return;
+  }
+
+  hlen = snprintf(hdr, sizeof(hdr), "%c %zu %08lx\n", type, size,
+                  (unsigned long) crc32(0L, (const Bytef*) data, size));
+  if (state->journal_size + hlen + size > state->journal_reserved) {
+    new_reserved = state->journal_reserved;
+    if (!new_reserved) new_reserved = 4096;
+    while (state->journal_size + hlen + size > new_reserved)
+      new_reserved *= 2;
+    state->journal_buf = xrealloc(state->journal_buf, new_reserved);
+    state->journal_reserved = new_reserved;
+  }
+  memcpy(state->journal_buf + state->journal_size, hdr, hlen);
+  memcpy(state->journal_buf + state->journal_size + hlen, data, size);
+  state->journal_size += hlen + size;
+}
+
+static void
+journal_printf(struct uldb_xml_state *state, int type, const char *format, ...)
+  __attribute__((format(printf, 3, 4)));
+static void
+journal_printf(struct uldb_xml_state *state, int type, const char *format, ...)
+{
+  char buf[256];
+  va_list args;
+  int len;
+
+  va_start(args, format);
+  len = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  if (len < 0 || len >= sizeof(buf)) {
+    state->dirty = 1;
+    return;
+  }
+  journal_append(state, type, buf, len);
+}
+
+static void
+journal_user(struct uldb_xml_state *state, const struct userlist_user *u)
+{
+  char *text = 0;
+  size_t size = 0;
+  FILE *f;
+
+  if (state->journal_fd < 0 || !(f = open_memstream(&text, &size))) {
+    state->dirty = 1;
+    return;
+  }
+  fprintf(f, "%d\n", state->userlist->member_serial);
+  userlist_unparse_user(u, f, USERLIST_MODE_ALL, -1,
+                        USERLIST_SHOW_REG_PASSWD | USERLIST_SHOW_CNTS_PASSWD);
+  close_memstream(f); f = 0;
+  journal_append(state, 'U', text, size);
+  xfree(text);
+}
+
+static void
+journal_cookie(struct uldb_xml_state *state, const struct userlist_cookie *c)
+{
+  journal_printf(state, 'C', "%d %llx %llx %s %d %lld %d %d %d %d %d %d %d %d\n",
+                 c->user_id, c->cookie, c->client_key,
+                 xml_unparse_ipv6(&c->ip), c->ssl, (long long) c->expire,
+                 c->contest_id, c->locale_id, c->priv_level, c->role,
+                 c->recovery, c->team_login, c->is_ws, c->is_job);
+}
+
+/* writes out the buffered records, a single sync covers all of them */
+static void
+journal_sync(struct uldb_xml_state *state, time_t cur_time)
+{
+  size_t pos = 0;
+  ssize_t w;
+
+  if (state->journal_fd < 0 || !state->journal_size) return;
+
+  while (pos < state->journal_size) {
+    w = write(state->journal_fd, state->journal_buf + pos,
+              state->journal_size - pos);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) {
+      err("journal: write() failed: %s", os_ErrorMsg());
+      goto failed;
+    }
+    pos += w;
+  }
+  if (fdatasync(state->journal_fd) < 0) {
+    err("journal: fdatasync() failed: %s", os_ErrorMsg());
+    goto failed;
+  }
+  state->journal_file_size += state->journal_size;
+  state->journal_size = 0;
+  state->journal_sync_time = cur_time;
+  return;
+
+ failed:
+  // the journal may be damaged, the snapshot truncates it
+  state->journal_file_size += pos;
+  state->journal_size = 0;
+  state->journal_sync_time = cur_time;
+  state->dirty = 1;
+  state->flush_interval = 0;
+}
+
+/* the snapshot contains all the changes, so the journal is not needed */
+static void
+journal_truncate(struct uldb_xml_state *state)
+{
+  state->journal_size = 0;
+  if (state->journal_fd < 0) return;
+  if (ftruncate(state->journal_fd, 0) < 0) {
+    // the records are replayed once more on the next start, which is ok
+    err("journal: ftruncate() failed: %s", os_ErrorMsg());
+    return;
+  }
+  state->journal_file_size = 0;
+}
+
+static struct userlist_cookie *
+find_user_cookie(const struct userlist_user *u, ej_cookie_t value)
+{
+  struct xml_tree *t;
+
+  if (!u->cookies) return 0;
+  for (t = u->cookies->first_down; t; t = t->right) {
+    if (((struct userlist_cookie*) t)->cookie == value)
+      return (struct userlist_cookie*) t;
+  }
+  return 0;
+}
+
+static struct userlist_user *
+get_replay_user(struct uldb_xml_state *state, int user_id)
+{
+  struct userlist_list *ul = state->userlist;
+
+  if (user_id <= 0 || user_id >= ul->user_map_size) return 0;
+  return ul->user_map[user_id];
+}
+
+static int
+replay_user(struct uldb_xml_state *state, char *text)
+{
+  struct userlist_list *ul = state->userlist;
+  struct userlist_user *u, *old_u, **new_map;
+  int serial = 0, n = 0;
+  size_t new_size;
+
+  if (sscanf(text, "%d%n", &serial, &n) != 1 || text[n] != '\n') return -1;
+  if (!(u = userlist_parse_user_str(text + n + 1))) return -1;
+  if (u->id <= 0) {
+    userlist_free(&u->b);
+    return -1;
+  }
+
+  if (u->id >= ul->user_map_size) {
+    new_size = ul->user_map_size;
+    while (u->id >= new_size) new_size *= 2;
+    new_map = (struct userlist_user**) xcalloc(new_size, sizeof(new_map[0]));
+    memcpy(new_map, ul->user_map, ul->user_map_size * sizeof(new_map[0]));
+    xfree(ul->user_map);
+    ul->user_map = new_map;
+    ul->user_map_size = new_size;
+  }
+  if ((old_u = ul->user_map[u->id])) {
+    // the group membership is not a part of the user's XML
+    u->group_first = old_u->group_first;
+    u->group_last = old_u->group_last;
+    old_u->group_first = old_u->group_last = 0;
+    userlist_remove_user(ul, old_u);
+  }
+  xml_link_node_last(&ul->b, &u->b);
+  ul->user_map[u->id] = u;
+  if (serial > ul->member_serial) ul->member_serial = serial;
+  return 0;
+}
+
+static int
+replay_cookie(struct uldb_xml_state *state, char *text)
+{
+  struct userlist_cookie cc, *c;
+  struct userlist_user *u;
+  struct xml_tree *cs;
+  unsigned char ip_buf[64];
+  long long expire = 0;
+
+  memset(&cc, 0, sizeof(cc));
+  if (sscanf(text, "%d %llx %llx %63s %d %lld %d %d %d %d %d %d %d %d",
+             &cc.user_id, &cc.cookie, &cc.client_key, ip_buf, &cc.ssl,
+             &expire, &cc.contest_id, &cc.locale_id, &cc.priv_level,
+             &cc.role, &cc.recovery, &cc.team_login, &cc.is_ws,
+             &cc.is_job) != 14)
+    return -1;
+  if (xml_parse_ipv6_2(ip_buf, &cc.ip) < 0) return -1;
+  if (!cc.cookie) return -1;
+  if (!(u = get_replay_user(state, cc.user_id))) return 0;
+
+  if (!(c = find_user_cookie(u, cc.cookie))) {
+    if (!(cs = u->cookies)) {
+      u->cookies = cs = userlist_node_alloc(USERLIST_T_COOKIES);
+      xml_link_node_last(&u->b, cs);
+    }
+    c = (struct userlist_cookie*) userlist_node_alloc(USERLIST_T_COOKIE);
+    xml_link_node_last(cs, &c->b);
+  }
+  c->user_id = cc.user_id;
+  c->ip = cc.ip;
+  c->ssl = cc.ssl;
+  c->cookie = cc.cookie;
+  c->client_key = cc.client_key;
+  c->expire = expire;
+  c->contest_id = cc.contest_id;
+  c->locale_id = cc.locale_id;
+  c->priv_level = cc.priv_level;
+  c->role = cc.role;
+  c->recovery = cc.recovery;
+  c->team_login = cc.team_login;
+  c->is_ws = cc.is_ws;
+  c->is_job = cc.is_job;
+  return 0;
+}
+
+static int
+replay_record(struct uldb_xml_state *state, int type, char *text)
+{
+  struct userlist_user *u;
+  struct userlist_cookie *c;
+  int user_id = 0;
+  ej_cookie_t value = 0;
+
+  switch (type) {
+  case 'U':
+    return replay_user(state, text);
+  case 'C':
+    return replay_cookie(state, text);
+  case 'R':
+    if (sscanf(text, "%d %llx", &user_id, &value) != 2) return -1;
+    if ((u = get_replay_user(state, user_id))
+        && (c = find_user_cookie(u, value)))
+      remove_cookie_func(state, c);
+    return 0;
+  case 'X':
+    if (sscanf(text, "%d", &user_id) != 1) return -1;
+    if (get_replay_user(state, user_id))
+      remove_user_cookies_func(state, user_id);
+    return 0;
+  case 'D':
+    if (sscanf(text, "%d", &user_id) != 1) return -1;
+    if (get_replay_user(state, user_id))
+      remove_user_func(state, user_id);
+    return 0;
+  }
+  return -1;
+}
+
+/* returns the size of the undamaged part of the journal */
+static long long
+journal_replay(struct uldb_xml_state *state, int fd, long long size)
+{
+  char *buf, *p, *e, *q, *payload;
+  long long rsize = 0;
+  ssize_t r;
+  char type, saved;
+  size_t len;
+  unsigned long crc;
+  int n, count = 0;
+
+  buf = xmalloc(size + 1);
+  while (rsize < size) {
+    r = read(fd, buf + rsize, size - rsize);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) break;
+    rsize += r;
+  }
+  buf[rsize] = 0;
+
+  p = buf; e = buf + rsize;
+  while (p < e) {
+    if (!(q = memchr(p, '\n', e - p))) break;
+    n = 0;
+    if (sscanf(p, "%c %zu %lx%n", &type, &len, &crc, &n) != 3 || p + n != q)
+      break;
+    payload = q + 1;
+    if (len > e - payload) break;
+    if (crc32(0L, (const Bytef*) payload, len) != crc) break;
+    saved = payload[len];
+    payload[len] = 0;
+    n = replay_record(state, type, payload);
+    payload[len] = saved;
+    if (n < 0) {
+      err("journal %s: invalid record at offset %lld",
+          state->journal_path, (long long) (p - buf));
+      break;
+    }
+    ++count;
+    p = payload + len;
+  }
+  rsize = p - buf;
+  xfree(buf);
+
+  if (count > 0) {
+    info("journal %s: %d records replayed", state->journal_path, count);
+    state->dirty = 1;
+  }
+  if (rsize < size) {
+    err("journal %s: %lld bytes of damaged records are dropped",
+        state->journal_path, size - rsize);
+    if (ftruncate(fd, rsize) < 0) {
+      err("journal: ftruncate() failed: %s", os_ErrorMsg());
+      return size;
+    }
+  }
+  return rsize;
+}
+
+static int
+journal_open(struct uldb_xml_state *state, int create_flag)
+{
+  struct stat stb;
+  int fd, flags = O_RDWR | O_CREAT | O_APPEND;
+  long long size = 0;
+
+  if (!state->journal_path) {
+    state->journal_path = xmalloc(strlen(state->db_path) + 16);
+    sprintf(state->journal_path, "%s.journal", state->db_path);
+  }
+  if (create_flag) flags |= O_TRUNC;
+  if ((fd = open(state->journal_path, flags, 0600)) < 0) {
+    err("journal: open() of `%s' failed: %s", state->journal_path,
+        os_ErrorMsg());
+    return -1;
+  }
+  if (fstat(fd, &stb) < 0) {
+    err("journal: fstat() failed: %s", os_ErrorMsg());
+    close(fd);
+    return -1;
+  }
+  if (stb.st_size > 0) size = journal_replay(state, fd, stb.st_size);
+
+  state->journal_fd = fd;
+  state->journal_file_size = size;
+  state->journal_sync_time = 0;
+  return 0;
+}
+
 static int
 check_func(void *data)
 {
@@ -532,6 +921,10 @@ check_func(void *data)
   state->last_flush_time = time(0);
   state->dirty = 0;
 
+  // the changes after the snapshot
+  if (journal_open(state, 0) < 0)
+    return -1;
+
   if (userlist_build_login_hash(state->userlist) < 0)
     return -1;
   if (userlist_build_cookie_hash(state->userlist) < 0)
@@ -550,6 +943,10 @@ create_func(void *data)
   state->last_flush_time = 0;
   state->dirty = 1;
 
+  // a stale journal must not be applied to the new database
+  if (journal_open(state, 1) < 0)
+    return -1;
+
   return 1;
 }
 
@@ -560,7 +957,9 @@ flush_database(struct uldb_xml_state *state)
   FILE *f = 0;
   int fd = -1;
 
-  if (!state->dirty) return;
+  if (!state->dirty
+      && state->journal_file_size + state->journal_size < JOURNAL_COMPACT_SIZE)
+    return;
 
   os_rDirName(state->db_path, basedir, sizeof(basedir));
   snprintf(tempname, sizeof(tempname), "%s/%u", basedir, random_u32());
@@ -576,10 +975,15 @@ flush_database(struct uldb_xml_state *state)
   fd = -1;
 
   userlist_unparse(state->userlist, f);
-  if (ferror(f)) {
+  if (fflush(f) < 0 || ferror(f)) {
     err("bdflush: write failed: %s", os_ErrorMsg());
     goto failed;
   }
+  // the journal is truncated after the rename, so the data must be on disk
+  if (fsync(fileno(f)) < 0) {
+    err("bdflush: fsync() failed: %s", os_ErrorMsg());
+    goto failed;
+  }
   if (fclose(f) < 0) {
     err("bdflush: fclose() failed: %s", os_ErrorMsg());
     f = NULL;
@@ -591,6 +995,18 @@ flush_database(struct uldb_xml_state *state)
     err("bdflush: rename() failed: %s", os_ErrorMsg());
     goto failed;
   }
+  // the rename must be on disk as well before the journal is truncated
+  if ((fd = open(basedir, O_RDONLY | O_DIRECTORY)) < 0) {
+    err("bdflush: open for `%s' failed: %s", basedir, os_ErrorMsg());
+    goto failed;
+  }
+  if (fsync(fd) < 0) {
+    err("bdflush: fsync() for `%s' failed: %s", basedir, os_ErrorMsg());
+    goto failed;
+  }
+  close(fd); fd = -1;
+
+  journal_truncate(state);
 
   state->last_flush_time = time(0);
   state->flush_interval = DEFAULT_FLUSH_INTERVAL;
@@ -610,6 +1026,9 @@ close_func(void *data)
 {
   struct uldb_xml_state *state = (struct uldb_xml_state*) data;
 
+  // compact the journal, so it is not replayed on the next start
+  if (state->journal_file_size + state->journal_size > 0) state->dirty = 1;
+
   // ensure success on saving
   while (state->dirty) {
     flush_database(state);
@@ -617,6 +1036,11 @@ close_func(void *data)
     sleep(10);
   }
 
+  if (state->journal_fd >= 0) close(state->journal_fd);
+  state->journal_fd = -1;
+  xfree(state->journal_buf); state->journal_buf = 0;
+  state->journal_size = state->journal_reserved = 0;
+
   return 0;
 }
 
@@ -730,6 +1154,7 @@ sync_func(void *data)
 {
   struct uldb_xml_state *state = (struct uldb_xml_state*) data;
 
+  journal_sync(state, time(0));
   state->flush_interval = 0;
 }
 
@@ -841,8 +1266,7 @@ new_user_func(
   }
 
   u->registration_time = time(0);
-  state->dirty = 1;
-  state->flush_interval /= 2;
+  journal_user(state, u);
 
   return u->id;
 }
@@ -865,7 +1289,7 @@ remove_user_func(void *data, int user_id)
     }
   }
   userlist_remove_user(ul, u);
-  state->dirty = 1;
+  journal_printf(state, 'D', "%d\n", user_id);
   return 0;
 }
 
@@ -976,7 +1400,7 @@ new_cookie_func(
 
   if (p_cookie) *p_cookie = c;
 
-  state->dirty = 1;
+  journal_cookie(state, c);
   return 0;
 }
 
@@ -1052,7 +1476,7 @@ new_cookie_2_func(
 
   if (p_cookie) *p_cookie = c;
 
-  state->dirty = 1;
+  journal_cookie(state, c);
   return 0;
 }
 
@@ -1069,6 +1493,7 @@ remove_cookie_func(void *data, const struct userlist_cookie *cookie)
     return -1;
   }
 
+  journal_printf(state, 'R', "%d %llx\n", cookie->user_id, cookie->cookie);
   userlist_cookie_hash_del(ul, cookie);
   xml_unlink_node(p);
   userlist_free(p);
@@ -1103,6 +1528,7 @@ remove_user_cookies_func(void *data, int user_id)
   xml_unlink_node(u->cookies);
   userlist_free(u->cookies);
   u->cookies = 0;
+  journal_printf(state, 'X', "%d\n", user_id);
   return count;
 }
 
@@ -1264,7 +1690,7 @@ touch_login_time_func(void *data, int user_id, int contest_id, time_t cur_time)
                                   0);
     if (ui) ui->last_login_time = cur_time;
   }
-  state->dirty = 1;
+  journal_user(state, u);
   return 0;
 }
 
@@ -1312,7 +1738,7 @@ set_cookie_contest_func(void *data,
 
   if (cc->contest_id != contest_id) {
     cc->contest_id = contest_id;
-    state->dirty = 1;
+    journal_cookie(state, cc);
   }
   return 0;
 }
@@ -1327,7 +1753,7 @@ set_cookie_locale_func(void *data,
 
   if (cc->locale_id != locale_id) {
     cc->locale_id = locale_id;
-    state->dirty = 1;
+    journal_cookie(state, cc);
   }
   return 0;
 }
@@ -1342,7 +1768,7 @@ set_cookie_priv_level_func(void *data,
 
   if (cc->priv_level != priv_level) {
     cc->priv_level = priv_level;
-    state->dirty = 1;
+    journal_cookie(state, cc);
   }
   return 0;
 }
@@ -1358,7 +1784,7 @@ set_cookie_team_login_func(
 
   if (cc->team_login != team_login) {
     cc->team_login = team_login;
-    state->dirty = 1;
+    journal_cookie(state, cc);
   }
   return 0;
 }
@@ -1587,8 +2013,7 @@ set_reg_passwd_func(void *data, int user_id,
   u->passwd_method = method;
   if (cur_time <= 0) cur_time = time(0);
   u->last_pwdchange_time = cur_time;
-  state->dirty = 1;
-  state->flush_interval /= 2;
+  journal_user(state, u);
   return 0;
 }
 
@@ -1621,8 +2046,7 @@ set_team_passwd_func(void *data, int user_id, int contest_id,
   ui->team_passwd = xstrdup(password);
   ui->team_passwd_method = method;
   ui->last_pwdchange_time = cur_time;
-  state->dirty = 1;
-  state->flush_interval /= 2;
+  journal_user(state, u);
   return 0;
 }
 
@@ -1666,8 +2090,7 @@ register_contest_func(void *data,
   c->flags = flags;
   c->create_time = cur_time;
 
-  state->dirty = 1;
-  state->flush_interval /= 2;
+  journal_user(state, u);
   if (p_c) *p_c = c;
 
   return 1;
@@ -1749,8 +2172,7 @@ remove_member_func(void *data, int user_id, int contest_id,
   */
 
   ui->last_change_time = cur_time;
-  state->dirty = 1;
-  state->flush_interval /= 2;
+  journal_user(state, u);
   return 0;
 }
 
@@ -1877,8 +2299,7 @@ clear_team_passwd_func(void *data, int user_id, int contest_id,
 
   xfree(ui->team_passwd); ui->team_passwd = 0;
   ui->team_passwd_method = 0;
-  state->dirty = 1;
-  state->flush_interval /= 2;
+  journal_user(state, u);
   return 0;
 }
 
@@ -1906,8 +2327,7 @@ remove_registration_func(void *data, int user_id, int contest_id)
   xml_unlink_node(t);
   userlist_free(t);
 
-  state->dirty = 1;
-  state->flush_interval /= 2;
+  journal_user(state, u);
   return 0;
 }
 
@@ -1929,8 +2349,7 @@ set_reg_status_func(void *data, int user_id, int contest_id, int status)
 
   if (status == c->status) return 0;
   c->status = status;
-  state->dirty = 1;
-  state->flush_interval /= 2;
+  journal_user(state, u);
   return 1;
 }
 
@@ -1962,8 +2381,7 @@ set_reg_flags_func(void *data, int user_id, int contest_id, int cmd,
   if (new_value == c->flags) return 0;
 
   c->flags = new_value;
-  state->dirty = 1;
-  state->flush_interval /= 2;
+  journal_user(state, u);
   return 1;
 }
 
@@ -1985,8 +2403,7 @@ remove_user_contest_info_func(void *data, int user_id, int contest_id)
     userlist_free(&uc->b);
   }
 
-  state->dirty = 1;
-  state->flush_interval /= 2;
+  journal_user(state, u);
   return 1;
 }
 
@@ -2009,8 +2426,7 @@ clear_user_field_func(void *data, int user_id, int field_id, time_t cur_time)
   if ((r = userlist_delete_user_field(u, field_id)) == 1) {
     if (field_id == USERLIST_NN_PASSWD) u->last_pwdchange_time = cur_time;
     else u->last_change_time = cur_time;
-    state->dirty = 1;
-    state->flush_interval /= 2;
+    journal_user(state, u);
   }
   return r;
 }
@@ -2045,8 +2461,7 @@ clear_user_info_field_func(void *data, int user_id, int contest_id,
   if ((r = userlist_delete_user_info_field(ui, field_id)) == 1) {
     if (field_id == USERLIST_NC_TEAM_PASSWD) ui->last_pwdchange_time = cur_time;
     else ui->last_change_time = cur_time;
-    state->dirty = 1;
-    state->flush_interval /= 2;
+    journal_user(state, u);
   }
   return r;
 }
@@ -2083,8 +2498,7 @@ clear_user_member_field_func(void *data, int user_id, int contest_id,
 
   if ((r = userlist_delete_member_field(m, field_id)) == 1) {
     m->last_change_time = cur_time;
-    state->dirty = 1;
-    state->flush_interval /= 2;
+    journal_user(state, u);
   }
   return r;
 }
@@ -2124,8 +2538,7 @@ set_user_field_func(void *data,
     if (field_id == USERLIST_NN_LOGIN) userlist_build_login_hash(ul);
     if (field_id == USERLIST_NN_PASSWD) u->last_pwdchange_time = cur_time;
     else u->last_change_time = cur_time;
-    state->dirty = 1;
-    state->flush_interval /= 2;
+    journal_user(state, u);
   }
   return r;
 }
@@ -2165,8 +2578,7 @@ set_user_info_field_func(void *data,
   if ((r = userlist_set_user_info_field_str(ui, field_id, value)) == 1) {
     if (field_id == USERLIST_NC_TEAM_PASSWD) ui->last_pwdchange_time = cur_time;
     else ui->last_change_time = cur_time;
-    state->dirty = 1;
-    state->flush_interval /= 2;
+    journal_user(state, u);
   }
   return r;
 }
@@ -2209,8 +2621,7 @@ set_user_member_field_func(void *data,
 
   if ((r = userlist_set_member_field_str(m, field_id, value)) == 1) {
     m->last_change_time = cur_time;
-    state->dirty = 1;
-    state->flush_interval /= 2;
+    journal_user(state, u);
   }
   return r;
 }
@@ -2277,8 +2688,7 @@ new_member_func(void *data, int user_id, int contest_id, int role,
   }
   mm->m[mm->u++] = m;
 
-  state->dirty = 1;
-  state->flush_interval /= 2;
+  journal_user(state, u);
   return m->serial;
 }
 
@@ -2368,6 +2778,12 @@ maintenance_func(void *data, time_t cur_time)
   if (cur_time > state->last_flush_time + state->flush_interval) {
     flush_database(state);
   }
+
+  if (state->journal_size > 0
+      && (cur_time != state->journal_sync_time
+          || state->journal_size >= JOURNAL_SYNC_SIZE)) {
+    journal_sync(state, cur_time);
+  }
   return 0;
 }
 
@@ -2439,8 +2855,7 @@ set_user_xml_func(void *data,
   // update the user's fields
   new_ui = new_u->cnts0;
   if (!new_ui) {
-    state->dirty = 1;
-    state->flush_interval /= 2;
+    journal_user(state, u);
     return 1;
   }
 
@@ -2702,8 +3117,7 @@ set_user_xml_func(void *data,
   }
 
   // FIXME: properly set the change flag?
-  state->dirty = 1;
-  state->flush_interval /= 2;
+  journal_user(state, u);
   return 1;
 }
 
@@ -2882,8 +3296,7 @@ copy_user_info_func(
   }
 
   ui_to->last_change_time = cur_time;
-  state->dirty = 1;
-  state->flush_interval /= 2;
+  journal_user(state, u);
   return 0;
 }
 
@@ -2918,23 +3331,20 @@ check_user_reg_data_func(void *data, int user_id, int contest_id)
     if ((c->flags & USERLIST_UC_INCOMPLETE)) {
       cm = (struct userlist_contest*) c;
       cm->flags &= ~USERLIST_UC_INCOMPLETE;
-      state->dirty = 1;
-      state->flush_interval /= 2;
+      journal_user(state, u);
       return 1;
     }
   } else {
     if (!nerr && (c->flags & USERLIST_UC_INCOMPLETE)) {
       cm = (struct userlist_contest*) c;
       cm->flags &= ~USERLIST_UC_INCOMPLETE;
-      state->dirty = 1;
-      state->flush_interval /= 2;
+      journal_user(state, u);
       return 1;
     } else if (nerr > 0 && !(c->flags & USERLIST_UC_INCOMPLETE)
                && (!ui || !ui->cnts_read_only)) {
       cm = (struct userlist_contest*) c;
       cm->flags |= USERLIST_UC_INCOMPLETE;
-      state->dirty = 1;
-      state->flush_interval /= 2;
+      journal_user(state, u);
       return 1;
     }
   }
@@ -2995,8 +3405,7 @@ move_member_func(
   m->team_role = new_role;
 
   ui->last_change_time = cur_time;
-  state->dirty = 1;
-  state->flush_interval /= 2;
+  journal_user(state, u);
   return 0;
 }
 
@@ -3336,8 +3745,7 @@ set_simple_reg_func(
   u->simple_registration = value;
   if (cur_time <= 0) cur_time = time(0);
   u->last_change_time = cur_time;
-  state->dirty = 1;
-  state->flush_interval /= 2;
+  journal_user(state, u);
   return 0;
 }
 
@@ -363,6 +363,8 @@ userlist_bin_marshall(
     header->max_user_id = cntx->max_user_id;
     header->root_offset = cntx->root_offset;
     header->contest_id = contest_id;
+    header->delta_count = cntx->delta_count;
+    header->delta_offset = cntx->delta_offset;
     memcpy(header->data, cntx->d.v, cntx->d.u);
     memcpy(header->data + cntx->d.u, cntx->s.v, cntx->s.u);
     return header;
@@ -379,6 +381,20 @@ userlist_bin_marshall_user_list(
     cntx->root_offset = make_offset(cntx, dul);
 }
 
+void
+userlist_bin_marshall_delta(
+        UserlistBinaryContext *cntx,
+        const int *user_ids,
+        int count)
+{
+    int32_t *dids = ulalloc(cntx, count * sizeof(dids[0]));
+    for (int i = 0; i < count; ++i) {
+        dids[i] = user_ids[i];
+    }
+    cntx->delta_count = count;
+    cntx->delta_offset = make_offset(cntx, dids);
+}
+
 void
 userlist_bin_finish_context(
         UserlistBinaryContext *cntx)
@@ -573,3 +589,14 @@ userlist_bin_get_root(const UserlistBinaryHeader *header)
 {
     return (const struct userlist_list *) (header->data + header->root_offset);
 }
+
+const int32_t *
+userlist_bin_get_delta(const UserlistBinaryHeader *header, int *p_count)
+{
+    if (!header->delta_offset) {
+        if (p_count) *p_count = 0;
+        return NULL;
+    }
+    if (p_count) *p_count = header->delta_count;
+    return (const int32_t *) (header->data + header->delta_offset);
+}
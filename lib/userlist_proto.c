@@ -159,6 +159,7 @@ static const unsigned char * const requests[] =
   [ULS_CHECK_USER_2]              = "CHECK_USER_2",
   [ULS_CREATE_COOKIE]             = "CREATE_COOKIE",
   [ULS_PRIV_CREATE_COOKIE]        = "PRIV_CREATE_COOKIE",
+  [ULS_LIST_STANDINGS_USERS_3]    = "LIST_STANDINGS_USERS_3",
 
   NULL,
 };
@@ -0,0 +1,637 @@
+/* -*- mode: c; c-basic-offset: 4 -*- */
+
+/* Copyright (C) 2024 Alexander Chernov <cher@ejudge.ru> */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "ejudge/userlist_shm.h"
+#include "ejudge/userlist_clnt.h"
+#include "ejudge/userlist_proto.h"
+#include "ejudge/xml_utils.h"
+#include "ejudge/errlog.h"
+#include "ejudge/osdeps.h"
+
+#include "ejudge/logger.h"
+#include "ejudge/xalloc.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define USERLIST_SHM_DIR "/dev/shm"
+#define USERLIST_SHM_MAGIC 0x4d48534c  /* "LSHM" */
+#define USERLIST_SHM_VERSION 1
+
+enum
+{
+    USERLIST_SHM_TIMEOUT = 10,          /* seconds without the writer */
+    USERLIST_SHM_USER_SERIALS = 1 << 20,
+    USERLIST_SHM_COOKIE_SLOTS = 8192,   /* power of 2 */
+    USERLIST_SHM_COOKIE_PROBES = 8,
+    USERLIST_SHM_PACKET_SIZE = 576,
+    USERLIST_SHM_READ_RETRIES = 16,
+};
+
+#define align64(x) (((x) + 63U) & ~(size_t) 63U)
+
+struct userlist_shm_header
+{
+    uint32_t magic;
+    int32_t version;
+    int32_t contest_id;           /* 0 - the cookie segment */
+    int32_t dead;                 /* the writer has left the segment */
+    int64_t update_time;          /* the last touch of the writer */
+    int32_t ip_check;             /* enable_cookie_ip_check of ej-users */
+    uint32_t global_serial;       /* changes of all users */
+    uint32_t serial_count;
+    uint32_t serial_offset;       /* uint32_t serials[serial_count] */
+    uint32_t cookie_count;
+    uint32_t cookie_offset;       /* struct userlist_shm_cookie[cookie_count] */
+    uint32_t users_seq;
+    uint32_t users_size;          /* 0 - the user list is not published */
+    uint64_t users_capacity;
+    uint64_t users_offset;        /* UserlistBinaryHeader */
+    uint64_t total_size;
+};
+
+struct userlist_shm_cookie
+{
+    uint32_t seq;
+    int32_t request_id;           /* 0 - the slot is free */
+    ej_cookie_t cookie;
+    ej_cookie_t client_key;
+    ej_ip_t ip;
+    int32_t ssl;
+    int32_t user_id;
+    uint32_t user_serial;
+    uint32_t global_serial;
+    int64_t expire;
+    uint32_t size;
+    unsigned char packet[USERLIST_SHM_PACKET_SIZE];
+};
+
+struct userlist_shm
+{
+    int contest_id;
+    int writable;
+    unsigned char *path;
+    size_t size;
+    struct userlist_shm_header *hdr;
+    time_t attempt_time;          /* the last attempt to map the segment */
+};
+
+/* the mapped segments of the reader by contest_id */
+static struct userlist_shm **readers;
+static int readers_size;
+
+/*
+ * the segments are kept in a private directory of the ejudge user,
+ * as /dev/shm is world-writable, and anybody may create a file
+ * with the expected name
+ */
+static int
+check_dir(const unsigned char *dir, int create_flag)
+{
+    struct stat stb;
+
+    if (create_flag && mkdir(dir, 0700) < 0 && errno != EEXIST) {
+        err("userlist_shm: mkdir %s failed: %s", dir, os_ErrorMsg());
+        return -1;
+    }
+    if (lstat(dir, &stb) < 0) return -1;
+    if (!S_ISDIR(stb.st_mode) || stb.st_uid != geteuid()
+        || (stb.st_mode & 0777) != 0700) {
+        err("userlist_shm: %s is not a private directory of uid %d",
+            dir, (int) geteuid());
+        return -1;
+    }
+    return 0;
+}
+
+/* the opened segment must be a private regular file of the ejudge user */
+static int
+check_file(int fd, const unsigned char *path, struct stat *pstb)
+{
+    if (fstat(fd, pstb) < 0) return -1;
+    if (!S_ISREG(pstb->st_mode) || pstb->st_uid != geteuid()
+        || (pstb->st_mode & 0777) != 0600) {
+        err("userlist_shm: %s is not a private file of uid %d",
+            path, (int) geteuid());
+        return -1;
+    }
+    return 0;
+}
+
+static unsigned char *
+make_path(const unsigned char *socket_path, int contest_id, int create_flag)
+{
+    unsigned char buf[PATH_MAX];
+    uint32_t h = 2166136261U;
+
+    // several ejudge installations may share the host
+    if (!socket_path) socket_path = "";
+    for (const unsigned char *s = socket_path; *s; ++s) {
+        h ^= *s;
+        h *= 16777619U;
+    }
+    snprintf(buf, sizeof(buf), "%s/ejudge-users.%08x",
+             USERLIST_SHM_DIR, (unsigned) h);
+    if (check_dir(buf, create_flag) < 0) return NULL;
+    size_t len = strlen(buf);
+    snprintf(buf + len, sizeof(buf) - len, "/%d", contest_id);
+    return xstrdup(buf);
+}
+
+static inline uint32_t
+seq_read_begin(const uint32_t *seq)
+{
+    return __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+}
+
+static inline int
+seq_read_retry(const uint32_t *seq, uint32_t start)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return (start & 1) || __atomic_load_n(seq, __ATOMIC_RELAXED) != start;
+}
+
+static inline void
+seq_write_begin(uint32_t *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void
+seq_write_end(uint32_t *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+static inline uint32_t *
+get_serials(const struct userlist_shm *shm)
+{
+    return (uint32_t *)((unsigned char *) shm->hdr + shm->hdr->serial_offset);
+}
+
+static inline struct userlist_shm_cookie *
+get_cookies(const struct userlist_shm *shm)
+{
+    return (struct userlist_shm_cookie *)((unsigned char *) shm->hdr + shm->hdr->cookie_offset);
+}
+
+static inline UserlistBinaryHeader *
+get_users(const struct userlist_shm *shm)
+{
+    return (UserlistBinaryHeader *)((unsigned char *) shm->hdr + shm->hdr->users_offset);
+}
+
+static inline unsigned
+cookie_slot(ej_cookie_t cookie)
+{
+    return (unsigned) (cookie ^ (cookie >> 32)) & (USERLIST_SHM_COOKIE_SLOTS - 1);
+}
+
+struct userlist_shm *
+userlist_shm_create(
+        const unsigned char *socket_path,
+        int contest_id,
+        size_t users_capacity)
+{
+    struct userlist_shm *shm = NULL;
+    struct userlist_shm_header *hdr;
+    size_t size;
+    int fd = -1;
+    void *addr;
+
+    XCALLOC(shm, 1);
+    shm->contest_id = contest_id;
+    shm->writable = 1;
+    if (!(shm->path = make_path(socket_path, contest_id, 1))) goto fail;
+
+    size = align64(sizeof(*hdr));
+    uint32_t serial_offset = 0, serial_count = 0;
+    uint32_t cookie_offset = 0, cookie_count = 0;
+    if (!contest_id) {
+        serial_offset = size;
+        serial_count = USERLIST_SHM_USER_SERIALS;
+        size += align64(serial_count * sizeof(uint32_t));
+        cookie_offset = size;
+        cookie_count = USERLIST_SHM_COOKIE_SLOTS;
+        size += align64(cookie_count * sizeof(struct userlist_shm_cookie));
+        users_capacity = 0;
+    }
+    size_t users_offset = size;
+    size += align64(users_capacity);
+
+    // the segment of the previous run of ej-users is dropped,
+    // its readers note it by the stale update_time
+    unlink(shm->path);
+    if ((fd = open(shm->path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600)) < 0) {
+        err("userlist_shm_create: open %s failed: %s", shm->path, os_ErrorMsg());
+        goto fail;
+    }
+    // the umask may strip the bits, but never adds any
+    if (fchmod(fd, 0600) < 0) {
+        err("userlist_shm_create: fchmod %s failed: %s", shm->path, os_ErrorMsg());
+        goto fail;
+    }
+    // the pages are allocated on the first write
+    if (ftruncate(fd, size) < 0) {
+        err("userlist_shm_create: ftruncate %s failed: %s", shm->path, os_ErrorMsg());
+        goto fail;
+    }
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        err("userlist_shm_create: mmap %s failed: %s", shm->path, os_ErrorMsg());
+        goto fail;
+    }
+    close(fd); fd = -1;
+
+    hdr = addr;
+    hdr->version = USERLIST_SHM_VERSION;
+    hdr->contest_id = contest_id;
+    hdr->update_time = time(NULL);
+    hdr->serial_count = serial_count;
+    hdr->serial_offset = serial_offset;
+    hdr->cookie_count = cookie_count;
+    hdr->cookie_offset = cookie_offset;
+    hdr->users_capacity = align64(users_capacity);
+    hdr->users_offset = users_offset;
+    hdr->total_size = size;
+    __atomic_store_n(&hdr->magic, USERLIST_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    shm->size = size;
+    shm->hdr = hdr;
+    return shm;
+
+fail:
+    if (fd >= 0) {
+        close(fd);
+        unlink(shm->path);
+    }
+    xfree(shm->path);
+    xfree(shm);
+    return NULL;
+}
+
+struct userlist_shm *
+userlist_shm_close(struct userlist_shm *shm)
+{
+    if (!shm) return NULL;
+
+    if (shm->hdr) {
+        if (shm->writable) {
+            __atomic_store_n(&shm->hdr->dead, 1, __ATOMIC_RELEASE);
+            unlink(shm->path);
+        }
+        munmap(shm->hdr, shm->size);
+    }
+    xfree(shm->path);
+    xfree(shm);
+    return NULL;
+}
+
+void
+userlist_shm_touch(struct userlist_shm *shm, time_t cur_time, int ip_check)
+{
+    if (!shm || !shm->writable) return;
+    shm->hdr->ip_check = ip_check;
+    __atomic_store_n(&shm->hdr->update_time, (int64_t) cur_time, __ATOMIC_RELEASE);
+}
+
+int
+userlist_shm_publish_users(
+        struct userlist_shm *shm,
+        const UserlistBinaryContext *cntx,
+        int vintage)
+{
+    struct userlist_shm_header *hdr = shm->hdr;
+
+    if (!shm->writable || cntx->total_size > hdr->users_capacity) return -1;
+
+    seq_write_begin(&hdr->users_seq);
+    UserlistBinaryHeader *header = userlist_bin_marshall(get_users(shm), cntx, hdr->contest_id);
+    header->reply_id = ULS_BIN_DATA;
+    header->vintage = vintage;
+    hdr->users_size = cntx->total_size;
+    seq_write_end(&hdr->users_seq);
+    return 0;
+}
+
+void
+userlist_shm_forget_user(struct userlist_shm *shm, int user_id)
+{
+    struct userlist_shm_header *hdr = shm->hdr;
+
+    if (!shm->writable || !hdr->serial_count) return;
+    if (user_id <= 0 || user_id >= hdr->serial_count) {
+        __atomic_add_fetch(&hdr->global_serial, 1, __ATOMIC_RELEASE);
+    } else {
+        __atomic_add_fetch(&get_serials(shm)[user_id], 1, __ATOMIC_RELEASE);
+    }
+}
+
+void
+userlist_shm_forget_cookie(struct userlist_shm *shm, ej_cookie_t cookie)
+{
+    struct userlist_shm_cookie *cookies;
+    unsigned slot;
+
+    if (!shm->writable || !shm->hdr->cookie_count || !cookie) return;
+    cookies = get_cookies(shm);
+    slot = cookie_slot(cookie);
+    for (int i = 0; i < USERLIST_SHM_COOKIE_PROBES; ++i) {
+        struct userlist_shm_cookie *e = &cookies[(slot + i) & (USERLIST_SHM_COOKIE_SLOTS - 1)];
+        if (e->request_id && e->cookie == cookie) {
+            seq_write_begin(&e->seq);
+            e->request_id = 0;
+            e->cookie = 0;
+            seq_write_end(&e->seq);
+        }
+    }
+}
+
+void
+userlist_shm_put_cookie(
+        struct userlist_shm *shm,
+        int request_id,
+        const ej_ip_t *ip,
+        int ssl,
+        const struct userlist_pk_login_ok *pkt,
+        size_t size)
+{
+    struct userlist_shm_header *hdr = shm->hdr;
+    struct userlist_shm_cookie *cookies, *e = NULL;
+    unsigned slot;
+
+    if (!shm->writable || !hdr->cookie_count || !pkt->cookie) return;
+    if (size > USERLIST_SHM_PACKET_SIZE) return;
+
+    // the same cookie, or a free slot, or the first slot in the chain
+    cookies = get_cookies(shm);
+    slot = cookie_slot(pkt->cookie);
+    for (int i = 0; i < USERLIST_SHM_COOKIE_PROBES; ++i) {
+        struct userlist_shm_cookie *p = &cookies[(slot + i) & (USERLIST_SHM_COOKIE_SLOTS - 1)];
+        if (p->request_id && p->cookie == pkt->cookie) {
+            e = p;
+            break;
+        }
+        if (!p->request_id && !e) e = p;
+    }
+    if (!e) e = &cookies[slot];
+
+    seq_write_begin(&e->seq);
+    e->request_id = request_id;
+    e->cookie = pkt->cookie;
+    e->client_key = pkt->client_key;
+    e->ip = *ip;
+    e->ssl = ssl;
+    e->user_id = pkt->user_id;
+    e->user_serial = 0;
+    if (pkt->user_id > 0 && pkt->user_id < hdr->serial_count) {
+        e->user_serial = get_serials(shm)[pkt->user_id];
+    }
+    e->global_serial = hdr->global_serial;
+    e->expire = pkt->expire;
+    e->size = size;
+    memcpy(e->packet, pkt, size);
+    seq_write_end(&e->seq);
+}
+
+static struct userlist_shm *
+map_segment(const unsigned char *socket_path, int contest_id)
+{
+    struct userlist_shm *shm = NULL;
+    const struct userlist_shm_header *hdr;
+    struct stat stb;
+    int fd = -1;
+    void *addr = MAP_FAILED;
+
+    XCALLOC(shm, 1);
+    shm->contest_id = contest_id;
+    if (!(shm->path = make_path(socket_path, contest_id, 0))) goto fail;
+
+    // the segment is absent, until ej-users publishes it
+    if ((fd = open(shm->path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC, 0)) < 0) goto fail;
+    if (check_file(fd, shm->path, &stb) < 0 || stb.st_size < sizeof(*hdr)) goto fail;
+    addr = mmap(NULL, stb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        err("userlist_shm: mmap %s failed: %s", shm->path, os_ErrorMsg());
+        goto fail;
+    }
+    close(fd); fd = -1;
+
+    hdr = addr;
+    if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != USERLIST_SHM_MAGIC
+        || hdr->version != USERLIST_SHM_VERSION
+        || hdr->contest_id != contest_id
+        || hdr->total_size != stb.st_size
+        || hdr->serial_offset + (size_t) hdr->serial_count * sizeof(uint32_t) > stb.st_size
+        || hdr->cookie_offset + (size_t) hdr->cookie_count * sizeof(struct userlist_shm_cookie) > stb.st_size
+        || (hdr->cookie_count && hdr->cookie_count != USERLIST_SHM_COOKIE_SLOTS)
+        || hdr->users_offset + hdr->users_capacity > stb.st_size) {
+        goto fail;
+    }
+
+    shm->size = stb.st_size;
+    shm->hdr = (struct userlist_shm_header *) addr;
+    return shm;
+
+fail:
+    if (addr != MAP_FAILED) munmap(addr, stb.st_size);
+    if (fd >= 0) close(fd);
+    xfree(shm->path);
+    xfree(shm);
+    return NULL;
+}
+
+static int
+is_alive(const struct userlist_shm *shm, time_t cur_time)
+{
+    const struct userlist_shm_header *hdr = shm->hdr;
+
+    if (__atomic_load_n(&hdr->dead, __ATOMIC_ACQUIRE)) return 0;
+    int64_t update_time = __atomic_load_n(&hdr->update_time, __ATOMIC_ACQUIRE);
+    return cur_time < update_time + USERLIST_SHM_TIMEOUT;
+}
+
+struct userlist_shm *
+userlist_shm_get(
+        const unsigned char *socket_path,
+        int contest_id,
+        time_t cur_time)
+{
+    struct userlist_shm *shm;
+
+    if (contest_id < 0) return NULL;
+    if (contest_id >= readers_size) {
+        int new_size = readers_size;
+        if (!new_size) new_size = 32;
+        while (contest_id >= new_size) new_size *= 2;
+        struct userlist_shm **new_readers = NULL;
+        XCALLOC(new_readers, new_size);
+        if (readers_size > 0) {
+            memcpy(new_readers, readers, readers_size * sizeof(new_readers[0]));
+        }
+        xfree(readers);
+        readers = new_readers;
+        readers_size = new_size;
+    }
+
+    // a segment without hdr records the failed attempt to map it
+    if ((shm = readers[contest_id])) {
+        if (shm->hdr && is_alive(shm, cur_time)) return shm;
+        // look for a new segment at most once a second
+        if (cur_time == shm->attempt_time) return NULL;
+        readers[contest_id] = shm = userlist_shm_close(shm);
+    }
+
+    if (!(shm = map_segment(socket_path, contest_id))) {
+        XCALLOC(shm, 1);
+        shm->contest_id = contest_id;
+    }
+    shm->attempt_time = cur_time;
+    readers[contest_id] = shm;
+    if (!shm->hdr || !is_alive(shm, cur_time)) return NULL;
+    return shm;
+}
+
+int
+userlist_shm_get_cookie(
+        struct userlist_shm *shm,
+        int request_id,
+        const ej_ip_t *ip,
+        int ssl,
+        ej_cookie_t cookie,
+        ej_cookie_t client_key,
+        time_t cur_time,
+        struct UserlistGetCookieResult *p_res)
+{
+    const struct userlist_shm_header *hdr = shm->hdr;
+    const struct userlist_shm_cookie *cookies;
+    struct userlist_shm_cookie copy;
+    unsigned slot;
+    int found = 0;
+
+    if (!hdr->cookie_count || !cookie || !client_key) return 0;
+
+    cookies = get_cookies(shm);
+    slot = cookie_slot(cookie);
+    for (int i = 0; i < USERLIST_SHM_COOKIE_PROBES && !found; ++i) {
+        const struct userlist_shm_cookie *e = &cookies[(slot + i) & (USERLIST_SHM_COOKIE_SLOTS - 1)];
+        for (int j = 0; j < USERLIST_SHM_READ_RETRIES; ++j) {
+            uint32_t seq = seq_read_begin(&e->seq);
+            if (e->cookie != cookie) break;
+            memcpy(&copy, e, sizeof(copy));
+            if (!seq_read_retry(&e->seq, seq)) {
+                found = 1;
+                break;
+            }
+        }
+    }
+    if (!found) return 0;
+
+    // everything the reply depends on is checked here or by ej-users
+    if (copy.request_id != request_id || copy.client_key != client_key) return 0;
+    if (copy.size < sizeof(struct userlist_pk_login_ok) || copy.size > USERLIST_SHM_PACKET_SIZE) return 0;
+    if (cur_time > copy.expire) return 0;
+    if (__atomic_load_n(&hdr->ip_check, __ATOMIC_RELAXED) > 0
+        && (ipv6cmp(&copy.ip, ip) != 0 || copy.ssl != ssl))
+        return 0;
+    if (copy.global_serial != __atomic_load_n(&hdr->global_serial, __ATOMIC_ACQUIRE))
+        return 0;
+    if (copy.user_id > 0 && copy.user_id < hdr->serial_count
+        && copy.user_serial != __atomic_load_n(&get_serials(shm)[copy.user_id], __ATOMIC_ACQUIRE))
+        return 0;
+
+    void *pkt = xmalloc(copy.size);
+    memcpy(pkt, copy.packet, copy.size);
+    memset(p_res, 0, sizeof(*p_res));
+    // the packet is consumed
+    if (userlist_clnt_parse_cookie_reply(copy.size, pkt, p_res) < 0) return 0;
+    return 1;
+}
+
+static UserlistBinaryHeader *
+make_empty_delta(int contest_id, int vintage)
+{
+    UserlistBinaryContext cntx;
+
+    userlist_bin_init_context(&cntx);
+    userlist_bin_marshall_user_list(&cntx, NULL, contest_id);
+    userlist_bin_marshall_delta(&cntx, NULL, 0);
+    userlist_bin_finish_context(&cntx);
+    UserlistBinaryHeader *header = userlist_bin_marshall(NULL, &cntx, contest_id);
+    header->reply_id = ULS_BIN_DATA;
+    header->vintage = vintage;
+    userlist_bin_destroy_context(&cntx);
+    return header;
+}
+
+int
+userlist_shm_get_users(
+        struct userlist_shm *shm,
+        int vintage,
+        UserlistBinaryHeader **p_header)
+{
+    const struct userlist_shm_header *hdr = shm->hdr;
+    const UserlistBinaryHeader *src = get_users(shm);
+    UserlistBinaryHeader *header = NULL;
+    size_t reserved = 0;
+
+    if (!hdr->users_capacity) return -1;
+
+    for (int j = 0; j < USERLIST_SHM_READ_RETRIES; ++j) {
+        uint32_t seq = seq_read_begin(&hdr->users_seq);
+        size_t size = hdr->users_size;
+        int cur_vintage = src->vintage;
+        if (seq_read_retry(&hdr->users_seq, seq)) continue;
+        if (!size || size < sizeof(*src) || size > hdr->users_capacity) return -1;
+        if (vintage && vintage == cur_vintage) {
+            xfree(header);
+            header = make_empty_delta(hdr->contest_id, vintage);
+            userlist_bin_unmarshall(header);
+            *p_header = header;
+            return 0;
+        }
+
+        if (size > reserved) {
+            xfree(header);
+            header = xmalloc(size);
+            reserved = size;
+        }
+        memcpy(header, src, size);
+        if (seq_read_retry(&hdr->users_seq, seq)) continue;
+
+        // the copy is consistent, but check it anyway
+        if (header->pkt_size != size || header->version != USERLIST_BIN_VERSION
+            || header->ptr_size != sizeof(void*)
+            || sizeof(*header) + header->size != size
+            || header->root_offset >= header->size) {
+            break;
+        }
+        if (!userlist_bin_unmarshall(header)) break;
+        *p_header = header;
+        return 0;
+    }
+
+    xfree(header);
+    return -1;
+}
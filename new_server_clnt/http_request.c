@@ -23,6 +23,7 @@
 #include "ejudge/osdeps.h"
 
 #include <unistd.h>
+#include <sys/uio.h>
 
 enum
 {
@@ -65,6 +66,19 @@ read_from_pipe(int fd, unsigned char **reply_bytes, size_t *reply_size)
   return -1;
 }
 
+/* every string in the packet is followed by \0 */
+static int
+add_iov(struct iovec *iov, int j, const void *data, size_t size)
+{
+  static const unsigned char zero_byte = 0;
+
+  iov[j].iov_base = (void*) data;
+  iov[j].iov_len = size;
+  iov[j + 1].iov_base = (void*) &zero_byte;
+  iov[j + 1].iov_len = 1;
+  return j + 2;
+}
+
 static void
 msg(FILE *f, const char *format, ...)
   __attribute__((format(printf, 2, 3)));
@@ -102,7 +116,9 @@ new_server_clnt_http_request(
   ej_size_t *param_name_sizes = 0;
   ej_size_t t;
   struct new_server_prot_http_request *out = 0;
-  size_t out_size;
+  size_t out_size, hdr_size;
+  struct iovec *iov = 0;
+  int iov_num = 0, j;
   unsigned long bptr;// hope,that that's enough for pointer
   int pipe_fd[2] = { -1, -1 }, pass_fd[2];
   int data_fd[2] = { -1, -1 };
@@ -185,7 +201,13 @@ new_server_clnt_http_request(
     goto failed;
   }
 
-  out = (struct new_server_prot_http_request*) xcalloc(out_size, 1);
+  /* only the fixed part and the sizes are built, the strings and
+     the parameter values are sent from where they are */
+  hdr_size = sizeof(*out);
+  hdr_size += arg_num * sizeof(ej_size_t);
+  hdr_size += env_num * sizeof(ej_size_t);
+  hdr_size += 2 * param_num * sizeof(ej_size_t);
+  out = (struct new_server_prot_http_request*) xcalloc(hdr_size, 1);
   out->b.magic = NEW_SERVER_PROT_PACKET_MAGIC;
   out->b.id = NEW_SRV_CMD_HTTP_REQUEST;
   out->arg_num = arg_num;
@@ -208,19 +230,21 @@ new_server_clnt_http_request(
     memcpy((void*) bptr, param_sizes, param_num * sizeof(param_sizes[0]));
     bptr += param_num * sizeof(param_sizes[0]);
   }
+
+  iov_num = 1 + 2 * (arg_num + env_num + 2 * param_num);
+  XCALLOC(iov, iov_num);
+  iov[0].iov_base = out;
+  iov[0].iov_len = hdr_size;
+  j = 1;
   for (i = 0; i < arg_num; i++) {
-    memcpy((void*) bptr, args[i], arg_sizes[i]);
-    bptr += arg_sizes[i] + 1;
+    j = add_iov(iov, j, args[i], arg_sizes[i]);
   }
   for (i = 0; i < env_num; i++) {
-    memcpy((void*) bptr, envs[i], env_sizes[i]);
-    bptr += env_sizes[i] + 1;
+    j = add_iov(iov, j, envs[i], env_sizes[i]);
   }
   for (i = 0; i < param_num; i++) {
-    memcpy((void*) bptr, param_names[i], param_name_sizes[i]);
-    bptr += param_name_sizes[i] + 1;
-    memcpy((void*) bptr, params[i], param_sizes[i]);
-    bptr += param_sizes[i] + 1;
+    j = add_iov(iov, j, param_names[i], param_name_sizes[i]);
+    j = add_iov(iov, j, params[i], param_sizes[i]);
   }
 
   if (pipe(pipe_fd) < 0) {
@@ -249,7 +273,7 @@ new_server_clnt_http_request(
   close(pipe_fd[1]); pipe_fd[1] = -1;
   if (data_fd[1] >= 0) close(data_fd[1]);
   data_fd[1] = -1;
-  if ((errcode = new_server_clnt_send_packet(conn, out_size, out)) < 0) {
+  if ((errcode = new_server_clnt_send_packet_v(conn, out_size, iov_num, iov)) < 0) {
     msg(log_f, "send_packet failed: error code: %d", -errcode);
     goto failed;
   }
@@ -298,6 +322,7 @@ new_server_clnt_http_request(
 
  failed:
   xfree(out);
+  xfree(iov);
   xfree(void_in);
   if (pipe_fd[0] >= 0) close(pipe_fd[0]);
   if (pipe_fd[1] >= 0) close(pipe_fd[1]);
@@ -23,6 +23,7 @@
 
 #include <unistd.h>
 #include <sys/uio.h>
+#include <errno.h>
 
 int
 new_server_clnt_send_packet(new_server_conn_t conn, size_t size, void const *buf)
@@ -76,3 +77,68 @@ new_server_clnt_send_packet(new_server_conn_t conn, size_t size, void const *buf
   err("new_server_clnt_send_packet: write() failed: %s", os_ErrorMsg());
   return -NEW_SRV_ERR_WRITE_ERROR;
 }
+
+int
+new_server_clnt_send_packet_v(
+        new_server_conn_t conn,
+        size_t size,
+        int iovcnt,
+        const struct iovec *iov)
+{
+  enum { IOV_BATCH = 256 };
+  struct iovec vv[IOV_BATCH];
+  struct iovec cur;
+  rint32_t size32;
+  int next = 0, n, i;
+  ssize_t w;
+
+  if (!conn || conn->fd < 0) return -NEW_SRV_ERR_NOT_CONNECTED;
+
+  /* -1073741824 is 0xc0000000 or 0xffffffffc0000000 */
+  if ((size & -1073741824L)) {
+    err("new_server_clnt_send_packet_v: packet length exceeds 1GiB");
+    return -NEW_SRV_ERR_PACKET_TOO_BIG;
+  }
+  size32 = (ruint32_t) size;
+
+  /* cur is the partially written piece */
+  cur.iov_base = &size32;
+  cur.iov_len = sizeof(size32);
+  while (1) {
+    n = 0;
+    if (cur.iov_len > 0) vv[n++] = cur;
+    for (i = next; i < iovcnt && n < IOV_BATCH; i++) {
+      if (iov[i].iov_len > 0) vv[n++] = iov[i];
+    }
+    if (!n) break;
+
+    w = writev(conn->fd, vv, n);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) goto write_error;
+
+    if (cur.iov_len > 0) {
+      if (w < cur.iov_len) {
+        cur.iov_base = (unsigned char*) cur.iov_base + w;
+        cur.iov_len -= w;
+        continue;
+      }
+      w -= cur.iov_len;
+      cur.iov_len = 0;
+    }
+    while (next < iovcnt && w >= iov[next].iov_len) {
+      w -= iov[next].iov_len;
+      next++;
+    }
+    if (w > 0) {
+      cur.iov_base = (unsigned char*) iov[next].iov_base + w;
+      cur.iov_len = iov[next].iov_len - w;
+      next++;
+    }
+  }
+
+  return 0;
+
+ write_error:
+  err("new_server_clnt_send_packet_v: write() failed: %s", os_ErrorMsg());
+  return -NEW_SRV_ERR_WRITE_ERROR;
+}
@@ -44,6 +44,8 @@ prepare_func(
         struct common_plugin_data *data,
         const struct ejudge_cfg *config,
         struct xml_tree *tree);
+static void
+fork_child_func(struct common_plugin_data *data);
 static int
 query_func(
         struct common_mongo_state *state,
@@ -111,6 +113,7 @@ struct common_mongo_iface plugin_common_mongo =
         init_func,
         finish_func,
         prepare_func,
+        fork_child_func,
     },
     COMMON_MONGO_PLUGIN_IFACE_VERSION,
     query_func,
@@ -303,6 +306,17 @@ prepare_func(
     return 0;
 }
 
+static void
+fork_child_func(struct common_plugin_data *data)
+{
+#if HAVE_LIBMONGOC - 0 > 1
+    struct common_mongo_state *state = (struct common_mongo_state *) data;
+    // the pooled connections belong to the parent process,
+    // the client opens new ones on the next request
+    if (state->conn) mongoc_client_reset(state->conn);
+#endif
+}
+
 static int
 query_func(
         struct common_mongo_state *state,
@@ -34,6 +34,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/time.h>
 
 static struct common_plugin_data *
@@ -45,6 +46,8 @@ prepare_func(
         struct common_plugin_data *,
         const struct ejudge_cfg *,
         struct xml_tree *);
+static void
+fork_child_func(struct common_plugin_data *);
 static int
 connect_func(struct common_mysql_state *state);
 static void
@@ -197,6 +200,7 @@ struct common_mysql_iface plugin_common_mysql =
     init_func,
     finish_func,
     prepare_func,
+    fork_child_func,
   },
   COMMON_MYSQL_PLUGIN_IFACE_VERSION,
 
@@ -507,6 +511,38 @@ connect_func(struct common_mysql_state *state)
   return 0;
 }
 
+/*
+ * the connection socket is shared with the parent process, so
+ * mysql_close must not send COM_QUIT to the server: the socket is
+ * replaced with /dev/null before closing, then a new connection
+ * is opened for the child process
+ */
+static void
+fork_child_func(struct common_plugin_data *data)
+{
+  struct common_mysql_state *state = (struct common_mysql_state *) data;
+
+  if (!state->conn) return;
+  if (state->res) mysql_free_result(state->res);
+  state->res = 0;
+  state->row = 0;
+  state->lengths = 0;
+
+  int fd = state->conn->net.fd;
+  int null_fd = -1;
+  if (fd < 0 || ((null_fd = open("/dev/null", O_RDWR | O_CLOEXEC, 0)) >= 0
+                 && dup2(null_fd, fd) >= 0)) {
+    mysql_close(state->conn);
+  } else {
+    // the handle is leaked rather than closing the session of the parent
+    err("fork_child_func: cannot detach the MySQL connection: %s", os_ErrorMsg());
+  }
+  if (null_fd >= 0) close(null_fd);
+  state->conn = 0;
+
+  connect_func(state);
+}
+
 static void
 free_res_func(struct common_mysql_state *state)
 {
@@ -37,6 +37,11 @@
 #include <zlib.h>
 #include <paths.h>
 
+#if defined __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
 #if HAVE_FERROR_UNLOCKED - 0 == 0
 #define ferror_unlocked(x) ferror(x)
 #endif
@@ -1071,6 +1076,40 @@ gzip_copy_file(int sfd, int sf, int dfd, int df)
   return -saved_errno;
 }
 
+/*
+ * copy the file contents without passing them through the user space:
+ * share the extents (reflink), if the filesystem supports it, or
+ * use in-kernel copying otherwise,
+ * returns 0 on success, 1, if the regular copying should be used
+ */
+static int
+kernel_copy_file(int sfd, int dfd)
+{
+#if defined __linux__
+#if defined FICLONE
+  if (ioctl(dfd, FICLONE, sfd) >= 0) return 0;
+#endif
+#if defined __GLIBC__ && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+  ssize_t r;
+  int first = 1;
+  while ((r = copy_file_range(sfd, NULL, dfd, NULL, 1 << 30, 0)) != 0) {
+    if (r < 0 && errno == EINTR) continue;
+    if (r < 0) {
+      // filesystem does not support it, nothing is copied yet
+      if (first && (errno == EXDEV || errno == EINVAL || errno == ENOSYS
+                    || errno == EOPNOTSUPP || errno == EBADF)) {
+        return 1;
+      }
+      return -errno;
+    }
+    first = 0;
+  }
+  return 0;
+#endif
+#endif
+  return 1;
+}
+
 static int
 do_copy_file(char const *src, int sf, char const *dst, int df)
 {
@@ -1104,6 +1143,16 @@ do_copy_file(char const *src, int sf, char const *dst, int df)
     }
   }
 
+  if ((errcode = kernel_copy_file(sfd, dfd)) < 0) {
+    err("do_copy_file: copying %s -> %s failed: %s", src, dst, strerror(-errcode));
+    goto _unlink_and_cleanup;
+  }
+  if (!errcode) {
+    close(sfd); sfd = -1;
+    if ((errcode = sf_close(dfd, dst)) < 0) goto _unlink_and_cleanup;
+    return 0;
+  }
+
   while ((sz = errcode = sf_read(sfd, buf, sizeof(buf), src)) > 0) {
     p = buf;
     while (sz > 0) {
@@ -1758,6 +1807,19 @@ fast_copy_file(const unsigned char *oldname, const unsigned char *newname)
   return do_copy_file(oldname, 0, newname, 0);
 }
 
+int
+link_or_copy_file(const unsigned char *oldname, const unsigned char *newname)
+{
+  if (link(oldname, newname) >= 0) return 1;
+  if (errno != EXDEV && errno != EPERM && errno != EMLINK) {
+    err("link_or_copy_file: link(%s,%s) failed: %s",
+        oldname, newname, os_ErrorMsg());
+    return -1;
+  }
+  if (do_copy_file(oldname, 0, newname, 0) < 0) return -1;
+  return 0;
+}
+
 int
 generic_truncate(const char *path, ssize_t size)
 {
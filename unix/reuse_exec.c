@@ -43,6 +43,7 @@
 
 #ifdef __linux__
 #include <sys/ptrace.h>
+#include <sys/socket.h>
 #include <sys/utsname.h>
 #endif
 
@@ -102,6 +103,7 @@ struct tTask
   int    enable_suid_exec;      /* change user_id through suid helper binaries */
   int    enable_security_violation_error;/*enable security violation detection*/
   int    enable_container;      /* enable linux containerization */
+  int    enable_container_template; /* start from the shared prepared sandbox */
   int    clear_env;             /* clear the environment? */
   int    quiet_flag;            /* be quiet */
   int    enable_all_signals;    /* unmask all signals after fork */
@@ -1110,6 +1112,15 @@ task_EnableContainer(tTask *tsk)
   return 0;
 }
 
+int
+task_EnableContainerTemplate(tTask *tsk)
+{
+  task_init_module();
+  ASSERT(tsk);
+  tsk->enable_container_template = 1;
+  return 0;
+}
+
 int
 task_EnableAllSignals(tTask *tsk)
 {
@@ -1605,11 +1616,132 @@ invoke_execv_helper(tTask *tsk, const char *path, char **args)
   execv(helper_path, new_args);
 }
 
+/*
+ * the mount namespace prepared by ej-suid-container once for
+ * the tasks with the same container options, each container
+ * starts from a private copy of it and only mounts the parts
+ * which depend on the particular task (working directory,
+ * /proc, pristine /tmp)
+ */
+static int container_template_fd = -1;
+static char *container_template_key = NULL;
+
+void
+task_CloseContainerTemplate(void)
+{
+  if (container_template_fd >= 0) close(container_template_fd);
+  container_template_fd = -1;
+  xfree(container_template_key); container_template_key = NULL;
+}
+
+static int
+recv_template_fd(int sock_fd)
+{
+  struct msghdr msg;
+  union
+  {
+    struct cmsghdr hdr;
+    unsigned char buf[CMSG_SPACE(sizeof(int))];
+  } cmsgbuf;
+  struct iovec vec;
+  int val = -1, fd = -1;
+  struct cmsghdr *pmsg;
+
+  memset(&msg, 0, sizeof(msg));
+  memset(&cmsgbuf, 0, sizeof(cmsgbuf));
+  vec.iov_base = &val;
+  vec.iov_len = sizeof(val);
+  msg.msg_iov = &vec;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cmsgbuf.buf;
+  msg.msg_controllen = sizeof(cmsgbuf.buf);
+  if (recvmsg(sock_fd, &msg, MSG_CMSG_CLOEXEC) != sizeof(val) || val != 0) return -1;
+  if ((msg.msg_flags & MSG_CTRUNC)) return -1;
+  if (!(pmsg = CMSG_FIRSTHDR(&msg))) return -1;
+  if (pmsg->cmsg_level != SOL_SOCKET || pmsg->cmsg_type != SCM_RIGHTS
+      || pmsg->cmsg_len != CMSG_LEN(sizeof(int))) return -1;
+  memcpy(&fd, CMSG_DATA(pmsg), sizeof(int));
+  return fd;
+}
+
+/* returns the template namespace descriptor, or -1, if it cannot be used */
+static int
+get_container_template(tTask *tsk)
+{
+  char *key_s = NULL;
+  size_t key_z = 0;
+  FILE *key_f = open_memstream(&key_s, &key_z);
+  fprintf(key_f, "%s", tsk->suid_helper_dir);
+  if (tsk->language_name && *tsk->language_name) {
+    int len = strlen(tsk->language_name);
+    fprintf(key_f, "ol%d%s", len, tsk->language_name);
+  }
+  if (tsk->container_options) fputs(tsk->container_options, key_f);
+  fclose(key_f); key_f = NULL;
+
+  if (container_template_key && !strcmp(container_template_key, key_s)) {
+    xfree(key_s);
+    return container_template_fd;
+  }
+  task_CloseContainerTemplate();
+  // do not retry the failed options
+  container_template_key = key_s;
+
+  int sp[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sp) < 0) {
+    write_log(LOG_REUSE, LOG_ERROR, "%s: socketpair() failed: %s", __FUNCTION__, os_ErrorMsg());
+    return -1;
+  }
+  int pid = fork();
+  if (pid < 0) {
+    write_log(LOG_REUSE, LOG_ERROR, "%s: fork() failed: %s", __FUNCTION__, os_ErrorMsg());
+    close(sp[0]); close(sp[1]);
+    return -1;
+  }
+  if (!pid) {
+    char helper_path[PATH_MAX];
+    char *spec_s = NULL;
+    size_t spec_z = 0;
+    FILE *spec_f = open_memstream(&spec_s, &spec_z);
+    fcntl(sp[1], F_SETFD, 0);
+    // the error messages are sent to the same socket
+    fprintf(spec_f, "-f%dmK%d", sp[1], sp[1]);
+    if (tsk->language_name && *tsk->language_name) {
+      int len = strlen(tsk->language_name);
+      fprintf(spec_f, "ol%d%s", len, tsk->language_name);
+    }
+    if (tsk->container_options) fputs(tsk->container_options, spec_f);
+    fclose(spec_f); spec_f = NULL;
+    if (snprintf(helper_path, sizeof(helper_path), "%s/%s", tsk->suid_helper_dir, "ej-suid-container") >= sizeof(helper_path)) {
+      _exit(1);
+    }
+    char *args[] = { helper_path, spec_s, NULL };
+    execv(helper_path, args);
+    _exit(1);
+  }
+
+  close(sp[1]);
+  int fd = recv_template_fd(sp[0]);
+  close(sp[0]);
+  waitpid(pid, NULL, 0);
+  if (fd < 0) {
+    write_log(LOG_REUSE, LOG_WARN, "%s: failed to prepare the container template, using regular containers", __FUNCTION__);
+    return -1;
+  }
+  container_template_fd = fd;
+  return fd;
+}
+
 static int
 task_StartContainer(tTask *tsk)
 {
   int status_pipe[2];
   char errbuf[512];
+  int template_fd = -1;
+
+  if (tsk->enable_container_template) {
+    template_fd = get_container_template(tsk);
+  }
 
   if (pipe(status_pipe) < 0) {
     tsk->state = TSK_ERROR;
@@ -1672,6 +1804,11 @@ task_StartContainer(tTask *tsk)
   if (tsk->user_serial > 0) {
     fprintf(spec_f, "cu%d", tsk->user_serial);
   }
+  if (template_fd >= 0) {
+    // the cached descriptor stays close-on-exec, the helper gets a copy
+    int ns_fd = dup(template_fd);
+    if (ns_fd >= 0) fprintf(spec_f, "mT%d", ns_fd);
+  }
 
   // add redirections
   for (int i = 0; i < tsk->redirs.u; i++) {
@@ -0,0 +1,442 @@
+/* -*- mode: c -*- */
+
+/* Copyright (C) 2024 Alexander Chernov <cher@ejudge.ru> */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "userlist_clnt/private.h"
+#include "ejudge/errlog.h"
+#include "ejudge/integral.h"
+
+#include <sys/socket.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+
+enum
+{
+  ASYNC_REPLY,
+  ASYNC_COOKIE,
+  ASYNC_STATUS,
+};
+
+struct async_request
+{
+  struct async_request *next;
+  long long request_id;
+  time_t send_time;
+  int kind;
+  userlist_async_reply_func_t reply_func;
+  userlist_async_cookie_func_t cookie_func;
+  userlist_async_status_func_t status_func;
+  void *user;
+};
+
+struct userlist_async
+{
+  int fd;
+
+  // the requests waiting for the replies, in the order of sending
+  struct async_request *first, *last;
+  int pending;
+  long long serial;
+
+  // the packets not yet written
+  unsigned char *out_buf;
+  size_t out_size;
+  size_t out_pos;
+  size_t out_reserved;
+
+  // the packet being read
+  unsigned char in_len_buf[4];
+  int in_len_size;
+  int in_expected;
+  int in_size;
+  unsigned char *in_buf;
+};
+
+userlist_async_t
+userlist_async_open(userlist_clnt_t clnt)
+{
+  struct userlist_async *ua;
+
+  if (!clnt || clnt->fd < 0) return NULL;
+
+  fcntl(clnt->fd, F_SETFL, fcntl(clnt->fd, F_GETFL) | O_NONBLOCK);
+  XCALLOC(ua, 1);
+  ua->fd = clnt->fd;
+  clnt->fd = -1;
+  xfree(clnt);
+  return ua;
+}
+
+static void
+complete_request(struct async_request *req, int status, size_t size, void *data)
+{
+  struct UserlistGetCookieResult res;
+  int r;
+
+  switch (req->kind) {
+  case ASYNC_REPLY:
+    if (req->reply_func) {
+      req->reply_func(req->user, req->request_id, status, size, data);
+    }
+    xfree(data);
+    break;
+  case ASYNC_COOKIE:
+    memset(&res, 0, sizeof(res));
+    if (status < 0) {
+      r = status;
+      xfree(data);
+    } else {
+      // the packet is consumed
+      r = userlist_clnt_parse_cookie_reply(size, data, &res);
+    }
+    if (req->cookie_func) {
+      req->cookie_func(req->user, req->request_id, r, &res);
+    } else if (r >= 0) {
+      xfree(res.data);
+    }
+    break;
+  case ASYNC_STATUS:
+    r = status;
+    if (r >= 0) {
+      if (size != sizeof(struct userlist_packet)) {
+        r = -ULS_ERR_PROTOCOL;
+      } else {
+        r = ((const struct userlist_packet *) data)->id;
+      }
+    }
+    if (req->status_func) {
+      req->status_func(req->user, req->request_id, r);
+    }
+    xfree(data);
+    break;
+  default:
+    xfree(data);
+    break;
+  }
+}
+
+/* the connection is already closed, so the callbacks cannot send more */
+static void
+fail_requests(struct userlist_async *ua, int status)
+{
+  struct async_request *list = ua->first, *req;
+
+  ua->first = ua->last = NULL;
+  ua->pending = 0;
+  while ((req = list)) {
+    list = req->next;
+    complete_request(req, status, 0, NULL);
+    xfree(req);
+  }
+}
+
+userlist_async_t
+userlist_async_close(userlist_async_t ua)
+{
+  if (!ua) return NULL;
+
+  if (ua->fd >= 0) close(ua->fd);
+  ua->fd = -1;
+  ua->out_size = ua->out_pos = 0;
+  fail_requests(ua, -ULS_ERR_DISCONNECT);
+  xfree(ua->out_buf);
+  xfree(ua->in_buf);
+  xfree(ua);
+  return NULL;
+}
+
+int
+userlist_async_get_fd(userlist_async_t ua)
+{
+  return ua->fd;
+}
+
+int
+userlist_async_get_events(userlist_async_t ua)
+{
+  // the reads are always watched to notice the disconnect
+  int events = USERLIST_ASYNC_READ;
+  if (ua->out_pos < ua->out_size) events |= USERLIST_ASYNC_WRITE;
+  return events;
+}
+
+int
+userlist_async_get_pending(userlist_async_t ua)
+{
+  return ua->pending;
+}
+
+time_t
+userlist_async_get_oldest_time(userlist_async_t ua)
+{
+  if (!ua->first) return 0;
+  return ua->first->send_time;
+}
+
+void
+userlist_async_cancel(userlist_async_t ua, long long request_id)
+{
+  for (struct async_request *req = ua->first; req; req = req->next) {
+    if (req->request_id == request_id) {
+      req->reply_func = NULL;
+      req->cookie_func = NULL;
+      req->status_func = NULL;
+      break;
+    }
+  }
+}
+
+static int
+write_output(struct userlist_async *ua)
+{
+  while (ua->out_pos < ua->out_size) {
+    ssize_t w = write(ua->fd, ua->out_buf + ua->out_pos, ua->out_size - ua->out_pos);
+    if (w < 0 && errno == EINTR) continue;
+    if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+    if (w <= 0) {
+      err("userlist_async: write() failed: %s", os_ErrorMsg());
+      return -ULS_ERR_WRITE_ERROR;
+    }
+    ua->out_pos += w;
+  }
+  ua->out_pos = ua->out_size = 0;
+  return 0;
+}
+
+/* returns 1, if a packet is read completely */
+static int
+read_input(struct userlist_async *ua)
+{
+  ssize_t r;
+
+  while (ua->in_len_size < 4) {
+    r = read(ua->fd, ua->in_len_buf + ua->in_len_size, 4 - ua->in_len_size);
+    if (r < 0 && errno == EINTR) continue;
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+    if (r < 0) {
+      err("userlist_async: read() failed: %s", os_ErrorMsg());
+      return -ULS_ERR_READ_ERROR;
+    }
+    if (!r) {
+      err("userlist_async: unexpected EOF from userlist-server");
+      return -ULS_ERR_UNEXPECTED_EOF;
+    }
+    ua->in_len_size += r;
+    if (ua->in_len_size == 4) {
+      rint32_t sz;
+      memcpy(&sz, ua->in_len_buf, 4);
+      if (sz <= 0) {
+        err("userlist_async: invalid packet length %d from userlist-server", sz);
+        return -ULS_ERR_PROTOCOL;
+      }
+      ua->in_expected = sz;
+      ua->in_size = 0;
+      ua->in_buf = xmalloc(sz);
+    }
+  }
+
+  while (ua->in_size < ua->in_expected) {
+    r = read(ua->fd, ua->in_buf + ua->in_size, ua->in_expected - ua->in_size);
+    if (r < 0 && errno == EINTR) continue;
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+    if (r < 0) {
+      err("userlist_async: read() failed: %s", os_ErrorMsg());
+      return -ULS_ERR_READ_ERROR;
+    }
+    if (!r) {
+      err("userlist_async: unexpected EOF from userlist-server");
+      return -ULS_ERR_UNEXPECTED_EOF;
+    }
+    ua->in_size += r;
+  }
+  return 1;
+}
+
+int
+userlist_async_process(userlist_async_t ua, int events)
+{
+  int r;
+
+  if (ua->fd < 0) return -ULS_ERR_NO_CONNECT;
+
+  if ((r = write_output(ua)) < 0) goto fail;
+
+  while (1) {
+    if ((r = read_input(ua)) < 0) goto fail;
+    if (!r) break;
+
+    size_t size = ua->in_size;
+    void *data = ua->in_buf;
+    ua->in_buf = NULL;
+    ua->in_len_size = 0;
+    ua->in_expected = 0;
+    ua->in_size = 0;
+
+    if (size == sizeof(struct userlist_pk_notification)
+        && ((const struct userlist_pk_notification *) data)->reply_id == ULS_NOTIFICATION) {
+      // the connection is not subscribed, but skip them anyway
+      xfree(data);
+      continue;
+    }
+
+    struct async_request *req = ua->first;
+    if (!req) {
+      err("userlist_async: unexpected reply from userlist-server");
+      xfree(data);
+      r = -ULS_ERR_PROTOCOL;
+      goto fail;
+    }
+    ua->first = req->next;
+    if (!ua->first) ua->last = NULL;
+    --ua->pending;
+    complete_request(req, 0, size, data);
+    xfree(req);
+  }
+
+  // the callbacks may have sent more requests
+  if ((r = write_output(ua)) < 0) goto fail;
+  return 0;
+
+fail:
+  close(ua->fd);
+  ua->fd = -1;
+  ua->out_size = ua->out_pos = 0;
+  fail_requests(ua, -ULS_ERR_DISCONNECT);
+  return r;
+}
+
+static struct async_request *
+queue_packet(struct userlist_async *ua, size_t size, const void *data)
+{
+  struct async_request *req;
+  rint32_t size32;
+
+  if (ua->fd < 0) return NULL;
+  /* -1073741824 is 0xc0000000 or 0xffffffffc0000000 */
+  if ((size & -1073741824L) || !size) {
+    err("userlist_async: invalid packet length");
+    return NULL;
+  }
+  size32 = (ruint32_t) size;
+
+  if (ua->out_pos > 0 && ua->out_pos == ua->out_size) {
+    ua->out_pos = ua->out_size = 0;
+  }
+  if (ua->out_size + size + 4 > ua->out_reserved) {
+    size_t new_reserved = ua->out_reserved;
+    if (!new_reserved) new_reserved = 4096;
+    while (ua->out_size + size + 4 > new_reserved) new_reserved *= 2;
+    ua->out_buf = xrealloc(ua->out_buf, new_reserved);
+    ua->out_reserved = new_reserved;
+  }
+  memcpy(ua->out_buf + ua->out_size, &size32, 4);
+  memcpy(ua->out_buf + ua->out_size + 4, data, size);
+  ua->out_size += size + 4;
+
+  XCALLOC(req, 1);
+  req->request_id = ++ua->serial;
+  req->send_time = time(NULL);
+  if (ua->last) {
+    ua->last->next = req;
+  } else {
+    ua->first = req;
+  }
+  ua->last = req;
+  ++ua->pending;
+
+  // try to send immediately, the errors are reported by process
+  if (write_output(ua) < 0) {
+    ua->out_pos = ua->out_size = 0;
+    shutdown(ua->fd, SHUT_RDWR);
+  }
+  return req;
+}
+
+long long
+userlist_async_send(
+        userlist_async_t ua,
+        size_t size,
+        const void *data,
+        userlist_async_reply_func_t callback,
+        void *user)
+{
+  struct async_request *req = queue_packet(ua, size, data);
+  if (!req) return -ULS_ERR_NO_CONNECT;
+  req->kind = ASYNC_REPLY;
+  req->reply_func = callback;
+  req->user = user;
+  return req->request_id;
+}
+
+long long
+userlist_async_get_cookie(
+        userlist_async_t ua,
+        int cmd,
+        const ej_ip_t *origin_ip,
+        int ssl,
+        ej_cookie_t cookie,
+        ej_cookie_t client_key,
+        userlist_async_cookie_func_t callback,
+        void *user)
+{
+  struct userlist_pk_check_cookie out;
+  struct async_request *req;
+
+  if (!cookie) return -ULS_ERR_NO_COOKIE;
+
+  memset(&out, 0, sizeof(out));
+  out.request_id = cmd;
+  if (origin_ip) {
+    out.origin_ip = *origin_ip;
+  }
+  out.ssl = ssl;
+  out.cookie = cookie;
+  out.client_key = client_key;
+  if (!(req = queue_packet(ua, sizeof(out), &out))) return -ULS_ERR_NO_CONNECT;
+  req->kind = ASYNC_COOKIE;
+  req->cookie_func = callback;
+  req->user = user;
+  return req->request_id;
+}
+
+long long
+userlist_async_register_contest(
+        userlist_async_t ua,
+        int cmd,
+        int user_id,
+        int contest_id,
+        const ej_ip_t *ip,
+        int ssl_flag,
+        userlist_async_status_func_t callback,
+        void *user)
+{
+  struct userlist_pk_register_contest out;
+  struct async_request *req;
+
+  memset(&out, 0, sizeof(out));
+  out.request_id = cmd;
+  out.user_id = user_id;
+  out.contest_id = contest_id;
+  if (ip) {
+    out.ip = *ip;
+  }
+  out.ssl_flag = ssl_flag;
+  if (!(req = queue_packet(ua, sizeof(out), &out))) return -ULS_ERR_NO_CONNECT;
+  req->kind = ASYNC_STATUS;
+  req->status_func = callback;
+  req->user = user;
+  return req->request_id;
+}
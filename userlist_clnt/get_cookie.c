@@ -109,41 +109,15 @@ userlist_clnt_get_cookie(
 }
 
 int
-userlist_clnt_get_cookie_2(
-        struct userlist_clnt *clnt,
-        int cmd,
-        const ej_ip_t *origin_ip,
-        int ssl,
-        ej_cookie_t cookie,
-        ej_cookie_t client_key,
+userlist_clnt_parse_cookie_reply(
+        size_t in_size,
+        void *void_in,
         struct UserlistGetCookieResult *p_res)
 {
-  struct userlist_pk_check_cookie *out = 0;
-  struct userlist_pk_login_ok *in = 0;
-  int r;
-  size_t out_size, in_size = 0;
+  struct userlist_pk_login_ok *in = void_in;
   unsigned char *login_ptr, *name_ptr;
-  void *void_in = 0;
-
-  if (!clnt) return -ULS_ERR_NO_CONNECT;
-  if (!cookie) return -ULS_ERR_NO_COOKIE;
+  int r;
 
-  out_size = sizeof(*out);
-  out = alloca(out_size);
-  memset(out, 0, out_size);
-  out->request_id = cmd;
-  if (origin_ip) {
-    out->origin_ip = *origin_ip;
-  }
-  out->ssl = ssl;
-  out->contest_id = 0;
-  out->cookie = cookie;
-  out->client_key = client_key;
-  out->priv_level = 0;
-  if ((r = userlist_clnt_send_packet(clnt, out_size, out)) < 0) return r;
-  if ((r = userlist_clnt_read_and_notify(clnt, &in_size, &void_in)) < 0)
-    return r;
-  in = void_in;
   if (in->reply_id < 0) {
     r = in->reply_id;
     goto cleanup;
@@ -177,3 +151,39 @@ userlist_clnt_get_cookie_2(
   xfree(in);
   return r;
 }
+
+int
+userlist_clnt_get_cookie_2(
+        struct userlist_clnt *clnt,
+        int cmd,
+        const ej_ip_t *origin_ip,
+        int ssl,
+        ej_cookie_t cookie,
+        ej_cookie_t client_key,
+        struct UserlistGetCookieResult *p_res)
+{
+  struct userlist_pk_check_cookie *out = 0;
+  int r;
+  size_t out_size, in_size = 0;
+  void *void_in = 0;
+
+  if (!clnt) return -ULS_ERR_NO_CONNECT;
+  if (!cookie) return -ULS_ERR_NO_COOKIE;
+
+  out_size = sizeof(*out);
+  out = alloca(out_size);
+  memset(out, 0, out_size);
+  out->request_id = cmd;
+  if (origin_ip) {
+    out->origin_ip = *origin_ip;
+  }
+  out->ssl = ssl;
+  out->contest_id = 0;
+  out->cookie = cookie;
+  out->client_key = client_key;
+  out->priv_level = 0;
+  if ((r = userlist_clnt_send_packet(clnt, out_size, out)) < 0) return r;
+  if ((r = userlist_clnt_read_and_notify(clnt, &in_size, &void_in)) < 0)
+    return r;
+  return userlist_clnt_parse_cookie_reply(in_size, void_in, p_res);
+}
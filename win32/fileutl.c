@@ -978,6 +978,12 @@ make_hardlink(const unsigned char *oldname, const unsigned char *newname)
   return fast_copy_file(oldname, newname);
 }
 
+int
+link_or_copy_file(const unsigned char *oldname, const unsigned char *newname)
+{
+  return fast_copy_file(oldname, newname);
+}
+
 int
 scan_executable_files(
         const unsigned char *dir,